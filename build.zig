@@ -24,18 +24,26 @@ fn buildLibrary(b: *std.Build, target: std.Build.ResolvedTarget, optimize: std.b
         .root_module = lib_mod,
     });
 
-    lib.addCSourceFile(.{ .file = b.path("freetracer-lib/src/macos/xpc/xpc_helper.c") });
-    lib.addCSourceFile(.{ .file = b.path("freetracer-lib/src/macos/cocoa/drag_hover.m"), .flags = &.{"-fobjc-arc"} });
-    lib.addIncludePath(b.path("freetracer-lib/src/macos/xpc/"));
-
     lib.linkLibC();
-    lib.linkFramework("IOKit");
-    lib.linkFramework("CoreFoundation");
-    lib.linkFramework("DiskArbitration");
-    lib.linkFramework("ServiceManagement");
-    lib.linkFramework("Security");
-    lib.linkFramework("Cocoa");
-    addMacOSSystemPaths(lib);
+
+    // The XPC, Cocoa and system codec bindings only exist on macOS; other hosts build
+    // the portable parsers so their tests and benchmarks can run
+    if (target.result.os.tag == .macos) {
+        lib.addCSourceFile(.{ .file = b.path("freetracer-lib/src/macos/xpc/xpc_helper.c") });
+        lib.addCSourceFile(.{ .file = b.path("freetracer-lib/src/macos/cocoa/drag_hover.m"), .flags = &.{"-fobjc-arc"} });
+        lib.addIncludePath(b.path("freetracer-lib/src/macos/xpc/"));
+
+        lib.linkFramework("IOKit");
+        lib.linkFramework("CoreFoundation");
+        lib.linkFramework("DiskArbitration");
+        lib.linkFramework("ServiceManagement");
+        lib.linkFramework("Security");
+        lib.linkFramework("Cocoa");
+        // UDIF (.dmg) chunk codecs without a Zig implementation: LZFSE and bzip2
+        lib.linkSystemLibrary("compression");
+        lib.linkSystemLibrary("bz2");
+        addMacOSSystemPaths(lib);
+    }
 
     b.installArtifact(lib);
 
@@ -48,6 +56,20 @@ fn buildLibrary(b: *std.Build, target: std.Build.ResolvedTarget, optimize: std.b
     const lib_test_step = b.step("test-lib", "Run freetracer-lib unit tests");
     lib_test_step.dependOn(&run_lib_unit_tests.step);
 
+    // Benchmarks are `test "benchmark: ..."` blocks that skip themselves unless
+    // FREETRACER_BENCH is set (freetracer-lib/src/util/bench.zig)
+    const lib_benchmarks = b.addTest(.{
+        .root_module = lib_mod,
+        .filters = &.{"benchmark:"},
+    });
+
+    const run_lib_benchmarks = b.addRunArtifact(lib_benchmarks);
+    run_lib_benchmarks.setEnvironmentVariable("FREETRACER_BENCH", "1");
+    run_lib_benchmarks.has_side_effects = true;
+
+    const lib_bench_step = b.step("bench", "Run freetracer-lib benchmarks (use -Doptimize=ReleaseFast)");
+    lib_bench_step.dependOn(&run_lib_benchmarks.step);
+
     return lib;
 }
 
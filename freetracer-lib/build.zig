@@ -37,18 +37,26 @@ pub fn build(b: *std.Build) void {
         .root_module = lib_mod,
     });
 
-    lib.addCSourceFile(.{ .file = b.path("src/macos/xpc/xpc_helper.c") });
-    lib.addCSourceFile(.{ .file = b.path("src/macos/cocoa/drag_hover.m"), .flags = &.{"-fobjc-arc"} });
-    lib.addIncludePath(b.path("src/macos/xpc/"));
-
     lib.linkLibC();
-    lib.linkFramework("IOKit");
-    lib.linkFramework("CoreFoundation");
-    lib.linkFramework("DiskArbitration");
-    lib.linkFramework("ServiceManagement");
-    lib.linkFramework("Security");
-    lib.linkFramework("Cocoa");
-    addMacOSSystemPaths(lib);
+
+    // The XPC, Cocoa and system codec bindings only exist on macOS; other hosts build
+    // the portable parsers so their tests and benchmarks can run
+    if (target.result.os.tag == .macos) {
+        lib.addCSourceFile(.{ .file = b.path("src/macos/xpc/xpc_helper.c") });
+        lib.addCSourceFile(.{ .file = b.path("src/macos/cocoa/drag_hover.m"), .flags = &.{"-fobjc-arc"} });
+        lib.addIncludePath(b.path("src/macos/xpc/"));
+
+        lib.linkFramework("IOKit");
+        lib.linkFramework("CoreFoundation");
+        lib.linkFramework("DiskArbitration");
+        lib.linkFramework("ServiceManagement");
+        lib.linkFramework("Security");
+        lib.linkFramework("Cocoa");
+        // UDIF (.dmg) chunk codecs without a Zig implementation: LZFSE and bzip2
+        lib.linkSystemLibrary("compression");
+        lib.linkSystemLibrary("bz2");
+        addMacOSSystemPaths(lib);
+    }
 
     // This declares intent for the library to be installed into the standard
     // location when the user invokes the "install" step (the default step when
@@ -68,6 +76,22 @@ pub fn build(b: *std.Build) void {
     // running the unit tests.
     const test_step = b.step("test", "Run unit tests");
     test_step.dependOn(&run_lib_unit_tests.step);
+
+    // Benchmarks are `test "benchmark: ..."` blocks that skip themselves unless
+    // FREETRACER_BENCH is set (src/util/bench.zig). This step builds the tests
+    // filtered down to the benchmarks and runs them with the variable set, on
+    // every invocation rather than from the cache.
+    const lib_benchmarks = b.addTest(.{
+        .root_module = lib_mod,
+        .filters = &.{"benchmark:"},
+    });
+
+    const run_lib_benchmarks = b.addRunArtifact(lib_benchmarks);
+    run_lib_benchmarks.setEnvironmentVariable("FREETRACER_BENCH", "1");
+    run_lib_benchmarks.has_side_effects = true;
+
+    const bench_step = b.step("bench", "Run benchmarks (use -Doptimize=ReleaseFast)");
+    bench_step.dependOn(&run_lib_benchmarks.step);
 }
 
 pub fn addMacOSSystemPaths(step: *std.Build.Step.Compile) void {
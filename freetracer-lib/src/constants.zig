@@ -44,6 +44,7 @@ pub const HelperRequestCode = enum(i64) {
     GET_HELPER_VERSION,
     UNMOUNT_DISK,
     WRITE_ISO_TO_DEVICE,
+    WRITE_IMAGE_TO_DEVICES,
 };
 
 pub const HelperResponseCode = enum(i64) {
@@ -73,6 +74,9 @@ pub const HelperResponseCode = enum(i64) {
     DEVICE_EJECT_SUCCESS,
     DEVICE_EJECT_FAIL,
     DEVICE_FLASH_COMPLETE,
+
+    FANOUT_DEVICE_WRITE_SUCCESS,
+    FANOUT_DEVICE_WRITE_FAIL,
 };
 
 pub const HelperReturnCode = enum(i32) {
@@ -0,0 +1,702 @@
+//! io_uring Write Engine (Linux)
+//!
+//! Asynchronous image-to-target transfer built on io_uring. Keeps a configurable
+//! number of registered (fixed) buffers in flight: each buffer cycles through
+//! read_fixed from the image, then write_fixed to the target, then back to the
+//! next unread image offset. Completions may arrive out of order; every buffer
+//! carries its own offset so ordering does not matter.
+//!
+//! Contract mirrors the helper's `writeImage`:
+//! - Writes the source to the target from `startOffset` (0, or a resume checkpoint)
+//!   up to `totalBytes`
+//! - Reports completed write bytes through `progress.advance(bytes)` and the
+//!   contiguous completed prefix through `progress.markDurable(target, offset)`
+//! - Issues a single fsync on the target once every buffer has drained
+//! - With a SparseMode other than OFF, all-zero chunks are skipped or BLKDISCARDed
+//! - With autotune, chunk size and queue depth are picked from measured throughput
+//!   (see util/autotune.zig); the buffers are sized for the largest candidate
+//!
+//! Works against block devices, loop devices and plain files, so it can be
+//! exercised and benchmarked on CI hosts without removable media.
+//! ==========================================================================
+const std = @import("std");
+const builtin = @import("builtin");
+const Debug = @import("../util/debug.zig");
+const simd = @import("../util/simd.zig");
+const autotune = @import("../util/autotune.zig");
+const bench = @import("../util/bench.zig");
+const BufferPool = @import("../util/bufferpool.zig").BufferPool;
+const SparseMode = @import("../types.zig").SparseMode;
+
+const linux = std.os.linux;
+const posix = std.posix;
+const IoUring = linux.IoUring;
+
+/// Default number of buffers in flight against the target.
+pub const DEFAULT_QUEUE_DEPTH: u16 = 8;
+
+/// Default per-request transfer size when the target does not advertise an optimal size.
+pub const DEFAULT_CHUNK_SIZE: usize = 4 * 1024 * 1024;
+
+const MIN_CHUNK_SIZE: usize = 1024 * 1024;
+const MAX_CHUNK_SIZE: usize = 16 * 1024 * 1024;
+const BUFFER_ALIGNMENT = 4096;
+
+// <linux/fs.h> block device ioctls
+const BLKSSZGET: u32 = 0x1268;
+const BLKIOOPT: u32 = 0x1279;
+const BLKDISCARD: u32 = 0x1277;
+
+/// Upper bound for the buffer region when autotuning; caps the largest chunk candidate
+/// at AUTOTUNE_REGION_BYTES / queueDepth.
+const AUTOTUNE_REGION_BYTES: usize = 64 * 1024 * 1024;
+
+pub const UringOptions = struct {
+    /// Number of fixed buffers (and therefore I/O requests) kept in flight
+    queueDepth: u16 = DEFAULT_QUEUE_DEPTH,
+    /// Size of every fixed buffer; 0 means probe the target
+    chunkSize: usize = 0,
+    /// Handling of all-zero chunks; see types.SparseMode
+    sparseMode: SparseMode = .OFF,
+    /// Measure candidate chunk sizes and queue depths at the start of the transfer and
+    /// lock the fastest. `queueDepth` becomes the upper bound; `chunkSize` is ignored.
+    autotune: bool = false,
+    /// Take the fixed buffers from a shared pool instead of allocating a private region.
+    /// The pool needs `queueDepth` free buffers, each at least as large as the chunk size.
+    pool: ?*BufferPool = null,
+};
+
+/// Per-buffer transfer state. `filled` tracks bytes read into the buffer,
+/// `written` tracks bytes of it already persisted to the target.
+const BufferState = struct {
+    offset: u64 = 0,
+    len: usize = 0,
+    filled: usize = 0,
+    written: usize = 0,
+    /// Range is claimed and not yet fully written (or elided)
+    isActive: bool = false,
+};
+
+const Operation = enum(u1) { READ = 0, WRITE = 1 };
+
+fn encodeUserData(index: usize, op: Operation) u64 {
+    return (@as(u64, @intCast(index)) << 1) | @intFromEnum(op);
+}
+
+fn decodeIndex(userData: u64) usize {
+    return @intCast(userData >> 1);
+}
+
+fn decodeOperation(userData: u64) Operation {
+    return @enumFromInt(@as(u1, @truncate(userData)));
+}
+
+/// Returns the logical block size of `target` (BLKSSZGET), or 512 when it reports none.
+pub fn probeLogicalBlockSize(target: std.fs.File) usize {
+    var logicalBlockSize: c_int = 512;
+
+    if (linux.E.init(linux.ioctl(target.handle, BLKSSZGET, @intFromPtr(&logicalBlockSize))) != .SUCCESS or logicalBlockSize <= 0) {
+        return 512;
+    }
+
+    return @intCast(logicalBlockSize);
+}
+
+/// Derives a transfer size for `target` from BLKIOOPT / BLKSSZGET.
+/// Plain files and devices that report nothing useful get DEFAULT_CHUNK_SIZE.
+/// The result is clamped to [1 MiB, 16 MiB] and aligned to the logical block size.
+pub fn probeChunkSize(target: std.fs.File) usize {
+    const blockSize = probeLogicalBlockSize(target);
+    var optimalIoSize: c_uint = 0;
+
+    if (linux.E.init(linux.ioctl(target.handle, BLKIOOPT, @intFromPtr(&optimalIoSize))) != .SUCCESS or optimalIoSize == 0) {
+        Debug.log(.INFO, "Target does not report an optimal I/O size, using default {d} bytes", .{DEFAULT_CHUNK_SIZE});
+        return DEFAULT_CHUNK_SIZE;
+    }
+
+    const clamped = std.math.clamp(@as(usize, optimalIoSize), MIN_CHUNK_SIZE, MAX_CHUNK_SIZE);
+    const aligned = (clamped / blockSize) * blockSize;
+
+    Debug.log(.INFO, "Probed io_uring chunk size: {d} bytes (logical block {d}, optimal I/O {d})", .{ aligned, blockSize, optimalIoSize });
+
+    return if (aligned > 0) aligned else DEFAULT_CHUNK_SIZE;
+}
+
+/// Discards (TRIMs) `length` bytes at `offset` on a block device via BLKDISCARD.
+///
+/// `Errors`:
+///   error.DiscardNotSupported: target is not a block device or lacks discard (ENOTTY/EOPNOTSUPP)
+///   error.DiscardFailed: any other ioctl failure (e.g. misaligned range)
+pub fn discardRange(target: std.fs.File, offset: u64, length: u64) error{ DiscardNotSupported, DiscardFailed }!void {
+    var range = [2]u64{ offset, length };
+
+    return switch (linux.E.init(linux.ioctl(target.handle, BLKDISCARD, @intFromPtr(&range)))) {
+        .SUCCESS => {},
+        .NOTTY, .OPNOTSUPP => error.DiscardNotSupported,
+        else => error.DiscardFailed,
+    };
+}
+
+/// Maps a negative io_uring completion result to a Zig error.
+fn completionError(res: i32) anyerror {
+    const errno: linux.E = @enumFromInt(@as(u16, @intCast(-res)));
+    return switch (errno) {
+        .IO => error.InputOutput,
+        .NOSPC => error.NoSpaceLeft,
+        .FBIG => error.FileTooBig,
+        .PERM, .ACCES => error.AccessDenied,
+        .NXIO, .NODEV => error.NoDevice,
+        else => posix.unexpectedErrno(errno),
+    };
+}
+
+pub const UringWriter = struct {
+    allocator: std.mem.Allocator,
+    ring: IoUring,
+    /// Private buffer region; null when the buffers are borrowed from `pool`
+    region: ?[]align(BUFFER_ALIGNMENT) u8,
+    pool: ?*BufferPool,
+    iovecs: []posix.iovec,
+    states: []BufferState,
+    chunkSize: usize,
+    usesFixedBuffers: bool,
+    sparseMode: SparseMode,
+    isDiscardSupported: bool = true,
+    /// Present when autotuning; decides the chunk size and number of busy buffers
+    tuner: ?autotune.Autotuner = null,
+    /// Stack of buffer indices without an outstanding request
+    idleBuffers: []usize,
+    idleCount: usize = 0,
+
+    /// Sets up the ring and registers `queueDepth` buffers of `chunkSize` bytes.
+    /// If the kernel refuses buffer registration (e.g. RLIMIT_MEMLOCK), the engine
+    /// keeps working with regular read/write submissions on the same buffers.
+    ///
+    /// `Errors`:
+    ///   error.SystemOutdated: kernel lacks io_uring
+    ///   error.PermissionDenied: io_uring disabled by sysctl/seccomp
+    ///   error.OutOfMemory: buffer allocation failed
+    ///   error.BufferPoolExhausted / error.PoolBufferTooSmall: `options.pool` cannot supply the buffers
+    pub fn init(allocator: std.mem.Allocator, target: std.fs.File, options: UringOptions) !UringWriter {
+        const queueDepth: u16 = @max(options.queueDepth, 1);
+
+        var tuner: ?autotune.Autotuner = null;
+        if (options.autotune) {
+            var largestChunk = std.math.clamp(AUTOTUNE_REGION_BYTES / queueDepth, autotune.MIN_CHUNK_SIZE, autotune.MAX_CHUNK_SIZE);
+            if (options.pool) |pool| largestChunk = @min(largestChunk, pool.bufferSize);
+            tuner = try autotune.Autotuner.init(.{
+                .maxChunkSize = largestChunk,
+                .blockSize = probeLogicalBlockSize(target),
+                .baseQueueDepth = queueDepth,
+                .maxQueueDepth = queueDepth,
+            });
+        }
+
+        const chunkSize = if (tuner) |*t|
+            std.mem.alignForward(usize, t.options.maxChunkSize, BUFFER_ALIGNMENT)
+        else if (options.chunkSize > 0)
+            std.mem.alignForward(usize, options.chunkSize, BUFFER_ALIGNMENT)
+        else
+            probeChunkSize(target);
+
+        // Each buffer has at most one request outstanding, so depth entries suffice;
+        // io_uring rounds the entry count up to a power of two.
+        var ring = try IoUring.init(try std.math.ceilPowerOfTwo(u16, queueDepth), 0);
+        errdefer ring.deinit();
+
+        const iovecs = try allocator.alloc(posix.iovec, queueDepth);
+        errdefer allocator.free(iovecs);
+
+        var region: ?[]align(BUFFER_ALIGNMENT) u8 = null;
+        errdefer if (region) |bytes| allocator.free(bytes);
+
+        var borrowedCount: usize = 0;
+        errdefer if (options.pool) |pool| for (iovecs[0..borrowedCount]) |iov| pool.release(@alignCast(iov.base[0..chunkSize]));
+
+        if (options.pool) |pool| {
+            if (chunkSize > pool.bufferSize) return error.PoolBufferTooSmall;
+            for (iovecs) |*iov| {
+                const buffer = pool.tryAcquire() orelse return error.BufferPoolExhausted;
+                iov.* = .{ .base = buffer.ptr, .len = chunkSize };
+                borrowedCount += 1;
+            }
+        } else {
+            const bytes = try allocator.alignedAlloc(u8, std.mem.Alignment.fromByteUnits(BUFFER_ALIGNMENT), chunkSize * queueDepth);
+            region = bytes;
+            for (iovecs, 0..) |*iov, i| {
+                iov.* = .{ .base = bytes[i * chunkSize ..].ptr, .len = chunkSize };
+            }
+        }
+
+        const states = try allocator.alloc(BufferState, queueDepth);
+        errdefer allocator.free(states);
+
+        const idleBuffers = try allocator.alloc(usize, queueDepth);
+        errdefer allocator.free(idleBuffers);
+
+        @memset(states, .{});
+
+        var usesFixedBuffers = true;
+        ring.register_buffers(iovecs) catch |err| {
+            Debug.log(.WARNING, "io_uring buffer registration failed ({any}); falling back to unregistered buffers.", .{err});
+            usesFixedBuffers = false;
+        };
+
+        Debug.log(.INFO, "io_uring engine ready: queue depth {d}, chunk size {d} bytes, fixed buffers: {}, autotune: {}", .{ queueDepth, chunkSize, usesFixedBuffers, tuner != null });
+
+        return UringWriter{
+            .allocator = allocator,
+            .ring = ring,
+            .region = region,
+            .pool = options.pool,
+            .iovecs = iovecs,
+            .states = states,
+            .chunkSize = chunkSize,
+            .usesFixedBuffers = usesFixedBuffers,
+            .sparseMode = options.sparseMode,
+            .tuner = tuner,
+            .idleBuffers = idleBuffers,
+        };
+    }
+
+    pub fn deinit(self: *UringWriter) void {
+        if (self.usesFixedBuffers) self.ring.unregister_buffers() catch {};
+        self.ring.deinit();
+        self.allocator.free(self.idleBuffers);
+        self.allocator.free(self.states);
+        if (self.pool) |pool| {
+            for (self.iovecs) |iov| pool.release(@alignCast(iov.base[0..iov.len]));
+        }
+        self.allocator.free(self.iovecs);
+        if (self.region) |region| self.allocator.free(region);
+    }
+
+    /// Queues a read of the unread remainder of buffer `index`.
+    fn queueRead(self: *UringWriter, source: std.fs.File, index: usize) !void {
+        const state = &self.states[index];
+        var iov = posix.iovec{
+            .base = self.iovecs[index].base + state.filled,
+            .len = state.len - state.filled,
+        };
+        const userData = encodeUserData(index, .READ);
+        const offset = state.offset + state.filled;
+
+        if (self.usesFixedBuffers) {
+            _ = try self.ring.read_fixed(userData, source.handle, &iov, offset, @intCast(index));
+        } else {
+            _ = try self.ring.read(userData, source.handle, .{ .buffer = iov.base[0..iov.len] }, offset);
+        }
+    }
+
+    /// Queues a write of the unwritten remainder of buffer `index`.
+    fn queueWrite(self: *UringWriter, target: std.fs.File, index: usize) !void {
+        const state = &self.states[index];
+        var iov = posix.iovec{
+            .base = self.iovecs[index].base + state.written,
+            .len = state.len - state.written,
+        };
+        const userData = encodeUserData(index, .WRITE);
+        const offset = state.offset + state.written;
+
+        if (self.usesFixedBuffers) {
+            _ = try self.ring.write_fixed(userData, target.handle, &iov, offset, @intCast(index));
+        } else {
+            _ = try self.ring.write(userData, target.handle, iov.base[0..iov.len], offset);
+        }
+    }
+
+    /// Applies the sparse policy to a fully read buffer. Returns true when the buffer is
+    /// all zeros and no write is needed: either the target is assumed zeroed, or the
+    /// range was discarded with BLKDISCARD. A failed discard returns false so the
+    /// (already zeroed) buffer is written normally.
+    fn elideZeroChunk(self: *UringWriter, target: std.fs.File, index: usize) bool {
+        if (self.sparseMode == .OFF) return false;
+
+        const state = &self.states[index];
+        if (!simd.isAllZero(self.iovecs[index].base[0..state.len])) return false;
+
+        switch (self.sparseMode) {
+            .OFF => unreachable,
+            .ASSUME_ZEROED => return true,
+            .DISCARD => {
+                if (!self.isDiscardSupported) return false;
+
+                discardRange(target, state.offset, state.len) catch |err| {
+                    if (err == error.DiscardNotSupported) {
+                        Debug.log(.WARNING, "Target does not support BLKDISCARD; writing zero chunks instead.", .{});
+                        self.isDiscardSupported = false;
+                    }
+                    return false;
+                };
+                return true;
+            },
+        }
+    }
+
+    /// Chunk size and number of busy buffers to use for the next range.
+    pub fn currentConfig(self: *const UringWriter) autotune.Config {
+        if (self.tuner) |*t| return t.current();
+        return .{ .chunkSize = self.chunkSize, .queueDepth = @intCast(self.states.len) };
+    }
+
+    /// Assigns the next unread image range to buffer `index`. Returns false when
+    /// the whole image has already been handed out.
+    fn claimNextRange(self: *UringWriter, index: usize, nextOffset: *u64, totalBytes: u64) bool {
+        if (nextOffset.* >= totalBytes) return false;
+
+        const len: usize = @intCast(@min(@as(u64, self.currentConfig().chunkSize), totalBytes - nextOffset.*));
+        self.states[index] = .{ .offset = nextOffset.*, .len = len, .isActive = true };
+        nextOffset.* += len;
+
+        return true;
+    }
+
+    /// Returns buffer `index` to the idle stack, then starts reads on idle buffers until
+    /// the current queue depth is busy or the image is fully handed out.
+    fn scheduleReads(self: *UringWriter, source: std.fs.File, index: ?usize, nextOffset: *u64, totalBytes: u64, inFlight: *usize) !void {
+        if (index) |i| {
+            self.states[i].isActive = false;
+            self.idleBuffers[self.idleCount] = i;
+            self.idleCount += 1;
+        }
+
+        // Every busy buffer has exactly one request outstanding
+        const depth = self.currentConfig().queueDepth;
+        while (inFlight.* < depth and self.idleCount > 0) {
+            const next = self.idleBuffers[self.idleCount - 1];
+            if (!self.claimNextRange(next, nextOffset, totalBytes)) return;
+
+            self.idleCount -= 1;
+            try self.queueRead(source, next);
+            inFlight.* += 1;
+        }
+    }
+
+    /// Offset below which every byte has been written or elided: the start of the lowest
+    /// range still in progress, or `nextOffset` when none is.
+    fn durableOffset(self: *const UringWriter, nextOffset: u64) u64 {
+        var offset = nextOffset;
+        for (self.states) |state| {
+            if (state.isActive) offset = @min(offset, state.offset);
+        }
+        return offset;
+    }
+
+    /// Streams bytes [startOffset, totalBytes) from `source` to the same offsets of `target`
+    /// and syncs the target.
+    ///
+    /// `Arguments`:
+    ///   startOffset: 0, or the offset of a verified resume checkpoint
+    ///   progress: any value with `advance(bytesWritten: u64) !void`, called once per write completion,
+    ///     `setIoConfig(chunkSize: u64, queueDepth: u64) void`, called when the configuration changes,
+    ///     and `markDurable(target: std.fs.File, durableOffset: u64) !void`, called whenever a range
+    ///     completes with the offset below which the target is fully written
+    ///
+    /// `Errors`:
+    ///   error.UnexpectedEndOfImage: source ended before `totalBytes`
+    ///   error.WriteZero: target accepted no bytes (device full or gone)
+    ///   Errno-derived errors from failed completions
+    pub fn run(self: *UringWriter, source: std.fs.File, target: std.fs.File, startOffset: u64, totalBytes: u64, progress: anytype) !void {
+        var nextOffset: u64 = startOffset;
+        var inFlight: usize = 0;
+
+        @memset(self.states, .{});
+
+        // Highest index on top so buffers are started in order
+        self.idleCount = 0;
+        var i = self.states.len;
+        while (i > 0) {
+            i -= 1;
+            self.idleBuffers[self.idleCount] = i;
+            self.idleCount += 1;
+        }
+
+        var config = self.currentConfig();
+        progress.setIoConfig(config.chunkSize, config.queueDepth);
+
+        try self.scheduleReads(source, null, &nextOffset, totalBytes, &inFlight);
+
+        // Drain whatever is still in flight before surfacing an error so no request
+        // completes into a buffer that has already been freed.
+        errdefer self.drain(inFlight);
+
+        _ = try self.ring.submit();
+
+        while (inFlight > 0) {
+            const cqe = try self.ring.copy_cqe();
+            inFlight -= 1;
+
+            const index = decodeIndex(cqe.user_data);
+            const state = &self.states[index];
+
+            if (cqe.res < 0) {
+                Debug.log(.ERROR, "io_uring {s} failed at offset {d} (res {d})", .{ @tagName(decodeOperation(cqe.user_data)), state.offset, cqe.res });
+                return completionError(cqe.res);
+            }
+
+            const res: usize = @intCast(cqe.res);
+
+            switch (decodeOperation(cqe.user_data)) {
+                .READ => {
+                    if (res == 0) return error.UnexpectedEndOfImage;
+                    state.filled += res;
+
+                    if (state.filled < state.len) {
+                        try self.queueRead(source, index);
+                        inFlight += 1;
+                    } else if (self.elideZeroChunk(target, index)) {
+                        try progress.advance(@as(u64, state.len));
+                        try self.scheduleReads(source, index, &nextOffset, totalBytes, &inFlight);
+                        try progress.markDurable(target, self.durableOffset(nextOffset));
+                    } else {
+                        try self.queueWrite(target, index);
+                        inFlight += 1;
+                    }
+                },
+                .WRITE => {
+                    if (res == 0) return error.WriteZero;
+                    state.written += res;
+
+                    if (self.tuner) |*t| t.record(res);
+                    try progress.advance(@as(u64, res));
+
+                    if (state.written < state.len) {
+                        try self.queueWrite(target, index);
+                        inFlight += 1;
+                    } else {
+                        try self.scheduleReads(source, index, &nextOffset, totalBytes, &inFlight);
+                        try progress.markDurable(target, self.durableOffset(nextOffset));
+                    }
+                },
+            }
+
+            const nextConfig = self.currentConfig();
+            if (!std.meta.eql(nextConfig, config)) {
+                config = nextConfig;
+                progress.setIoConfig(config.chunkSize, config.queueDepth);
+            }
+
+            _ = try self.ring.submit();
+        }
+
+        try target.sync();
+    }
+
+    /// Waits for `count` outstanding completions, discarding their results.
+    fn drain(self: *UringWriter, count: usize) void {
+        // Flush any queued but unsubmitted requests so every counted completion can arrive
+        _ = self.ring.submit() catch return;
+
+        var remaining = count;
+        while (remaining > 0) : (remaining -= 1) {
+            _ = self.ring.copy_cqe() catch return;
+        }
+    }
+};
+
+// ============================================================================
+// TESTS
+// ============================================================================
+
+const TestProgress = struct {
+    bytes: u64 = 0,
+    updates: usize = 0,
+    durableOffset: u64 = 0,
+
+    pub fn advance(self: *TestProgress, bytesWritten: u64) !void {
+        self.bytes += bytesWritten;
+        self.updates += 1;
+    }
+
+    pub fn setIoConfig(self: *TestProgress, chunkSize: u64, queueDepth: u64) void {
+        _ = self;
+        _ = chunkSize;
+        _ = queueDepth;
+    }
+
+    pub fn markDurable(self: *TestProgress, target: std.fs.File, durableOffset: u64) !void {
+        _ = target;
+        // Completions may arrive out of order, but the durable prefix never shrinks
+        std.debug.assert(durableOffset >= self.durableOffset);
+        self.durableOffset = durableOffset;
+    }
+};
+
+fn writeTestImage(dir: std.fs.Dir, name: []const u8, size: usize) !std.fs.File {
+    const file = try dir.createFile(name, .{ .read = true });
+    errdefer file.close();
+
+    var block: [4096]u8 = undefined;
+    var written: usize = 0;
+    while (written < size) {
+        const len = @min(block.len, size - written);
+        for (block[0..len], 0..) |*byte, i| byte.* = @truncate((written + i) *% 131);
+        try file.writeAll(block[0..len]);
+        written += len;
+    }
+
+    return file;
+}
+
+fn initOrSkip(target: std.fs.File, options: UringOptions) !UringWriter {
+    return UringWriter.init(std.testing.allocator, target, options) catch |err| switch (err) {
+        error.SystemOutdated, error.PermissionDenied => return error.SkipZigTest,
+        else => return err,
+    };
+}
+
+test "UringWriter copies an image to a plain file target" {
+    if (builtin.os.tag != .linux) return error.SkipZigTest;
+
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const imageSize = 3 * 1024 * 1024 + 777;
+    const image = try writeTestImage(tmp.dir, "image.img", imageSize);
+    defer image.close();
+
+    const target = try tmp.dir.createFile("target.img", .{ .read = true });
+    defer target.close();
+
+    var writer = try initOrSkip(target, .{ .queueDepth = 4, .chunkSize = 256 * 1024 });
+    defer writer.deinit();
+
+    var progress = TestProgress{};
+    try writer.run(image, target, 0, imageSize, &progress);
+
+    try std.testing.expectEqual(@as(u64, imageSize), progress.bytes);
+
+    const expected = try std.testing.allocator.alloc(u8, imageSize);
+    defer std.testing.allocator.free(expected);
+    const actual = try std.testing.allocator.alloc(u8, imageSize);
+    defer std.testing.allocator.free(actual);
+
+    try std.testing.expectEqual(@as(usize, imageSize), try image.preadAll(expected, 0));
+    try std.testing.expectEqual(@as(usize, imageSize), try target.preadAll(actual, 0));
+    try std.testing.expectEqualSlices(u8, expected, actual);
+}
+
+test "UringWriter resumes from a start offset" {
+    if (builtin.os.tag != .linux) return error.SkipZigTest;
+
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const imageSize = 1024 * 1024 + 333;
+    const startOffset = 256 * 1024;
+    const image = try writeTestImage(tmp.dir, "image.img", imageSize);
+    defer image.close();
+
+    const target = try tmp.dir.createFile("target.img", .{ .read = true });
+    defer target.close();
+
+    // Poison the already-written prefix: a resumed write must not touch it
+    var chunk: [4096]u8 = undefined;
+    @memset(&chunk, 0xFF);
+    var offset: u64 = 0;
+    while (offset < startOffset) : (offset += chunk.len) try target.pwriteAll(&chunk, offset);
+
+    var writer = try initOrSkip(target, .{ .queueDepth = 4, .chunkSize = 64 * 1024 });
+    defer writer.deinit();
+
+    var progress = TestProgress{};
+    try writer.run(image, target, startOffset, imageSize, &progress);
+
+    try std.testing.expectEqual(@as(u64, imageSize - startOffset), progress.bytes);
+    try std.testing.expectEqual(@as(u64, imageSize), progress.durableOffset);
+
+    _ = try target.preadAll(&chunk, startOffset - chunk.len);
+    try std.testing.expect(std.mem.allEqual(u8, &chunk, 0xFF));
+
+    var expected: [4096]u8 = undefined;
+    _ = try image.preadAll(&expected, startOffset);
+    _ = try target.preadAll(&chunk, startOffset);
+    try std.testing.expectEqualSlices(u8, &expected, &chunk);
+}
+
+test "UringWriter reports a truncated source" {
+    if (builtin.os.tag != .linux) return error.SkipZigTest;
+
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const image = try writeTestImage(tmp.dir, "short.img", 64 * 1024);
+    defer image.close();
+
+    const target = try tmp.dir.createFile("target.img", .{ .read = true });
+    defer target.close();
+
+    var writer = try initOrSkip(target, .{ .queueDepth = 2, .chunkSize = 16 * 1024 });
+    defer writer.deinit();
+
+    var progress = TestProgress{};
+    try std.testing.expectError(error.UnexpectedEndOfImage, writer.run(image, target, 0, 128 * 1024, &progress));
+}
+
+test "UringWriter skips zero chunks when the target is assumed zeroed" {
+    if (builtin.os.tag != .linux) return error.SkipZigTest;
+
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const chunkSize = 64 * 1024;
+    const image = try tmp.dir.createFile("sparse.img", .{ .read = true });
+    defer image.close();
+
+    // data | zeros | data
+    var chunk: [chunkSize]u8 = undefined;
+    @memset(&chunk, 0x5A);
+    try image.writeAll(&chunk);
+    @memset(&chunk, 0);
+    try image.writeAll(&chunk);
+    @memset(&chunk, 0xA5);
+    try image.writeAll(&chunk);
+
+    const target = try tmp.dir.createFile("target.img", .{ .read = true });
+    defer target.close();
+
+    // Poison the middle chunk: a skipped chunk must leave the target untouched
+    @memset(&chunk, 0xFF);
+    try target.pwriteAll(&chunk, chunkSize);
+
+    var writer = try initOrSkip(target, .{ .queueDepth = 2, .chunkSize = chunkSize, .sparseMode = .ASSUME_ZEROED });
+    defer writer.deinit();
+
+    var progress = TestProgress{};
+    try writer.run(image, target, 0, chunkSize * 3, &progress);
+
+    try std.testing.expectEqual(@as(u64, chunkSize * 3), progress.bytes);
+
+    _ = try target.preadAll(&chunk, chunkSize);
+    try std.testing.expect(std.mem.allEqual(u8, &chunk, 0xFF));
+    _ = try target.preadAll(&chunk, chunkSize * 2);
+    try std.testing.expect(std.mem.allEqual(u8, &chunk, 0xA5));
+}
+
+test "benchmark: UringWriter queue depths against a plain file" {
+    if (builtin.os.tag != .linux) return error.SkipZigTest;
+    try bench.skipUnlessEnabled();
+
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const imageSize = 32 * 1024 * 1024;
+    const image = try writeTestImage(tmp.dir, "bench.img", imageSize);
+    defer image.close();
+
+    for ([_]u16{ 1, 4, 16 }) |depth| {
+        const target = try tmp.dir.createFile("bench-target.img", .{ .read = true, .truncate = true });
+        defer target.close();
+
+        var writer = try initOrSkip(target, .{ .queueDepth = depth, .chunkSize = 1024 * 1024 });
+        defer writer.deinit();
+
+        var progress = TestProgress{};
+        var timer = try std.time.Timer.start();
+        try writer.run(image, target, 0, imageSize, &progress);
+        const elapsedNs = timer.read();
+
+        var labelBuffer: [32]u8 = undefined;
+        bench.report(try std.fmt.bufPrint(&labelBuffer, "io_uring depth {d:>2}", .{depth}), imageSize, elapsedNs);
+    }
+}
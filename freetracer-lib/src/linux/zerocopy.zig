@@ -0,0 +1,384 @@
+//! Zero-Copy Write Engine (Linux)
+//!
+//! Moves image bytes to the target inside the kernel instead of bouncing every chunk
+//! through a user-space buffer:
+//! - copy_file_range(2) when the kernel supports the source/target pair (file to file)
+//! - splice(2) through a pipe otherwise (file to block or loop device)
+//!
+//! The method is resolved on the first chunk: if the kernel rejects copy_file_range
+//! for the pair, splice is tried; if that is rejected as well, run() returns
+//! error.ZeroCopyUnsupported. Progress only ever counts bytes that reached the target,
+//! so the caller can continue from `progress` with another engine at any point.
+//!
+//! Contract mirrors `UringWriter.run`:
+//! - Writes the source to the target from `startOffset` up to `totalBytes`
+//! - Reports transferred bytes through `progress.advance(bytes)`, the chunk size through
+//!   `progress.setIoConfig`, and the written prefix through `progress.markDurable`
+//! - Issues a single fsync on the target at the end
+//!
+//! Sparse modes are not supported: the bytes never pass through user space, so zero
+//! chunks cannot be detected.
+//! ==========================================================================
+const std = @import("std");
+const builtin = @import("builtin");
+const Debug = @import("../util/debug.zig");
+const bench = @import("../util/bench.zig");
+const uring = @import("uring.zig");
+
+const linux = std.os.linux;
+const posix = std.posix;
+
+// <linux/fcntl.h>, <linux/splice.h>
+const F_SETPIPE_SZ: i32 = 1031;
+const SPLICE_F_MOVE: usize = 0x01;
+const SPLICE_F_MORE: usize = 0x04;
+
+/// Capacity of a pipe the kernel refused to resize.
+const DEFAULT_PIPE_SIZE: usize = 64 * 1024;
+
+pub const Method = enum { COPY_FILE_RANGE, SPLICE };
+
+pub const ZeroCopyOptions = struct {
+    /// Bytes per transfer call; 0 means probe the target (BLKIOOPT / BLKSSZGET)
+    chunkSize: usize = 0,
+    /// Use this method only instead of trying copy_file_range first
+    method: ?Method = null,
+};
+
+/// Distinguishes "the kernel cannot do this for the pair" from real I/O failures.
+const TransferError = error{MethodRejected};
+
+pub const ZeroCopyWriter = struct {
+    chunkSize: usize,
+    /// Null until the first chunk resolves it
+    method: ?Method,
+    /// Pipe used by splice, created on first use: [read end, write end]
+    pipe: ?[2]posix.fd_t = null,
+    pipeSize: usize = 0,
+
+    pub fn init(target: std.fs.File, options: ZeroCopyOptions) ZeroCopyWriter {
+        return .{
+            .chunkSize = if (options.chunkSize > 0) options.chunkSize else uring.probeChunkSize(target),
+            .method = options.method,
+        };
+    }
+
+    pub fn deinit(self: *ZeroCopyWriter) void {
+        self.closePipe();
+    }
+
+    /// Transfers bytes [startOffset, totalBytes) from `source` to the same offsets of
+    /// `target` and syncs the target.
+    ///
+    /// `Arguments`:
+    ///   progress: same interface as for UringWriter.run()
+    ///
+    /// `Errors`:
+    ///   error.ZeroCopyUnsupported: the kernel rejected every method for this pair
+    ///   error.UnexpectedEndOfImage: source ended before `totalBytes`
+    ///   error.WriteZero: target accepted no bytes (device full or gone)
+    ///   Errno-derived errors from failed transfers
+    pub fn run(self: *ZeroCopyWriter, source: std.fs.File, target: std.fs.File, startOffset: u64, totalBytes: u64, progress: anytype) !void {
+        var offset = startOffset;
+        progress.setIoConfig(self.chunkSize, 1);
+
+        while (offset < totalBytes) {
+            const len: usize = @intCast(@min(@as(u64, self.chunkSize), totalBytes - offset));
+
+            const transferred = self.transferChunk(source, target, offset, len) catch |err| switch (err) {
+                error.MethodRejected => return error.ZeroCopyUnsupported,
+                else => return err,
+            };
+            if (transferred == 0) return error.UnexpectedEndOfImage;
+
+            offset += transferred;
+            try progress.advance(@as(u64, transferred));
+            try progress.markDurable(target, offset);
+        }
+
+        try target.sync();
+    }
+
+    /// Transfers up to `len` bytes at `offset`, resolving the method on first use.
+    fn transferChunk(self: *ZeroCopyWriter, source: std.fs.File, target: std.fs.File, offset: u64, len: usize) !usize {
+        if (self.method) |method| return switch (method) {
+            .COPY_FILE_RANGE => copyRange(source, target, offset, len),
+            .SPLICE => self.spliceRange(source, target, offset, len),
+        };
+
+        if (copyRange(source, target, offset, len)) |transferred| {
+            self.resolve(.COPY_FILE_RANGE);
+            return transferred;
+        } else |err| if (err != error.MethodRejected) return err;
+
+        const transferred = try self.spliceRange(source, target, offset, len);
+        self.resolve(.SPLICE);
+        return transferred;
+    }
+
+    fn resolve(self: *ZeroCopyWriter, method: Method) void {
+        self.method = method;
+        Debug.log(.INFO, "Zero-copy engine using {s} with {d} byte chunks", .{ @tagName(method), self.chunkSize });
+    }
+
+    /// Moves one chunk through the pipe: source -> pipe, then pipe -> target until drained.
+    fn spliceRange(self: *ZeroCopyWriter, source: std.fs.File, target: std.fs.File, offset: u64, len: usize) !usize {
+        const pipe = try self.ensurePipe();
+
+        var sourceOffset: i64 = @intCast(offset);
+        const filled = try splice(source.handle, &sourceOffset, pipe[1], null, @min(len, self.pipeSize));
+        if (filled == 0) return 0;
+
+        var targetOffset: i64 = @intCast(offset);
+        var drained: usize = 0;
+
+        // Bytes left behind in the pipe would land at the wrong offset on the next chunk
+        errdefer self.closePipe();
+
+        while (drained < filled) {
+            const written = try splice(pipe[0], null, target.handle, &targetOffset, filled - drained);
+            if (written == 0) return error.WriteZero;
+            drained += written;
+        }
+
+        return filled;
+    }
+
+    fn ensurePipe(self: *ZeroCopyWriter) ![2]posix.fd_t {
+        if (self.pipe) |pipe| return pipe;
+
+        const pipe = try posix.pipe2(.{ .CLOEXEC = true });
+
+        // A pipe as large as a chunk moves it in one splice pair; the kernel may refuse
+        // sizes above /proc/sys/fs/pipe-max-size for unprivileged callers
+        const rc = linux.fcntl(pipe[0], F_SETPIPE_SZ, self.chunkSize);
+        self.pipeSize = if (linux.E.init(rc) == .SUCCESS) rc else DEFAULT_PIPE_SIZE;
+        self.pipe = pipe;
+
+        return pipe;
+    }
+
+    fn closePipe(self: *ZeroCopyWriter) void {
+        const pipe = self.pipe orelse return;
+        posix.close(pipe[0]);
+        posix.close(pipe[1]);
+        self.pipe = null;
+    }
+};
+
+/// copy_file_range(2) for `len` bytes at the same offset on both sides.
+fn copyRange(source: std.fs.File, target: std.fs.File, offset: u64, len: usize) !usize {
+    var sourceOffset: i64 = @intCast(offset);
+    var targetOffset: i64 = @intCast(offset);
+
+    while (true) {
+        const rc = linux.copy_file_range(source.handle, &sourceOffset, target.handle, &targetOffset, len, 0);
+        switch (linux.E.init(rc)) {
+            .SUCCESS => return rc,
+            .INTR => continue,
+            // Pair not supported: cross-device on older kernels, block device targets, ...
+            .XDEV, .INVAL, .OPNOTSUPP, .NOSYS => return TransferError.MethodRejected,
+            else => |errno| return transferError(errno),
+        }
+    }
+}
+
+fn splice(fdIn: posix.fd_t, offsetIn: ?*i64, fdOut: posix.fd_t, offsetOut: ?*i64, len: usize) !usize {
+    while (true) {
+        const rc = linux.syscall6(
+            .splice,
+            @as(usize, @bitCast(@as(isize, fdIn))),
+            @intFromPtr(offsetIn),
+            @as(usize, @bitCast(@as(isize, fdOut))),
+            @intFromPtr(offsetOut),
+            len,
+            SPLICE_F_MOVE | SPLICE_F_MORE,
+        );
+        switch (linux.E.init(rc)) {
+            .SUCCESS => return rc,
+            .INTR => continue,
+            .INVAL, .OPNOTSUPP, .NOSYS => return TransferError.MethodRejected,
+            else => |errno| return transferError(errno),
+        }
+    }
+}
+
+/// Maps a transfer errno to a Zig error.
+fn transferError(errno: linux.E) anyerror {
+    return switch (errno) {
+        .IO => error.InputOutput,
+        .NOSPC => error.NoSpaceLeft,
+        .FBIG => error.FileTooBig,
+        .PERM, .ACCES => error.AccessDenied,
+        .NXIO, .NODEV => error.NoDevice,
+        else => posix.unexpectedErrno(errno),
+    };
+}
+
+// ============================================================================
+// TESTS
+// ============================================================================
+
+const TestProgress = struct {
+    bytes: u64 = 0,
+    durableOffset: u64 = 0,
+
+    pub fn advance(self: *TestProgress, bytesWritten: u64) !void {
+        self.bytes += bytesWritten;
+    }
+
+    pub fn setIoConfig(self: *TestProgress, chunkSize: u64, queueDepth: u64) void {
+        _ = self;
+        _ = chunkSize;
+        _ = queueDepth;
+    }
+
+    pub fn markDurable(self: *TestProgress, target: std.fs.File, durableOffset: u64) !void {
+        _ = target;
+        self.durableOffset = durableOffset;
+    }
+};
+
+fn writeTestImage(dir: std.fs.Dir, name: []const u8, size: usize) !std.fs.File {
+    const file = try dir.createFile(name, .{ .read = true });
+    errdefer file.close();
+
+    var block: [4096]u8 = undefined;
+    var written: usize = 0;
+    while (written < size) {
+        const len = @min(block.len, size - written);
+        for (block[0..len], 0..) |*byte, i| byte.* = @truncate((written + i) *% 151);
+        try file.writeAll(block[0..len]);
+        written += len;
+    }
+
+    return file;
+}
+
+fn expectSameContents(image: std.fs.File, target: std.fs.File, size: usize) !void {
+    const expected = try std.testing.allocator.alloc(u8, size);
+    defer std.testing.allocator.free(expected);
+    const actual = try std.testing.allocator.alloc(u8, size);
+    defer std.testing.allocator.free(actual);
+
+    try std.testing.expectEqual(size, try image.preadAll(expected, 0));
+    try std.testing.expectEqual(size, try target.preadAll(actual, 0));
+    try std.testing.expectEqualSlices(u8, expected, actual);
+}
+
+test "ZeroCopyWriter copies an image to a plain file target" {
+    if (builtin.os.tag != .linux) return error.SkipZigTest;
+
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const imageSize = 2 * 1024 * 1024 + 555;
+    const image = try writeTestImage(tmp.dir, "image.img", imageSize);
+    defer image.close();
+
+    const target = try tmp.dir.createFile("target.img", .{ .read = true });
+    defer target.close();
+
+    var writer = ZeroCopyWriter.init(target, .{ .chunkSize = 256 * 1024 });
+    defer writer.deinit();
+
+    var progress = TestProgress{};
+    writer.run(image, target, 0, imageSize, &progress) catch |err| switch (err) {
+        error.ZeroCopyUnsupported => return error.SkipZigTest,
+        else => return err,
+    };
+
+    try std.testing.expect(writer.method != null);
+    try std.testing.expectEqual(@as(u64, imageSize), progress.bytes);
+    try std.testing.expectEqual(@as(u64, imageSize), progress.durableOffset);
+    try expectSameContents(image, target, imageSize);
+}
+
+test "ZeroCopyWriter splices through a pipe when forced" {
+    if (builtin.os.tag != .linux) return error.SkipZigTest;
+
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const imageSize = 1024 * 1024 + 17;
+    const image = try writeTestImage(tmp.dir, "image.img", imageSize);
+    defer image.close();
+
+    const target = try tmp.dir.createFile("target.img", .{ .read = true });
+    defer target.close();
+
+    var writer = ZeroCopyWriter.init(target, .{ .chunkSize = 128 * 1024, .method = .SPLICE });
+    defer writer.deinit();
+
+    var progress = TestProgress{};
+    writer.run(image, target, 0, imageSize, &progress) catch |err| switch (err) {
+        error.ZeroCopyUnsupported => return error.SkipZigTest,
+        else => return err,
+    };
+
+    try std.testing.expectEqual(@as(u64, imageSize), progress.bytes);
+    try expectSameContents(image, target, imageSize);
+}
+
+/// Buffered baseline for the benchmark: pread into a user buffer, pwrite it out.
+fn copyBuffered(source: std.fs.File, target: std.fs.File, size: u64, buffer: []u8) !void {
+    var offset: u64 = 0;
+    while (offset < size) {
+        const len: usize = @intCast(@min(@as(u64, buffer.len), size - offset));
+        const bytesRead = try source.preadAll(buffer[0..len], offset);
+        if (bytesRead == 0) return error.UnexpectedEndOfImage;
+        try target.pwriteAll(buffer[0..bytesRead], offset);
+        offset += bytesRead;
+    }
+    try target.sync();
+}
+
+fn benchmarkTarget(label: []const u8, image: std.fs.File, target: std.fs.File, size: u64) !void {
+    const chunkSize = 1024 * 1024;
+    const buffer = try std.testing.allocator.alloc(u8, chunkSize);
+    defer std.testing.allocator.free(buffer);
+
+    var timer = try std.time.Timer.start();
+    try copyBuffered(image, target, size, buffer);
+    const bufferedNs = timer.lap();
+
+    inline for (.{ Method.COPY_FILE_RANGE, Method.SPLICE }) |method| {
+        var writer = ZeroCopyWriter.init(target, .{ .chunkSize = chunkSize, .method = method });
+        defer writer.deinit();
+
+        var progress = TestProgress{};
+        _ = timer.lap();
+        if (writer.run(image, target, 0, size, &progress)) |_| {
+            std.debug.print("{s}: {s} {d} MB/s vs buffered {d} MB/s\n", .{ label, @tagName(method), bench.megabytesPerSecond(size, timer.read()), bench.megabytesPerSecond(size, bufferedNs) });
+        } else |err| {
+            std.debug.print("{s}: {s} unavailable ({any})\n", .{ label, @tagName(method), err });
+        }
+    }
+}
+
+test "benchmark: zero-copy against the buffered path" {
+    if (builtin.os.tag != .linux) return error.SkipZigTest;
+    try bench.skipUnlessEnabled();
+
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const imageSize = 64 * 1024 * 1024;
+    const image = try writeTestImage(tmp.dir, "bench.img", imageSize);
+    defer image.close();
+
+    {
+        const target = try tmp.dir.createFile("bench-target.img", .{ .read = true, .truncate = true });
+        defer target.close();
+        try benchmarkTarget("file", image, target, imageSize);
+    }
+
+    // Loop devices need root to set up; point FREETRACER_BENCH_LOOP_DEVICE at a spare one
+    // (e.g. /dev/loop7 backed by a file of at least 64 MiB) to include it
+    const loopPath = std.process.getEnvVarOwned(std.testing.allocator, "FREETRACER_BENCH_LOOP_DEVICE") catch return;
+    defer std.testing.allocator.free(loopPath);
+
+    const loopDevice = try std.fs.openFileAbsolute(loopPath, .{ .mode = .read_write });
+    defer loopDevice.close();
+    try benchmarkTarget("loop device", image, loopDevice, imageSize);
+}
@@ -10,7 +10,7 @@
 //!   - Whitelist validation (Desktop, Documents, Downloads)
 //!
 //! **Image File Validation**
-//!   - Magic signature detection (ISO 9660, El Torito, MBR, GPT, UDF)
+//!   - Magic signature detection (ISO 9660, El Torito, MBR, GPT, UDF, Android sparse, UDIF)
 //!   - File extension parsing and classification
 //!   - Minimum size validation
 //!   - File kind verification (rejects symlinks)
@@ -30,6 +30,10 @@ const Debug = @import("../util/debug.zig");
 const ImageType = @import("../types.zig").ImageType;
 const String = @import("../util/string.zig");
 const ISOParser = @import("../ISOParser.zig");
+const compression = @import("../util/compression.zig");
+const simg = @import("../util/simg.zig");
+const udif = @import("../util/udif.zig");
+const vdisk = @import("../util/vdisk.zig");
 
 /// Supported disk image and partition table formats
 pub const FileSystemType = enum {
@@ -38,6 +42,9 @@ pub const FileSystemType = enum {
     MBR, // Master Boot Record partition table
     GPT, // GUID Partition Table (modern alternative to MBR)
     UDF, // Universal Disk Format (used by DVDs/Blu-rays)
+    ANDROID_SPARSE, // Android sparse image (simg); expanded chunk by chunk while writing
+    APPLE_UDIF, // Apple disk image (.dmg); chunks are decompressed while writing
+    VIRTUAL_DISK, // qcow2/VHD/VHDX/VMDK; allocated clusters are streamed, the rest is sparse
     UNKNOWN, // Format not recognized
 };
 
@@ -47,6 +54,8 @@ pub const ImageFileValidationResult = struct {
     isValid: bool = false,
     fileSystem: FileSystemType = .UNKNOWN,
     isoParserResult: ISOParser.ISO_PARSER_RESULT = .UNABLE_TO_OBTAIN_ISO_FILE_STAT,
+    /// Container compression; when not NONE, `fileSystem` describes the decompressed image
+    compression: compression.Compression = .NONE,
 };
 
 /// Error set for filesystem path operations
@@ -518,6 +527,21 @@ pub fn validateImageFile(file: std.fs.File) ImageFileValidationResult {
         return badResult;
     }
 
+    // Checked before the container magic: an LZMA .dmg starts with an xz stream
+    if (udif.detect(file)) {
+        Debug.log(.DEBUG, "isValidImageFile: Detected Apple UDIF disk image.", .{});
+        return .{ .isValid = true, .fileSystem = .APPLE_UDIF };
+    }
+
+    // Checked before the MBR/GPT signatures: a fixed VHD is a raw disk with a footer
+    if (vdisk.detect(file)) |format| {
+        Debug.log(.DEBUG, "isValidImageFile: Detected {s} virtual disk.", .{@tagName(format)});
+        return .{ .isValid = true, .fileSystem = .VIRTUAL_DISK };
+    }
+
+    const containerCompression = compression.detect(file);
+    if (containerCompression != .NONE) return validateCompressedImageFile(file, containerCompression);
+
     Debug.log(.DEBUG, "isValidImageFile: Seeking to start of file", .{});
     file.seekTo(0) catch |err| {
         Debug.log(.ERROR, "isValidImageFile: Unable to seek to beginning of file. Error: {any}", .{err});
@@ -537,6 +561,12 @@ pub fn validateImageFile(file: std.fs.File) ImageFileValidationResult {
         return badResult;
     }
 
+    // The sparse container is not expanded here: its chunk layout is validated in full by the writer
+    if (simg.isSparseImage(&buffer)) {
+        Debug.log(.DEBUG, "isValidImageFile: Detected Android sparse image.", .{});
+        return .{ .isValid = true, .fileSystem = .ANDROID_SPARSE };
+    }
+
     if (isISO9660(buffer)) {
         Debug.log(.DEBUG, "isValidImageFile: Detected ISO 9660 image.", .{});
 
@@ -568,6 +598,53 @@ pub fn validateImageFile(file: std.fs.File) ImageFileValidationResult {
     return badResult;
 }
 
+/// Bytes decompressed to validate a compressed image: covers the MBR, the GPT header
+/// and the ISO 9660 primary volume descriptor at sector 16.
+const COMPRESSED_VALIDATION_HEAD_SIZE = 17 * 2048;
+
+/// Validates a compressed image by decompressing its head and checking the ISO 9660,
+/// MBR and GPT signatures there. El Torito and UDF need random access into the image,
+/// so a compressed ISO is reported as plain ISO9660.
+fn validateCompressedImageFile(file: std.fs.File, containerCompression: compression.Compression) ImageFileValidationResult {
+    Debug.log(.DEBUG, "isValidImageFile: Detected {s} container, validating decompressed head", .{@tagName(containerCompression)});
+    const badResult = ImageFileValidationResult{ .compression = containerCompression };
+
+    const head = std.heap.page_allocator.alloc(u8, COMPRESSED_VALIDATION_HEAD_SIZE) catch return badResult;
+    defer std.heap.page_allocator.free(head);
+
+    var stream: compression.DecompressStream = undefined;
+    stream.init(std.heap.page_allocator, file, containerCompression) catch |err| {
+        Debug.log(.ERROR, "isValidImageFile: Unable to initialize decompressor. Error: {any}", .{err});
+        return badResult;
+    };
+    defer stream.deinit();
+
+    const bytesRead = stream.read(head) catch |err| {
+        Debug.log(.ERROR, "isValidImageFile: Unable to decompress image head. Error: {any}", .{err});
+        return badResult;
+    };
+
+    if (bytesRead < 1024) {
+        Debug.log(.ERROR, "isValidImageFile: Decompressed image is too small to contain valid image signatures.", .{});
+        return badResult;
+    }
+
+    if (bytesRead == head.len and isISO9660(head[16 * 2048 ..][0..512].*)) {
+        return .{ .isValid = true, .fileSystem = .ISO9660, .compression = containerCompression };
+    }
+
+    if (isMBRPartitionTable(head[0..512].*)) {
+        return .{ .isValid = true, .fileSystem = .MBR, .compression = containerCompression };
+    }
+
+    if (std.mem.eql(u8, head[512..520], "EFI PART")) {
+        return .{ .isValid = true, .fileSystem = .GPT, .compression = containerCompression };
+    }
+
+    Debug.log(.WARNING, "isValidImageFile: Decompressed image does not contain recognized image signatures.", .{});
+    return badResult;
+}
+
 /// Classifies image type based on file extension.
 /// Performs case-insensitive extension matching.
 /// Used to provide user-facing information about the image file.
@@ -579,12 +656,17 @@ pub fn validateImageFile(file: std.fs.File) ImageFileValidationResult {
 ///   ImageType.ISO if extension is .iso (case-insensitive)
 ///   ImageType.IMG if extension is .img (case-insensitive)
 ///   ImageType.Other for any other extension
+///   A trailing .gz/.xz/.zst is looked through, so "raspios.img.xz" is IMG
 ///
 /// `Note`:
 ///   This is purely a hint based on file extension, not validation.
 ///   Always call validateImageFile() for actual format verification.
 pub fn getImageType(path: []const u8) ImageType {
-    const ext = getExtensionFromPath(path);
+    var ext = getExtensionFromPath(path);
+
+    if (compression.isCompressedExtension(ext)) {
+        ext = getExtensionFromPath(path[0 .. path.len - ext.len]);
+    }
 
     if (std.ascii.eqlIgnoreCase(ext, ".ISO")) return .ISO;
     if (std.ascii.eqlIgnoreCase(ext, ".IMG")) return .IMG;
@@ -592,6 +674,9 @@ pub fn getImageType(path: []const u8) ImageType {
     return .Other;
 }
 
+/// Minimum ISO system block: 16 sectors by 2048 bytes each + 1 sector for PVD contents.
+pub const MIN_ISO_FILE_SIZE: u64 = (16 + 1) * 2048;
+
 /// Opens an ISO image file with comprehensive security validation.
 /// This is the primary entry point for accessing user-provided image files.
 /// Implements defense-in-depth with multiple validation layers.
@@ -606,11 +691,12 @@ pub fn getImageType(path: []const u8) ImageType {
 ///   7. File opening with read_only mode
 ///   8. File stat validation
 ///   9. File kind check (must be regular file, reject symlinks)
-///   10. Minimum size check (must be at least 17 sectors = 34816 bytes)
+///   10. Minimum size check (params.minFileSize, by default 17 sectors = 34816 bytes)
 ///
 /// `Arguments`:
 ///   unsanitizedIsoPath: User-provided path (NOT trusted, requires validation)
 ///   params.userHomePath: User home directory (must be provided securely)
+///   params.minFileSize: Smallest accepted file size; sidecar files (e.g. .bmap) pass a lower bound
 ///
 /// `Returns`:
 ///   Open std.fs.File handle for reading the image
@@ -634,7 +720,7 @@ pub fn getImageType(path: []const u8) ImageType {
 ///   - File kind validation rejects symlinks
 ///   - Whitelist prevents access to system directories
 ///   - Minimum size check for basic sanity
-pub fn openFileValidated(unsanitizedIsoPath: []const u8, params: struct { userHomePath: []const u8 }) !std.fs.File {
+pub fn openFileValidated(unsanitizedIsoPath: []const u8, params: struct { userHomePath: []const u8, minFileSize: u64 = MIN_ISO_FILE_SIZE }) !std.fs.File {
     Debug.log(.DEBUG, "openFileValidated: Starting validation for path", .{});
 
     // Buffer overflow protection
@@ -703,9 +789,8 @@ pub fn openFileValidated(unsanitizedIsoPath: []const u8, params: struct { userHo
         return error.InvalidISOFileKind;
     }
 
-    // Minimum ISO system block: 16 sectors by 2048 bytes each + 1 sector for PVD contents.
-    if (fileStat.size < (16 + 1) * 2048) {
-        Debug.log(.ERROR, "openFileValidated: File size {d} is smaller than minimum required {d}", .{ fileStat.size, (16 + 1) * 2048 });
+    if (fileStat.size < params.minFileSize) {
+        Debug.log(.ERROR, "openFileValidated: File size {d} is smaller than minimum required {d}", .{ fileStat.size, params.minFileSize });
         return error.InvalidISOSystemStructure;
     }
 
@@ -861,6 +946,12 @@ test "getImageType: uppercase .img file" {
     try std.testing.expect(getImageType(path) == .IMG);
 }
 
+test "getImageType: looks through compression suffixes" {
+    try std.testing.expect(getImageType("raspios-lite.img.xz") == .IMG);
+    try std.testing.expect(getImageType("installer.iso.zst") == .ISO);
+    try std.testing.expect(getImageType("archive.tar.gz") == .Other);
+}
+
 test "getImageType: other extension returns .Other" {
     const path = "data.zip";
     try std.testing.expect(getImageType(path) == .Other);
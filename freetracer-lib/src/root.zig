@@ -12,6 +12,16 @@
 //!   - Time: Timestamp and duration utilities
 //!   - Endian: Byte order conversion
 //!   - Device: Device enumeration and detection
+//!   - SIMD: Vectorized byte scanning (zero detection, first mismatch search)
+//!   - Compression: gzip/xz/zstd image container detection and streaming decompression
+//!   - Autotune: Throughput-driven chunk size and queue depth selection
+//!   - BufferPool: Reusable page-aligned I/O buffers, optionally on huge pages
+//!   - Bmap: bmaptool block maps (sibling lookup, parsing, range checksum verification)
+//!   - Simg: Android sparse image chunk parsing
+//!   - Udif: Apple UDIF (.dmg) chunk tables and parallel in-order chunk decoding
+//!   - VDisk: qcow2/VHD/VHDX/VMDK allocation tables mapped to data and zero extents
+//!   - ImageSource: One read/pread/extent interface over files, split parts, pipes, streams and disks
+//!   - ImageHash: Parallel BLAKE3 tree / pipelined SHA-256 image hashing, checksum sidecar lookup
 //!
 //! **macOS Integration**
 //!   - FileSystem: Home directory resolution and path utilities
@@ -20,6 +30,10 @@
 //!   - Mach: Low-level Mach kernel APIs
 //!   - IOKit: Hardware and device information APIs
 //!
+//! **Linux Integration**
+//!   - Uring: io_uring-backed asynchronous write engine
+//!   - ZeroCopy: copy_file_range/splice engine that keeps image bytes in the kernel
+//!
 //! **Data Processing**
 //!   - ISO9660: ISO 9660 filesystem parsing and validation
 //!   - ISOParser: High-level ISO image analysis
@@ -66,6 +80,36 @@ pub const device = @import("./util/device.zig");
 /// Byte order conversion and endianness utilities
 pub const endian = @import("./util/endian.zig");
 
+/// Vectorized byte scanning for hot I/O paths (zero-chunk detection)
+pub const simd = @import("./util/simd.zig");
+
+/// Compressed image containers: magic detection, size metadata, streaming decompression
+pub const compression = @import("./util/compression.zig");
+
+/// Measured chunk size / queue depth search for device writes
+pub const autotune = @import("./util/autotune.zig");
+
+/// Page-aligned I/O buffer pool shared by the stages of a write job
+pub const bufferpool = @import("./util/bufferpool.zig");
+
+/// Block map (.bmap) files: which image ranges hold data, with per-range checksums
+pub const bmap = @import("./util/bmap.zig");
+
+/// Android sparse images (simg): header validation and RAW/FILL/DONT_CARE/CRC32 chunk walking
+pub const simg = @import("./util/simg.zig");
+
+/// Apple UDIF (.dmg) images: koly trailer, blkx chunk tables, parallel chunk decoding
+pub const udif = @import("./util/udif.zig");
+
+/// Virtual machine disks (qcow2, VHD, VHDX, VMDK): allocation tables as data/zero extent maps
+pub const vdisk = @import("./util/vdisk.zig");
+
+/// Image sources: the interface the write pipeline reads images through
+pub const imagesource = @import("./util/imagesource.zig");
+
+/// Image hashing: multithreaded BLAKE3 tree digests, pipelined SHA-256, SHA256SUMS sidecars
+pub const imagehash = @import("./util/imagehash.zig");
+
 // ============================================================================
 // macOS INTEGRATION - System framework bindings and utilities
 // ============================================================================
@@ -90,6 +134,18 @@ pub const Mach = @import("./macos/Mach.zig");
 /// Hardware device information and device tree traversal
 pub const IOKit = @import("./macos/IOKit.zig");
 
+// ============================================================================
+// LINUX INTEGRATION - Kernel interfaces for Linux flashing hosts
+// ============================================================================
+
+/// io_uring write engine
+/// Keeps registered buffers in flight against block devices, loop devices or plain files
+pub const Uring = @import("./linux/uring.zig");
+
+/// Zero-copy write engine
+/// Transfers image bytes with copy_file_range or splice, without a user-space bounce buffer
+pub const ZeroCopy = @import("./linux/zerocopy.zig");
+
 // ============================================================================
 // DATA PROCESSING - File format parsing and analysis
 // ============================================================================
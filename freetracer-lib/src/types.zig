@@ -48,6 +48,9 @@ pub const c = if (isMac) @cImport({
 
     // for posix_fallocate
     @cInclude("fcntl.h");
+    // --- UDIF (.dmg) chunk decoding: LZFSE and bzip2
+    @cInclude("compression.h");
+    @cInclude("bzlib.h");
 }) else if (isLinux) @cImport({
     // @cInclude("blkid/blkid.h");
 });
@@ -72,9 +75,22 @@ pub const ImageType = enum(u64) {
     Other,
 };
 
+/// Policy for image ranges that contain only zeros (filesystem holes or all-zero chunks).
+/// Anything other than OFF makes the caller responsible for the target's prior state.
+pub const SparseMode = enum(u64) {
+    /// Write every byte of the image
+    OFF,
+    /// Skip zero ranges entirely; the target MUST already be zeroed/discarded
+    ASSUME_ZEROED,
+    /// Discard (unmap/TRIM) zero ranges on the target; writes zeros where discard is unsupported
+    DISCARD,
+};
+
 pub const Image = struct {
     path: ?[:0]u8 = null,
     type: ImageType = undefined,
+    /// A bmaptool block map was found next to the image (see bmap.findSiblingPath)
+    hasBlockMap: bool = false,
 };
 
 pub const StorageDevice = struct {
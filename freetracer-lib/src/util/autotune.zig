@@ -0,0 +1,246 @@
+//! Throughput autotuner for device writes.
+//!
+//! Chooses the write chunk size (and, for engines that can vary it, the queue depth)
+//! from measured throughput rather than a static clamp. The start of a job is split
+//! into trials, each written with one candidate configuration; the sustained rate of
+//! every trial is recorded and the fastest configuration is locked for the rest of
+//! the job.
+//!
+//! Search is coordinate-wise to keep the measured prefix to a few hundred MB:
+//!   1. Chunk sizes (powers of two, block-aligned) are swept at the base queue depth
+//!   2. Queue depths (powers of two) are swept at the winning chunk size
+//!
+//! The tuner only does bookkeeping. Writers ask `current()` before issuing I/O and
+//! report completed bytes through `record()`. It is not thread-safe; drive it from
+//! the thread that completes writes.
+const std = @import("std");
+const Debug = @import("debug.zig");
+
+pub const MIN_CHUNK_SIZE: usize = 1024 * 1024;
+pub const MAX_CHUNK_SIZE: usize = 16 * 1024 * 1024;
+
+/// Bytes measured per candidate. Large chunks get at least TRIAL_MIN_CHUNKS writes.
+pub const TRIAL_BYTES: u64 = 32 * 1024 * 1024;
+const TRIAL_MIN_CHUNKS = 3;
+
+/// Images smaller than this finish before a search would pay off; callers should
+/// use their static probe instead.
+pub const MIN_IMAGE_SIZE: u64 = 1024 * 1024 * 1024;
+
+const MAX_CANDIDATES = 16;
+
+pub const Config = struct {
+    chunkSize: usize,
+    queueDepth: u16,
+};
+
+pub const AutotuneOptions = struct {
+    /// Chunk candidates are the powers of two in [minChunkSize, maxChunkSize], aligned down to blockSize
+    minChunkSize: usize = MIN_CHUNK_SIZE,
+    maxChunkSize: usize = MAX_CHUNK_SIZE,
+    blockSize: usize = 512,
+    /// Queue depth used while sweeping chunk sizes
+    baseQueueDepth: u16 = 1,
+    /// Depth candidates are the powers of two in [2, maxQueueDepth]; values below 2 skip the depth sweep
+    maxQueueDepth: u16 = 1,
+    trialBytes: u64 = TRIAL_BYTES,
+};
+
+const Phase = enum { CHUNK_SIZE, QUEUE_DEPTH, LOCKED };
+
+pub const Autotuner = struct {
+    options: AutotuneOptions,
+    phase: Phase = .CHUNK_SIZE,
+    timer: std.time.Timer,
+
+    candidates: [MAX_CANDIDATES]Config = undefined,
+    candidateCount: usize = 0,
+    trialIndex: usize = 0,
+    /// Bytes measured in the current trial (excludes the completion that started its clock)
+    trialBytes: u64 = 0,
+    trialStartNs: ?u64 = null,
+
+    best: Config,
+    bestRate: u64 = 0,
+
+    /// `Errors`:
+    ///   error.TimerUnsupported: no monotonic clock is available
+    pub fn init(options: AutotuneOptions) !Autotuner {
+        var tuner = Autotuner{
+            .options = options,
+            .timer = try std.time.Timer.start(),
+            .best = .{ .chunkSize = alignToBlock(options.maxChunkSize, options.blockSize), .queueDepth = @max(options.baseQueueDepth, 1) },
+        };
+
+        var size = std.math.ceilPowerOfTwo(usize, @max(options.minChunkSize, 1)) catch options.maxChunkSize;
+        while (size <= options.maxChunkSize and tuner.candidateCount < MAX_CANDIDATES) : (size *= 2) {
+            const aligned = alignToBlock(size, options.blockSize);
+            if (aligned == 0) continue;
+            if (tuner.candidateCount > 0 and tuner.candidates[tuner.candidateCount - 1].chunkSize == aligned) continue;
+
+            tuner.candidates[tuner.candidateCount] = .{ .chunkSize = aligned, .queueDepth = tuner.best.queueDepth };
+            tuner.candidateCount += 1;
+        }
+
+        // Nothing to compare: run with the single configuration straight away
+        if (tuner.candidateCount < 2) {
+            if (tuner.candidateCount == 1) tuner.best = tuner.candidates[0];
+            if (!tuner.beginDepthSweep()) tuner.lock();
+        }
+
+        return tuner;
+    }
+
+    /// Configuration the next write should use.
+    pub fn current(self: *const Autotuner) Config {
+        return if (self.phase == .LOCKED) self.best else self.candidates[self.trialIndex];
+    }
+
+    pub fn isLocked(self: *const Autotuner) bool {
+        return self.phase == .LOCKED;
+    }
+
+    /// Reports `bytes` completed with the current configuration.
+    pub fn record(self: *Autotuner, bytes: u64) void {
+        self.recordAt(bytes, self.timer.read());
+    }
+
+    fn recordAt(self: *Autotuner, bytes: u64, nowNs: u64) void {
+        if (self.phase == .LOCKED) return;
+
+        // The first completion of a trial only starts its clock: it absorbs pipeline fill
+        // and, for asynchronous engines, requests issued under the previous candidate.
+        const startNs = self.trialStartNs orelse {
+            self.trialStartNs = nowNs;
+            return;
+        };
+
+        self.trialBytes += bytes;
+        const candidate = self.candidates[self.trialIndex];
+        const targetBytes = @max(self.options.trialBytes, @as(u64, candidate.chunkSize) * TRIAL_MIN_CHUNKS);
+        if (self.trialBytes < targetBytes) return;
+
+        const elapsedNs = @max(nowNs - startNs, 1);
+        const rate: u64 = @intCast(@min(@as(u128, self.trialBytes) * std.time.ns_per_s / elapsedNs, std.math.maxInt(u64)));
+
+        Debug.log(.INFO, "Autotune trial: chunk {d} KB, queue depth {d} -> {d} MB/s", .{
+            candidate.chunkSize / 1024,
+            candidate.queueDepth,
+            rate / (1024 * 1024),
+        });
+
+        if (rate > self.bestRate) {
+            self.bestRate = rate;
+            self.best = candidate;
+        }
+
+        self.trialIndex += 1;
+        self.trialBytes = 0;
+        self.trialStartNs = null;
+
+        if (self.trialIndex < self.candidateCount) return;
+
+        if (self.phase == .CHUNK_SIZE and self.beginDepthSweep()) return;
+        self.lock();
+    }
+
+    /// Replaces the candidates with depth variations of the best chunk size.
+    /// Returns false when there is no depth worth trying.
+    fn beginDepthSweep(self: *Autotuner) bool {
+        self.candidateCount = 0;
+        self.trialIndex = 0;
+
+        var depth: u32 = 2;
+        while (depth <= self.options.maxQueueDepth and self.candidateCount < MAX_CANDIDATES) : (depth *= 2) {
+            // Already measured during the chunk sweep
+            if (depth == self.best.queueDepth) continue;
+
+            self.candidates[self.candidateCount] = .{ .chunkSize = self.best.chunkSize, .queueDepth = @intCast(depth) };
+            self.candidateCount += 1;
+        }
+
+        if (self.candidateCount == 0) return false;
+
+        self.phase = .QUEUE_DEPTH;
+        return true;
+    }
+
+    fn lock(self: *Autotuner) void {
+        self.phase = .LOCKED;
+        Debug.log(.INFO, "Autotune locked: chunk {d} KB, queue depth {d} ({d} MB/s measured)", .{
+            self.best.chunkSize / 1024,
+            self.best.queueDepth,
+            self.bestRate / (1024 * 1024),
+        });
+    }
+};
+
+fn alignToBlock(size: usize, blockSize: usize) usize {
+    const block = @max(blockSize, 1);
+    return (size / block) * block;
+}
+
+// ============================================================================
+// TESTS
+// ============================================================================
+
+const MiB = 1024 * 1024;
+
+/// Feeds one trial at a fixed rate (bytes per second) through recordAt.
+fn runTrial(tuner: *Autotuner, nowNs: *u64, bytesPerSecond: u64) void {
+    const config = tuner.current();
+    const perWriteNs = @as(u64, config.chunkSize) * std.time.ns_per_s / bytesPerSecond;
+    const writes = @max(tuner.options.trialBytes / config.chunkSize, TRIAL_MIN_CHUNKS) + 1;
+
+    for (0..writes) |_| {
+        nowNs.* += perWriteNs;
+        tuner.recordAt(config.chunkSize, nowNs.*);
+    }
+}
+
+test "Autotuner sweeps chunk sizes and locks the fastest" {
+    var tuner = try Autotuner.init(.{ .minChunkSize = 1 * MiB, .maxChunkSize = 8 * MiB, .trialBytes = 8 * MiB });
+    try std.testing.expectEqual(@as(usize, 4), tuner.candidateCount);
+
+    var now: u64 = 0;
+    // 1, 2, 4, 8 MiB: the 2 MiB candidate is fastest
+    for ([_]u64{ 20, 90, 60, 40 }) |mbPerSecond| {
+        try std.testing.expect(!tuner.isLocked());
+        runTrial(&tuner, &now, mbPerSecond * MiB);
+    }
+
+    try std.testing.expect(tuner.isLocked());
+    try std.testing.expectEqual(@as(usize, 2 * MiB), tuner.current().chunkSize);
+    try std.testing.expectEqual(@as(u16, 1), tuner.current().queueDepth);
+}
+
+test "Autotuner sweeps queue depth at the winning chunk size" {
+    var tuner = try Autotuner.init(.{
+        .minChunkSize = 1 * MiB,
+        .maxChunkSize = 2 * MiB,
+        .baseQueueDepth = 8,
+        .maxQueueDepth = 8,
+        .trialBytes = 4 * MiB,
+    });
+
+    var now: u64 = 0;
+    runTrial(&tuner, &now, 50 * MiB); // 1 MiB @ depth 8
+    runTrial(&tuner, &now, 70 * MiB); // 2 MiB @ depth 8
+
+    // Depth sweep tries 2 and 4; depth 8 was already measured
+    try std.testing.expect(!tuner.isLocked());
+    try std.testing.expectEqual(@as(usize, 2 * MiB), tuner.current().chunkSize);
+    try std.testing.expectEqual(@as(u16, 2), tuner.current().queueDepth);
+
+    runTrial(&tuner, &now, 40 * MiB); // depth 2
+    runTrial(&tuner, &now, 80 * MiB); // depth 4
+
+    try std.testing.expect(tuner.isLocked());
+    try std.testing.expectEqual(Config{ .chunkSize = 2 * MiB, .queueDepth = 4 }, tuner.current());
+}
+
+test "Autotuner with a single candidate locks immediately" {
+    const tuner = try Autotuner.init(.{ .minChunkSize = 4 * MiB, .maxChunkSize = 4 * MiB, .blockSize = 4096 });
+    try std.testing.expect(tuner.isLocked());
+    try std.testing.expectEqual(@as(usize, 4 * MiB), tuner.current().chunkSize);
+}
@@ -0,0 +1,24 @@
+//! Benchmark Gate
+//!
+//! Benchmarks live next to the code they measure as `test "benchmark: ..."` blocks.
+//! They allocate tens of MiB and print throughput, so the regular test steps skip
+//! them; `zig build bench` runs only the benchmarks, with ENV_VAR set.
+const std = @import("std");
+
+/// Set by the `bench` build step; any value enables the benchmarks.
+pub const ENV_VAR = "FREETRACER_BENCH";
+
+/// First statement of every benchmark test: skips it outside the `bench` step.
+pub fn skipUnlessEnabled() error{SkipZigTest}!void {
+    if (!std.process.hasEnvVarConstant(ENV_VAR)) return error.SkipZigTest;
+}
+
+/// Throughput in MB/s of `bytes` moved in `elapsedNs`.
+pub fn megabytesPerSecond(bytes: u64, elapsedNs: u64) u64 {
+    return bytes * std.time.ns_per_s / @max(elapsedNs, 1) / 1_000_000;
+}
+
+/// Prints one `label: N MB/s` result line.
+pub fn report(label: []const u8, bytes: u64, elapsedNs: u64) void {
+    std.debug.print("{s}: {d} MB/s\n", .{ label, megabytesPerSecond(bytes, elapsedNs) });
+}
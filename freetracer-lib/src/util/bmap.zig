@@ -0,0 +1,492 @@
+//! Block map (.bmap) files, as produced by bmaptool for Yocto/Tizen images.
+//!
+//! A bmap lists the block ranges of a raw image that hold data, each with a checksum.
+//! Writing only those ranges skips the (often much larger) unmapped remainder:
+//! - findSiblingPath() locates `image.bmap` / `image.img.bmap` next to an image,
+//!   looking through a compression extension (`image.img.gz` uses `image.img.bmap`)
+//! - parse() reads format versions 1.x and 2.x, verifies the bmap's own checksum when
+//!   present and converts block ranges to byte ranges
+//! - RangeVerifier walks image bytes in offset order, clips them to the mapped ranges
+//!   and checks every range checksum as soon as the range is complete
+//!
+//! The XML is parsed with a minimal scanner: bmap files are machine-generated, flat and
+//! never use entities or CDATA.
+//! ------------------------------------------------------------------------------
+const std = @import("std");
+const compression = @import("./compression.zig");
+
+const Sha1 = std.crypto.hash.Sha1;
+const Sha256 = std.crypto.hash.sha2.Sha256;
+
+pub const EXTENSION = ".bmap";
+
+/// Upper bound on the bmap file size we are willing to load.
+pub const MAX_BMAP_SIZE = 16 * 1024 * 1024;
+
+const MAX_DIGEST_LENGTH = Sha256.digest_length;
+
+pub const ChecksumType = enum {
+    SHA1,
+    SHA256,
+
+    fn digestLength(self: ChecksumType) usize {
+        return switch (self) {
+            .SHA1 => Sha1.digest_length,
+            .SHA256 => Sha256.digest_length,
+        };
+    }
+};
+
+pub const BmapError = error{
+    InvalidBmap,
+    UnsupportedBmapVersion,
+    UnsupportedChecksumType,
+    BmapWithoutChecksums,
+    BmapChecksumMismatch,
+};
+
+/// Mapped byte range of the image with its expected checksum.
+pub const Range = struct {
+    offset: u64,
+    len: u64,
+    digest: [MAX_DIGEST_LENGTH]u8,
+
+    pub fn end(self: Range) u64 {
+        return self.offset + self.len;
+    }
+};
+
+pub const BlockMap = struct {
+    allocator: std.mem.Allocator,
+    imageSize: u64,
+    blockSize: u64,
+    checksumType: ChecksumType,
+    /// Ascending, non-overlapping
+    ranges: []Range,
+
+    pub fn deinit(self: *BlockMap) void {
+        self.allocator.free(self.ranges);
+    }
+
+    /// Bytes covered by the ranges: what a bmap write transfers.
+    pub fn mappedBytes(self: *const BlockMap) u64 {
+        var total: u64 = 0;
+        for (self.ranges) |range| total += range.len;
+        return total;
+    }
+};
+
+/// Writes the first existing bmap candidate for `imagePath` into `buffer`:
+/// `<image>.bmap`, then `<image without extension>.bmap`, where `<image>` has any
+/// compression extension removed. Returns null when none exists.
+pub fn findSiblingPath(buffer: *[std.fs.max_path_bytes]u8, imagePath: []const u8) ?[:0]const u8 {
+    var base = imagePath;
+    const compressedExtension = std.fs.path.extension(base);
+    if (compression.isCompressedExtension(compressedExtension)) base = base[0 .. base.len - compressedExtension.len];
+
+    const candidates = [_][]const u8{ base, base[0 .. base.len - std.fs.path.extension(base).len] };
+    for (candidates) |stem| {
+        const path = std.fmt.bufPrintZ(buffer, "{s}" ++ EXTENSION, .{stem}) catch continue;
+        std.fs.cwd().access(path, .{}) catch continue;
+        return path;
+    }
+
+    return null;
+}
+
+/// Parses a bmap document. The returned ranges are owned by `allocator`.
+///
+/// `Errors`:
+///   error.InvalidBmap: missing fields, malformed or unordered ranges
+///   error.UnsupportedBmapVersion: major version other than 1 or 2
+///   error.UnsupportedChecksumType: checksum other than sha1/sha256
+///   error.BmapWithoutChecksums: a range carries no checksum (nothing to verify against)
+///   error.BmapChecksumMismatch: the file's own checksum does not match its contents
+pub fn parse(allocator: std.mem.Allocator, xml: []const u8) !BlockMap {
+    var version: ?[]const u8 = null;
+    var imageSize: ?u64 = null;
+    var blockSize: ?u64 = null;
+    var blocksCount: ?u64 = null;
+    var checksumType: ChecksumType = .SHA1; // 1.x files imply SHA-1
+    var fileChecksum: ?[]const u8 = null;
+
+    var ranges: std.ArrayList(Range) = .empty;
+    errdefer ranges.deinit(allocator);
+
+    // Header fields precede the block map, so sizes are known when ranges are converted
+    var elements = ElementIterator{ .xml = xml };
+    while (elements.next()) |element| {
+        if (std.mem.eql(u8, element.name, "bmap")) {
+            version = attribute(element.attributes, "version");
+        } else if (std.mem.eql(u8, element.name, "ImageSize")) {
+            imageSize = try parseNumber(element.text);
+        } else if (std.mem.eql(u8, element.name, "BlockSize")) {
+            blockSize = try parseNumber(element.text);
+        } else if (std.mem.eql(u8, element.name, "BlocksCount")) {
+            blocksCount = try parseNumber(element.text);
+        } else if (std.mem.eql(u8, element.name, "ChecksumType")) {
+            const name = std.mem.trim(u8, element.text, &std.ascii.whitespace);
+            checksumType = if (std.ascii.eqlIgnoreCase(name, "sha1")) .SHA1 else if (std.ascii.eqlIgnoreCase(name, "sha256")) .SHA256 else return error.UnsupportedChecksumType;
+        } else if (std.mem.eql(u8, element.name, "BmapFileChecksum") or std.mem.eql(u8, element.name, "BmapFileSHA1")) {
+            fileChecksum = std.mem.trim(u8, element.text, &std.ascii.whitespace);
+        } else if (std.mem.eql(u8, element.name, "Range")) {
+            const size = imageSize orelse return error.InvalidBmap;
+            const block = blockSize orelse return error.InvalidBmap;
+            try ranges.append(allocator, try parseRange(element, size, block, checksumType, ranges.items));
+        }
+    }
+
+    const versionText = version orelse return error.InvalidBmap;
+    const major = std.fmt.parseInt(u8, versionText[0 .. std.mem.indexOfScalar(u8, versionText, '.') orelse versionText.len], 10) catch return error.InvalidBmap;
+    if (major != 1 and major != 2) return error.UnsupportedBmapVersion;
+
+    const size = imageSize orelse return error.InvalidBmap;
+    const block = blockSize orelse return error.InvalidBmap;
+    if (block == 0) return error.InvalidBmap;
+    if (blocksCount) |count| {
+        if (count != std.math.divCeil(u64, size, block) catch unreachable) return error.InvalidBmap;
+    }
+
+    if (fileChecksum) |expected| try verifyFileChecksum(xml, expected, checksumType);
+
+    return .{
+        .allocator = allocator,
+        .imageSize = size,
+        .blockSize = block,
+        .checksumType = checksumType,
+        .ranges = try ranges.toOwnedSlice(allocator),
+    };
+}
+
+/// Converts `<Range chksum="...">first-last</Range>` to a byte range clipped to the image.
+fn parseRange(element: Element, imageSize: u64, blockSize: u64, checksumType: ChecksumType, previous: []const Range) !Range {
+    if (blockSize == 0) return error.InvalidBmap;
+
+    const text = std.mem.trim(u8, element.text, &std.ascii.whitespace);
+    const separator = std.mem.indexOfScalar(u8, text, '-');
+    const first = try parseNumber(text[0 .. separator orelse text.len]);
+    const last = if (separator) |index| try parseNumber(text[index + 1 ..]) else first;
+
+    const offset = std.math.mul(u64, first, blockSize) catch return error.InvalidBmap;
+    if (last < first or offset >= imageSize) return error.InvalidBmap;
+    const endBlock = std.math.add(u64, last, 1) catch return error.InvalidBmap;
+    const rangeEnd = @min(std.math.mul(u64, endBlock, blockSize) catch imageSize, imageSize);
+
+    if (previous.len > 0 and previous[previous.len - 1].end() > offset) return error.InvalidBmap;
+
+    const checksum = attribute(element.attributes, "chksum") orelse attribute(element.attributes, "sha1") orelse return error.BmapWithoutChecksums;
+    var range = Range{ .offset = offset, .len = rangeEnd - offset, .digest = undefined };
+    try decodeHex(range.digest[0..checksumType.digestLength()], checksum);
+
+    return range;
+}
+
+/// The file checksum is computed with its own value replaced by ASCII zeros.
+fn verifyFileChecksum(xml: []const u8, expected: []const u8, checksumType: ChecksumType) !void {
+    const position = std.mem.indexOf(u8, xml, expected) orelse return error.InvalidBmap;
+
+    var digest: [MAX_DIGEST_LENGTH]u8 = undefined;
+    const zeros = [_]u8{'0'} ** (MAX_DIGEST_LENGTH * 2);
+    if (expected.len > zeros.len) return error.InvalidBmap;
+
+    var hasher = Hasher.init(checksumType);
+    hasher.update(xml[0..position]);
+    hasher.update(zeros[0..expected.len]);
+    hasher.update(xml[position + expected.len ..]);
+    hasher.final(&digest);
+
+    var expectedDigest: [MAX_DIGEST_LENGTH]u8 = undefined;
+    const length = checksumType.digestLength();
+    try decodeHex(expectedDigest[0..length], expected);
+    if (!std.mem.eql(u8, digest[0..length], expectedDigest[0..length])) return error.BmapChecksumMismatch;
+}
+
+fn parseNumber(text: []const u8) !u64 {
+    return std.fmt.parseInt(u64, std.mem.trim(u8, text, &std.ascii.whitespace), 10) catch error.InvalidBmap;
+}
+
+fn decodeHex(out: []u8, text: []const u8) !void {
+    const decoded = std.fmt.hexToBytes(out, std.mem.trim(u8, text, &std.ascii.whitespace)) catch return error.InvalidBmap;
+    if (decoded.len != out.len) return error.InvalidBmap;
+}
+
+/// Returns the value of `name="value"` within an element's attribute text.
+fn attribute(attributes: []const u8, name: []const u8) ?[]const u8 {
+    var rest = attributes;
+    while (std.mem.indexOf(u8, rest, name)) |index| {
+        const after = rest[index + name.len ..];
+        const isWholeName = index == 0 or std.ascii.isWhitespace(rest[index - 1]);
+        rest = after;
+
+        if (!isWholeName) continue;
+        const trimmed = std.mem.trimLeft(u8, after, &std.ascii.whitespace);
+        if (trimmed.len < 2 or trimmed[0] != '=') continue;
+
+        const quoted = std.mem.trimLeft(u8, trimmed[1..], &std.ascii.whitespace);
+        if (quoted.len == 0 or (quoted[0] != '"' and quoted[0] != '\'')) continue;
+        const close = std.mem.indexOfScalar(u8, quoted[1..], quoted[0]) orelse return null;
+        return quoted[1..][0..close];
+    }
+    return null;
+}
+
+const Element = struct {
+    name: []const u8,
+    attributes: []const u8,
+    /// Text up to the next tag; whitespace for container elements
+    text: []const u8,
+};
+
+/// Yields start tags in document order, skipping comments, processing instructions
+/// and end tags.
+const ElementIterator = struct {
+    xml: []const u8,
+    position: usize = 0,
+
+    fn next(self: *ElementIterator) ?Element {
+        while (std.mem.indexOfScalarPos(u8, self.xml, self.position, '<')) |start| {
+            const rest = self.xml[start..];
+
+            if (std.mem.startsWith(u8, rest, "<!--")) {
+                self.position = if (std.mem.indexOfPos(u8, self.xml, start, "-->")) |close| close + 3 else self.xml.len;
+                continue;
+            }
+
+            const close = std.mem.indexOfScalarPos(u8, self.xml, start, '>') orelse return null;
+            self.position = close + 1;
+            if (rest.len < 2 or rest[1] == '/' or rest[1] == '?' or rest[1] == '!') continue;
+
+            var tag = self.xml[start + 1 .. close];
+            const isSelfClosing = std.mem.endsWith(u8, tag, "/");
+            if (isSelfClosing) tag = tag[0 .. tag.len - 1];
+
+            const nameEnd = std.mem.indexOfAny(u8, tag, &std.ascii.whitespace) orelse tag.len;
+            const textEnd = std.mem.indexOfScalarPos(u8, self.xml, self.position, '<') orelse self.xml.len;
+
+            return .{
+                .name = tag[0..nameEnd],
+                .attributes = tag[nameEnd..],
+                .text = if (isSelfClosing) "" else self.xml[self.position..textEnd],
+            };
+        }
+        return null;
+    }
+};
+
+const Hasher = union(ChecksumType) {
+    SHA1: Sha1,
+    SHA256: Sha256,
+
+    fn init(checksumType: ChecksumType) Hasher {
+        return switch (checksumType) {
+            .SHA1 => .{ .SHA1 = Sha1.init(.{}) },
+            .SHA256 => .{ .SHA256 = Sha256.init(.{}) },
+        };
+    }
+
+    fn update(self: *Hasher, bytes: []const u8) void {
+        switch (self.*) {
+            inline else => |*hasher| hasher.update(bytes),
+        }
+    }
+
+    /// Writes the digest to the start of `out`.
+    fn final(self: *Hasher, out: *[MAX_DIGEST_LENGTH]u8) void {
+        switch (self.*) {
+            inline else => |*hasher, tag| hasher.final(out[0..comptime ChecksumType.digestLength(tag)]),
+        }
+    }
+};
+
+/// Part of a chunk that falls inside the current mapped range.
+pub const Part = struct {
+    offset: u64,
+    bytes: []const u8,
+};
+
+/// Checks image bytes against the range checksums. Feed it chunks in ascending offset
+/// order: nextPart() clips a chunk to the current range, consume() hashes what was taken
+/// and verifies the range once it is complete.
+pub const RangeVerifier = struct {
+    map: *const BlockMap,
+    index: usize = 0,
+    /// Next image offset expected within the current range
+    position: u64,
+    hasher: Hasher,
+
+    pub fn init(map: *const BlockMap) RangeVerifier {
+        return .{
+            .map = map,
+            .position = if (map.ranges.len > 0) map.ranges[0].offset else 0,
+            .hasher = Hasher.init(map.checksumType),
+        };
+    }
+
+    /// Returns the next unconsumed part of `bytes` (image bytes starting at `offset`) that
+    /// lies in a mapped range, or null when the rest of the chunk is unmapped.
+    ///
+    /// `Errors`:
+    ///   error.InvalidBmap: the chunk starts past mapped bytes that were never consumed
+    pub fn nextPart(self: *RangeVerifier, offset: u64, bytes: []const u8) !?Part {
+        if (self.index == self.map.ranges.len) return null;
+
+        const chunkEnd = offset + bytes.len;
+        if (self.position >= chunkEnd) return null;
+        if (self.position < offset) return error.InvalidBmap;
+
+        const partEnd = @min(chunkEnd, self.map.ranges[self.index].end());
+        const start: usize = @intCast(self.position - offset);
+        return .{ .offset = self.position, .bytes = bytes[start..@intCast(partEnd - offset)] };
+    }
+
+    /// Accounts for a part returned by nextPart().
+    ///
+    /// `Errors`:
+    ///   error.BmapChecksumMismatch: the range just completed does not match its checksum
+    pub fn consume(self: *RangeVerifier, part: Part) !void {
+        self.hasher.update(part.bytes);
+        self.position += part.bytes.len;
+
+        const range = self.map.ranges[self.index];
+        if (self.position < range.end()) return;
+
+        var digest: [MAX_DIGEST_LENGTH]u8 = undefined;
+        self.hasher.final(&digest);
+        const length = self.map.checksumType.digestLength();
+        if (!std.mem.eql(u8, digest[0..length], range.digest[0..length])) return error.BmapChecksumMismatch;
+
+        self.index += 1;
+        self.hasher = Hasher.init(self.map.checksumType);
+        if (self.index < self.map.ranges.len) self.position = self.map.ranges[self.index].offset;
+    }
+
+    /// True once every range has been consumed and verified.
+    pub fn isComplete(self: *const RangeVerifier) bool {
+        return self.index == self.map.ranges.len;
+    }
+};
+
+// ============================================================================
+// TESTS
+// ============================================================================
+
+/// Builds a 2.0 bmap for `image` mapping the given block ranges, with a valid file checksum.
+fn buildTestBmap(buffer: []u8, image: []const u8, blockSize: u64, blockRanges: []const [2]u64) ![]u8 {
+    var writer = std.Io.Writer.fixed(buffer);
+    try writer.print("<?xml version=\"1.0\" ?>\n<!-- generated for tests -->\n<bmap version=\"2.0\">\n", .{});
+    try writer.print("    <ImageSize> {d} </ImageSize>\n    <BlockSize> {d} </BlockSize>\n", .{ image.len, blockSize });
+    try writer.print("    <BlocksCount> {d} </BlocksCount>\n    <ChecksumType> sha256 </ChecksumType>\n", .{std.math.divCeil(u64, image.len, blockSize) catch unreachable});
+    try writer.print("    <BmapFileChecksum> {s} </BmapFileChecksum>\n    <BlockMap>\n", .{&([_]u8{'0'} ** 64)});
+
+    for (blockRanges) |blocks| {
+        const start: usize = @intCast(blocks[0] * blockSize);
+        const end: usize = @intCast(@min((blocks[1] + 1) * blockSize, image.len));
+        var digest: [Sha256.digest_length]u8 = undefined;
+        Sha256.hash(image[start..end], &digest, .{});
+
+        if (blocks[0] == blocks[1]) {
+            try writer.print("        <Range chksum=\"{x}\"> {d} </Range>\n", .{ &digest, blocks[0] });
+        } else {
+            try writer.print("        <Range chksum=\"{x}\"> {d}-{d} </Range>\n", .{ &digest, blocks[0], blocks[1] });
+        }
+    }
+    try writer.print("    </BlockMap>\n</bmap>\n", .{});
+
+    // Fill in the file checksum computed over the zeroed placeholder
+    const xml = writer.buffered();
+    var fileDigest: [Sha256.digest_length]u8 = undefined;
+    Sha256.hash(xml, &fileDigest, .{});
+    const placeholder = std.mem.indexOf(u8, xml, &([_]u8{'0'} ** 64)).?;
+    _ = try std.fmt.bufPrint(xml[placeholder..][0..64], "{x}", .{&fileDigest});
+    return xml;
+}
+
+test "parse reads ranges and verifies the file checksum" {
+    var image: [4096 * 10 + 100]u8 = undefined;
+    for (&image, 0..) |*byte, i| byte.* = @truncate(i *% 7);
+
+    var buffer: [4096]u8 = undefined;
+    const xml = try buildTestBmap(&buffer, &image, 4096, &.{ .{ 0, 1 }, .{ 4, 4 }, .{ 8, 10 } });
+
+    var map = try parse(std.testing.allocator, xml);
+    defer map.deinit();
+
+    try std.testing.expectEqual(ChecksumType.SHA256, map.checksumType);
+    try std.testing.expectEqual(@as(usize, 3), map.ranges.len);
+    try std.testing.expectEqual(@as(u64, 4096 * 4), map.ranges[1].offset);
+    // The last range is clipped to the image size
+    try std.testing.expectEqual(@as(u64, image.len), map.ranges[2].end());
+    try std.testing.expectEqual(@as(u64, 4096 * 3 + 4096 * 2 + 100), map.mappedBytes());
+
+    // Any edit invalidates the file checksum
+    const tampered = try std.testing.allocator.dupe(u8, xml);
+    defer std.testing.allocator.free(tampered);
+    tampered[std.mem.indexOf(u8, tampered, "> 4 <").? + 2] = '5';
+    try std.testing.expectError(error.BmapChecksumMismatch, parse(std.testing.allocator, tampered));
+}
+
+test "parse rejects a range ending at the last representable block" {
+    const element = Element{
+        .name = "Range",
+        .attributes = " chksum=\"" ++ "ab" ** Sha256.digest_length ++ "\"",
+        .text = " 0-18446744073709551615 ",
+    };
+    try std.testing.expectError(error.InvalidBmap, parseRange(element, 4096 * 10, 4096, .SHA256, &.{}));
+
+    // A range merely running past the image is clipped instead
+    const clipped = try parseRange(.{ .name = "Range", .attributes = element.attributes, .text = "2-1000" }, 4096 * 10, 4096, .SHA256, &.{});
+    try std.testing.expectEqual(@as(u64, 4096 * 10), clipped.end());
+}
+
+test "RangeVerifier clips chunks to mapped ranges and checks them" {
+    var image: [1024 * 8]u8 = undefined;
+    for (&image, 0..) |*byte, i| byte.* = @truncate(i *% 31 + 3);
+
+    var buffer: [4096]u8 = undefined;
+    const xml = try buildTestBmap(&buffer, &image, 1024, &.{ .{ 1, 2 }, .{ 5, 5 } });
+
+    var map = try parse(std.testing.allocator, xml);
+    defer map.deinit();
+
+    // Feed the whole image in 1.5 KiB chunks, as a decompressing reader would
+    var verifier = RangeVerifier.init(&map);
+    var mappedBytes: u64 = 0;
+    var offset: usize = 0;
+    while (offset < image.len) : (offset += 1536) {
+        const chunk = image[offset..@min(offset + 1536, image.len)];
+        while (try verifier.nextPart(offset, chunk)) |part| {
+            try std.testing.expect(part.offset >= 1024);
+            mappedBytes += part.bytes.len;
+            try verifier.consume(part);
+        }
+    }
+
+    try std.testing.expect(verifier.isComplete());
+    try std.testing.expectEqual(map.mappedBytes(), mappedBytes);
+
+    // A corrupted mapped byte fails the range
+    image[1024 * 5 + 17] ^= 0xFF;
+    var strict = RangeVerifier.init(&map);
+    try strict.consume((try strict.nextPart(1024, image[1024 .. 1024 * 3])).?);
+    try std.testing.expectError(error.BmapChecksumMismatch, strict.consume((try strict.nextPart(1024 * 5, image[1024 * 5 .. 1024 * 6])).?));
+}
+
+test "findSiblingPath looks through compression extensions" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    (try tmp.dir.createFile("core-image.wic.bmap", .{})).close();
+
+    var dirBuffer: [std.fs.max_path_bytes]u8 = undefined;
+    const dirPath = try tmp.dir.realpath(".", &dirBuffer);
+
+    var imageBuffer: [std.fs.max_path_bytes]u8 = undefined;
+    var pathBuffer: [std.fs.max_path_bytes]u8 = undefined;
+
+    const compressedImage = try std.fmt.bufPrint(&imageBuffer, "{s}/core-image.wic.gz", .{dirPath});
+    const found = findSiblingPath(&pathBuffer, compressedImage) orelse return error.TestExpectedSibling;
+    try std.testing.expect(std.mem.endsWith(u8, found, "/core-image.wic.bmap"));
+
+    const unrelatedImage = try std.fmt.bufPrint(&imageBuffer, "{s}/other.img", .{dirPath});
+    try std.testing.expectEqual(@as(?[:0]const u8, null), findSiblingPath(&pathBuffer, unrelatedImage));
+}
@@ -0,0 +1,417 @@
+//! Compressed image containers (gzip, xz, zstd).
+//!
+//! Lets callers flash `.img.gz` / `.img.xz` / `.img.zst` files without decompressing
+//! them to disk first:
+//! - detect() classifies a file by its magic bytes, independent of the extension
+//! - uncompressedSize() reads the decompressed size from container metadata when the
+//!   format records it reliably (xz index, zstd frame header)
+//! - DecompressStream yields decompressed bytes sequentially and reports how much of
+//!   the compressed input has been consumed, for progress when the size is unknown
+//! - initPooled() places the decoder's input buffer and window in a BufferPool buffer
+//! ------------------------------------------------------------------------------
+const std = @import("std");
+const Debug = @import("./debug.zig");
+const endian = @import("./endian.zig");
+const bufferpool = @import("./bufferpool.zig");
+
+pub const Compression = enum {
+    NONE,
+    GZIP,
+    XZ,
+    ZSTD,
+};
+
+const GZIP_MAGIC = [_]u8{ 0x1F, 0x8B };
+const XZ_MAGIC = [_]u8{ 0xFD, '7', 'z', 'X', 'Z', 0x00 };
+const XZ_FOOTER_MAGIC = [_]u8{ 'Y', 'Z' };
+const ZSTD_MAGIC = [_]u8{ 0x28, 0xB5, 0x2F, 0xFD };
+
+const XZ_HEADER_SIZE = 12;
+const XZ_FOOTER_SIZE = 12;
+
+/// Upper bound on the xz index we are willing to load (records for ~1M blocks).
+const MAX_XZ_INDEX_SIZE = 16 * 1024 * 1024;
+
+/// Read buffer between the file and the decoder.
+const INPUT_BUFFER_SIZE = 64 * 1024;
+
+/// Classifies a header by container magic. `header` should hold at least 6 bytes.
+pub fn detectBytes(header: []const u8) Compression {
+    if (std.mem.startsWith(u8, header, &XZ_MAGIC)) return .XZ;
+    if (std.mem.startsWith(u8, header, &ZSTD_MAGIC)) return .ZSTD;
+    if (std.mem.startsWith(u8, header, &GZIP_MAGIC)) return .GZIP;
+    return .NONE;
+}
+
+/// Classifies `file` by the magic bytes at offset 0. Read errors classify as NONE.
+pub fn detect(file: std.fs.File) Compression {
+    var header: [XZ_MAGIC.len]u8 = undefined;
+    const bytesRead = file.preadAll(&header, 0) catch return .NONE;
+    return detectBytes(header[0..bytesRead]);
+}
+
+/// Returns true if `extension` (with leading dot) names a supported compressed container.
+pub fn isCompressedExtension(extension: []const u8) bool {
+    return std.ascii.eqlIgnoreCase(extension, ".gz") or
+        std.ascii.eqlIgnoreCase(extension, ".xz") or
+        std.ascii.eqlIgnoreCase(extension, ".zst");
+}
+
+/// Returns the decompressed size recorded in the container, or null when unavailable.
+///
+/// `Formats`:
+///   XZ: sum of uncompressed sizes from the stream index (single-stream files only)
+///   ZSTD: Frame_Content_Size of the first frame, when the encoder recorded it
+///   GZIP: always null; ISIZE is stored modulo 2^32 and is wrong for images over 4 GiB
+pub fn uncompressedSize(file: std.fs.File, compression: Compression) ?u64 {
+    const size = switch (compression) {
+        .XZ => xzUncompressedSize(file) catch |err| blk: {
+            Debug.log(.WARNING, "Unable to read xz index, progress will be estimated. Error: {any}", .{err});
+            break :blk null;
+        },
+        .ZSTD => zstdFrameContentSize(file) catch null,
+        .GZIP, .NONE => null,
+    };
+
+    if (size) |bytes| Debug.log(.INFO, "Container reports {d} decompressed bytes.", .{bytes});
+    return size;
+}
+
+/// Decodes an xz multibyte integer (7 bits per byte, least significant first).
+fn readMultibyteInt(bytes: []const u8, pos: *usize) !u64 {
+    var result: u64 = 0;
+    var i: usize = 0;
+
+    while (i < 9) : (i += 1) {
+        if (pos.* >= bytes.len) return error.CorruptXzIndex;
+
+        const byte = bytes[pos.*];
+        pos.* += 1;
+        result |= @as(u64, byte & 0x7F) << @intCast(i * 7);
+
+        if (byte & 0x80 == 0) return result;
+    }
+
+    return error.CorruptXzIndex;
+}
+
+fn xzUncompressedSize(file: std.fs.File) !?u64 {
+    const fileSize = (try file.stat()).size;
+    if (fileSize < XZ_HEADER_SIZE + XZ_FOOTER_SIZE) return error.CorruptXzStream;
+
+    var footer: [XZ_FOOTER_SIZE]u8 = undefined;
+    if (try file.preadAll(&footer, fileSize - XZ_FOOTER_SIZE) != footer.len) return error.CorruptXzStream;
+
+    // Trailing stream padding or concatenated streams: not worth walking backwards
+    if (!std.mem.eql(u8, footer[10..12], &XZ_FOOTER_MAGIC)) return null;
+
+    const indexSize = (@as(u64, endian.readLittle(u32, footer[4..8])) + 1) * 4;
+    if (indexSize > MAX_XZ_INDEX_SIZE or indexSize + XZ_HEADER_SIZE + XZ_FOOTER_SIZE > fileSize) return error.CorruptXzIndex;
+
+    const indexOffset = fileSize - XZ_FOOTER_SIZE - indexSize;
+    const index = try std.heap.page_allocator.alloc(u8, @intCast(indexSize));
+    defer std.heap.page_allocator.free(index);
+
+    if (try file.preadAll(index, indexOffset) != index.len) return error.CorruptXzIndex;
+    if (index[0] != 0x00) return error.CorruptXzIndex;
+
+    var pos: usize = 1;
+    const recordCount = try readMultibyteInt(index, &pos);
+
+    var blocksSize: u64 = 0;
+    var total: u64 = 0;
+    var i: u64 = 0;
+    while (i < recordCount) : (i += 1) {
+        const unpaddedSize = try readMultibyteInt(index, &pos);
+        const blockUncompressedSize = try readMultibyteInt(index, &pos);
+
+        blocksSize += std.mem.alignForward(u64, unpaddedSize, 4);
+        total = std.math.add(u64, total, blockUncompressedSize) catch return error.CorruptXzIndex;
+    }
+
+    // The index accounts for every byte only in a single-stream file
+    if (XZ_HEADER_SIZE + blocksSize != indexOffset) return null;
+
+    return total;
+}
+
+fn zstdFrameContentSize(file: std.fs.File) !?u64 {
+    var header: [18]u8 = undefined;
+    const bytesRead = try file.preadAll(&header, 0);
+    return parseZstdFrameContentSize(header[0..bytesRead]);
+}
+
+/// Parses Frame_Content_Size from a zstd frame header (RFC 8878, section 3.1.1.1).
+fn parseZstdFrameContentSize(header: []const u8) ?u64 {
+    if (header.len < 5 or !std.mem.startsWith(u8, header, &ZSTD_MAGIC)) return null;
+
+    const descriptor = header[4];
+    const fcsFlag: u2 = @intCast(descriptor >> 6);
+    const isSingleSegment = (descriptor >> 5) & 1 == 1;
+    const dictionaryIdSizes = [_]usize{ 0, 1, 2, 4 };
+
+    var pos: usize = 5;
+    if (!isSingleSegment) pos += 1; // Window_Descriptor
+    pos += dictionaryIdSizes[descriptor & 0x3];
+
+    const fcsSize: usize = switch (fcsFlag) {
+        0 => if (isSingleSegment) 1 else 0,
+        1 => 2,
+        2 => 4,
+        3 => 8,
+    };
+
+    if (fcsSize == 0 or header.len < pos + fcsSize) return null;
+
+    const field = header[pos .. pos + fcsSize];
+    return switch (fcsSize) {
+        1 => field[0],
+        2 => @as(u64, endian.readLittle(u16, field[0..2])) + 256,
+        4 => endian.readLittle(u32, field[0..4]),
+        8 => endian.readLittle(u64, field[0..8]),
+        else => unreachable,
+    };
+}
+
+const XzDecoder = std.compress.xz.Decompress(std.Io.AnyReader);
+
+/// Sequential decompressor over an image file.
+/// Initialized in place because the decoders keep pointers into the stream's own
+/// reader and buffers; the struct must not be moved after init().
+pub const DecompressStream = struct {
+    allocator: std.mem.Allocator,
+    compression: Compression,
+    inputBuffer: []u8,
+    window: []u8,
+    /// Set by initPooled(): the pool buffer backing `inputBuffer` and `window`
+    pool: ?*bufferpool.BufferPool = null,
+    poolBuffer: ?bufferpool.AlignedBuffer = null,
+    fileReader: std.fs.File.Reader,
+    decoder: union(enum) {
+        gzip: std.compress.flate.Decompress,
+        zstd: std.compress.zstd.Decompress,
+        xz: XzDecoder,
+    },
+
+    /// `Errors`:
+    ///   error.NotCompressed: `compression` is NONE
+    ///   error.OutOfMemory: buffer allocation failed
+    ///   xz stream header errors
+    pub fn init(self: *DecompressStream, allocator: std.mem.Allocator, file: std.fs.File, compression: Compression) !void {
+        const windowSize = try decoderWindowSize(compression);
+
+        const inputBuffer = try allocator.alloc(u8, INPUT_BUFFER_SIZE);
+        errdefer allocator.free(inputBuffer);
+
+        const window = try allocator.alloc(u8, windowSize);
+        errdefer allocator.free(window);
+
+        try self.initWithBuffers(allocator, file, compression, inputBuffer, window);
+    }
+
+    /// Like init(), but carves the input buffer and the decoder window out of one `pool`
+    /// buffer instead of allocating them. xz still allocates its own dictionary.
+    ///
+    /// `Errors`:
+    ///   error.BufferPoolExhausted: no free buffer in `pool`
+    ///   error.PoolBufferTooSmall: the pool's buffers cannot hold input buffer and window
+    pub fn initPooled(self: *DecompressStream, allocator: std.mem.Allocator, pool: *bufferpool.BufferPool, file: std.fs.File, compression: Compression) !void {
+        const windowSize = try decoderWindowSize(compression);
+        if (INPUT_BUFFER_SIZE + windowSize > pool.bufferSize) return error.PoolBufferTooSmall;
+
+        const buffer = pool.tryAcquire() orelse return error.BufferPoolExhausted;
+        errdefer pool.release(buffer);
+
+        try self.initWithBuffers(allocator, file, compression, buffer[0..INPUT_BUFFER_SIZE], buffer[INPUT_BUFFER_SIZE..][0..windowSize]);
+        self.pool = pool;
+        self.poolBuffer = buffer;
+    }
+
+    fn decoderWindowSize(compression: Compression) !usize {
+        return switch (compression) {
+            .NONE => error.NotCompressed,
+            .GZIP => std.compress.flate.max_window_len,
+            .ZSTD => std.compress.zstd.default_window_len + std.compress.zstd.block_size_max,
+            .XZ => 0, // xz manages its own dictionary
+        };
+    }
+
+    fn initWithBuffers(self: *DecompressStream, allocator: std.mem.Allocator, file: std.fs.File, compression: Compression, inputBuffer: []u8, window: []u8) !void {
+        self.* = .{
+            .allocator = allocator,
+            .compression = compression,
+            .inputBuffer = inputBuffer,
+            .window = window,
+            .fileReader = file.reader(inputBuffer),
+            .decoder = undefined,
+        };
+
+        const input = &self.fileReader.interface;
+
+        self.decoder = switch (compression) {
+            .NONE => unreachable,
+            .GZIP => .{ .gzip = std.compress.flate.Decompress.init(input, .gzip, window) },
+            .ZSTD => .{ .zstd = std.compress.zstd.Decompress.init(input, window, .{}) },
+            .XZ => .{ .xz = try std.compress.xz.decompress(allocator, input.adaptToOldInterface()) },
+        };
+    }
+
+    pub fn deinit(self: *DecompressStream) void {
+        if (self.decoder == .xz) self.decoder.xz.deinit();
+
+        if (self.pool) |pool| {
+            pool.release(self.poolBuffer.?);
+        } else {
+            self.allocator.free(self.window);
+            self.allocator.free(self.inputBuffer);
+        }
+    }
+
+    /// Fills `buffer` with decompressed bytes. Returns fewer than `buffer.len` bytes only
+    /// at the end of the stream, and 0 once the stream is exhausted.
+    pub fn read(self: *DecompressStream, buffer: []u8) !usize {
+        switch (self.decoder) {
+            .gzip => |*decoder| return self.readNew(&decoder.reader, buffer),
+            .zstd => |*decoder| return self.readNew(&decoder.reader, buffer),
+            .xz => |*decoder| {
+                var filled: usize = 0;
+                while (filled < buffer.len) {
+                    const bytesRead = try decoder.read(buffer[filled..]);
+                    if (bytesRead == 0) break;
+                    filled += bytesRead;
+                }
+                return filled;
+            },
+        }
+    }
+
+    fn readNew(self: *DecompressStream, reader: *std.Io.Reader, buffer: []u8) !usize {
+        return reader.readSliceShort(buffer) catch |err| switch (err) {
+            // Surface the underlying file error when there is one, otherwise the data is bad
+            error.ReadFailed => return self.fileReader.err orelse error.CorruptCompressedImage,
+        };
+    }
+
+    /// Number of compressed input bytes consumed by the decoder so far.
+    pub fn consumedBytes(self: *const DecompressStream) u64 {
+        return self.fileReader.logicalPos();
+    }
+};
+
+// ============================================================================
+// TESTS
+// ============================================================================
+
+const TEST_PAYLOAD = "freetracer " ** 64;
+
+// gzip -n of TEST_PAYLOAD
+const TEST_GZIP = [_]u8{
+    0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x4B, 0x2B, 0x4A, 0x4D, 0x2D, 0x29,
+    0x4A, 0x4C, 0x4E, 0x2D, 0x52, 0x48, 0x1B, 0x65, 0x8E, 0x32, 0x87, 0x1A, 0x13, 0x00, 0xBC, 0xCA,
+    0x94, 0x8C, 0xC0, 0x02, 0x00, 0x00,
+};
+
+// xz --check=crc32 of TEST_PAYLOAD
+const TEST_XZ = [_]u8{
+    0xFD, 0x37, 0x7A, 0x58, 0x5A, 0x00, 0x00, 0x01, 0x69, 0x22, 0xDE, 0x36, 0x02, 0x00, 0x21, 0x01,
+    0x16, 0x00, 0x00, 0x00, 0x74, 0x2F, 0xE5, 0xA3, 0xE0, 0x02, 0xBF, 0x00, 0x15, 0x5D, 0x00, 0x33,
+    0x1C, 0x88, 0xE0, 0xEE, 0x00, 0xD0, 0x74, 0xFD, 0xFC, 0x47, 0x61, 0x02, 0x9C, 0xD7, 0x3E, 0xDA,
+    0x4A, 0xFE, 0xA0, 0x00, 0x00, 0x00, 0x00, 0x00, 0xBC, 0xCA, 0x94, 0x8C, 0x00, 0x01, 0x2D, 0xC0,
+    0x05, 0x00, 0x00, 0x00, 0xDC, 0xDA, 0xAC, 0xA6, 0x3E, 0x30, 0x0D, 0x8B, 0x02, 0x00, 0x00, 0x00,
+    0x00, 0x01, 0x59, 0x5A,
+};
+
+/// Single-segment zstd frame with a 2-byte content size and one raw block.
+fn buildTestZstd() [5 + 2 + 3 + TEST_PAYLOAD.len]u8 {
+    var frame: [5 + 2 + 3 + TEST_PAYLOAD.len]u8 = undefined;
+    @memcpy(frame[0..4], &ZSTD_MAGIC);
+    frame[4] = 0b0110_0000; // FCS flag 1 (2 bytes), single segment
+    std.mem.writeInt(u16, frame[5..7], TEST_PAYLOAD.len - 256, .little);
+    // Block header: last block, raw, size
+    std.mem.writeInt(u24, frame[7..10], (TEST_PAYLOAD.len << 3) | 1, .little);
+    @memcpy(frame[10..], TEST_PAYLOAD);
+    return frame;
+}
+
+fn expectRoundTrip(fixture: []const u8, expected: Compression) !void {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const file = try tmp.dir.createFile("image.bin", .{ .read = true });
+    defer file.close();
+    try file.writeAll(fixture);
+
+    try std.testing.expectEqual(expected, detect(file));
+
+    var stream: DecompressStream = undefined;
+    try stream.init(std.testing.allocator, file, expected);
+    defer stream.deinit();
+
+    var output: [TEST_PAYLOAD.len + 16]u8 = undefined;
+    const bytesRead = try stream.read(&output);
+
+    try std.testing.expectEqualStrings(TEST_PAYLOAD, output[0..bytesRead]);
+    try std.testing.expectEqual(@as(usize, 0), try stream.read(&output));
+}
+
+test "detectBytes recognizes container magic" {
+    try std.testing.expectEqual(Compression.GZIP, detectBytes(&TEST_GZIP));
+    try std.testing.expectEqual(Compression.XZ, detectBytes(&TEST_XZ));
+    try std.testing.expectEqual(Compression.ZSTD, detectBytes(&buildTestZstd()));
+    try std.testing.expectEqual(Compression.NONE, detectBytes("CD001\x01"));
+    try std.testing.expectEqual(Compression.NONE, detectBytes(&.{0x1F}));
+}
+
+test "DecompressStream decodes gzip" {
+    try expectRoundTrip(&TEST_GZIP, .GZIP);
+}
+
+test "DecompressStream decodes xz" {
+    try expectRoundTrip(&TEST_XZ, .XZ);
+}
+
+test "DecompressStream decodes zstd" {
+    try expectRoundTrip(&buildTestZstd(), .ZSTD);
+}
+
+test "uncompressedSize reads xz index and zstd frame header" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const xzFile = try tmp.dir.createFile("image.xz", .{ .read = true });
+    defer xzFile.close();
+    try xzFile.writeAll(&TEST_XZ);
+    try std.testing.expectEqual(@as(?u64, TEST_PAYLOAD.len), uncompressedSize(xzFile, .XZ));
+
+    const zstdFile = try tmp.dir.createFile("image.zst", .{ .read = true });
+    defer zstdFile.close();
+    try zstdFile.writeAll(&buildTestZstd());
+    try std.testing.expectEqual(@as(?u64, TEST_PAYLOAD.len), uncompressedSize(zstdFile, .ZSTD));
+
+    const gzipFile = try tmp.dir.createFile("image.gz", .{ .read = true });
+    defer gzipFile.close();
+    try gzipFile.writeAll(&TEST_GZIP);
+    try std.testing.expectEqual(@as(?u64, null), uncompressedSize(gzipFile, .GZIP));
+}
+
+test "DecompressStream decodes gzip from a pooled buffer" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const file = try tmp.dir.createFile("image.gz", .{ .read = true });
+    defer file.close();
+    try file.writeAll(&TEST_GZIP);
+
+    var pool = try bufferpool.BufferPool.init(std.testing.allocator, .{ .bufferSize = 256 * 1024, .bufferCount = 1 });
+    defer pool.deinit(std.testing.allocator);
+
+    var stream: DecompressStream = undefined;
+    try stream.initPooled(std.testing.allocator, &pool, file, .GZIP);
+
+    var output: [TEST_PAYLOAD.len]u8 = undefined;
+    try std.testing.expectEqualStrings(TEST_PAYLOAD, output[0..try stream.read(&output)]);
+    try std.testing.expect(pool.tryAcquire() == null);
+
+    stream.deinit();
+    try std.testing.expectEqual(@as(usize, 1), pool.freeCount);
+}
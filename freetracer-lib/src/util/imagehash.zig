@@ -0,0 +1,525 @@
+//! Image Hashing
+//!
+//! Hashes whole image files off the UI thread and checks them against the checksum
+//! files distributors publish next to their downloads:
+//! - SHA-256 is sequential by construction. A reader thread fills one buffer while the
+//!   hasher consumes the other, so disk time and hash time overlap instead of adding up
+//! - BLAKE3 is hashed as a two-level tree: TREE_CHUNK_SIZE chunks are hashed on every
+//!   core, and the image digest is BLAKE3 over the image size and the chunk digests. This
+//!   is the digest the helper logs while writing (digestlog.zig), so the two can be
+//!   compared; it is not the digest `b3sum` prints, and is never checked against a file
+//! - findSidecar() looks for `<image>.sha256`, `<image>.sha256sum`, `SHA256SUMS` and
+//!   friends next to the image and picks the line naming the image (GNU `<hex>  name`,
+//!   `<hex> *name` or BSD `SHA256 (name) = <hex>`)
+//!
+//! With a sidecar, hashImage() computes SHA-256 and compares; without one it computes
+//! the (much faster) BLAKE3 tree digest as a fingerprint of the image.
+//! ------------------------------------------------------------------------------
+const std = @import("std");
+const Debug = @import("./debug.zig");
+
+const Blake3 = std.crypto.hash.Blake3;
+const Sha256 = std.crypto.hash.sha2.Sha256;
+
+/// Bytes covered by one BLAKE3 chunk digest; shared with the helper's digest log.
+pub const TREE_CHUNK_SIZE: u64 = 4 * 1024 * 1024;
+const TREE_CHUNK_LEN: usize = TREE_CHUNK_SIZE;
+/// Size of each of the two SHA-256 pipeline buffers.
+pub const PIPELINE_BUFFER_SIZE: usize = 4 * 1024 * 1024;
+/// Upper bound on a checksum file we are willing to load.
+pub const MAX_SIDECAR_SIZE = 4 * 1024 * 1024;
+/// Upper bound on BLAKE3 tree workers; past this the disk is the limit anyway.
+pub const MAX_WORKERS = 16;
+
+pub const DIGEST_LENGTH = 32;
+
+comptime {
+    std.debug.assert(Blake3.digest_length == DIGEST_LENGTH and Sha256.digest_length == DIGEST_LENGTH);
+}
+
+pub const ChunkDigest = [DIGEST_LENGTH]u8;
+
+/// Files checked for a digest of `<image>`, in order. Files named after the image may
+/// hold a bare digest; shared lists must name the image.
+const IMAGE_SIDECAR_SUFFIXES = [_][]const u8{ ".sha256", ".sha256sum" };
+const DIRECTORY_SIDECAR_NAMES = [_][]const u8{ "SHA256SUMS", "sha256sums", "SHA256SUMS.txt", "sha256sum.txt", "sha256sums.txt" };
+
+pub const Algorithm = enum {
+    SHA256,
+    BLAKE3_TREE,
+
+    pub fn label(self: Algorithm) []const u8 {
+        return switch (self) {
+            .SHA256 => "SHA-256",
+            .BLAKE3_TREE => "BLAKE3",
+        };
+    }
+};
+
+pub const Digest = struct {
+    algorithm: Algorithm,
+    bytes: [DIGEST_LENGTH]u8,
+
+    pub fn hex(self: Digest) [DIGEST_LENGTH * 2]u8 {
+        return std.fmt.bytesToHex(self.bytes, .lower);
+    }
+};
+
+/// A checksum file next to the image that lists a SHA-256 digest for it.
+pub const Sidecar = struct {
+    /// `.sha256`-style suffix or the shared list's file name; static memory
+    name: []const u8,
+    expected: [DIGEST_LENGTH]u8,
+};
+
+pub const Verdict = enum {
+    /// No checksum file was found; the digest is a fingerprint only
+    UNVERIFIED,
+    MATCH,
+    MISMATCH,
+};
+
+pub const Result = struct {
+    digest: Digest,
+    verdict: Verdict = .UNVERIFIED,
+    sidecar: ?Sidecar = null,
+};
+
+/// Shared between a hashing thread and its owner: progress for display and a cancel flag.
+pub const Control = struct {
+    hashedBytes: std.atomic.Value(u64) = .init(0),
+    totalBytes: std.atomic.Value(u64) = .init(0),
+    cancelled: std.atomic.Value(bool) = .init(false),
+
+    pub fn cancel(self: *Control) void {
+        self.cancelled.store(true, .release);
+    }
+
+    pub fn isCancelled(self: *const Control) bool {
+        return self.cancelled.load(.acquire);
+    }
+
+    /// Hashed share of the image in percent, 0 while the size is unknown.
+    pub fn percent(self: *const Control) u8 {
+        const total = self.totalBytes.load(.monotonic);
+        if (total == 0) return 0;
+        return @intCast(@min(100, self.hashedBytes.load(.monotonic) * 100 / total));
+    }
+
+    fn advance(self: *Control, len: u64) void {
+        _ = self.hashedBytes.fetchAdd(len, .monotonic);
+    }
+};
+
+/// Hash of one full chunk (or the final short chunk) of image bytes.
+pub fn hashChunk(bytes: []const u8) ChunkDigest {
+    var digest: ChunkDigest = undefined;
+    Blake3.hash(bytes, &digest, .{});
+    return digest;
+}
+
+/// Root of the two-level BLAKE3 tree: the image size followed by every chunk digest.
+pub fn combineChunkDigests(imageSize: u64, chunkDigests: []const ChunkDigest) ChunkDigest {
+    var hasher = Blake3.init(.{});
+    var sizeBytes: [8]u8 = undefined;
+    std.mem.writeInt(u64, &sizeBytes, imageSize, .little);
+    hasher.update(&sizeBytes);
+    for (chunkDigests) |*digest| hasher.update(digest);
+
+    var digest: ChunkDigest = undefined;
+    hasher.final(&digest);
+    return digest;
+}
+
+/// Worker count for hashBlake3Tree() on this host.
+pub fn defaultWorkerCount() usize {
+    const cpuCount = std.Thread.getCpuCount() catch 1;
+    return std.math.clamp(cpuCount, 1, MAX_WORKERS);
+}
+
+/// Hashes an open image file: SHA-256 checked against a sidecar when `directory` holds
+/// one for `imageName`, otherwise the BLAKE3 tree digest.
+///
+/// `Errors`:
+///   error.HashCancelled: `control` was cancelled
+///   error.UnexpectedEndOfImage: the file shrank while it was hashed
+///   File read and allocation errors
+pub fn hashImage(allocator: std.mem.Allocator, file: std.fs.File, directory: std.fs.Dir, imageName: []const u8, control: *Control) !Result {
+    const imageSize = (try file.stat()).size;
+    control.totalBytes.store(imageSize, .monotonic);
+
+    if (try findSidecar(allocator, directory, imageName)) |sidecar| {
+        Debug.log(.INFO, "Found a SHA-256 checksum for {s} in {s}; hashing the image.", .{ imageName, sidecar.name });
+
+        const digest = try hashSha256(allocator, file, control);
+        const verdict: Verdict = if (std.mem.eql(u8, &digest.bytes, &sidecar.expected)) .MATCH else .MISMATCH;
+        return .{ .digest = digest, .verdict = verdict, .sidecar = sidecar };
+    }
+
+    return .{ .digest = try hashBlake3Tree(allocator, file, imageSize, defaultWorkerCount(), control) };
+}
+
+/// SHA-256 of the whole file, read on a second thread into two alternating buffers.
+/// Reads by offset, so the file position does not matter.
+///
+/// `Errors`:
+///   error.HashCancelled: `control` was cancelled
+///   File read and allocation errors
+pub fn hashSha256(allocator: std.mem.Allocator, file: std.fs.File, control: *Control) !Digest {
+    const memory = try allocator.alloc(u8, PIPELINE_BUFFER_SIZE * 2);
+    defer allocator.free(memory);
+
+    var pipeline = Pipeline{
+        .file = file,
+        .buffers = .{ memory[0..PIPELINE_BUFFER_SIZE], memory[PIPELINE_BUFFER_SIZE..] },
+    };
+
+    const reader = try std.Thread.spawn(.{}, Pipeline.read, .{&pipeline});
+    defer reader.join();
+    errdefer pipeline.stop();
+
+    var hasher = Sha256.init(.{});
+    while (try pipeline.next()) |bytes| {
+        hasher.update(bytes);
+        control.advance(bytes.len);
+        pipeline.release();
+        if (control.isCancelled()) return error.HashCancelled;
+    }
+
+    var digest = Digest{ .algorithm = .SHA256, .bytes = undefined };
+    hasher.final(&digest.bytes);
+    return digest;
+}
+
+/// BLAKE3 tree digest of the first `imageSize` bytes, chunks hashed by up to
+/// `workerCount` threads (the calling thread included).
+///
+/// `Errors`:
+///   error.HashCancelled: `control` was cancelled
+///   error.UnexpectedEndOfImage: the file is shorter than `imageSize`
+///   File read and allocation errors
+pub fn hashBlake3Tree(allocator: std.mem.Allocator, file: std.fs.File, imageSize: u64, workerCount: usize, control: *Control) !Digest {
+    const chunkCount: usize = @intCast(std.math.divCeil(u64, imageSize, TREE_CHUNK_SIZE) catch unreachable);
+    const threadCount = std.math.clamp(workerCount, 1, @max(chunkCount, 1));
+
+    const chunkDigests = try allocator.alloc(ChunkDigest, chunkCount);
+    defer allocator.free(chunkDigests);
+
+    const buffers = try allocator.alloc(u8, threadCount * TREE_CHUNK_LEN);
+    defer allocator.free(buffers);
+
+    var job = TreeJob{ .file = file, .imageSize = imageSize, .chunkDigests = chunkDigests, .control = control };
+
+    const threads = try allocator.alloc(std.Thread, threadCount - 1);
+    defer allocator.free(threads);
+
+    var spawnedCount: usize = 0;
+    for (threads, 0..) |*thread, i| {
+        const buffer = buffers[(i + 1) * TREE_CHUNK_LEN ..][0..TREE_CHUNK_LEN];
+        thread.* = std.Thread.spawn(.{}, TreeJob.work, .{ &job, buffer }) catch break;
+        spawnedCount += 1;
+    }
+
+    // A worker that failed to spawn only costs parallelism
+    job.work(buffers[0..TREE_CHUNK_LEN]);
+    for (threads[0..spawnedCount]) |thread| thread.join();
+
+    if (job.err) |err| return err;
+    if (control.isCancelled()) return error.HashCancelled;
+
+    return .{ .algorithm = .BLAKE3_TREE, .bytes = combineChunkDigests(imageSize, chunkDigests) };
+}
+
+/// Looks in `directory` for a checksum file listing a SHA-256 digest for `imageName`.
+/// Unreadable or oversized candidates are logged and skipped.
+pub fn findSidecar(allocator: std.mem.Allocator, directory: std.fs.Dir, imageName: []const u8) !?Sidecar {
+    var pathBuffer: [std.fs.max_path_bytes]u8 = undefined;
+
+    for (IMAGE_SIDECAR_SUFFIXES) |suffix| {
+        const path = std.fmt.bufPrint(&pathBuffer, "{s}{s}", .{ imageName, suffix }) catch continue;
+        if (try findInSidecarFile(allocator, directory, path, imageName, true)) |expected| return .{ .name = suffix, .expected = expected };
+    }
+
+    for (DIRECTORY_SIDECAR_NAMES) |name| {
+        if (try findInSidecarFile(allocator, directory, name, imageName, false)) |expected| return .{ .name = name, .expected = expected };
+    }
+
+    return null;
+}
+
+/// Finds the SHA-256 digest `contents` lists for `imageName`. With `acceptAnyName`
+/// (a file named after the image) a bare digest or a line naming another file is
+/// taken as well, since images are often renamed after download.
+pub fn parseChecksumList(contents: []const u8, imageName: []const u8, acceptAnyName: bool) ?[DIGEST_LENGTH]u8 {
+    var fallback: ?[DIGEST_LENGTH]u8 = null;
+
+    var lines = std.mem.splitScalar(u8, contents, '\n');
+    while (lines.next()) |rawLine| {
+        const line = std.mem.trim(u8, rawLine, " \t\r");
+        if (line.len == 0 or line[0] == '#') continue;
+
+        const entry = parseChecksumLine(line) orelse continue;
+        if (entry.name) |name| {
+            if (namesImage(name, imageName)) return entry.digest;
+        }
+        if (fallback == null) fallback = entry.digest;
+    }
+
+    return if (acceptAnyName) fallback else null;
+}
+
+const ChecksumLine = struct {
+    digest: [DIGEST_LENGTH]u8,
+    name: ?[]const u8,
+};
+
+fn parseChecksumLine(line: []const u8) ?ChecksumLine {
+    // BSD: SHA256 (name) = <hex>
+    const bsdPrefix = "SHA256 (";
+    if (std.mem.startsWith(u8, line, bsdPrefix)) {
+        const separator = std.mem.lastIndexOf(u8, line, ") = ") orelse return null;
+        if (separator < bsdPrefix.len) return null;
+        const digest = parseHexDigest(line[separator + 4 ..]) orelse return null;
+        return .{ .digest = digest, .name = line[bsdPrefix.len..separator] };
+    }
+
+    // GNU: <hex>  name, <hex> *name, or a bare <hex>
+    const hexEnd = std.mem.indexOfAny(u8, line, " \t") orelse line.len;
+    const digest = parseHexDigest(line[0..hexEnd]) orelse return null;
+
+    var name = std.mem.trimLeft(u8, line[hexEnd..], " \t");
+    if (name.len > 0 and name[0] == '*') name = name[1..];
+    return .{ .digest = digest, .name = if (name.len > 0) name else null };
+}
+
+fn parseHexDigest(text: []const u8) ?[DIGEST_LENGTH]u8 {
+    if (text.len != DIGEST_LENGTH * 2) return null;
+    var digest: [DIGEST_LENGTH]u8 = undefined;
+    _ = std.fmt.hexToBytes(&digest, text) catch return null;
+    return digest;
+}
+
+/// Checksum lists name files relative to their own directory, sometimes with `./`.
+fn namesImage(name: []const u8, imageName: []const u8) bool {
+    const relative = if (std.mem.startsWith(u8, name, "./")) name[2..] else name;
+    return std.mem.eql(u8, relative, imageName);
+}
+
+fn findInSidecarFile(allocator: std.mem.Allocator, directory: std.fs.Dir, path: []const u8, imageName: []const u8, acceptAnyName: bool) !?[DIGEST_LENGTH]u8 {
+    const contents = directory.readFileAlloc(allocator, path, MAX_SIDECAR_SIZE) catch |err| switch (err) {
+        error.FileNotFound => return null,
+        error.OutOfMemory => return err,
+        else => {
+            Debug.log(.WARNING, "Skipping checksum file {s}: {any}", .{ path, err });
+            return null;
+        },
+    };
+    defer allocator.free(contents);
+
+    const expected = parseChecksumList(contents, imageName, acceptAnyName);
+    if (expected == null) Debug.log(.DEBUG, "Checksum file {s} lists no digest for {s}.", .{ path, imageName });
+    return expected;
+}
+
+/// Two buffers handed back and forth between the reader thread and the hasher.
+const Pipeline = struct {
+    file: std.fs.File,
+    buffers: [2][]u8,
+    lens: [2]usize = .{ 0, 0 },
+    isFull: [2]bool = .{ false, false },
+    mutex: std.Thread.Mutex = .{},
+    changed: std.Thread.Condition = .{},
+    /// Buffer the consumer reads next
+    consumerIndex: usize = 0,
+    /// Set by the reader at end of file
+    isDrained: bool = false,
+    /// Set by the consumer when it gives up early
+    isStopped: bool = false,
+    err: ?anyerror = null,
+
+    /// Reader thread entry point.
+    fn read(self: *Pipeline) void {
+        var index: usize = 0;
+        var offset: u64 = 0;
+        while (true) {
+            {
+                self.mutex.lock();
+                defer self.mutex.unlock();
+                while (self.isFull[index] and !self.isStopped) self.changed.wait(&self.mutex);
+                if (self.isStopped) return;
+            }
+
+            const result = self.file.preadAll(self.buffers[index], offset);
+
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            defer self.changed.broadcast();
+
+            const bytesRead = result catch |err| {
+                self.err = err;
+                return;
+            };
+            if (bytesRead == 0) {
+                self.isDrained = true;
+                return;
+            }
+
+            self.lens[index] = bytesRead;
+            self.isFull[index] = true;
+            offset += bytesRead;
+            index ^= 1;
+        }
+    }
+
+    /// Blocks until the next buffer is filled; null at end of file.
+    fn next(self: *Pipeline) !?[]const u8 {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        const index = self.consumerIndex;
+        while (!self.isFull[index] and !self.isDrained and self.err == null) self.changed.wait(&self.mutex);
+        if (self.err) |err| return err;
+        if (!self.isFull[index]) return null;
+        return self.buffers[index][0..self.lens[index]];
+    }
+
+    /// Returns the buffer last handed out by next() to the reader.
+    fn release(self: *Pipeline) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        self.isFull[self.consumerIndex] = false;
+        self.consumerIndex ^= 1;
+        self.changed.broadcast();
+    }
+
+    fn stop(self: *Pipeline) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        self.isStopped = true;
+        self.changed.broadcast();
+    }
+};
+
+/// Chunk claims and results of one hashBlake3Tree() call.
+const TreeJob = struct {
+    file: std.fs.File,
+    imageSize: u64,
+    chunkDigests: []ChunkDigest,
+    control: *Control,
+    nextChunk: std.atomic.Value(usize) = .init(0),
+    mutex: std.Thread.Mutex = .{},
+    /// First worker error
+    err: ?anyerror = null,
+    hasFailed: std.atomic.Value(bool) = .init(false),
+
+    /// Worker entry point; claims chunks until none are left or the job stopped.
+    fn work(self: *TreeJob, buffer: []u8) void {
+        while (!self.control.isCancelled() and !self.hasFailed.load(.acquire)) {
+            const index = self.nextChunk.fetchAdd(1, .monotonic);
+            if (index >= self.chunkDigests.len) return;
+
+            const offset = @as(u64, index) * TREE_CHUNK_SIZE;
+            const chunk = buffer[0..@intCast(@min(TREE_CHUNK_SIZE, self.imageSize - offset))];
+
+            const bytesRead = self.file.preadAll(chunk, offset) catch |err| return self.fail(err);
+            if (bytesRead < chunk.len) return self.fail(error.UnexpectedEndOfImage);
+
+            self.chunkDigests[index] = hashChunk(chunk);
+            self.control.advance(chunk.len);
+        }
+    }
+
+    fn fail(self: *TreeJob, err: anyerror) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        if (self.err == null) self.err = err;
+        self.hasFailed.store(true, .release);
+    }
+};
+
+// ============================================================================
+// TESTS
+// ============================================================================
+
+test "checksum lists yield the digest naming the image" {
+    const digestHex = "9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08";
+    const otherHex = "60303ae22b998861bce3b28f33eec1be758a213c86c93c076dbe9f558c11c752";
+
+    var expected: [DIGEST_LENGTH]u8 = undefined;
+    _ = try std.fmt.hexToBytes(&expected, digestHex);
+
+    const gnu = otherHex ++ "  other.iso\r\n" ++ digestHex ++ " *./image.iso\r\n";
+    try std.testing.expectEqual(expected, parseChecksumList(gnu, "image.iso", false).?);
+
+    const bsd = "# comment\nSHA256 (other.iso) = " ++ otherHex ++ "\nSHA256 (image.iso) = " ++ digestHex ++ "\n";
+    try std.testing.expectEqual(expected, parseChecksumList(bsd, "image.iso", false).?);
+
+    // Shared lists must name the image; a file named after it need not
+    try std.testing.expectEqual(@as(?[DIGEST_LENGTH]u8, null), parseChecksumList(digestHex ++ "  renamed.iso\n", "image.iso", false));
+    try std.testing.expectEqual(expected, parseChecksumList(digestHex ++ "  renamed.iso\n", "image.iso", true).?);
+    try std.testing.expectEqual(expected, parseChecksumList(digestHex ++ "\n", "image.iso", true).?);
+
+    // Truncated digests are not digests
+    try std.testing.expectEqual(@as(?[DIGEST_LENGTH]u8, null), parseChecksumList(digestHex[0..62] ++ "  image.iso\n", "image.iso", true));
+}
+
+test "hashImage checks SHA-256 sidecars and falls back to the BLAKE3 tree" {
+    const allocator = std.testing.allocator;
+
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    // Spans several pipeline buffers and tree chunks, with a short last chunk
+    const image = try allocator.alloc(u8, TREE_CHUNK_LEN * 3 + 1234);
+    defer allocator.free(image);
+    for (image, 0..) |*byte, i| byte.* = @truncate(i *% 31 + 5);
+
+    const file = try tmp.dir.createFile("image.iso", .{ .read = true });
+    defer file.close();
+    try file.writeAll(image);
+
+    var chunkDigests: [4]ChunkDigest = undefined;
+    for (&chunkDigests, 0..) |*digest, i| digest.* = hashChunk(image[i * TREE_CHUNK_LEN .. @min(image.len, (i + 1) * TREE_CHUNK_LEN)]);
+    const treeDigest = combineChunkDigests(image.len, &chunkDigests);
+
+    inline for (.{ 1, 3, 8 }) |workerCount| {
+        var control = Control{};
+        const digest = try hashBlake3Tree(allocator, file, image.len, workerCount, &control);
+        try std.testing.expectEqual(treeDigest, digest.bytes);
+        try std.testing.expectEqual(@as(u64, image.len), control.hashedBytes.load(.monotonic));
+    }
+
+    var control = Control{};
+    const unverified = try hashImage(allocator, file, tmp.dir, "image.iso", &control);
+    try std.testing.expectEqual(Verdict.UNVERIFIED, unverified.verdict);
+    try std.testing.expectEqual(Algorithm.BLAKE3_TREE, unverified.digest.algorithm);
+    try std.testing.expectEqual(@as(u8, 100), control.percent());
+
+    var sha: [DIGEST_LENGTH]u8 = undefined;
+    Sha256.hash(image, &sha, .{});
+    var listBuffer: [256]u8 = undefined;
+    const list = try std.fmt.bufPrint(&listBuffer, "0000  other.iso\n{s}  image.iso\n", .{std.fmt.bytesToHex(sha, .lower)});
+    try tmp.dir.writeFile(.{ .sub_path = "SHA256SUMS", .data = list });
+
+    control = .{};
+    const matched = try hashImage(allocator, file, tmp.dir, "image.iso", &control);
+    try std.testing.expectEqual(Verdict.MATCH, matched.verdict);
+    try std.testing.expectEqualStrings("SHA256SUMS", matched.sidecar.?.name);
+    try std.testing.expectEqual(sha, matched.digest.bytes);
+
+    // The image's own checksum file wins over the shared list
+    sha[0] ^= 0xff;
+    const wrongHex = std.fmt.bytesToHex(sha, .lower);
+    try tmp.dir.writeFile(.{ .sub_path = "image.iso.sha256", .data = &wrongHex });
+
+    control = .{};
+    const mismatched = try hashImage(allocator, file, tmp.dir, "image.iso", &control);
+    try std.testing.expectEqual(Verdict.MISMATCH, mismatched.verdict);
+    try std.testing.expectEqualStrings(".sha256", mismatched.sidecar.?.name);
+
+    control.cancel();
+    try std.testing.expectError(error.HashCancelled, hashBlake3Tree(allocator, file, image.len, 2, &control));
+}
@@ -0,0 +1,553 @@
+//! Image Sources
+//!
+//! One interface over everything an image can be read from, so the write, verify and
+//! probe stages do not depend on std.fs.File or on per-format read loops:
+//! - size(): logical (expanded) image size, or null while unknown (pipes, gzip streams)
+//! - extentAt(offset): the sparse map around `offset`, as a DATA or ZERO extent, or null
+//!   when the source cannot tell (everything then counts as data)
+//! - read(buffer): sequential reads from the current position; every source has them
+//! - pread(buffer, offset): random reads for probing; streams only accept their
+//!   current position and fail with error.SourceNotSeekable elsewhere
+//! - consumedBytes(): stored bytes consumed so far, for progress estimates of streams
+//!
+//! Implementations:
+//! - FileSource: plain files; holes reported through SEEK_DATA/SEEK_HOLE
+//! - SplitSource: numbered parts (image.iso.001, image.iso.002, ...) read as one image
+//! - StreamSource: pipes and other non-seekable descriptors such as stdin
+//! - DecompressSource: gzip/xz/zstd streams (compression.DecompressStream)
+//! - VirtualDiskSource: qcow2/VHD/VHDX/VMDK guest disks through their extent maps
+//!
+//! Reads only return fewer bytes than requested at the end of the image, so consumers
+//! can treat a short read as EOF. Sources are not thread-safe; one reader at a time.
+//! ------------------------------------------------------------------------------
+const std = @import("std");
+const builtin = @import("builtin");
+const compression = @import("./compression.zig");
+const vdisk = @import("./vdisk.zig");
+
+/// Highest part number SplitSource looks for (three-digit suffixes).
+pub const MAX_SPLIT_PARTS = 999;
+
+pub const ExtentKind = enum {
+    /// Stored bytes; they still have to be read (and may turn out to be zeros)
+    DATA,
+    /// Reads as zeros without touching the underlying storage
+    ZERO,
+};
+
+/// A run of the image starting at `offset` that is either stored or known to be zeros.
+pub const Extent = struct {
+    offset: u64,
+    len: u64,
+    kind: ExtentKind,
+
+    pub fn end(self: Extent) u64 {
+        return self.offset + self.len;
+    }
+};
+
+pub const ImageSource = struct {
+    /// Represents the concrete source implementing this interface as an opaque pointer.
+    /// Must be @ptrCast and @alignCast to the concrete pointer, e.g. *FileSource.
+    ptr: *anyopaque,
+
+    /// Pointer to the virtual table of the concrete source.
+    vtable: *const VTable,
+
+    /// Image source interface virtual table.
+    pub const VTable = struct {
+        size_fn: *const fn (ptr: *anyopaque) ?u64,
+        extent_at_fn: *const fn (ptr: *anyopaque, offset: u64) ?Extent,
+        read_fn: *const fn (ptr: *anyopaque, buffer: []u8) anyerror!usize,
+        pread_fn: *const fn (ptr: *anyopaque, buffer: []u8, offset: u64) anyerror!usize,
+        consumed_bytes_fn: *const fn (ptr: *anyopaque) u64,
+        /// True when pread() accepts any offset
+        is_seekable: bool,
+    };
+
+    pub fn size(self: ImageSource) ?u64 {
+        return self.vtable.size_fn(self.ptr);
+    }
+
+    pub fn extentAt(self: ImageSource, offset: u64) ?Extent {
+        return self.vtable.extent_at_fn(self.ptr, offset);
+    }
+
+    pub fn read(self: ImageSource, buffer: []u8) !usize {
+        return self.vtable.read_fn(self.ptr, buffer);
+    }
+
+    pub fn pread(self: ImageSource, buffer: []u8, offset: u64) !usize {
+        return self.vtable.pread_fn(self.ptr, buffer, offset);
+    }
+
+    pub fn consumedBytes(self: ImageSource) u64 {
+        return self.vtable.consumed_bytes_fn(self.ptr);
+    }
+
+    pub fn isSeekable(self: ImageSource) bool {
+        return self.vtable.is_seekable;
+    }
+};
+
+/// Builds the ImageSource vtable of `T` from its size, extentAt, read, pread and
+/// consumedBytes methods and its `IS_SEEKABLE` declaration.
+pub fn ImplementImageSource(comptime T: type) type {
+    return struct {
+        pub const vtable = ImageSource.VTable{
+            .size_fn = sizeWrapper,
+            .extent_at_fn = extentAtWrapper,
+            .read_fn = readWrapper,
+            .pread_fn = preadWrapper,
+            .consumed_bytes_fn = consumedBytesWrapper,
+            .is_seekable = T.IS_SEEKABLE,
+        };
+
+        pub fn asImageSource(self: *T) ImageSource {
+            return .{ .ptr = self, .vtable = &vtable };
+        }
+
+        fn asInstance(ptr: *anyopaque) *T {
+            return @ptrCast(@alignCast(ptr));
+        }
+
+        fn sizeWrapper(ptr: *anyopaque) ?u64 {
+            return asInstance(ptr).size();
+        }
+
+        fn extentAtWrapper(ptr: *anyopaque, offset: u64) ?Extent {
+            return asInstance(ptr).extentAt(offset);
+        }
+
+        fn readWrapper(ptr: *anyopaque, buffer: []u8) anyerror!usize {
+            return asInstance(ptr).read(buffer);
+        }
+
+        fn preadWrapper(ptr: *anyopaque, buffer: []u8, offset: u64) anyerror!usize {
+            return asInstance(ptr).pread(buffer, offset);
+        }
+
+        fn consumedBytesWrapper(ptr: *anyopaque) u64 {
+            return asInstance(ptr).consumedBytes();
+        }
+    };
+}
+
+// --- Plain files ------------------------------------------------------------
+
+// lseek(2) whence values for hole detection; they differ between Darwin and Linux
+const SEEK_DATA: c_int = if (builtin.os.tag == .linux) 3 else 4;
+const SEEK_HOLE: c_int = if (builtin.os.tag == .linux) 4 else 3;
+
+/// Result of a hole-aware lseek: the resolved offset, or null when the file has no
+/// further data (ENXIO) or the filesystem does not support hole queries.
+fn seekSparse(file: std.fs.File, offset: u64, whence: c_int) ?u64 {
+    const result = std.c.lseek(file.handle, @intCast(offset), whence);
+    if (result < 0) return null;
+    return @intCast(result);
+}
+
+/// A regular file, read positionally so the shared file offset is never touched.
+pub const FileSource = struct {
+    pub const IS_SEEKABLE = true;
+    const Implementation = ImplementImageSource(FileSource);
+
+    file: std.fs.File,
+    fileSize: u64,
+    position: u64 = 0,
+    holesSupported: bool,
+
+    pub fn init(file: std.fs.File) !FileSource {
+        return initSized(file, (try file.stat()).size);
+    }
+
+    /// Treats only the first `imageSize` bytes of `file` as the image.
+    pub fn initSized(file: std.fs.File, imageSize: u64) FileSource {
+        return .{ .file = file, .fileSize = imageSize, .holesSupported = seekSparse(file, 0, SEEK_HOLE) != null };
+    }
+
+    pub fn imageSource(self: *FileSource) ImageSource {
+        return Implementation.asImageSource(self);
+    }
+
+    pub fn size(self: *FileSource) ?u64 {
+        return self.fileSize;
+    }
+
+    /// Holes become ZERO extents. Returns null when the filesystem cannot report holes.
+    pub fn extentAt(self: *FileSource, offset: u64) ?Extent {
+        if (!self.holesSupported or offset >= self.fileSize) return null;
+
+        // ENXIO from SEEK_DATA means the rest of the file is a hole
+        const dataStart = @min(seekSparse(self.file, offset, SEEK_DATA) orelse self.fileSize, self.fileSize);
+        if (dataStart > offset) return .{ .offset = offset, .len = dataStart - offset, .kind = .ZERO };
+
+        const holeStart = @min(seekSparse(self.file, offset, SEEK_HOLE) orelse self.fileSize, self.fileSize);
+        const dataEnd = if (holeStart > offset) holeStart else self.fileSize;
+        return .{ .offset = offset, .len = dataEnd - offset, .kind = .DATA };
+    }
+
+    pub fn read(self: *FileSource, buffer: []u8) !usize {
+        const bytesRead = try self.pread(buffer, self.position);
+        self.position += bytesRead;
+        return bytesRead;
+    }
+
+    pub fn pread(self: *FileSource, buffer: []u8, offset: u64) !usize {
+        if (offset >= self.fileSize) return 0;
+        const len: usize = @intCast(@min(@as(u64, buffer.len), self.fileSize - offset));
+        return self.file.preadAll(buffer[0..len], offset);
+    }
+
+    pub fn consumedBytes(self: *FileSource) u64 {
+        return self.position;
+    }
+};
+
+// --- Split images -----------------------------------------------------------
+
+/// An image cut into numbered parts (`name.001`, `name.002`, ...) read as one image.
+pub const SplitSource = struct {
+    pub const IS_SEEKABLE = true;
+    const Implementation = ImplementImageSource(SplitSource);
+
+    const Part = struct {
+        file: std.fs.File,
+        offset: u64,
+        len: u64,
+    };
+
+    allocator: std.mem.Allocator,
+    parts: []Part,
+    totalSize: u64,
+    position: u64 = 0,
+
+    /// True for paths naming the first part of a split image.
+    pub fn isFirstPart(path: []const u8) bool {
+        return std.mem.endsWith(u8, path, ".001");
+    }
+
+    /// Opens `firstPartPath` (relative to `dir`) and every consecutive part after it.
+    /// The parts stay open until deinit().
+    ///
+    /// `Errors`:
+    ///   error.NotASplitImage: the path does not end in ".001"
+    ///   error.TooManySplitParts: more than MAX_SPLIT_PARTS parts
+    ///   File open and stat errors of the first part
+    pub fn open(allocator: std.mem.Allocator, dir: std.fs.Dir, firstPartPath: []const u8) !SplitSource {
+        if (!isFirstPart(firstPartPath)) return error.NotASplitImage;
+        const stem = firstPartPath[0 .. firstPartPath.len - 3];
+
+        var parts: std.ArrayList(Part) = .empty;
+        errdefer {
+            for (parts.items) |part| part.file.close();
+            parts.deinit(allocator);
+        }
+
+        var totalSize: u64 = 0;
+        var number: usize = 1;
+        while (true) : (number += 1) {
+            if (number > MAX_SPLIT_PARTS) return error.TooManySplitParts;
+
+            var pathBuffer: [std.fs.max_path_bytes]u8 = undefined;
+            const partPath = try std.fmt.bufPrint(&pathBuffer, "{s}{d:0>3}", .{ stem, number });
+
+            const file = dir.openFile(partPath, .{}) catch |err| {
+                // The first missing number ends the set; the first part itself must exist
+                if (err == error.FileNotFound and number > 1) break;
+                return err;
+            };
+            errdefer file.close();
+
+            const len = (try file.stat()).size;
+            try parts.append(allocator, .{ .file = file, .offset = totalSize, .len = len });
+            totalSize += len;
+        }
+
+        return .{ .allocator = allocator, .parts = try parts.toOwnedSlice(allocator), .totalSize = totalSize };
+    }
+
+    pub fn deinit(self: *SplitSource) void {
+        for (self.parts) |part| part.file.close();
+        self.allocator.free(self.parts);
+    }
+
+    pub fn imageSource(self: *SplitSource) ImageSource {
+        return Implementation.asImageSource(self);
+    }
+
+    pub fn size(self: *SplitSource) ?u64 {
+        return self.totalSize;
+    }
+
+    pub fn extentAt(_: *SplitSource, _: u64) ?Extent {
+        return null;
+    }
+
+    pub fn read(self: *SplitSource, buffer: []u8) !usize {
+        const bytesRead = try self.pread(buffer, self.position);
+        self.position += bytesRead;
+        return bytesRead;
+    }
+
+    /// Reads across part boundaries as if the parts were one file.
+    pub fn pread(self: *SplitSource, buffer: []u8, offset: u64) !usize {
+        var filled: usize = 0;
+
+        for (self.parts) |part| {
+            const cursor = offset + filled;
+            if (filled == buffer.len) break;
+            if (cursor >= part.offset + part.len) continue;
+
+            const len: usize = @intCast(@min(@as(u64, buffer.len - filled), part.offset + part.len - cursor));
+            const bytesRead = try part.file.preadAll(buffer[filled..][0..len], cursor - part.offset);
+            filled += bytesRead;
+
+            // A part shrank since open(); the image ends here
+            if (bytesRead < len) break;
+        }
+
+        return filled;
+    }
+
+    pub fn consumedBytes(self: *SplitSource) u64 {
+        return self.position;
+    }
+};
+
+// --- Streams ----------------------------------------------------------------
+
+/// A pipe or other descriptor that can only be read front to back, such as stdin.
+pub const StreamSource = struct {
+    pub const IS_SEEKABLE = false;
+    const Implementation = ImplementImageSource(StreamSource);
+
+    file: std.fs.File,
+    position: u64 = 0,
+
+    pub fn stdin() StreamSource {
+        return .{ .file = std.fs.File.stdin() };
+    }
+
+    pub fn imageSource(self: *StreamSource) ImageSource {
+        return Implementation.asImageSource(self);
+    }
+
+    pub fn size(_: *StreamSource) ?u64 {
+        return null;
+    }
+
+    pub fn extentAt(_: *StreamSource, _: u64) ?Extent {
+        return null;
+    }
+
+    /// Fills `buffer` unless the stream ends first.
+    pub fn read(self: *StreamSource, buffer: []u8) !usize {
+        const bytesRead = try self.file.readAll(buffer);
+        self.position += bytesRead;
+        return bytesRead;
+    }
+
+    pub fn pread(self: *StreamSource, buffer: []u8, offset: u64) !usize {
+        if (offset != self.position) return error.SourceNotSeekable;
+        return self.read(buffer);
+    }
+
+    pub fn consumedBytes(self: *StreamSource) u64 {
+        return self.position;
+    }
+};
+
+/// A decompressed gzip/xz/zstd stream. size() stays null: container metadata is only a
+/// hint (see compression.uncompressedSize), the stream ends where the decoder says.
+pub const DecompressSource = struct {
+    pub const IS_SEEKABLE = false;
+    const Implementation = ImplementImageSource(DecompressSource);
+
+    stream: *compression.DecompressStream,
+    position: u64 = 0,
+
+    pub fn imageSource(self: *DecompressSource) ImageSource {
+        return Implementation.asImageSource(self);
+    }
+
+    pub fn size(_: *DecompressSource) ?u64 {
+        return null;
+    }
+
+    pub fn extentAt(_: *DecompressSource, _: u64) ?Extent {
+        return null;
+    }
+
+    pub fn read(self: *DecompressSource, buffer: []u8) !usize {
+        const bytesRead = try self.stream.read(buffer);
+        self.position += bytesRead;
+        return bytesRead;
+    }
+
+    pub fn pread(self: *DecompressSource, buffer: []u8, offset: u64) !usize {
+        if (offset != self.position) return error.SourceNotSeekable;
+        return self.read(buffer);
+    }
+
+    /// Compressed bytes consumed, unlike the other sources' decompressed position.
+    pub fn consumedBytes(self: *DecompressSource) u64 {
+        return self.stream.consumedBytes();
+    }
+};
+
+// --- Virtual disks ----------------------------------------------------------
+
+/// The guest disk of a qcow2/VHD/VHDX/VMDK image. Unallocated extents are ZERO extents
+/// and read as zeros; allocated clusters are gathered from wherever they are stored.
+pub const VirtualDiskSource = struct {
+    pub const IS_SEEKABLE = true;
+    const Implementation = ImplementImageSource(VirtualDiskSource);
+
+    file: std.fs.File,
+    map: *const vdisk.ExtentMap,
+    position: u64 = 0,
+
+    pub fn imageSource(self: *VirtualDiskSource) ImageSource {
+        return Implementation.asImageSource(self);
+    }
+
+    pub fn size(self: *VirtualDiskSource) ?u64 {
+        return self.map.virtualSize;
+    }
+
+    /// Index of the extent containing `offset`, which must be below the virtual size.
+    fn extentIndex(self: *const VirtualDiskSource, offset: u64) usize {
+        const Compare = struct {
+            fn order(target: u64, extent: vdisk.Extent) std.math.Order {
+                if (target < extent.outputOffset) return .lt;
+                if (target >= extent.end()) return .gt;
+                return .eq;
+            }
+        };
+        return std.sort.binarySearch(vdisk.Extent, self.map.extents, offset, Compare.order).?;
+    }
+
+    /// The run of same-kind extents from `offset`: consecutive stored extents form one
+    /// DATA extent even when they are scattered in the file.
+    pub fn extentAt(self: *VirtualDiskSource, offset: u64) ?Extent {
+        if (offset >= self.map.virtualSize) return null;
+
+        var index = self.extentIndex(offset);
+        const isZero = self.map.extents[index].fileOffset == null;
+        while (index + 1 < self.map.extents.len and (self.map.extents[index + 1].fileOffset == null) == isZero) index += 1;
+
+        return .{ .offset = offset, .len = self.map.extents[index].end() - offset, .kind = if (isZero) .ZERO else .DATA };
+    }
+
+    pub fn read(self: *VirtualDiskSource, buffer: []u8) !usize {
+        const bytesRead = try self.pread(buffer, self.position);
+        self.position += bytesRead;
+        return bytesRead;
+    }
+
+    /// `Errors`:
+    ///   error.UnexpectedEndOfImage: an allocated extent lies past the end of the file
+    pub fn pread(self: *VirtualDiskSource, buffer: []u8, offset: u64) !usize {
+        if (offset >= self.map.virtualSize) return 0;
+
+        const len: usize = @intCast(@min(@as(u64, buffer.len), self.map.virtualSize - offset));
+        var index = self.extentIndex(offset);
+        var filled: usize = 0;
+
+        while (filled < len) : (index += 1) {
+            const extent = self.map.extents[index];
+            const cursor = offset + filled;
+            const part = buffer[filled..][0..@intCast(@min(@as(u64, len - filled), extent.end() - cursor))];
+
+            if (extent.fileOffset) |fileOffset| {
+                if (try self.file.preadAll(part, fileOffset + (cursor - extent.outputOffset)) < part.len) return error.UnexpectedEndOfImage;
+            } else {
+                @memset(part, 0);
+            }
+
+            filled += part.len;
+        }
+
+        return filled;
+    }
+
+    pub fn consumedBytes(self: *VirtualDiskSource) u64 {
+        return self.position;
+    }
+};
+
+// ============================================================================
+// TESTS
+// ============================================================================
+
+test "SplitSource reads across part boundaries" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    var payload: [3000]u8 = undefined;
+    for (&payload, 0..) |*byte, i| byte.* = @truncate(i *% 7 + 3);
+
+    // Parts of 1000, 1500 and 500 bytes; part .004 is missing and ends the set
+    try tmp.dir.writeFile(.{ .sub_path = "image.iso.001", .data = payload[0..1000] });
+    try tmp.dir.writeFile(.{ .sub_path = "image.iso.002", .data = payload[1000..2500] });
+    try tmp.dir.writeFile(.{ .sub_path = "image.iso.003", .data = payload[2500..] });
+    try tmp.dir.writeFile(.{ .sub_path = "image.iso.005", .data = "stray" });
+
+    var split = try SplitSource.open(std.testing.allocator, tmp.dir, "image.iso.001");
+    defer split.deinit();
+
+    const source = split.imageSource();
+    try std.testing.expectEqual(@as(?u64, payload.len), source.size());
+
+    var buffer: [1200]u8 = undefined;
+    try std.testing.expectEqual(@as(usize, 1200), try source.pread(&buffer, 900));
+    try std.testing.expectEqualSlices(u8, payload[900..2100], &buffer);
+
+    // Sequential reads end with a short read at the end of the last part
+    var received: usize = 0;
+    while (true) {
+        const bytesRead = try source.read(&buffer);
+        try std.testing.expectEqualSlices(u8, payload[received..][0..bytesRead], buffer[0..bytesRead]);
+        received += bytesRead;
+        if (bytesRead < buffer.len) break;
+    }
+    try std.testing.expectEqual(payload.len, received);
+
+    try std.testing.expectError(error.NotASplitImage, SplitSource.open(std.testing.allocator, tmp.dir, "image.iso"));
+}
+
+test "VirtualDiskSource gathers scattered clusters and zero-fills holes" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    var stored: [300]u8 = undefined;
+    for (&stored, 0..) |*byte, i| byte.* = @truncate(i + 1);
+
+    const file = try tmp.dir.createFile("disk.img", .{ .read = true });
+    defer file.close();
+    try file.writeAll(&stored);
+
+    var extents = [_]vdisk.Extent{
+        .{ .outputOffset = 0, .len = 100, .fileOffset = 200 },
+        .{ .outputOffset = 100, .len = 100, .fileOffset = 0 },
+        .{ .outputOffset = 200, .len = 50, .fileOffset = null },
+        .{ .outputOffset = 250, .len = 50, .fileOffset = 100 },
+    };
+    const map = vdisk.ExtentMap{ .allocator = std.testing.allocator, .format = .QCOW2, .virtualSize = 300, .extents = &extents };
+
+    var disk = VirtualDiskSource{ .file = file, .map = &map };
+    const source = disk.imageSource();
+
+    // Both stored extents before the hole count as one DATA run
+    try std.testing.expectEqual(Extent{ .offset = 50, .len = 150, .kind = .DATA }, source.extentAt(50).?);
+    try std.testing.expectEqual(Extent{ .offset = 210, .len = 40, .kind = .ZERO }, source.extentAt(210).?);
+    try std.testing.expect(source.extentAt(300) == null);
+
+    var buffer: [200]u8 = undefined;
+    try std.testing.expectEqual(@as(usize, 200), try source.pread(&buffer, 90));
+    try std.testing.expectEqualSlices(u8, stored[290..300], buffer[0..10]);
+    try std.testing.expectEqualSlices(u8, stored[0..100], buffer[10..110]);
+    try std.testing.expect(std.mem.allEqual(u8, buffer[110..160], 0));
+    try std.testing.expectEqualSlices(u8, stored[100..140], buffer[160..200]);
+}
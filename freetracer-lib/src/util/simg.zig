@@ -0,0 +1,354 @@
+//! Android sparse images (simg), as produced by img2simg and the AOSP build.
+//!
+//! A sparse image is a 28-byte file header followed by chunks, each describing a run of
+//! output blocks:
+//! - RAW: the blocks follow the chunk header verbatim
+//! - FILL: the blocks repeat a single 4-byte pattern
+//! - DONT_CARE: the blocks' contents do not matter (nothing is stored)
+//! - CRC32: no blocks; carries the CRC-32 of the expanded output up to this point
+//!
+//! ChunkReader walks the chunk headers with positional reads, so RAW payloads can be
+//! streamed straight from the image file to the device without expanding the image.
+//! All fields are little-endian.
+//! ------------------------------------------------------------------------------
+const std = @import("std");
+
+pub const MAGIC: u32 = 0xED26FF3A;
+pub const MAJOR_VERSION: u16 = 1;
+pub const FILE_HEADER_SIZE = 28;
+pub const CHUNK_HEADER_SIZE = 12;
+
+pub const ChunkType = enum(u16) {
+    RAW = 0xCAC1,
+    FILL = 0xCAC2,
+    DONT_CARE = 0xCAC3,
+    CRC32 = 0xCAC4,
+};
+
+pub const SparseImageError = error{
+    InvalidSparseImage,
+    UnsupportedSparseVersion,
+    UnexpectedEndOfImage,
+};
+
+pub const Header = struct {
+    blockSize: u32,
+    totalBlocks: u32,
+    totalChunks: u32,
+    /// Sizes as recorded in the file; newer writers may append fields we skip
+    fileHeaderSize: u16,
+    chunkHeaderSize: u16,
+
+    /// Size of the image once expanded: what simg2img would produce.
+    pub fn expandedSize(self: Header) u64 {
+        return @as(u64, self.totalBlocks) * self.blockSize;
+    }
+};
+
+/// One chunk, with its position in the expanded output and, for RAW chunks, in the file.
+pub const Chunk = struct {
+    type: ChunkType,
+    outputOffset: u64,
+    outputLen: u64,
+    /// File offset of the RAW payload
+    dataOffset: u64 = 0,
+    /// FILL pattern, or the expected checksum of a CRC32 chunk
+    value: u32 = 0,
+};
+
+/// Returns true if `head` starts with the sparse image magic.
+pub fn isSparseImage(head: []const u8) bool {
+    return head.len >= 4 and std.mem.readInt(u32, head[0..4], .little) == MAGIC;
+}
+
+/// Classifies `file` by the magic at offset 0. Read errors classify as not sparse.
+pub fn detect(file: std.fs.File) bool {
+    var head: [4]u8 = undefined;
+    const bytesRead = file.preadAll(&head, 0) catch return false;
+    return isSparseImage(head[0..bytesRead]);
+}
+
+/// Parses and validates the file header.
+///
+/// `Errors`:
+///   error.InvalidSparseImage: wrong magic, header sizes or block size
+///   error.UnsupportedSparseVersion: major version other than 1
+pub fn parseHeader(bytes: *const [FILE_HEADER_SIZE]u8) SparseImageError!Header {
+    if (!isSparseImage(bytes)) return error.InvalidSparseImage;
+    if (std.mem.readInt(u16, bytes[4..6], .little) != MAJOR_VERSION) return error.UnsupportedSparseVersion;
+
+    const header = Header{
+        .fileHeaderSize = std.mem.readInt(u16, bytes[8..10], .little),
+        .chunkHeaderSize = std.mem.readInt(u16, bytes[10..12], .little),
+        .blockSize = std.mem.readInt(u32, bytes[12..16], .little),
+        .totalBlocks = std.mem.readInt(u32, bytes[16..20], .little),
+        .totalChunks = std.mem.readInt(u32, bytes[20..24], .little),
+    };
+
+    if (header.fileHeaderSize < FILE_HEADER_SIZE or header.chunkHeaderSize < CHUNK_HEADER_SIZE) return error.InvalidSparseImage;
+    // The format requires 4-byte multiples so FILL patterns tile each block exactly
+    if (header.blockSize == 0 or header.blockSize % 4 != 0) return error.InvalidSparseImage;
+
+    return header;
+}
+
+/// Iterates the chunks of a sparse image file, validating each header against the
+/// file header and the chunk's declared size.
+pub const ChunkReader = struct {
+    file: std.fs.File,
+    header: Header,
+    fileOffset: u64,
+    outputOffset: u64 = 0,
+    chunkIndex: u32 = 0,
+
+    /// `Errors`:
+    ///   parseHeader errors, error.UnexpectedEndOfImage, file read errors
+    pub fn init(file: std.fs.File) !ChunkReader {
+        var bytes: [FILE_HEADER_SIZE]u8 = undefined;
+        if (try file.preadAll(&bytes, 0) < bytes.len) return error.UnexpectedEndOfImage;
+
+        const header = try parseHeader(&bytes);
+        return .{ .file = file, .header = header, .fileOffset = header.fileHeaderSize };
+    }
+
+    /// Returns the next chunk, or null after the last one.
+    ///
+    /// `Errors`:
+    ///   error.InvalidSparseImage: unknown chunk type, inconsistent sizes, or chunks that
+    ///     do not add up to the header's block count
+    ///   error.UnexpectedEndOfImage: the file ends inside a chunk
+    pub fn next(self: *ChunkReader) !?Chunk {
+        if (self.chunkIndex == self.header.totalChunks) {
+            if (self.outputOffset != self.header.expandedSize()) return error.InvalidSparseImage;
+            return null;
+        }
+
+        var bytes: [CHUNK_HEADER_SIZE]u8 = undefined;
+        const bytesRead = try self.file.preadAll(&bytes, self.fileOffset);
+        if (bytesRead < CHUNK_HEADER_SIZE) return error.UnexpectedEndOfImage;
+
+        const chunkType = std.meta.intToEnum(ChunkType, std.mem.readInt(u16, bytes[0..2], .little)) catch return error.InvalidSparseImage;
+        const blocks = std.mem.readInt(u32, bytes[4..8], .little);
+        const totalSize = std.mem.readInt(u32, bytes[8..12], .little);
+
+        const headerSize: u64 = self.header.chunkHeaderSize;
+        const outputLen = @as(u64, blocks) * self.header.blockSize;
+        const payloadSize: u64 = switch (chunkType) {
+            .RAW => outputLen,
+            .FILL, .CRC32 => 4,
+            .DONT_CARE => 0,
+        };
+        if (totalSize != headerSize + payloadSize) return error.InvalidSparseImage;
+        if (chunkType == .CRC32 and blocks != 0) return error.InvalidSparseImage;
+        // outputOffset never exceeds expandedSize, so the subtraction cannot wrap
+        if (outputLen > self.header.expandedSize() - self.outputOffset) return error.InvalidSparseImage;
+
+        var chunk = Chunk{ .type = chunkType, .outputOffset = self.outputOffset, .outputLen = outputLen };
+        switch (chunkType) {
+            .RAW => chunk.dataOffset = self.fileOffset + headerSize,
+            .FILL, .CRC32 => {
+                var value: [4]u8 = undefined;
+                if (try self.file.preadAll(&value, self.fileOffset + headerSize) < value.len) return error.UnexpectedEndOfImage;
+                chunk.value = std.mem.readInt(u32, &value, .little);
+            },
+            .DONT_CARE => {},
+        }
+
+        self.fileOffset += totalSize;
+        self.outputOffset += outputLen;
+        self.chunkIndex += 1;
+        return chunk;
+    }
+};
+
+/// What a sparse image holds, from one pass over its chunk headers.
+pub const Summary = struct {
+    header: Header,
+    /// RAW + FILL bytes: what a sparse write transfers to the device
+    dataBytes: u64 = 0,
+    dontCareBytes: u64 = 0,
+    hasChecksums: bool = false,
+};
+
+/// Walks every chunk header (payloads are not read) and validates the whole image layout
+/// before anything is written. Errors as ChunkReader.next; the file must end after the
+/// last chunk's payload.
+pub fn scan(file: std.fs.File) !Summary {
+    var reader = try ChunkReader.init(file);
+    var summary = Summary{ .header = reader.header };
+
+    while (try reader.next()) |chunk| {
+        switch (chunk.type) {
+            .RAW, .FILL => summary.dataBytes += chunk.outputLen,
+            .DONT_CARE => summary.dontCareBytes += chunk.outputLen,
+            .CRC32 => summary.hasChecksums = true,
+        }
+    }
+
+    if ((try file.stat()).size < reader.fileOffset) return error.UnexpectedEndOfImage;
+    return summary;
+}
+
+/// Fills `buffer` with the little-endian `pattern`. `buffer.len` must be a multiple of 4.
+pub fn fillPattern(buffer: []u8, pattern: u32) void {
+    std.debug.assert(buffer.len % 4 == 0);
+
+    var word: [4]u8 = undefined;
+    std.mem.writeInt(u32, &word, pattern, .little);
+
+    var offset: usize = 0;
+    while (offset < buffer.len) : (offset += 4) @memcpy(buffer[offset..][0..4], &word);
+}
+
+// ============================================================================
+// TESTS
+// ============================================================================
+
+/// Appends a chunk header (and FILL/CRC32 value) to `writer`.
+fn writeTestChunk(writer: *std.Io.Writer, chunkType: ChunkType, blocks: u32, totalSize: u32, value: ?u32) !void {
+    try writer.writeInt(u16, @intFromEnum(chunkType), .little);
+    try writer.writeInt(u16, 0, .little);
+    try writer.writeInt(u32, blocks, .little);
+    try writer.writeInt(u32, totalSize, .little);
+    if (value) |v| try writer.writeInt(u32, v, .little);
+}
+
+/// Builds a 6-block image: 2 RAW, 1 FILL, 2 DONT_CARE, 1 RAW, then a CRC32 chunk.
+fn buildTestImage(buffer: []u8, blockSize: u32, raw: []const u8) ![]const u8 {
+    var writer = std.Io.Writer.fixed(buffer);
+
+    try writer.writeInt(u32, MAGIC, .little);
+    try writer.writeInt(u16, MAJOR_VERSION, .little);
+    try writer.writeInt(u16, 0, .little);
+    try writer.writeInt(u16, FILE_HEADER_SIZE, .little);
+    try writer.writeInt(u16, CHUNK_HEADER_SIZE, .little);
+    try writer.writeInt(u32, blockSize, .little);
+    try writer.writeInt(u32, 6, .little);
+    try writer.writeInt(u32, 5, .little);
+    try writer.writeInt(u32, 0, .little);
+
+    try writeTestChunk(&writer, .RAW, 2, CHUNK_HEADER_SIZE + 2 * blockSize, null);
+    try writer.writeAll(raw[0 .. 2 * blockSize]);
+    try writeTestChunk(&writer, .FILL, 1, CHUNK_HEADER_SIZE + 4, 0xDEADBEEF);
+    try writeTestChunk(&writer, .DONT_CARE, 2, CHUNK_HEADER_SIZE, null);
+    try writeTestChunk(&writer, .RAW, 1, CHUNK_HEADER_SIZE + blockSize, null);
+    try writer.writeAll(raw[2 * blockSize .. 3 * blockSize]);
+    try writeTestChunk(&writer, .CRC32, 0, CHUNK_HEADER_SIZE + 4, 0x12345678);
+
+    return writer.buffered();
+}
+
+test "ChunkReader walks chunks in output order" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const blockSize = 64;
+    var raw: [3 * blockSize]u8 = undefined;
+    for (&raw, 0..) |*byte, i| byte.* = @truncate(i *% 11 + 5);
+
+    var buffer: [1024]u8 = undefined;
+    const image = try buildTestImage(&buffer, blockSize, &raw);
+
+    const file = try tmp.dir.createFile("image.simg", .{ .read = true });
+    defer file.close();
+    try file.writeAll(image);
+
+    try std.testing.expect(detect(file));
+
+    var reader = try ChunkReader.init(file);
+    try std.testing.expectEqual(@as(u64, 6 * blockSize), reader.header.expandedSize());
+
+    const expected = [_]struct { ChunkType, u64, u64 }{
+        .{ .RAW, 0, 2 * blockSize },
+        .{ .FILL, 2 * blockSize, blockSize },
+        .{ .DONT_CARE, 3 * blockSize, 2 * blockSize },
+        .{ .RAW, 5 * blockSize, blockSize },
+        .{ .CRC32, 6 * blockSize, 0 },
+    };
+
+    for (expected) |entry| {
+        const chunk = (try reader.next()).?;
+        try std.testing.expectEqual(entry[0], chunk.type);
+        try std.testing.expectEqual(entry[1], chunk.outputOffset);
+        try std.testing.expectEqual(entry[2], chunk.outputLen);
+
+        switch (chunk.type) {
+            .RAW => {
+                var payload: [2 * blockSize]u8 = undefined;
+                _ = try file.preadAll(payload[0..@intCast(chunk.outputLen)], chunk.dataOffset);
+                const rawStart: usize = if (chunk.outputOffset == 0) 0 else 2 * blockSize;
+                try std.testing.expectEqualSlices(u8, raw[rawStart..][0..@intCast(chunk.outputLen)], payload[0..@intCast(chunk.outputLen)]);
+            },
+            .FILL => try std.testing.expectEqual(@as(u32, 0xDEADBEEF), chunk.value),
+            else => {},
+        }
+    }
+    try std.testing.expectEqual(@as(?Chunk, null), try reader.next());
+
+    const summary = try scan(file);
+    try std.testing.expectEqual(@as(u64, 4 * blockSize), summary.dataBytes);
+    try std.testing.expectEqual(@as(u64, 2 * blockSize), summary.dontCareBytes);
+    try std.testing.expect(summary.hasChecksums);
+}
+
+test "scan rejects truncated and inconsistent images" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const blockSize = 64;
+    const raw = [_]u8{0xAB} ** (3 * blockSize);
+
+    var buffer: [1024]u8 = undefined;
+    const image = try buildTestImage(&buffer, blockSize, &raw);
+
+    const truncated = try tmp.dir.createFile("truncated.simg", .{ .read = true });
+    defer truncated.close();
+    try truncated.writeAll(image[0 .. image.len - 20]);
+    try std.testing.expectError(error.UnexpectedEndOfImage, scan(truncated));
+
+    // A FILL chunk claiming a payload other than its 4-byte pattern
+    var corrupt = buffer;
+    const fillSizeOffset = FILE_HEADER_SIZE + CHUNK_HEADER_SIZE + 2 * blockSize + 8;
+    std.mem.writeInt(u32, corrupt[fillSizeOffset..][0..4], CHUNK_HEADER_SIZE + 8, .little);
+
+    const inconsistent = try tmp.dir.createFile("inconsistent.simg", .{ .read = true });
+    defer inconsistent.close();
+    try inconsistent.writeAll(corrupt[0..image.len]);
+    try std.testing.expectError(error.InvalidSparseImage, scan(inconsistent));
+}
+
+test "ChunkReader rejects chunks overrunning a maximal image" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    var buffer: [FILE_HEADER_SIZE + 2 * CHUNK_HEADER_SIZE]u8 = undefined;
+    var writer = std.Io.Writer.fixed(&buffer);
+    try writer.writeInt(u32, MAGIC, .little);
+    try writer.writeInt(u16, MAJOR_VERSION, .little);
+    try writer.writeInt(u16, 0, .little);
+    try writer.writeInt(u16, FILE_HEADER_SIZE, .little);
+    try writer.writeInt(u16, CHUNK_HEADER_SIZE, .little);
+    try writer.writeInt(u32, std.math.maxInt(u32) - 3, .little);
+    try writer.writeInt(u32, std.math.maxInt(u32), .little);
+    try writer.writeInt(u32, 2, .little);
+    try writer.writeInt(u32, 0, .little);
+
+    // Each chunk alone covers the whole image, so their sum exceeds u64
+    try writeTestChunk(&writer, .DONT_CARE, std.math.maxInt(u32), CHUNK_HEADER_SIZE, null);
+    try writeTestChunk(&writer, .DONT_CARE, std.math.maxInt(u32), CHUNK_HEADER_SIZE, null);
+
+    const file = try tmp.dir.createFile("overrun.simg", .{ .read = true });
+    defer file.close();
+    try file.writeAll(writer.buffered());
+
+    var reader = try ChunkReader.init(file);
+    const first = (try reader.next()).?;
+    try std.testing.expectEqual(reader.header.expandedSize(), first.outputLen);
+    try std.testing.expectError(error.InvalidSparseImage, reader.next());
+}
+
+test "fillPattern tiles the pattern little-endian" {
+    var buffer: [12]u8 = undefined;
+    fillPattern(&buffer, 0x04030201);
+    try std.testing.expectEqualSlices(u8, &.{ 1, 2, 3, 4, 1, 2, 3, 4, 1, 2, 3, 4 }, &buffer);
+}
@@ -0,0 +1,744 @@
+//! Apple UDIF disk images (.dmg), as produced by hdiutil and Disk Utility.
+//!
+//! A UDIF file is a data fork of (mostly compressed) chunks, an XML property list that
+//! describes them, and a 512-byte "koly" trailer locating both:
+//! - parse() reads the trailer and the blkx tables ("mish" blocks, base64 in the plist)
+//!   into one list of chunks in output order; sectors no table covers become zero-fill
+//! - ChunkDecoder expands one chunk: raw, zlib and LZMA (xz container) on every host,
+//!   bzip2 and LZFSE through the system libraries on macOS
+//! - ParallelDecoder expands chunks on a pool of worker threads and hands them to a
+//!   single consumer strictly in output order, within a bounded reorder window
+//!
+//! Zero-fill and ignore chunks carry no data; consumers treat them as sparse ranges.
+//! Parsing and decoding are pure data, so both run (and are tested and benchmarked) on
+//! Linux hosts.
+//! All trailer and table fields are big-endian.
+//! ------------------------------------------------------------------------------
+const std = @import("std");
+const builtin = @import("builtin");
+const endian = @import("./endian.zig");
+const bench = @import("./bench.zig");
+const c = @import("../types.zig").c;
+
+const isMacOS = builtin.os.tag == .macos;
+
+pub const SECTOR_SIZE = 512;
+pub const TRAILER_SIZE = 512;
+
+const TRAILER_MAGIC = "koly";
+const TRAILER_VERSION = 4;
+const BLOCK_TABLE_MAGIC = "mish";
+const BLOCK_TABLE_VERSION = 1;
+const BLOCK_TABLE_HEADER_SIZE = 204;
+const BLOCK_CHUNK_ENTRY_SIZE = 40;
+
+/// Upper bound on the property list we are willing to load.
+pub const MAX_PLIST_SIZE = 64 * 1024 * 1024;
+/// Largest chunk expanded in memory; hdiutil writes 1 MiB (2048-sector) chunks by default.
+pub const MAX_CHUNK_SIZE = 64 * 1024 * 1024;
+/// Upper bound on decoder worker threads.
+pub const MAX_WORKERS = 8;
+/// Memory budget for the reorder window (input + output buffers of every slot).
+const MAX_WINDOW_MEMORY = 256 * 1024 * 1024;
+
+pub const ChunkType = enum(u32) {
+    ZERO_FILL = 0x00000000,
+    RAW = 0x00000001,
+    IGNORE = 0x00000002,
+    ADC = 0x80000004,
+    ZLIB = 0x80000005,
+    BZIP2 = 0x80000006,
+    LZFSE = 0x80000007,
+    LZMA = 0x80000008,
+    COMMENT = 0x7FFFFFFE,
+    TERMINATOR = 0xFFFFFFFF,
+
+    /// True for chunks that store no data and read as zeros.
+    pub fn isSparse(self: ChunkType) bool {
+        return self == .ZERO_FILL or self == .IGNORE;
+    }
+};
+
+pub const UdifError = error{
+    InvalidUdif,
+    UnsupportedUdifVersion,
+    UnsupportedUdifCompression,
+    UdifChunkTooLarge,
+    CorruptUdifChunk,
+};
+
+pub const Trailer = struct {
+    dataForkOffset: u64,
+    dataForkLength: u64,
+    plistOffset: u64,
+    plistLength: u64,
+    sectorCount: u64,
+};
+
+/// One run of output sectors and, for data chunks, where its stored bytes live.
+pub const Chunk = struct {
+    type: ChunkType,
+    outputOffset: u64,
+    outputLen: u64,
+    /// Absolute file offset and length of the stored bytes (0 for sparse chunks)
+    inputOffset: u64 = 0,
+    inputLen: u64 = 0,
+
+    pub fn end(self: Chunk) u64 {
+        return self.outputOffset + self.outputLen;
+    }
+};
+
+pub const Image = struct {
+    allocator: std.mem.Allocator,
+    trailer: Trailer,
+    /// Ascending, contiguous, covering the whole expanded image
+    chunks: []Chunk,
+    maxOutputLen: u64,
+    maxInputLen: u64,
+
+    pub fn deinit(self: *Image) void {
+        self.allocator.free(self.chunks);
+    }
+
+    /// Size of the image once expanded: what `hdiutil convert -format UDTO` would produce.
+    pub fn expandedSize(self: *const Image) u64 {
+        return self.trailer.sectorCount * SECTOR_SIZE;
+    }
+
+    /// Bytes held by data chunks; the rest of the image is sparse.
+    pub fn dataBytes(self: *const Image) u64 {
+        var total: u64 = 0;
+        for (self.chunks) |chunk| {
+            if (!chunk.type.isSparse()) total += chunk.outputLen;
+        }
+        return total;
+    }
+};
+
+/// Returns true if `bytes` is a koly trailer.
+pub fn isTrailer(bytes: []const u8) bool {
+    return bytes.len >= TRAILER_SIZE and std.mem.eql(u8, bytes[0..4], TRAILER_MAGIC);
+}
+
+/// Classifies `file` by the trailer in its last 512 bytes. Read errors classify as not UDIF.
+pub fn detect(file: std.fs.File) bool {
+    const size = (file.stat() catch return false).size;
+    if (size < TRAILER_SIZE) return false;
+
+    var bytes: [TRAILER_SIZE]u8 = undefined;
+    const bytesRead = file.preadAll(&bytes, size - TRAILER_SIZE) catch return false;
+    return isTrailer(bytes[0..bytesRead]);
+}
+
+/// Parses and validates a koly trailer.
+///
+/// `Errors`:
+///   error.InvalidUdif: wrong magic or header size
+///   error.UnsupportedUdifVersion: trailer version other than 4
+pub fn parseTrailer(bytes: *const [TRAILER_SIZE]u8) UdifError!Trailer {
+    if (!isTrailer(bytes)) return error.InvalidUdif;
+    if (endian.readBig(u32, bytes[4..8]) != TRAILER_VERSION) return error.UnsupportedUdifVersion;
+    if (endian.readBig(u32, bytes[8..12]) != TRAILER_SIZE) return error.InvalidUdif;
+
+    return .{
+        .dataForkOffset = endian.readBig(u64, bytes[24..32]),
+        .dataForkLength = endian.readBig(u64, bytes[32..40]),
+        .plistOffset = endian.readBig(u64, bytes[216..224]),
+        .plistLength = endian.readBig(u64, bytes[224..232]),
+        .sectorCount = endian.readBig(u64, bytes[492..500]),
+    };
+}
+
+/// Reads the trailer and every blkx table of `file`. The chunks are owned by `allocator`.
+///
+/// `Errors`:
+///   error.InvalidUdif: inconsistent trailer, missing blkx table, overlapping chunks, or
+///     chunks outside the data fork or the image
+///   error.UnsupportedUdifVersion: unknown trailer or block table version
+///   error.UnsupportedUdifCompression: ADC or an unknown chunk type
+///   error.UdifChunkTooLarge: a chunk exceeds MAX_CHUNK_SIZE
+pub fn parse(allocator: std.mem.Allocator, file: std.fs.File) !Image {
+    const fileSize = (try file.stat()).size;
+    if (fileSize < TRAILER_SIZE) return error.InvalidUdif;
+
+    var trailerBytes: [TRAILER_SIZE]u8 = undefined;
+    if (try file.preadAll(&trailerBytes, fileSize - TRAILER_SIZE) < TRAILER_SIZE) return error.InvalidUdif;
+    const trailer = try parseTrailer(&trailerBytes);
+
+    // Images without a plist keep their tables in a resource fork, which we do not read
+    if (trailer.plistLength == 0 or trailer.plistLength > MAX_PLIST_SIZE) return error.InvalidUdif;
+    const plistEnd = std.math.add(u64, trailer.plistOffset, trailer.plistLength) catch return error.InvalidUdif;
+    const dataForkEnd = std.math.add(u64, trailer.dataForkOffset, trailer.dataForkLength) catch return error.InvalidUdif;
+    if (plistEnd > fileSize - TRAILER_SIZE or dataForkEnd > fileSize) return error.InvalidUdif;
+
+    const plist = try allocator.alloc(u8, @intCast(trailer.plistLength));
+    defer allocator.free(plist);
+    if (try file.preadAll(plist, trailer.plistOffset) < plist.len) return error.InvalidUdif;
+
+    var tableChunks: std.ArrayList(Chunk) = .empty;
+    defer tableChunks.deinit(allocator);
+    try collectBlockTables(allocator, plist, trailer, &tableChunks);
+
+    std.mem.sort(Chunk, tableChunks.items, {}, struct {
+        fn lessThan(_: void, a: Chunk, b: Chunk) bool {
+            return a.outputOffset < b.outputOffset;
+        }
+    }.lessThan);
+
+    // Fill the sectors no table mentions with zero-fill chunks, so consumers see every byte
+    var chunks: std.ArrayList(Chunk) = .empty;
+    errdefer chunks.deinit(allocator);
+
+    const expandedSize = std.math.mul(u64, trailer.sectorCount, SECTOR_SIZE) catch return error.InvalidUdif;
+    var cursor: u64 = 0;
+    var maxOutputLen: u64 = 0;
+    var maxInputLen: u64 = 0;
+
+    for (tableChunks.items) |chunk| {
+        if (chunk.outputOffset < cursor or chunk.outputOffset > expandedSize or chunk.outputLen > expandedSize - chunk.outputOffset) return error.InvalidUdif;
+        if (chunk.outputOffset > cursor) try chunks.append(allocator, .{ .type = .ZERO_FILL, .outputOffset = cursor, .outputLen = chunk.outputOffset - cursor });
+
+        try chunks.append(allocator, chunk);
+        cursor = chunk.end();
+        maxOutputLen = @max(maxOutputLen, chunk.outputLen);
+        maxInputLen = @max(maxInputLen, chunk.inputLen);
+    }
+    if (cursor < expandedSize) try chunks.append(allocator, .{ .type = .ZERO_FILL, .outputOffset = cursor, .outputLen = expandedSize - cursor });
+
+    return .{
+        .allocator = allocator,
+        .trailer = trailer,
+        .chunks = try chunks.toOwnedSlice(allocator),
+        .maxOutputLen = maxOutputLen,
+        .maxInputLen = maxInputLen,
+    };
+}
+
+/// Decodes every `<data>` element of the plist's blkx array and appends its chunks.
+fn collectBlockTables(allocator: std.mem.Allocator, plist: []const u8, trailer: Trailer, chunks: *std.ArrayList(Chunk)) !void {
+    const key = std.mem.indexOf(u8, plist, "<key>blkx</key>") orelse return error.InvalidUdif;
+    const arrayStart = std.mem.indexOfPos(u8, plist, key, "<array>") orelse return error.InvalidUdif;
+    const arrayEnd = std.mem.indexOfPos(u8, plist, arrayStart, "</array>") orelse return error.InvalidUdif;
+    const blkx = plist[0..arrayEnd];
+
+    const base64 = std.base64.standard.decoderWithIgnore(" \t\r\n");
+    var tableCount: usize = 0;
+    var pos = arrayStart;
+
+    while (std.mem.indexOfPos(u8, blkx, pos, "<data>")) |dataStart| {
+        const contentStart = dataStart + "<data>".len;
+        const contentEnd = std.mem.indexOfPos(u8, blkx, contentStart, "</data>") orelse return error.InvalidUdif;
+        const encoded = blkx[contentStart..contentEnd];
+
+        const table = try allocator.alloc(u8, base64.calcSizeUpperBound(encoded.len) catch return error.InvalidUdif);
+        defer allocator.free(table);
+        const tableLen = base64.decode(table, encoded) catch return error.InvalidUdif;
+
+        try appendBlockTable(allocator, table[0..tableLen], trailer, chunks);
+        tableCount += 1;
+        pos = contentEnd;
+    }
+
+    if (tableCount == 0) return error.InvalidUdif;
+}
+
+/// Appends the chunks of one "mish" block table, translated to absolute byte offsets.
+fn appendBlockTable(allocator: std.mem.Allocator, table: []const u8, trailer: Trailer, chunks: *std.ArrayList(Chunk)) !void {
+    if (table.len < BLOCK_TABLE_HEADER_SIZE or !std.mem.eql(u8, table[0..4], BLOCK_TABLE_MAGIC)) return error.InvalidUdif;
+    if (endian.readBig(u32, table[4..8]) != BLOCK_TABLE_VERSION) return error.UnsupportedUdifVersion;
+
+    const firstSector = endian.readBig(u64, table[8..16]);
+    const dataOffset = endian.readBig(u64, table[24..32]);
+    const entryCount = endian.readBig(u32, table[200..204]);
+    if (table.len < BLOCK_TABLE_HEADER_SIZE + @as(u64, entryCount) * BLOCK_CHUNK_ENTRY_SIZE) return error.InvalidUdif;
+
+    for (0..entryCount) |index| {
+        const entry = table[BLOCK_TABLE_HEADER_SIZE + index * BLOCK_CHUNK_ENTRY_SIZE ..][0..BLOCK_CHUNK_ENTRY_SIZE];
+
+        const chunkType = std.meta.intToEnum(ChunkType, endian.readBig(u32, entry[0..4])) catch return error.UnsupportedUdifCompression;
+        switch (chunkType) {
+            .COMMENT => continue,
+            .TERMINATOR => break,
+            // Apple Data Compression predates 10.2 and is not worth a decoder
+            .ADC => return error.UnsupportedUdifCompression,
+            else => {},
+        }
+
+        const sector = std.math.add(u64, firstSector, endian.readBig(u64, entry[8..16])) catch return error.InvalidUdif;
+        const outputLen = std.math.mul(u64, endian.readBig(u64, entry[16..24]), SECTOR_SIZE) catch return error.InvalidUdif;
+        if (outputLen == 0) continue;
+
+        var chunk = Chunk{
+            .type = chunkType,
+            .outputOffset = std.math.mul(u64, sector, SECTOR_SIZE) catch return error.InvalidUdif,
+            .outputLen = outputLen,
+        };
+
+        if (!chunkType.isSparse()) {
+            const forkOffset = std.math.add(u64, dataOffset, endian.readBig(u64, entry[24..32])) catch return error.InvalidUdif;
+            const inputLen = endian.readBig(u64, entry[32..40]);
+            const forkEnd = std.math.add(u64, forkOffset, inputLen) catch return error.InvalidUdif;
+            if (forkEnd > trailer.dataForkLength) return error.InvalidUdif;
+            if (outputLen > MAX_CHUNK_SIZE or inputLen > MAX_CHUNK_SIZE) return error.UdifChunkTooLarge;
+            if (chunkType == .RAW and inputLen != outputLen) return error.InvalidUdif;
+
+            chunk.inputOffset = trailer.dataForkOffset + forkOffset;
+            chunk.inputLen = inputLen;
+        }
+
+        try chunks.append(allocator, chunk);
+    }
+}
+
+/// Expands single chunks. Holds the zlib window, so each thread needs its own.
+pub const ChunkDecoder = struct {
+    allocator: std.mem.Allocator,
+    window: []u8,
+
+    pub fn init(allocator: std.mem.Allocator) !ChunkDecoder {
+        return .{ .allocator = allocator, .window = try allocator.alloc(u8, std.compress.flate.max_window_len) };
+    }
+
+    pub fn deinit(self: *ChunkDecoder) void {
+        self.allocator.free(self.window);
+    }
+
+    /// Expands the stored bytes `input` of a `chunkType` chunk into exactly `output`.
+    ///
+    /// `Errors`:
+    ///   error.CorruptUdifChunk: the stored bytes do not decode to `output.len` bytes
+    ///   error.UnsupportedUdifCompression: bzip2/LZFSE off macOS, ADC, or a non-data type
+    pub fn decode(self: *ChunkDecoder, chunkType: ChunkType, input: []const u8, output: []u8) UdifError!void {
+        switch (chunkType) {
+            .ZERO_FILL, .IGNORE => @memset(output, 0),
+            .RAW => {
+                if (input.len != output.len) return error.CorruptUdifChunk;
+                @memcpy(output, input);
+            },
+            .ZLIB => {
+                var reader: std.Io.Reader = .fixed(input);
+                var zlib = std.compress.flate.Decompress.init(&reader, .zlib, self.window);
+                zlib.reader.readSliceAll(output) catch return error.CorruptUdifChunk;
+            },
+            .LZMA => {
+                // libcompression's LZMA chunks are complete xz streams
+                var reader: std.Io.Reader = .fixed(input);
+                var xz = std.compress.xz.decompress(self.allocator, reader.adaptToOldInterface()) catch return error.CorruptUdifChunk;
+                defer xz.deinit();
+
+                var filled: usize = 0;
+                while (filled < output.len) {
+                    const bytesRead = xz.read(output[filled..]) catch return error.CorruptUdifChunk;
+                    if (bytesRead == 0) return error.CorruptUdifChunk;
+                    filled += bytesRead;
+                }
+            },
+            .BZIP2 => if (comptime isMacOS) {
+                var outputLen: c_uint = @intCast(output.len);
+                const rc = c.BZ2_bzBuffToBuffDecompress(output.ptr, &outputLen, @constCast(input.ptr), @intCast(input.len), 0, 0);
+                if (rc != c.BZ_OK or outputLen != output.len) return error.CorruptUdifChunk;
+            } else return error.UnsupportedUdifCompression,
+            .LZFSE => if (comptime isMacOS) {
+                const outputLen = c.compression_decode_buffer(output.ptr, output.len, input.ptr, input.len, null, c.COMPRESSION_LZFSE);
+                if (outputLen != output.len) return error.CorruptUdifChunk;
+            } else return error.UnsupportedUdifCompression,
+            .ADC, .COMMENT, .TERMINATOR => return error.UnsupportedUdifCompression,
+        }
+    }
+};
+
+/// Worker count for a ParallelDecoder on this host.
+pub fn defaultWorkerCount() usize {
+    const cpuCount = std.Thread.getCpuCount() catch 1;
+    return std.math.clamp(cpuCount, 1, MAX_WORKERS);
+}
+
+/// Expands the chunks of an Image on worker threads and hands them to one consumer in
+/// output order. Chunk `i` is decoded into slot `i % slots.len`, so workers run at most
+/// one window ahead of the consumer and memory use is fixed.
+///
+/// Must not be moved between start() and stop(); the workers hold a pointer to it.
+pub const ParallelDecoder = struct {
+    allocator: std.mem.Allocator,
+    file: std.fs.File,
+    image: *const Image,
+    slots: []Slot,
+    workers: []std.Thread,
+    mutex: std.Thread.Mutex = .{},
+    changed: std.Thread.Condition = .{},
+    nextToClaim: usize = 0,
+    nextToDeliver: usize = 0,
+    /// First worker error; the consumer returns it from next()
+    err: ?anyerror = null,
+    isCancelled: bool = false,
+
+    const Slot = struct {
+        state: enum { EMPTY, DECODING, READY } = .EMPTY,
+        input: []u8,
+        output: []u8,
+    };
+
+    pub const Decoded = struct {
+        chunk: Chunk,
+        /// Expanded bytes; empty for sparse chunks
+        bytes: []const u8,
+    };
+
+    /// Allocates the reorder window and spawns up to `workerCount` workers.
+    pub fn start(self: *ParallelDecoder, allocator: std.mem.Allocator, file: std.fs.File, image: *const Image, workerCount: usize) !void {
+        const slotMemory = @max(image.maxInputLen + image.maxOutputLen, 1);
+        const slotCount: usize = @intCast(std.math.clamp(MAX_WINDOW_MEMORY / slotMemory, 2, @as(u64, @max(workerCount, 1) * 2)));
+
+        self.* = .{
+            .allocator = allocator,
+            .file = file,
+            .image = image,
+            .slots = try allocator.alloc(Slot, slotCount),
+            .workers = &.{},
+        };
+        errdefer allocator.free(self.slots);
+
+        var allocatedCount: usize = 0;
+        errdefer {
+            for (self.slots[0..allocatedCount]) |slot| freeSlot(allocator, slot);
+        }
+
+        for (self.slots) |*slot| {
+            const input = try allocator.alloc(u8, @intCast(image.maxInputLen));
+            errdefer allocator.free(input);
+            slot.* = .{ .input = input, .output = try allocator.alloc(u8, @intCast(image.maxOutputLen)) };
+            allocatedCount += 1;
+        }
+
+        const workers = try allocator.alloc(std.Thread, std.math.clamp(workerCount, 1, slotCount));
+        errdefer allocator.free(workers);
+
+        var spawnedCount: usize = 0;
+        errdefer {
+            self.cancel();
+            for (workers[0..spawnedCount]) |worker| worker.join();
+        }
+
+        for (workers) |*worker| {
+            worker.* = try std.Thread.spawn(.{}, work, .{self});
+            spawnedCount += 1;
+        }
+
+        self.workers = workers;
+    }
+
+    /// Stops the workers and frees the window. Safe after an error from next().
+    pub fn stop(self: *ParallelDecoder) void {
+        self.cancel();
+        for (self.workers) |worker| worker.join();
+
+        for (self.slots) |slot| freeSlot(self.allocator, slot);
+        self.allocator.free(self.slots);
+        self.allocator.free(self.workers);
+    }
+
+    /// Blocks until the next chunk in output order is expanded and returns it, or null
+    /// after the last chunk. The bytes stay valid until release().
+    ///
+    /// `Errors`:
+    ///   The first error any worker hit (file read, ChunkDecoder.decode)
+    pub fn next(self: *ParallelDecoder) !?Decoded {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        if (self.nextToDeliver == self.image.chunks.len) return null;
+
+        const slot = &self.slots[self.nextToDeliver % self.slots.len];
+        while (slot.state != .READY and self.err == null) self.changed.wait(&self.mutex);
+        if (self.err) |err| return err;
+
+        const chunk = self.image.chunks[self.nextToDeliver];
+        return .{ .chunk = chunk, .bytes = if (chunk.type.isSparse()) &.{} else slot.output[0..@intCast(chunk.outputLen)] };
+    }
+
+    /// Returns the slot of the chunk last returned by next() to the workers.
+    pub fn release(self: *ParallelDecoder) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        self.slots[self.nextToDeliver % self.slots.len].state = .EMPTY;
+        self.nextToDeliver += 1;
+        self.changed.broadcast();
+    }
+
+    fn cancel(self: *ParallelDecoder) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        self.isCancelled = true;
+        self.changed.broadcast();
+    }
+
+    fn freeSlot(allocator: std.mem.Allocator, slot: Slot) void {
+        allocator.free(slot.input);
+        allocator.free(slot.output);
+    }
+
+    /// Worker thread entry point.
+    fn work(self: *ParallelDecoder) void {
+        var decoder = ChunkDecoder.init(self.allocator) catch |err| return self.complete(null, err);
+        defer decoder.deinit();
+
+        while (self.claim()) |index| {
+            const slot = &self.slots[index % self.slots.len];
+            self.complete(slot, self.decodeInto(&decoder, self.image.chunks[index], slot));
+        }
+    }
+
+    /// Takes the next chunk once its slot is free. Returns null when there is nothing
+    /// left to do or the job failed.
+    fn claim(self: *ParallelDecoder) ?usize {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        while (!self.isCancelled and self.err == null and self.nextToClaim < self.image.chunks.len) {
+            const slot = &self.slots[self.nextToClaim % self.slots.len];
+            if (slot.state == .EMPTY) {
+                slot.state = .DECODING;
+                self.nextToClaim += 1;
+                return self.nextToClaim - 1;
+            }
+            self.changed.wait(&self.mutex);
+        }
+
+        return null;
+    }
+
+    fn decodeInto(self: *ParallelDecoder, decoder: *ChunkDecoder, chunk: Chunk, slot: *Slot) !void {
+        if (chunk.type.isSparse()) return;
+
+        const input = slot.input[0..@intCast(chunk.inputLen)];
+        if (try self.file.preadAll(input, chunk.inputOffset) < input.len) return error.UnexpectedEndOfImage;
+        try decoder.decode(chunk.type, input, slot.output[0..@intCast(chunk.outputLen)]);
+    }
+
+    fn complete(self: *ParallelDecoder, slot: ?*Slot, result: anyerror!void) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        if (result) |_| {} else |err| {
+            if (self.err == null) self.err = err;
+        }
+        if (slot) |decoded| decoded.state = .READY;
+        self.changed.broadcast();
+    }
+};
+
+// ============================================================================
+// TESTS
+// ============================================================================
+
+const TestEntry = struct { ChunkType, u64, u64, u64, u64 };
+
+/// Encodes a mish table starting at `firstSector` with entries
+/// (type, sector, sectorCount, forkOffset, storedLength), followed by a terminator.
+fn writeTestBlockTable(writer: *std.Io.Writer, firstSector: u64, entries: []const TestEntry) !void {
+    try writer.writeAll(BLOCK_TABLE_MAGIC);
+    try writer.writeInt(u32, BLOCK_TABLE_VERSION, .big);
+    try writer.writeInt(u64, firstSector, .big);
+    try writer.writeInt(u64, 0, .big); // sector count (unused)
+    try writer.writeInt(u64, 0, .big); // data offset
+    try writer.splatByteAll(0, 200 - 32);
+    try writer.writeInt(u32, @intCast(entries.len + 1), .big);
+
+    for (entries) |entry| try writeTestBlockEntry(writer, entry);
+    try writeTestBlockEntry(writer, .{ .TERMINATOR, 0, 0, 0, 0 });
+}
+
+fn writeTestBlockEntry(writer: *std.Io.Writer, entry: TestEntry) !void {
+    try writer.writeInt(u32, @intFromEnum(entry[0]), .big);
+    try writer.writeInt(u32, 0, .big);
+    inline for (1..5) |field| try writer.writeInt(u64, entry[field], .big);
+}
+
+/// Wraps `payload` in a zlib stream made of stored deflate blocks.
+fn writeTestZlib(writer: *std.Io.Writer, payload: []const u8) !void {
+    try writer.writeAll(&.{ 0x78, 0x01 });
+
+    var rest = payload;
+    while (true) {
+        const block = rest[0..@min(rest.len, std.math.maxInt(u16))];
+        rest = rest[block.len..];
+
+        try writer.writeByte(@intFromBool(rest.len == 0));
+        try writer.writeInt(u16, @intCast(block.len), .little);
+        try writer.writeInt(u16, ~@as(u16, @intCast(block.len)), .little);
+        try writer.writeAll(block);
+        if (rest.len == 0) break;
+    }
+
+    try writer.writeInt(u32, std.hash.Adler32.hash(payload), .big);
+}
+
+/// Writes `fork`, a plist listing `tables` and a trailer for `sectorCount` sectors.
+fn writeTestContainer(dir: std.fs.Dir, name: []const u8, fork: []const u8, tables: []const []const u8, sectorCount: u64) !std.fs.File {
+    var plist: std.Io.Writer.Allocating = .init(std.testing.allocator);
+    defer plist.deinit();
+
+    try plist.writer.writeAll("<plist><dict><key>resource-fork</key><dict><key>blkx</key><array>");
+    for (tables) |table| {
+        const encoded = try std.testing.allocator.alloc(u8, std.base64.standard.Encoder.calcSize(table.len));
+        defer std.testing.allocator.free(encoded);
+        try plist.writer.print("<dict><key>Data</key><data>\n\t{s}\n</data></dict>", .{std.base64.standard.Encoder.encode(encoded, table)});
+    }
+    try plist.writer.writeAll("</array></dict></dict></plist>");
+
+    var trailer = [_]u8{0} ** TRAILER_SIZE;
+    @memcpy(trailer[0..4], TRAILER_MAGIC);
+    std.mem.writeInt(u32, trailer[4..8], TRAILER_VERSION, .big);
+    std.mem.writeInt(u32, trailer[8..12], TRAILER_SIZE, .big);
+    std.mem.writeInt(u64, trailer[32..40], fork.len, .big);
+    std.mem.writeInt(u64, trailer[216..224], fork.len, .big);
+    std.mem.writeInt(u64, trailer[224..232], plist.written().len, .big);
+    std.mem.writeInt(u64, trailer[492..500], sectorCount, .big);
+
+    const file = try dir.createFile(name, .{ .read = true });
+    errdefer file.close();
+    try file.writeAll(fork);
+    try file.writeAll(plist.written());
+    try file.writeAll(&trailer);
+    return file;
+}
+
+/// Builds a 7-sector image: RAW sector 0, zlib sectors 1-2, zero-fill 3, an uncovered
+/// sector 4, ignore 5 and an uncovered sector 6. The second table is listed first.
+fn buildTestImage(dir: std.fs.Dir, expected: *[7 * SECTOR_SIZE]u8) !std.fs.File {
+    for (expected, 0..) |*byte, i| byte.* = if (i < 3 * SECTOR_SIZE) @truncate(i *% 13 + 1) else 0;
+
+    var forkBuffer: [4 * SECTOR_SIZE]u8 = undefined;
+    var fork = std.Io.Writer.fixed(&forkBuffer);
+    try fork.writeAll(expected[0..SECTOR_SIZE]);
+    try writeTestZlib(&fork, expected[SECTOR_SIZE .. 3 * SECTOR_SIZE]);
+    const zlibLen = fork.buffered().len - SECTOR_SIZE;
+
+    var tableBuffers: [2][1024]u8 = undefined;
+    var first = std.Io.Writer.fixed(&tableBuffers[0]);
+    try writeTestBlockTable(&first, 0, &.{
+        .{ .RAW, 0, 1, 0, SECTOR_SIZE },
+        .{ .ZLIB, 1, 2, SECTOR_SIZE, zlibLen },
+        .{ .COMMENT, 3, 0, 0, 0 },
+        .{ .ZERO_FILL, 3, 1, 0, 0 },
+    });
+    var second = std.Io.Writer.fixed(&tableBuffers[1]);
+    try writeTestBlockTable(&second, 5, &.{.{ .IGNORE, 0, 1, 0, 0 }});
+
+    return writeTestContainer(dir, "image.dmg", fork.buffered(), &.{ second.buffered(), first.buffered() }, 7);
+}
+
+test "parse orders the blkx chunks and fills uncovered sectors" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    var expected: [7 * SECTOR_SIZE]u8 = undefined;
+    const file = try buildTestImage(tmp.dir, &expected);
+    defer file.close();
+
+    try std.testing.expect(detect(file));
+
+    var image = try parse(std.testing.allocator, file);
+    defer image.deinit();
+
+    const types = [_]ChunkType{ .RAW, .ZLIB, .ZERO_FILL, .ZERO_FILL, .IGNORE, .ZERO_FILL };
+    try std.testing.expectEqual(@as(usize, types.len), image.chunks.len);
+
+    var cursor: u64 = 0;
+    for (image.chunks, types) |chunk, chunkType| {
+        try std.testing.expectEqual(chunkType, chunk.type);
+        try std.testing.expectEqual(cursor, chunk.outputOffset);
+        cursor = chunk.end();
+    }
+    try std.testing.expectEqual(image.expandedSize(), cursor);
+    try std.testing.expectEqual(@as(u64, 3 * SECTOR_SIZE), image.dataBytes());
+}
+
+test "ParallelDecoder delivers expanded chunks in output order" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    var expected: [7 * SECTOR_SIZE]u8 = undefined;
+    const file = try buildTestImage(tmp.dir, &expected);
+    defer file.close();
+
+    var image = try parse(std.testing.allocator, file);
+    defer image.deinit();
+
+    var decoder: ParallelDecoder = undefined;
+    try decoder.start(std.testing.allocator, file, &image, 3);
+    defer decoder.stop();
+
+    var expanded = [_]u8{0xFF} ** (7 * SECTOR_SIZE);
+    while (try decoder.next()) |decoded| {
+        const range = expanded[@intCast(decoded.chunk.outputOffset)..@intCast(decoded.chunk.end())];
+        if (decoded.chunk.type.isSparse()) @memset(range, 0) else @memcpy(range, decoded.bytes);
+        decoder.release();
+    }
+
+    try std.testing.expectEqualSlices(u8, &expected, &expanded);
+}
+
+test "parseTrailer rejects foreign trailers" {
+    var trailer = [_]u8{0} ** TRAILER_SIZE;
+    try std.testing.expectError(error.InvalidUdif, parseTrailer(&trailer));
+
+    @memcpy(trailer[0..4], TRAILER_MAGIC);
+    std.mem.writeInt(u32, trailer[4..8], 3, .big);
+    try std.testing.expectError(error.UnsupportedUdifVersion, parseTrailer(&trailer));
+}
+
+test "benchmark: ParallelDecoder zlib chunks" {
+    try bench.skipUnlessEnabled();
+
+    const allocator = std.testing.allocator;
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    // 64 chunks of hdiutil's default 1 MiB, all pointing at one zlib stream in the fork
+    const chunkCount = 64;
+    const chunkSectors = 2048;
+
+    const payload = try allocator.alloc(u8, chunkSectors * SECTOR_SIZE);
+    defer allocator.free(payload);
+    var prng = std.Random.DefaultPrng.init(chunkCount);
+    prng.random().bytes(payload);
+
+    var fork: std.Io.Writer.Allocating = .init(allocator);
+    defer fork.deinit();
+    try writeTestZlib(&fork.writer, payload);
+
+    var entries: [chunkCount]TestEntry = undefined;
+    for (&entries, 0..) |*entry, index| entry.* = .{ .ZLIB, index * chunkSectors, chunkSectors, 0, fork.written().len };
+
+    var table: std.Io.Writer.Allocating = .init(allocator);
+    defer table.deinit();
+    try writeTestBlockTable(&table.writer, 0, &entries);
+
+    const file = try writeTestContainer(tmp.dir, "bench.dmg", fork.written(), &.{table.written()}, chunkCount * chunkSectors);
+    defer file.close();
+
+    var image = try parse(allocator, file);
+    defer image.deinit();
+
+    for ([_]usize{ 1, defaultWorkerCount() }) |workerCount| {
+        var timer = try std.time.Timer.start();
+
+        var decoder: ParallelDecoder = undefined;
+        try decoder.start(allocator, file, &image, workerCount);
+        defer decoder.stop();
+
+        var decodedBytes: u64 = 0;
+        while (try decoder.next()) |decoded| {
+            decodedBytes += decoded.bytes.len;
+            decoder.release();
+        }
+        try std.testing.expectEqual(image.expandedSize(), decodedBytes);
+
+        var labelBuffer: [64]u8 = undefined;
+        bench.report(try std.fmt.bufPrint(&labelBuffer, "UDIF zlib decode, {d} workers", .{workerCount}), decodedBytes, timer.read());
+    }
+}
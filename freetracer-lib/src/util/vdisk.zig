@@ -0,0 +1,751 @@
+//! Virtual machine disk images (qcow2, VHD, VHDX, VMDK) as flash sources.
+//!
+//! Each format stores the guest disk as allocated clusters (qcow2), blocks (VHD, VHDX)
+//! or grains (VMDK) located through an allocation table; unallocated entries read as
+//! zeros. parse() walks the table of the detected format once and returns an ExtentMap:
+//! the virtual disk as an ascending, gap-free list of extents, each either stored at a
+//! file offset or zero. Adjacent extents are merged, so an image whose clusters were
+//! allocated in order collapses into a few large reads.
+//!
+//! Supported layouts:
+//! - qcow2 v2/v3 without backing file, encryption, external data file, compressed
+//!   clusters or extended L2 entries
+//! - VHD fixed and dynamic (differencing disks need their parent)
+//! - VHDX fixed and dynamic with a clean log and no parent
+//! - VMDK monolithic sparse ("KDMV" extents) without compressed grains
+//!
+//! qcow2 and VHD fields are big-endian; VHDX and VMDK fields are little-endian.
+//! Parsing is pure data, so it runs (and is tested) on Linux hosts.
+//! ------------------------------------------------------------------------------
+const std = @import("std");
+const endian = @import("./endian.zig");
+
+/// Upper bound on an allocation table (L1, BAT, grain directory) loaded in one piece.
+pub const MAX_TABLE_SIZE = 256 * 1024 * 1024;
+
+const SECTOR_SIZE = 512;
+
+const QCOW2_MAGIC = "QFI\xfb";
+const QCOW2_HEADER_V2_SIZE = 72;
+const QCOW2_HEADER_V3_SIZE = 104;
+/// Host cluster offset bits of L1 and standard L2 entries
+const QCOW2_OFFSET_MASK: u64 = 0x00ff_ffff_ffff_fe00;
+const QCOW2_COMPRESSED_FLAG: u64 = 1 << 62;
+/// v3 only: the cluster reads as zeros regardless of its offset
+const QCOW2_ZERO_FLAG: u64 = 1;
+const QCOW2_INCOMPAT_DIRTY: u64 = 1 << 0;
+const QCOW2_INCOMPAT_CORRUPT: u64 = 1 << 1;
+/// Only changes how compressed clusters decode, and those are rejected anyway
+const QCOW2_INCOMPAT_COMPRESSION_TYPE: u64 = 1 << 3;
+
+const VHD_COOKIE = "conectix";
+const VHD_FOOTER_SIZE = 512;
+const VHD_DYNAMIC_COOKIE = "cxsparse";
+const VHD_DYNAMIC_HEADER_SIZE = 1024;
+const VHD_UNALLOCATED: u32 = 0xFFFF_FFFF;
+const VHD_TYPE_FIXED = 2;
+const VHD_TYPE_DYNAMIC = 3;
+const VHD_TYPE_DIFFERENCING = 4;
+
+const VHDX_SIGNATURE = "vhdxfile";
+const VHDX_HEADER_OFFSETS = [_]u64{ 64 * 1024, 128 * 1024 };
+const VHDX_HEADER_SIZE = 4096;
+const VHDX_REGION_TABLE_OFFSETS = [_]u64{ 192 * 1024, 256 * 1024 };
+const VHDX_TABLE_SIZE = 64 * 1024;
+const VHDX_MAX_REGION_ENTRIES = 2047;
+const VHDX_MAX_METADATA_ENTRIES = 2047;
+const VHDX_MB = 1024 * 1024;
+/// Region and metadata item GUIDs, in their on-disk (mixed-endian) byte order
+const VHDX_BAT_GUID = [16]u8{ 0x66, 0x77, 0xC2, 0x2D, 0x23, 0xF6, 0x00, 0x42, 0x9D, 0x64, 0x11, 0x5E, 0x9B, 0xFD, 0x4A, 0x08 };
+const VHDX_METADATA_GUID = [16]u8{ 0x06, 0xA2, 0x7C, 0x8B, 0x90, 0x47, 0x9A, 0x4B, 0xB8, 0xFE, 0x57, 0x5F, 0x05, 0x0F, 0x88, 0x6E };
+const VHDX_FILE_PARAMETERS_GUID = [16]u8{ 0x37, 0x67, 0xA1, 0xCA, 0x36, 0xFA, 0x43, 0x4D, 0xB3, 0xB6, 0x33, 0xF0, 0xAA, 0x44, 0xE7, 0x6B };
+const VHDX_VIRTUAL_DISK_SIZE_GUID = [16]u8{ 0x24, 0x42, 0xA5, 0x2F, 0x1B, 0xCD, 0x76, 0x48, 0xB2, 0x11, 0x5D, 0xBE, 0xD8, 0x3B, 0xF4, 0xB8 };
+const VHDX_LOGICAL_SECTOR_SIZE_GUID = [16]u8{ 0x1D, 0xBF, 0x41, 0x81, 0x6F, 0xA9, 0x09, 0x47, 0xBA, 0x47, 0xF2, 0x33, 0xA8, 0xFA, 0xAB, 0x5F };
+const VHDX_HAS_PARENT_FLAG: u32 = 1 << 1;
+const VHDX_METADATA_REQUIRED_FLAG: u32 = 1 << 2;
+
+const VMDK_MAGIC = "KDMV";
+const VMDK_HEADER_SIZE = 512;
+const VMDK_COMPRESSED_FLAG: u32 = 1 << 16;
+/// Stream-optimized images keep their grain directory in a footer
+const VMDK_GD_AT_END: u64 = 0xFFFF_FFFF_FFFF_FFFF;
+/// Grain table entry of a grain that reads as zeros (version 2 and later)
+const VMDK_ZERO_GRAIN: u32 = 1;
+/// Largest grain accepted (32 MiB), far above the 64 KiB that VMware writes
+const VMDK_MAX_GRAIN_SECTORS: u64 = 1 << 16;
+
+pub const Format = enum {
+    QCOW2,
+    VHD,
+    VHDX,
+    VMDK,
+};
+
+pub const VirtualDiskError = error{
+    InvalidVirtualDisk,
+    UnsupportedVirtualDiskVersion,
+    UnsupportedVirtualDiskFeature,
+    VirtualDiskTableTooLarge,
+};
+
+/// A run of the virtual disk: stored contiguously in the image file, or unallocated.
+pub const Extent = struct {
+    outputOffset: u64,
+    len: u64,
+    /// File offset of the stored bytes; null for unallocated ranges, which read as zeros
+    fileOffset: ?u64,
+
+    pub fn end(self: Extent) u64 {
+        return self.outputOffset + self.len;
+    }
+};
+
+pub const ExtentMap = struct {
+    allocator: std.mem.Allocator,
+    format: Format,
+    virtualSize: u64,
+    /// Ascending, contiguous, covering [0, virtualSize)
+    extents: []Extent,
+
+    pub fn deinit(self: *ExtentMap) void {
+        self.allocator.free(self.extents);
+    }
+
+    /// Bytes stored in the image; the rest of the virtual disk is sparse.
+    pub fn dataBytes(self: *const ExtentMap) u64 {
+        var total: u64 = 0;
+        for (self.extents) |extent| {
+            if (extent.fileOffset != null) total += extent.len;
+        }
+        return total;
+    }
+};
+
+/// Classifies `file` by its leading magic (qcow2, VHDX, VMDK) or its trailing footer (VHD).
+/// Read errors classify as not a virtual disk.
+pub fn detect(file: std.fs.File) ?Format {
+    var head: [8]u8 = undefined;
+    if ((file.preadAll(&head, 0) catch return null) == head.len) {
+        if (std.mem.eql(u8, head[0..4], QCOW2_MAGIC)) return .QCOW2;
+        if (std.mem.eql(u8, &head, VHDX_SIGNATURE)) return .VHDX;
+        if (std.mem.eql(u8, head[0..4], VMDK_MAGIC)) return .VMDK;
+    }
+
+    // Fixed VHDs are a raw disk plus footer, so the footer is the only reliable mark
+    const size = (file.stat() catch return null).size;
+    if (size < VHD_FOOTER_SIZE) return null;
+
+    var cookie: [8]u8 = undefined;
+    if ((file.preadAll(&cookie, size - VHD_FOOTER_SIZE) catch return null) < cookie.len) return null;
+    return if (std.mem.eql(u8, &cookie, VHD_COOKIE)) .VHD else null;
+}
+
+/// Maps the allocation table of `file` to extents. The extents are owned by `allocator`.
+///
+/// `Errors`:
+///   error.InvalidVirtualDisk: no known format, bad checksums, or tables and data
+///     pointing outside the file
+///   error.UnsupportedVirtualDiskVersion: unknown qcow2 or VHDX version
+///   error.UnsupportedVirtualDiskFeature: backing/parent disks, encryption, compressed
+///     clusters or grains, a VHDX log that needs replay
+///   error.VirtualDiskTableTooLarge: an allocation table exceeds MAX_TABLE_SIZE
+pub fn parse(allocator: std.mem.Allocator, file: std.fs.File) !ExtentMap {
+    const fileSize = (try file.stat()).size;
+    const format = detect(file) orelse return error.InvalidVirtualDisk;
+
+    var builder = ExtentBuilder{ .allocator = allocator, .fileSize = fileSize };
+    errdefer builder.deinit();
+
+    const virtualSize = switch (format) {
+        .QCOW2 => try mapQcow2(allocator, file, &builder),
+        .VHD => try mapVhd(allocator, file, &builder),
+        .VHDX => try mapVhdx(allocator, file, &builder),
+        .VMDK => try mapVmdk(allocator, file, &builder),
+    };
+
+    return builder.finish(format, virtualSize);
+}
+
+/// Appends extents in output order, merging each with its predecessor when both are
+/// unallocated or stored back to back in the file.
+const ExtentBuilder = struct {
+    allocator: std.mem.Allocator,
+    fileSize: u64,
+    extents: std.ArrayList(Extent) = .empty,
+    cursor: u64 = 0,
+
+    fn deinit(self: *ExtentBuilder) void {
+        self.extents.deinit(self.allocator);
+    }
+
+    /// Appends [cursor, cursor + len), stored at `fileOffset` or zero when null.
+    fn push(self: *ExtentBuilder, len: u64, fileOffset: ?u64) !void {
+        if (len == 0) return;
+        if (fileOffset) |offset| {
+            if (offset > self.fileSize or len > self.fileSize - offset) return error.InvalidVirtualDisk;
+        }
+
+        defer self.cursor += len;
+
+        if (self.extents.items.len > 0) {
+            const last = &self.extents.items[self.extents.items.len - 1];
+            const isAdjacent = if (last.fileOffset) |lastOffset|
+                fileOffset != null and lastOffset + last.len == fileOffset.?
+            else
+                fileOffset == null;
+
+            if (isAdjacent) {
+                last.len += len;
+                return;
+            }
+        }
+
+        try self.extents.append(self.allocator, .{ .outputOffset = self.cursor, .len = len, .fileOffset = fileOffset });
+    }
+
+    /// Pads the map with zeros up to `virtualSize` and hands the extents over.
+    fn finish(self: *ExtentBuilder, format: Format, virtualSize: u64) !ExtentMap {
+        if (self.cursor > virtualSize) return error.InvalidVirtualDisk;
+        try self.push(virtualSize - self.cursor, null);
+
+        return .{
+            .allocator = self.allocator,
+            .format = format,
+            .virtualSize = virtualSize,
+            .extents = try self.extents.toOwnedSlice(self.allocator),
+        };
+    }
+};
+
+/// Reads exactly `buffer.len` bytes at `offset`; a short read means a truncated image.
+fn readExact(file: std.fs.File, buffer: []u8, offset: u64) !void {
+    if (try file.preadAll(buffer, offset) < buffer.len) return error.InvalidVirtualDisk;
+}
+
+/// Loads a `len`-byte allocation table at `offset`. Owned by `allocator`.
+fn readTable(allocator: std.mem.Allocator, file: std.fs.File, offset: u64, len: u64) ![]u8 {
+    if (len > MAX_TABLE_SIZE) return error.VirtualDiskTableTooLarge;
+
+    const table = try allocator.alloc(u8, @intCast(len));
+    errdefer allocator.free(table);
+    try readExact(file, table, offset);
+    return table;
+}
+
+fn isPowerOfTwo(value: u64) bool {
+    return value != 0 and value & (value - 1) == 0;
+}
+
+// --- qcow2 ------------------------------------------------------------------
+
+/// Maps the two-level L1/L2 cluster table. Returns the virtual size.
+fn mapQcow2(allocator: std.mem.Allocator, file: std.fs.File, builder: *ExtentBuilder) !u64 {
+    var header = [_]u8{0} ** QCOW2_HEADER_V3_SIZE;
+    const headerLen = try file.preadAll(&header, 0);
+    if (headerLen < QCOW2_HEADER_V2_SIZE) return error.InvalidVirtualDisk;
+
+    const version = endian.readBig(u32, header[4..8]);
+    if (version != 2 and version != 3) return error.UnsupportedVirtualDiskVersion;
+
+    const clusterBits = endian.readBig(u32, header[20..24]);
+    const virtualSize = endian.readBig(u64, header[24..32]);
+    const l1Size = endian.readBig(u32, header[36..40]);
+    const l1Offset = endian.readBig(u64, header[40..48]);
+
+    if (clusterBits < 9 or clusterBits > 21) return error.InvalidVirtualDisk;
+    // Unallocated clusters would have to be read from the backing file
+    if (endian.readBig(u64, header[8..16]) != 0) return error.UnsupportedVirtualDiskFeature;
+    if (endian.readBig(u32, header[32..36]) != 0) return error.UnsupportedVirtualDiskFeature;
+
+    if (version == 3) {
+        if (headerLen < QCOW2_HEADER_V3_SIZE) return error.InvalidVirtualDisk;
+
+        // A dirty image only has stale refcounts; the cluster tables are still valid
+        const incompatible = endian.readBig(u64, header[72..80]);
+        if (incompatible & QCOW2_INCOMPAT_CORRUPT != 0) return error.InvalidVirtualDisk;
+        if (incompatible & ~(QCOW2_INCOMPAT_DIRTY | QCOW2_INCOMPAT_COMPRESSION_TYPE) != 0) return error.UnsupportedVirtualDiskFeature;
+    }
+
+    const clusterSize = @as(u64, 1) << @intCast(clusterBits);
+    const l2Entries = clusterSize / 8;
+    const l1Needed = try std.math.divCeil(u64, try std.math.divCeil(u64, virtualSize, clusterSize), l2Entries);
+    if (l1Size < l1Needed) return error.InvalidVirtualDisk;
+
+    const l1 = try readTable(allocator, file, l1Offset, l1Needed * 8);
+    defer allocator.free(l1);
+
+    const l2 = try allocator.alloc(u8, @intCast(clusterSize));
+    defer allocator.free(l2);
+
+    for (0..@intCast(l1Needed)) |l1Index| {
+        const l2Offset = endian.readBig(u64, l1[l1Index * 8 ..][0..8]) & QCOW2_OFFSET_MASK;
+
+        if (l2Offset == 0) {
+            try builder.push(@min(l2Entries * clusterSize, virtualSize - builder.cursor), null);
+            continue;
+        }
+
+        try readExact(file, l2, l2Offset);
+
+        for (0..@intCast(l2Entries)) |l2Index| {
+            if (builder.cursor >= virtualSize) break;
+
+            const entry = endian.readBig(u64, l2[l2Index * 8 ..][0..8]);
+            if (entry & QCOW2_COMPRESSED_FLAG != 0) return error.UnsupportedVirtualDiskFeature;
+
+            const hostOffset = entry & QCOW2_OFFSET_MASK;
+            const readsZero = hostOffset == 0 or (version == 3 and entry & QCOW2_ZERO_FLAG != 0);
+            try builder.push(@min(clusterSize, virtualSize - builder.cursor), if (readsZero) null else hostOffset);
+        }
+    }
+
+    return virtualSize;
+}
+
+// --- VHD --------------------------------------------------------------------
+
+/// One's complement of the byte sum of `bytes`, skipping the 4-byte checksum field.
+fn vhdChecksum(bytes: []const u8, checksumOffset: usize) u32 {
+    var sum: u32 = 0;
+    for (bytes, 0..) |byte, i| {
+        if (i >= checksumOffset and i < checksumOffset + 4) continue;
+        sum +%= byte;
+    }
+    return ~sum;
+}
+
+/// Maps a fixed VHD (one extent) or the block allocation table and sector bitmaps of a
+/// dynamic one. Returns the virtual size.
+fn mapVhd(allocator: std.mem.Allocator, file: std.fs.File, builder: *ExtentBuilder) !u64 {
+    if (builder.fileSize < VHD_FOOTER_SIZE) return error.InvalidVirtualDisk;
+
+    var footer: [VHD_FOOTER_SIZE]u8 = undefined;
+    try readExact(file, &footer, builder.fileSize - VHD_FOOTER_SIZE);
+    if (!std.mem.eql(u8, footer[0..8], VHD_COOKIE)) return error.InvalidVirtualDisk;
+    if (endian.readBig(u32, footer[64..68]) != vhdChecksum(&footer, 64)) return error.InvalidVirtualDisk;
+
+    const virtualSize = endian.readBig(u64, footer[48..56]);
+
+    switch (endian.readBig(u32, footer[60..64])) {
+        VHD_TYPE_FIXED => {
+            if (virtualSize > builder.fileSize - VHD_FOOTER_SIZE) return error.InvalidVirtualDisk;
+            try builder.push(virtualSize, 0);
+        },
+        VHD_TYPE_DYNAMIC => try mapVhdBlocks(allocator, file, builder, endian.readBig(u64, footer[16..24]), virtualSize),
+        VHD_TYPE_DIFFERENCING => return error.UnsupportedVirtualDiskFeature,
+        else => return error.InvalidVirtualDisk,
+    }
+
+    return virtualSize;
+}
+
+fn mapVhdBlocks(allocator: std.mem.Allocator, file: std.fs.File, builder: *ExtentBuilder, headerOffset: u64, virtualSize: u64) !void {
+    var header: [VHD_DYNAMIC_HEADER_SIZE]u8 = undefined;
+    try readExact(file, &header, headerOffset);
+    if (!std.mem.eql(u8, header[0..8], VHD_DYNAMIC_COOKIE)) return error.InvalidVirtualDisk;
+    if (endian.readBig(u32, header[36..40]) != vhdChecksum(&header, 36)) return error.InvalidVirtualDisk;
+
+    const tableOffset = endian.readBig(u64, header[16..24]);
+    const maxTableEntries = endian.readBig(u32, header[28..32]);
+    const blockSize: u64 = endian.readBig(u32, header[32..36]);
+    if (!isPowerOfTwo(blockSize) or blockSize < SECTOR_SIZE) return error.InvalidVirtualDisk;
+
+    const blockCount = try std.math.divCeil(u64, virtualSize, blockSize);
+    if (blockCount > maxTableEntries) return error.InvalidVirtualDisk;
+
+    const table = try readTable(allocator, file, tableOffset, blockCount * 4);
+    defer allocator.free(table);
+
+    // Each block starts with a bitmap of its present sectors, padded to whole sectors
+    const sectorsPerBlock = blockSize / SECTOR_SIZE;
+    const bitmapSize = std.mem.alignForward(u64, try std.math.divCeil(u64, sectorsPerBlock, 8), SECTOR_SIZE);
+    const bitmap = try allocator.alloc(u8, @intCast(bitmapSize));
+    defer allocator.free(bitmap);
+
+    for (0..@intCast(blockCount)) |blockIndex| {
+        const len = @min(blockSize, virtualSize - builder.cursor);
+        const entry = endian.readBig(u32, table[blockIndex * 4 ..][0..4]);
+
+        if (entry == VHD_UNALLOCATED) {
+            try builder.push(len, null);
+            continue;
+        }
+
+        const blockStart = @as(u64, entry) * SECTOR_SIZE;
+        const dataStart = blockStart + bitmapSize;
+        try readExact(file, bitmap, blockStart);
+
+        const sectorCount: usize = @intCast(try std.math.divCeil(u64, len, SECTOR_SIZE));
+        if (sectorCount % 8 == 0 and std.mem.allEqual(u8, bitmap[0 .. sectorCount / 8], 0xFF)) {
+            try builder.push(len, dataStart);
+            continue;
+        }
+
+        for (0..sectorCount) |sector| {
+            const isPresent = (bitmap[sector / 8] >> @intCast(7 - sector % 8)) & 1 != 0;
+            const sectorOffset = @as(u64, sector) * SECTOR_SIZE;
+            try builder.push(@min(SECTOR_SIZE, len - sectorOffset), if (isPresent) dataStart + sectorOffset else null);
+        }
+    }
+}
+
+// --- VHDX -------------------------------------------------------------------
+
+/// Verifies the CRC-32C of a VHDX structure whose checksum sits at bytes 4..8.
+/// Zeroes the checksum field in `bytes` as a side effect.
+fn isVhdxChecksumValid(bytes: []u8) bool {
+    const stored = endian.readLittle(u32, bytes[4..8]);
+    @memset(bytes[4..8], 0);
+    return std.hash.crc.Crc32Iscsi.hash(bytes) == stored;
+}
+
+const VhdxRegions = struct {
+    batOffset: u64 = 0,
+    batLen: u64 = 0,
+    metadataOffset: u64 = 0,
+};
+
+/// Maps the payload blocks listed in the VHDX block allocation table. Returns the virtual size.
+fn mapVhdx(allocator: std.mem.Allocator, file: std.fs.File, builder: *ExtentBuilder) !u64 {
+    try checkVhdxHeader(file);
+
+    const buffer = try allocator.alloc(u8, VHDX_TABLE_SIZE);
+    defer allocator.free(buffer);
+
+    const regions = try readVhdxRegions(file, buffer);
+    if (regions.batLen == 0 or regions.metadataOffset == 0) return error.InvalidVirtualDisk;
+
+    // Metadata table, then the three items needed to size the disk and its blocks
+    try readExact(file, buffer, regions.metadataOffset);
+    if (!std.mem.eql(u8, buffer[0..8], "metadata")) return error.InvalidVirtualDisk;
+
+    const entryCount = endian.readLittle(u16, buffer[10..12]);
+    if (entryCount > VHDX_MAX_METADATA_ENTRIES) return error.InvalidVirtualDisk;
+
+    var blockSize: ?u64 = null;
+    var virtualSize: ?u64 = null;
+    var logicalSectorSize: ?u64 = null;
+
+    for (0..entryCount) |index| {
+        const entry = buffer[32 + index * 32 ..][0..32];
+        const itemOffset = regions.metadataOffset + endian.readLittle(u32, entry[16..20]);
+        const flags = endian.readLittle(u32, entry[24..28]);
+
+        var value: [8]u8 = undefined;
+        if (std.mem.eql(u8, entry[0..16], &VHDX_FILE_PARAMETERS_GUID)) {
+            try readExact(file, &value, itemOffset);
+            if (endian.readLittle(u32, value[4..8]) & VHDX_HAS_PARENT_FLAG != 0) return error.UnsupportedVirtualDiskFeature;
+            blockSize = @as(u64, endian.readLittle(u32, value[0..4]));
+        } else if (std.mem.eql(u8, entry[0..16], &VHDX_VIRTUAL_DISK_SIZE_GUID)) {
+            try readExact(file, &value, itemOffset);
+            virtualSize = endian.readLittle(u64, &value);
+        } else if (std.mem.eql(u8, entry[0..16], &VHDX_LOGICAL_SECTOR_SIZE_GUID)) {
+            try readExact(file, value[0..4], itemOffset);
+            logicalSectorSize = @as(u64, endian.readLittle(u32, value[0..4]));
+        } else if (flags & VHDX_METADATA_REQUIRED_FLAG != 0) {
+            // Physical sector size and page 83 data are optional; anything required and unknown is not
+            if (!isKnownOptionalVhdxItem(entry[0..16])) return error.UnsupportedVirtualDiskFeature;
+        }
+    }
+
+    const block = blockSize orelse return error.InvalidVirtualDisk;
+    const size = virtualSize orelse return error.InvalidVirtualDisk;
+    const sector = logicalSectorSize orelse return error.InvalidVirtualDisk;
+    if (!isPowerOfTwo(block) or block < VHDX_MB or block > 256 * VHDX_MB) return error.InvalidVirtualDisk;
+    if (sector != 512 and sector != 4096) return error.InvalidVirtualDisk;
+
+    // Every `chunkRatio` payload entries are followed by one sector bitmap entry
+    const chunkRatio = (@as(u64, 1) << 23) * sector / block;
+    const blockCount = try std.math.divCeil(u64, size, block);
+    const entriesNeeded = blockCount + (blockCount -| 1) / chunkRatio;
+    if (entriesNeeded * 8 > regions.batLen) return error.InvalidVirtualDisk;
+
+    const bat = try readTable(allocator, file, regions.batOffset, entriesNeeded * 8);
+    defer allocator.free(bat);
+
+    for (0..@intCast(blockCount)) |blockIndex| {
+        const batIndex = blockIndex + blockIndex / @as(usize, @intCast(chunkRatio));
+        const entry = endian.readLittle(u64, bat[batIndex * 8 ..][0..8]);
+        const len = @min(block, size - builder.cursor);
+
+        switch (@as(u3, @truncate(entry))) {
+            // NOT_PRESENT, UNDEFINED, ZERO, UNMAPPED: no payload, reads as zeros
+            0, 1, 2, 3 => try builder.push(len, null),
+            // FULLY_PRESENT
+            6 => try builder.push(len, std.math.mul(u64, entry >> 20, VHDX_MB) catch return error.InvalidVirtualDisk),
+            // PARTIALLY_PRESENT only occurs in differencing disks
+            7 => return error.UnsupportedVirtualDiskFeature,
+            else => return error.InvalidVirtualDisk,
+        }
+    }
+
+    return size;
+}
+
+/// Physical sector size and page 83 data: informational items flagged as required.
+fn isKnownOptionalVhdxItem(guid: *const [16]u8) bool {
+    const physicalSectorSize = [16]u8{ 0xC7, 0x48, 0xA3, 0xCD, 0x5D, 0x44, 0x71, 0x44, 0x9C, 0xC9, 0xE9, 0x88, 0x52, 0x51, 0xC5, 0x56 };
+    const page83Data = [16]u8{ 0xAB, 0x12, 0xCA, 0xBE, 0xE6, 0xB2, 0x23, 0x45, 0x93, 0xEF, 0xC3, 0x09, 0xE0, 0x00, 0xC7, 0x46 };
+    return std.mem.eql(u8, guid, &physicalSectorSize) or std.mem.eql(u8, guid, &page83Data);
+}
+
+/// Picks the current of the two VHDX headers (valid, highest sequence number) and
+/// refuses images whose log still holds unreplayed writes.
+fn checkVhdxHeader(file: std.fs.File) !void {
+    var bestSequence: ?u64 = null;
+    var isLogActive = false;
+    var version: u16 = 0;
+
+    for (VHDX_HEADER_OFFSETS) |offset| {
+        var header: [VHDX_HEADER_SIZE]u8 = undefined;
+        try readExact(file, &header, offset);
+        if (!std.mem.eql(u8, header[0..4], "head") or !isVhdxChecksumValid(&header)) continue;
+
+        const sequence = endian.readLittle(u64, header[8..16]);
+        if (bestSequence != null and sequence <= bestSequence.?) continue;
+
+        bestSequence = sequence;
+        isLogActive = !std.mem.allEqual(u8, header[48..64], 0);
+        version = endian.readLittle(u16, header[66..68]);
+    }
+
+    if (bestSequence == null) return error.InvalidVirtualDisk;
+    if (version != 1) return error.UnsupportedVirtualDiskVersion;
+    // Replaying the log would mean writing to the source image
+    if (isLogActive) return error.UnsupportedVirtualDiskFeature;
+}
+
+/// Reads the first valid copy of the region table into `buffer` and locates the BAT and
+/// metadata regions.
+fn readVhdxRegions(file: std.fs.File, buffer: []u8) !VhdxRegions {
+    for (VHDX_REGION_TABLE_OFFSETS) |offset| {
+        try readExact(file, buffer, offset);
+        if (!std.mem.eql(u8, buffer[0..4], "regi") or !isVhdxChecksumValid(buffer)) continue;
+
+        const entryCount = endian.readLittle(u32, buffer[8..12]);
+        if (entryCount > VHDX_MAX_REGION_ENTRIES) return error.InvalidVirtualDisk;
+
+        var regions = VhdxRegions{};
+        for (0..entryCount) |index| {
+            const entry = buffer[16 + index * 32 ..][0..32];
+            const regionOffset = endian.readLittle(u64, entry[16..24]);
+            const regionLen = endian.readLittle(u32, entry[24..28]);
+
+            if (std.mem.eql(u8, entry[0..16], &VHDX_BAT_GUID)) {
+                regions.batOffset = regionOffset;
+                regions.batLen = regionLen;
+            } else if (std.mem.eql(u8, entry[0..16], &VHDX_METADATA_GUID)) {
+                regions.metadataOffset = regionOffset;
+            } else if (endian.readLittle(u32, entry[28..32]) & 1 != 0) {
+                return error.UnsupportedVirtualDiskFeature;
+            }
+        }
+        return regions;
+    }
+
+    return error.InvalidVirtualDisk;
+}
+
+// --- VMDK -------------------------------------------------------------------
+
+/// Maps the grain directory and grain tables of a monolithic sparse extent. Returns the
+/// virtual size.
+fn mapVmdk(allocator: std.mem.Allocator, file: std.fs.File, builder: *ExtentBuilder) !u64 {
+    var header: [VMDK_HEADER_SIZE]u8 = undefined;
+    try readExact(file, &header, 0);
+
+    const version = endian.readLittle(u32, header[4..8]);
+    if (version < 1 or version > 3) return error.UnsupportedVirtualDiskVersion;
+
+    const flags = endian.readLittle(u32, header[8..12]);
+    const capacity = endian.readLittle(u64, header[12..20]);
+    const grainSectors = endian.readLittle(u64, header[20..28]);
+    const tableEntries: u64 = endian.readLittle(u32, header[44..48]);
+    const directoryOffset = endian.readLittle(u64, header[56..64]);
+    const compressAlgorithm = endian.readLittle(u16, header[77..79]);
+
+    if (flags & VMDK_COMPRESSED_FLAG != 0 or compressAlgorithm != 0 or directoryOffset == VMDK_GD_AT_END) return error.UnsupportedVirtualDiskFeature;
+    if (!isPowerOfTwo(grainSectors) or grainSectors < 8 or grainSectors > VMDK_MAX_GRAIN_SECTORS or tableEntries == 0) return error.InvalidVirtualDisk;
+
+    const virtualSize = std.math.mul(u64, capacity, SECTOR_SIZE) catch return error.InvalidVirtualDisk;
+    const grainSize = std.math.mul(u64, grainSectors, SECTOR_SIZE) catch return error.InvalidVirtualDisk;
+    const tableSpan = std.math.mul(u64, tableEntries, grainSize) catch return error.InvalidVirtualDisk;
+    if (tableEntries * 4 > MAX_TABLE_SIZE) return error.VirtualDiskTableTooLarge;
+    const grainCount = try std.math.divCeil(u64, capacity, grainSectors);
+    const tableCount = try std.math.divCeil(u64, grainCount, tableEntries);
+
+    const directory = try readTable(allocator, file, std.math.mul(u64, directoryOffset, SECTOR_SIZE) catch return error.InvalidVirtualDisk, tableCount * 4);
+    defer allocator.free(directory);
+
+    const grainTable = try allocator.alloc(u8, @intCast(tableEntries * 4));
+    defer allocator.free(grainTable);
+
+    for (0..@intCast(tableCount)) |tableIndex| {
+        const tableSector = endian.readLittle(u32, directory[tableIndex * 4 ..][0..4]);
+
+        if (tableSector == 0) {
+            try builder.push(@min(tableSpan, virtualSize - builder.cursor), null);
+            continue;
+        }
+
+        try readExact(file, grainTable, @as(u64, tableSector) * SECTOR_SIZE);
+
+        for (0..@intCast(tableEntries)) |entryIndex| {
+            if (builder.cursor >= virtualSize) break;
+
+            const grainSector = endian.readLittle(u32, grainTable[entryIndex * 4 ..][0..4]);
+            const readsZero = grainSector == 0 or grainSector == VMDK_ZERO_GRAIN;
+            try builder.push(@min(grainSize, virtualSize - builder.cursor), if (readsZero) null else @as(u64, grainSector) * SECTOR_SIZE);
+        }
+    }
+
+    return virtualSize;
+}
+
+// ============================================================================
+// TESTS
+// ============================================================================
+
+fn expectExtents(expected: []const Extent, actual: []const Extent) !void {
+    try std.testing.expectEqual(expected.len, actual.len);
+    for (expected, actual) |want, got| try std.testing.expectEqualDeep(want, got);
+}
+
+test "qcow2 clusters map to data and zero extents" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    // 512-byte clusters: header, L1, L2, then two data clusters stored out of order
+    var image = [_]u8{0} ** (5 * 512);
+    @memcpy(image[0..4], QCOW2_MAGIC);
+    std.mem.writeInt(u32, image[4..8], 3, .big);
+    std.mem.writeInt(u32, image[20..24], 9, .big);
+    std.mem.writeInt(u64, image[24..32], 4 * 512, .big);
+    std.mem.writeInt(u32, image[36..40], 1, .big);
+    std.mem.writeInt(u64, image[40..48], 512, .big);
+    std.mem.writeInt(u32, image[100..104], QCOW2_HEADER_V3_SIZE, .big);
+    std.mem.writeInt(u64, image[512..520], 1024, .big);
+    std.mem.writeInt(u64, image[1024..1032], 4 * 512, .big);
+    std.mem.writeInt(u64, image[1032..1040], 3 * 512, .big);
+    std.mem.writeInt(u64, image[1048..1056], (4 * 512) | QCOW2_ZERO_FLAG, .big);
+
+    const file = try tmp.dir.createFile("disk.qcow2", .{ .read = true });
+    defer file.close();
+    try file.writeAll(&image);
+
+    try std.testing.expectEqual(Format.QCOW2, detect(file).?);
+
+    var map = try parse(std.testing.allocator, file);
+    defer map.deinit();
+
+    try expectExtents(&.{
+        .{ .outputOffset = 0, .len = 512, .fileOffset = 4 * 512 },
+        .{ .outputOffset = 512, .len = 512, .fileOffset = 3 * 512 },
+        .{ .outputOffset = 1024, .len = 1024, .fileOffset = null },
+    }, map.extents);
+    try std.testing.expectEqual(@as(u64, 1024), map.dataBytes());
+
+    // Compressed clusters are refused rather than written as garbage
+    var compressed: [8]u8 = undefined;
+    std.mem.writeInt(u64, &compressed, QCOW2_COMPRESSED_FLAG | 4 * 512, .big);
+    try file.pwriteAll(&compressed, 1040);
+    try std.testing.expectError(error.UnsupportedVirtualDiskFeature, parse(std.testing.allocator, file));
+}
+
+test "dynamic VHD blocks follow their sector bitmaps" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    // Footer copy, dynamic header, BAT, one 2 KiB block (bitmap + 4 sectors), footer
+    var image = [_]u8{0} ** (512 + 1024 + 512 + 512 + 2048 + 512);
+    const footer = image[image.len - VHD_FOOTER_SIZE ..];
+    @memcpy(footer[0..8], VHD_COOKIE);
+    std.mem.writeInt(u64, footer[16..24], 512, .big);
+    std.mem.writeInt(u64, footer[48..56], 4096, .big);
+    std.mem.writeInt(u32, footer[60..64], VHD_TYPE_DYNAMIC, .big);
+    std.mem.writeInt(u32, footer[64..68], vhdChecksum(footer, 64), .big);
+    @memcpy(image[0..512], footer);
+
+    const header = image[512..1536];
+    @memcpy(header[0..8], VHD_DYNAMIC_COOKIE);
+    std.mem.writeInt(u64, header[16..24], 1536, .big);
+    std.mem.writeInt(u32, header[28..32], 2, .big);
+    std.mem.writeInt(u32, header[32..36], 2048, .big);
+    std.mem.writeInt(u32, header[36..40], vhdChecksum(header, 36), .big);
+
+    // Block 0 at sector 4 holds sectors 0, 2 and 3; block 1 is unallocated
+    std.mem.writeInt(u32, image[1536..1540], 4, .big);
+    std.mem.writeInt(u32, image[1540..1544], VHD_UNALLOCATED, .big);
+    image[2048] = 0b1011_0000;
+
+    const file = try tmp.dir.createFile("disk.vhd", .{ .read = true });
+    defer file.close();
+    try file.writeAll(&image);
+
+    try std.testing.expectEqual(Format.VHD, detect(file).?);
+
+    var map = try parse(std.testing.allocator, file);
+    defer map.deinit();
+
+    try expectExtents(&.{
+        .{ .outputOffset = 0, .len = 512, .fileOffset = 2560 },
+        .{ .outputOffset = 512, .len = 512, .fileOffset = null },
+        .{ .outputOffset = 1024, .len = 1024, .fileOffset = 3584 },
+        .{ .outputOffset = 2048, .len = 2048, .fileOffset = null },
+    }, map.extents);
+}
+
+test "VMDK grains map through the grain directory" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    // Two 4 KiB grains: directory at sector 1, grain table at sector 2, grain 0 at sector 8
+    var image = [_]u8{0} ** (8 * 512 + 4096);
+    @memcpy(image[0..4], VMDK_MAGIC);
+    std.mem.writeInt(u32, image[4..8], 1, .little);
+    std.mem.writeInt(u64, image[12..20], 16, .little);
+    std.mem.writeInt(u64, image[20..28], 8, .little);
+    std.mem.writeInt(u32, image[44..48], 4, .little);
+    std.mem.writeInt(u64, image[56..64], 1, .little);
+    std.mem.writeInt(u32, image[512..516], 2, .little);
+    std.mem.writeInt(u32, image[1024..1028], 8, .little);
+
+    const file = try tmp.dir.createFile("disk.vmdk", .{ .read = true });
+    defer file.close();
+    try file.writeAll(&image);
+
+    try std.testing.expectEqual(Format.VMDK, detect(file).?);
+
+    var map = try parse(std.testing.allocator, file);
+    defer map.deinit();
+
+    try expectExtents(&.{
+        .{ .outputOffset = 0, .len = 4096, .fileOffset = 4096 },
+        .{ .outputOffset = 4096, .len = 4096, .fileOffset = null },
+    }, map.extents);
+    try std.testing.expectEqual(@as(u64, 8192), map.virtualSize);
+}
+
+test "VMDK headers with oversized grains or grain tables are rejected" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    var image = [_]u8{0} ** (4 * 512);
+    @memcpy(image[0..4], VMDK_MAGIC);
+    std.mem.writeInt(u32, image[4..8], 1, .little);
+    std.mem.writeInt(u64, image[12..20], 16, .little);
+    std.mem.writeInt(u64, image[20..28], VMDK_MAX_GRAIN_SECTORS * 2, .little);
+    std.mem.writeInt(u32, image[44..48], 4, .little);
+    std.mem.writeInt(u64, image[56..64], 1, .little);
+
+    const file = try tmp.dir.createFile("disk.vmdk", .{ .read = true });
+    defer file.close();
+    try file.writeAll(&image);
+    try std.testing.expectError(error.InvalidVirtualDisk, parse(std.testing.allocator, file));
+
+    // A valid grain size but a grain table larger than MAX_TABLE_SIZE
+    std.mem.writeInt(u64, image[20..28], 8, .little);
+    std.mem.writeInt(u32, image[44..48], std.math.maxInt(u32), .little);
+    try file.pwriteAll(&image, 0);
+    try std.testing.expectError(error.VirtualDiskTableTooLarge, parse(std.testing.allocator, file));
+}
@@ -20,6 +20,7 @@
 //!   - INITIAL_PING: Heartbeat; responds with INITIAL_PONG.
 //!   - GET_HELPER_VERSION: Fetch helper version string; responds with HELPER_VERSION_OBTAINED.
 //!   - WRITE_ISO_TO_DEVICE: Write image to device with optional verification & eject.
+//!   - WRITE_IMAGE_TO_DEVICES: Fan-out write of one image to several devices with optional eject.
 //!
 //! Response codes are defined in `freetracer_lib.constants.HelperResponseCode`:
 //!   - ISO_FILE_VALID, DEVICE_VALID, ISO_WRITE_SUCCESS, etc. (see constants.zig)
@@ -37,11 +38,16 @@ const std = @import("std");
 const builtin = @import("builtin");
 const env = @import("env.zig");
 const fsops = @import("util/filesystem.zig");
+const pipeline = @import("util/pipeline.zig");
+const digestlog = @import("util/digestlog.zig");
+const quickverify = @import("util/quickverify.zig");
+const repair = @import("util/repair.zig");
 const str = @import("util/strings.zig");
 const testing = std.testing;
 const freetracer_lib = @import("freetracer-lib");
 const dev = freetracer_lib.device;
 const fs = freetracer_lib.fs;
+const bmap = freetracer_lib.bmap;
 
 const ShutdownManager = @import("./managers/ShutdownManager.zig").ShutdownManagerSingleton;
 const Debug = freetracer_lib.Debug;
@@ -49,6 +55,8 @@ const xpc = freetracer_lib.xpc;
 const ISOParser = freetracer_lib.ISOParser;
 const DeviceType = freetracer_lib.types.DeviceType;
 const ImageType = freetracer_lib.types.ImageType;
+const SparseMode = freetracer_lib.types.SparseMode;
+const BufferPool = freetracer_lib.bufferpool.BufferPool;
 
 const k = freetracer_lib.constants.k;
 const c = freetracer_lib.c;
@@ -91,8 +99,13 @@ const RequestValidationError = error{
     InvalidDeviceType,
     /// Image type enum value is not a valid ImageType variant.
     InvalidImageType,
+    /// Fan-out request lists more devices than MAX_FANOUT_DEVICES.
+    TooManyFanOutDevices,
 };
 
+/// Upper bound on targets in a single WRITE_IMAGE_TO_DEVICES request (one writer thread each).
+const MAX_FANOUT_DEVICES = 16;
+
 /// Entry point for the SMJobBlessed privileged helper.
 ///
 /// Initialization sequence:
@@ -230,6 +243,12 @@ fn processRequestMessage(connection: XPCConnection, data: XPCObject) void {
                 .{ .xpcConnection = connection, .xpcResponseCode = .ISO_WRITE_FAIL },
             );
         },
+        .WRITE_IMAGE_TO_DEVICES => processRequestWriteImageFanOut(connection, data) catch |err| {
+            respondWithErrorAndTerminate(
+                .{ .err = err, .message = "Helper failed to process the fan-out write request" },
+                .{ .xpcConnection = connection, .xpcResponseCode = .ISO_WRITE_FAIL },
+            );
+        },
     }
 }
 
@@ -267,6 +286,23 @@ fn respondWithErrorAndTerminate(
     ShutdownManager.terminateWithError(err.err);
 }
 
+/// Sends WRITE_VERIFICATION_FAIL with the location of the first mismatch and schedules helper shutdown.
+/// The GUI reads `mismatch_offset` (device byte offset), `mismatch_lba` (logical block) and
+/// `mismatch_count` (logical blocks affected), plus `mismatch_bytes` for the run length and
+/// `mismatch_ranges` for the number of differing ranges found.
+fn respondWithMismatchAndTerminate(connection: XPCConnection, err: anyerror, mismatch: repair.Mismatch, rangeCount: usize) void {
+    Debug.log(.ERROR, "Verification failed at byte {d} (LBA {d}, {d} blocks), {d} ranges differ. Error: {any}", .{ mismatch.offset, mismatch.lba(), mismatch.blockCount(), rangeCount, err });
+    const xpcErrorResponse = XPCService.createResponse(.WRITE_VERIFICATION_FAIL);
+    defer XPCService.releaseObject(xpcErrorResponse);
+    XPCService.createUInt64(xpcErrorResponse, "mismatch_offset", mismatch.offset);
+    XPCService.createUInt64(xpcErrorResponse, "mismatch_lba", mismatch.lba());
+    XPCService.createUInt64(xpcErrorResponse, "mismatch_count", mismatch.blockCount());
+    XPCService.createUInt64(xpcErrorResponse, "mismatch_bytes", mismatch.len);
+    XPCService.createUInt64(xpcErrorResponse, "mismatch_ranges", rangeCount);
+    XPCService.connectionSendMessage(connection, xpcErrorResponse);
+    ShutdownManager.terminateWithError(err);
+}
+
 /// Convenience helper to emit a success response and keep logging consistent across request stages.
 fn sendXPCReply(connection: XPCConnection, reply: HelperResponseCode, comptime logMessage: []const u8) void {
     Debug.log(.INFO, logMessage, .{});
@@ -275,6 +311,118 @@ fn sendXPCReply(connection: XPCConnection, reply: HelperResponseCode, comptime l
     XPCService.releaseObject(replyObject);
 }
 
+/// Sends WRITE_VERIFICATION_SUCCESS for a quick verification, with what it covered:
+/// `verification_coverage` (hundredths of a percent of the image), `verification_seed`
+/// and `verification_samples`, enough to replay the same sample.
+fn sendVerificationCoverage(connection: XPCConnection, coverage: quickverify.Coverage) void {
+    Debug.log(.INFO, "Sampled image bytes successfully verified: {d}.{d:0>2}% of the image (seed {d}, {d} samples).", .{
+        coverage.basisPoints() / 100,
+        coverage.basisPoints() % 100,
+        coverage.seed,
+        coverage.sampleCount,
+    });
+    const reply = XPCService.createResponse(.WRITE_VERIFICATION_SUCCESS);
+    defer XPCService.releaseObject(reply);
+    XPCService.createUInt64(reply, "verification_coverage", coverage.basisPoints());
+    XPCService.createUInt64(reply, "verification_seed", coverage.seed);
+    XPCService.createUInt64(reply, "verification_samples", coverage.sampleCount);
+    XPCService.connectionSendMessage(connection, reply);
+}
+
+/// Parses the quick verification keys; null unless config_quickVerify is set.
+fn parseQuickVerifyOptions(data: XPCObject) ?quickverify.Options {
+    const enabled = XPCService.getUInt64(data, "config_quickVerify") catch 0;
+    if (enabled == 0) return null;
+
+    return .{
+        .seed = XPCService.getUInt64(data, "config_quickVerifySeed") catch std.crypto.random.int(u64),
+        .sampleCount = XPCService.getUInt64(data, "config_quickVerifySamples") catch quickverify.DEFAULT_SAMPLE_COUNT,
+    };
+}
+
+/// Parses optional write tunables from the request dictionary.
+/// Every key is optional; missing or malformed values fall back to `fsops.WriteOptions` defaults
+/// so older GUI builds keep working against a newer helper.
+fn parseWriteOptions(data: XPCObject) fsops.WriteOptions {
+    var options = fsops.WriteOptions{};
+
+    if (XPCService.getUInt64(data, "config_pipelineDepth")) |depth| {
+        options.pipelineDepth = @intCast(depth);
+    } else |_| {}
+
+    if (XPCService.getUInt64(data, "config_queueDepth")) |depth| {
+        options.queueDepth = @intCast(std.math.clamp(depth, 1, pipeline.MAX_QUEUE_DEPTH));
+    } else |_| {}
+
+    if (XPCService.getUInt64(data, "config_sparseMode")) |mode| {
+        options.sparseMode = meta.intToEnum(SparseMode, mode) catch blk: {
+            Debug.log(.WARNING, "Ignoring unknown sparse mode {d}; writing every byte.", .{mode});
+            break :blk .OFF;
+        };
+    } else |_| {}
+
+    if (XPCService.getUInt64(data, "config_autotune")) |autotune| {
+        options.autotune = autotune != 0;
+    } else |_| {}
+
+    if (XPCService.getUInt64(data, "config_resume")) |resumeWrite| {
+        options.resumeFromCheckpoint = resumeWrite != 0;
+    } else |_| {}
+
+    if (XPCService.getUInt64(data, "config_mapImage")) |mapImage| {
+        options.mapImage = mapImage != 0;
+    } else |_| {}
+
+    if (XPCService.getUInt64(data, "config_zeroCopy")) |zeroCopy| {
+        options.zeroCopy = zeroCopy != 0;
+    } else |_| {}
+
+    if (XPCService.getUInt64(data, "config_writebackInterval")) |interval| {
+        options.writebackInterval = interval;
+    } else |_| {}
+
+    if (XPCService.getUInt64(data, "config_badBlockPolicy")) |policy| {
+        options.badBlockPolicy = meta.intToEnum(fsops.BadBlockPolicy, policy) catch blk: {
+            Debug.log(.WARNING, "Ignoring unknown bad-block policy {d}; aborting on unwritable blocks.", .{policy});
+            break :blk .ABORT;
+        };
+    } else |_| {}
+
+    return options;
+}
+
+/// Maps the page-aligned buffer pool shared by every stage of a write job.
+/// Sized for the most demanding stage (see fsops.poolBufferCount), so memory use is fixed
+/// for the whole job regardless of image size.
+fn initJobBufferPool(options: fsops.WriteOptions) !BufferPool {
+    return BufferPool.init(std.heap.page_allocator, .{
+        .bufferSize = fsops.POOL_BUFFER_SIZE,
+        .bufferCount = fsops.poolBufferCount(options),
+        .useHugePages = true,
+    });
+}
+
+/// Opens and parses the .bmap file next to `imagePath`, applying the same path validation
+/// as the image itself. Returns null (full write) when there is no usable map.
+fn loadSiblingBlockMap(imagePath: []const u8, userHomePath: []const u8, imageFile: std.fs.File) ?bmap.BlockMap {
+    var pathBuffer: [std.fs.max_path_bytes]u8 = undefined;
+    const bmapPath = bmap.findSiblingPath(&pathBuffer, imagePath) orelse {
+        Debug.log(.WARNING, "Block map requested, but no .bmap file was found next to the image; writing the full image.", .{});
+        return null;
+    };
+
+    const bmapFile = fs.openFileValidated(bmapPath, .{ .userHomePath = userHomePath, .minFileSize = 1 }) catch |err| {
+        Debug.log(.WARNING, "Unable to open the block map file ({any}); writing the full image.", .{err});
+        return null;
+    };
+    defer bmapFile.close();
+
+    return fsops.loadBlockMap(std.heap.page_allocator, bmapFile, imageFile) catch |err| {
+        Debug.log(.WARNING, "Ignoring invalid block map ({any}); writing the full image.", .{err});
+        return null;
+    };
+}
+
 /// Handles WRITE_ISO_TO_DEVICE request: image validation, device write, verification, and eject.
 ///
 /// Request XPC Dict Parameters (from GUI):
@@ -285,13 +433,40 @@ fn sendXPCReply(connection: XPCConnection, reply: HelperResponseCode, comptime l
 ///   - config_userForced (uint64): If non-zero, skip image validation (user acknowledged warnings).
 ///   - config_ejectDevice (uint64): If non-zero, eject device after write.
 ///   - config_verifyBytes (uint64): If non-zero, verify all written bytes after write.
+///   - config_quickVerify (uint64): Optional; non-zero verifies a sample instead (see quickverify.zig):
+///     image edges, partition tables, El Torito boot images and seeded random blocks.
+///   - config_quickVerifySeed (uint64): Optional; sample seed. A random seed is drawn (and logged)
+///     when absent, so any quick verification can be replayed.
+///   - config_quickVerifySamples (uint64): Optional; random blocks to sample
+///     (quickverify.DEFAULT_SAMPLE_COUNT when absent).
+///   - config_pipelineDepth (uint64): Optional; buffers in flight for pipelined writes (< 2 disables).
+///   - config_queueDepth (uint64): Optional; io_uring fixed buffers in flight (Linux hosts only),
+///     clamped to pipeline.MAX_QUEUE_DEPTH.
+///   - config_deltaMode (uint64): If non-zero, only rewrite chunks that differ from the device contents.
+///   - config_useBmap (uint64): Optional; non-zero writes and verifies only the ranges listed in the
+///     image's sibling .bmap file. Falls back to a full write if the map is missing or invalid;
+///     ignored in delta mode.
+///   - config_sparseMode (uint64): Optional; SparseMode for zero ranges (OFF unless the target is known zeroed).
+///   - config_autotune (uint64): Optional; zero disables throughput autotuning of the chunk size / queue depth.
+///   - config_resume (uint64): Optional; non-zero enables the checkpoint journal, so an interrupted
+///     write of the same image to the same medium resumes after its synced prefix. Off by default:
+///     the device identity cannot tell two sticks of the same model apart. Ignored in delta mode
+///     and for compressed images.
+///   - config_mapImage (uint64): Optional; non-zero writes and verifies from a memory mapping of the
+///     image instead of reading it into buffers. Only safe for images on local, stable storage.
+///   - config_zeroCopy (uint64): Optional; non-zero moves image bytes with copy_file_range/splice
+///     (Linux hosts only, falls back to io_uring when the kernel rejects the pair).
+///   - config_writebackInterval (uint64): Optional; bytes between incremental device flushes
+///     (0 leaves everything to the final sync).
+///   - config_badBlockPolicy (uint64): Optional; 0 = ABORT (default) fails on a block that stays
+///     unwritable after retries, 1 = SKIP records it and continues.
 ///
 /// Sequence:
 /// 1. Parse and validate XPC payload.
 /// 2. Open and validate image image file.
 /// 3. Open device (with permission error handling).
 /// 4. Write image to device (with progress updates over XPC).
-/// 5. Optionally verify written bytes.
+/// 5. Optionally verify written bytes; mismatching ranges are rewritten and verified once more.
 /// 6. Optionally eject device.
 /// 7. Exit helper on success or error.
 fn processRequestWriteImage(connection: XPCConnection, data: XPCObject) !void {
@@ -311,13 +486,30 @@ fn processRequestWriteImage(connection: XPCConnection, data: XPCObject) !void {
     const configUserForced: u64 = XPCService.getUInt64(data, "config_userForced") catch 0;
     const configEjectDevice: u64 = XPCService.getUInt64(data, "config_ejectDevice") catch 0;
     const configVerifyBytes: u64 = XPCService.getUInt64(data, "config_verifyBytes") catch 0;
+    const configDeltaMode: u64 = XPCService.getUInt64(data, "config_deltaMode") catch 0;
+    const configUseBmap: u64 = XPCService.getUInt64(data, "config_useBmap") catch 0;
+    const quickVerify = parseQuickVerifyOptions(data);
 
-    Debug.log(.INFO, "Parsed write request: disk={s}, deviceServiceId={d}, config={{userForced={}, ejectDevice={}, verifyBytes={}}}", .{
+    const writeOptions = parseWriteOptions(data);
+
+    Debug.log(.INFO, "Parsed write request: disk={s}, deviceServiceId={d}, config={{userForced={}, ejectDevice={}, verifyBytes={}, quickVerify={}, deltaMode={}, useBmap={}, pipelineDepth={d}, queueDepth={d}, sparseMode={s}, autotune={}, resume={}, mapImage={}, zeroCopy={}, writebackInterval={d}, badBlockPolicy={s}}}", .{
         deviceBsdName,
         deviceServiceId,
         configUserForced != 0,
         configEjectDevice != 0,
         configVerifyBytes != 0,
+        quickVerify != null,
+        configDeltaMode != 0,
+        configUseBmap != 0,
+        writeOptions.pipelineDepth,
+        writeOptions.queueDepth,
+        @tagName(writeOptions.sparseMode),
+        writeOptions.autotune,
+        writeOptions.resumeFromCheckpoint,
+        writeOptions.mapImage,
+        writeOptions.zeroCopy,
+        writeOptions.writebackInterval,
+        @tagName(writeOptions.badBlockPolicy),
     });
 
     // Validate core parameters
@@ -354,6 +546,9 @@ fn processRequestWriteImage(connection: XPCConnection, data: XPCObject) !void {
 
     sendXPCReply(connection, .ISO_FILE_VALID, "Image file is determined to be valid and is successfully opened.");
 
+    var blockMap: ?bmap.BlockMap = if (configUseBmap != 0 and configDeltaMode == 0) loadSiblingBlockMap(imagePath, userHomePath, imageFile) else null;
+    defer if (blockMap) |*map| map.deinit();
+
     var deviceHandle = dev.openDeviceValidated(deviceBsdName, deviceType) catch |err| {
         switch (err) {
             error.AccessDenied => {
@@ -377,8 +572,25 @@ fn processRequestWriteImage(connection: XPCConnection, data: XPCObject) !void {
 
     sendXPCReply(connection, .DEVICE_VALID, "Device is determined to be valid and is successfully opened.");
 
+    // One buffer pool for the whole job: write, decompression and verification reuse the same buffers.
+    var bufferPool = try initJobBufferPool(writeOptions);
+    defer bufferPool.deinit(std.heap.page_allocator);
+
+    // Chunk digests of the image, taken while it is written, let verification read only the device.
+    // Only a full verification reads the digests back; quick verification compares samples
+    var digests: ?digestlog.DigestLog = if (configVerifyBytes != 0 and quickVerify == null and blockMap == null) digestlog.DigestLog.init(std.heap.page_allocator) else null;
+    defer if (digests) |*log| log.deinit();
+    const digestsRef: ?*digestlog.DigestLog = if (digests) |*log| log else null;
+
     // Write image to device; progress updates sent over XPC connection.
-    fsops.writeImage(connection, imageFile, deviceHandle) catch |err| {
+    const writeResult = if (configDeltaMode != 0)
+        fsops.writeImageDelta(connection, imageFile, deviceHandle, writeOptions, &bufferPool, digestsRef)
+    else if (blockMap) |*map|
+        fsops.writeImageBlockMap(connection, imageFile, deviceHandle, map, writeOptions, &bufferPool)
+    else
+        fsops.writeImage(connection, imageFile, deviceHandle, writeOptions, &bufferPool, digestsRef);
+
+    writeResult catch |err| {
         respondWithErrorAndTerminate(
             .{ .err = err, .message = "Unable to write image to device." },
             .{ .xpcConnection = connection, .xpcResponseCode = .ISO_WRITE_FAIL },
@@ -388,9 +600,27 @@ fn processRequestWriteImage(connection: XPCConnection, data: XPCObject) !void {
 
     sendXPCReply(connection, .ISO_WRITE_SUCCESS, "Image successfully written to device!");
 
-    // Verification step: read back and compare every byte written (optional, config-driven).
-    if (configVerifyBytes != 0) {
-        fsops.verifyWrittenBytes(connection, imageFile, deviceHandle) catch |err| {
+    // Verification step: read back and compare every byte written, or a sample of them (optional, config-driven).
+    if (configVerifyBytes != 0 or quickVerify != null) {
+        var mismatches = repair.MismatchMap{};
+        var coverage: ?quickverify.Coverage = null;
+        var verifyResult: anyerror!void = if (blockMap) |*map|
+            fsops.verifyBlockMap(connection, deviceHandle, map, &bufferPool, &mismatches)
+        else if (quickVerify) |options|
+            fsops.verifySampledBytes(connection, imageFile, deviceHandle, &bufferPool, options, &mismatches, &coverage)
+        else
+            fsops.verifyWrittenBytes(connection, imageFile, deviceHandle, &bufferPool, writeOptions.mapImage, digestsRef, &mismatches);
+
+        // Mismatching ranges are rewritten and checked once more before the job counts as failed
+        if (mismatches.isRepairable()) {
+            verifyResult = fsops.repairMismatches(connection, imageFile, deviceHandle, &bufferPool, &mismatches);
+        }
+
+        verifyResult catch |err| {
+            if (mismatches.first()) |found| {
+                respondWithMismatchAndTerminate(connection, err, found, mismatches.count);
+                return;
+            }
             respondWithErrorAndTerminate(
                 .{ .err = err, .message = "Unable to verify the written image." },
                 .{ .xpcConnection = connection, .xpcResponseCode = .WRITE_VERIFICATION_FAIL },
@@ -398,7 +628,11 @@ fn processRequestWriteImage(connection: XPCConnection, data: XPCObject) !void {
             return;
         };
 
-        sendXPCReply(connection, .WRITE_VERIFICATION_SUCCESS, "Written image bytes successfully verified!");
+        if (coverage) |sampled| {
+            sendVerificationCoverage(connection, sampled);
+        } else {
+            sendXPCReply(connection, .WRITE_VERIFICATION_SUCCESS, "Written image bytes successfully verified!");
+        }
     } else {
         Debug.log(.INFO, "Verification skipped: config.verifyBytes flag is disabled.", .{});
     }
@@ -434,6 +668,186 @@ fn processRequestWriteImage(connection: XPCConnection, data: XPCObject) !void {
     ShutdownManager.exitSuccessfully();
 }
 
+/// Handles WRITE_IMAGE_TO_DEVICES request: writes one image to several devices with a single source read.
+///
+/// Request XPC Dict Parameters (from GUI):
+///   - imagePath (string): Absolute path to the image file.
+///   - disks (string): Comma-separated device identifiers (e.g., "disk4,disk5"), at most MAX_FANOUT_DEVICES.
+///   - deviceType (uint64): Device type enum shared by all targets (cast from DeviceType).
+///   - config_userForced (uint64): If non-zero, skip image validation (user acknowledged warnings).
+///   - config_ejectDevice (uint64): If non-zero, eject every successfully written device.
+///   - config_pipelineDepth (uint64): Optional; shared buffers in flight, i.e. how far the fastest
+///     target may run ahead of the slowest.
+///
+/// Responses:
+///   - ISO_FILE_VALID / DEVICE_VALID once the image and every device are opened
+///   - ISO_WRITE_PROGRESS per device, tagged with `device_index`
+///   - FANOUT_DEVICE_WRITE_SUCCESS / FANOUT_DEVICE_WRITE_FAIL per device, tagged with `device_index`
+///   - DEVICE_FLASH_COMPLETE if at least one device was written, ISO_WRITE_FAIL otherwise
+///
+/// Verification is not performed for fan-out jobs; config_verifyBytes is ignored. Fan-out jobs are
+/// not checkpointed either (config_resume is ignored): the targets progress at different rates.
+fn processRequestWriteImageFanOut(connection: XPCConnection, data: XPCObject) !void {
+    Debug.log(.INFO, "Parsing fan-out write request from XPC message...", .{});
+
+    const imagePath: [:0]const u8 = try XPCService.parseString(data, "imagePath");
+    const diskList: [:0]const u8 = try XPCService.parseString(data, "disks");
+
+    const deviceTypeInt: u64 = try XPCService.getUInt64(data, "deviceType");
+    const deviceType = try meta.intToEnum(DeviceType, deviceTypeInt);
+
+    const configUserForced: u64 = XPCService.getUInt64(data, "config_userForced") catch 0;
+    const configEjectDevice: u64 = XPCService.getUInt64(data, "config_ejectDevice") catch 0;
+
+    if (XPCService.getUInt64(data, "config_verifyBytes")) |verify| {
+        if (verify != 0) Debug.log(.WARNING, "Verification is not supported for fan-out writes yet; skipping.", .{});
+    } else |_| {}
+
+    const writeOptions = parseWriteOptions(data);
+
+    if (imagePath.len == 0) return RequestValidationError.EmptyImagePath;
+
+    // Names are validated (length, flat filename) by dev.openDeviceValidated below
+    var deviceNameBuffer: [MAX_FANOUT_DEVICES][]const u8 = undefined;
+    var deviceCount: usize = 0;
+
+    var names = std.mem.tokenizeScalar(u8, diskList, ',');
+    while (names.next()) |rawName| {
+        const name = std.mem.trim(u8, rawName, " ");
+        if (name.len == 0) return RequestValidationError.EmptyDeviceIdentifier;
+        if (deviceCount == MAX_FANOUT_DEVICES) return RequestValidationError.TooManyFanOutDevices;
+
+        deviceNameBuffer[deviceCount] = name;
+        deviceCount += 1;
+    }
+
+    if (deviceCount == 0) return RequestValidationError.EmptyDeviceIdentifier;
+    const deviceNames = deviceNameBuffer[0..deviceCount];
+
+    Debug.log(.INFO, "Parsed fan-out write request: disks={s} ({d}), config={{userForced={}, ejectDevice={}, pipelineDepth={d}}}", .{
+        diskList,
+        deviceCount,
+        configUserForced != 0,
+        configEjectDevice != 0,
+        writeOptions.pipelineDepth,
+    });
+
+    const userHomePath: []const u8 = try XPCService.getUserHomePath(connection);
+
+    const imageFile = fs.openFileValidated(imagePath, .{ .userHomePath = userHomePath }) catch |err| {
+        respondWithErrorAndTerminate(
+            .{ .err = err, .message = "Unable to open the image file or its directory." },
+            .{ .xpcConnection = connection, .xpcResponseCode = .ISO_FILE_INVALID },
+        );
+        return;
+    };
+
+    defer imageFile.close();
+
+    const imageValidationResult = fs.validateImageFile(imageFile);
+
+    if (imageValidationResult.fileSystem == .ISO9660_EL_TORITO) {
+        const iso9660ValidationResult = fs.doesImageConformToISO9660(imageFile);
+
+        if (iso9660ValidationResult != .ISO_VALID and configUserForced != 1) {
+            respondWithErrorAndTerminate(
+                .{ .err = error.ImageValidationFailed, .message = "Failed to validate image and user did not force unknown image." },
+                .{ .xpcConnection = connection, .xpcResponseCode = .IMAGE_STRUCTURE_UNRECOGNIZED },
+            );
+            return;
+        }
+    }
+
+    sendXPCReply(connection, .ISO_FILE_VALID, "Image file is determined to be valid and is successfully opened.");
+
+    // Open every target up front: a job never starts with a device that failed validation
+    var deviceHandles: [MAX_FANOUT_DEVICES]dev.DeviceHandle = undefined;
+    var openedCount: usize = 0;
+    var isClosed = false;
+    defer if (!isClosed) for (deviceHandles[0..openedCount]) |*handle| handle.close();
+
+    for (deviceNames) |name| {
+        deviceHandles[openedCount] = dev.openDeviceValidated(name, deviceType) catch |err| {
+            Debug.log(.ERROR, "Fan-out device {s} could not be opened.", .{name});
+            respondWithErrorAndTerminate(
+                .{ .err = err, .message = if (err == error.AccessDenied) "Helper required disk access permissions." else "Unable to safely open specified device, validation error." },
+                .{ .xpcConnection = connection, .xpcResponseCode = if (err == error.AccessDenied) .NEED_DISK_PERMISSIONS else .DEVICE_INVALID },
+            );
+            return;
+        };
+        openedCount += 1;
+    }
+
+    sendXPCReply(connection, .DEVICE_VALID, "All fan-out devices are determined to be valid and are successfully opened.");
+
+    var devices: [MAX_FANOUT_DEVICES]std.fs.File = undefined;
+    for (deviceHandles[0..deviceCount], devices[0..deviceCount]) |handle, *device| device.* = handle.raw;
+
+    var results: [MAX_FANOUT_DEVICES]fsops.FanOutResult = undefined;
+
+    var bufferPool = try initJobBufferPool(writeOptions);
+    defer bufferPool.deinit(std.heap.page_allocator);
+
+    fsops.writeImageFanOut(connection, imageFile, devices[0..deviceCount], results[0..deviceCount], writeOptions, &bufferPool) catch |err| {
+        respondWithErrorAndTerminate(
+            .{ .err = err, .message = "Unable to start the fan-out write." },
+            .{ .xpcConnection = connection, .xpcResponseCode = .ISO_WRITE_FAIL },
+        );
+        return;
+    };
+
+    var successCount: usize = 0;
+
+    for (results[0..deviceCount], 0..) |result, index| {
+        const reply = XPCService.createResponse(if (result.err == null) .FANOUT_DEVICE_WRITE_SUCCESS else .FANOUT_DEVICE_WRITE_FAIL);
+        defer XPCService.releaseObject(reply);
+        XPCService.createUInt64(reply, "device_index", index);
+        XPCService.connectionSendMessage(connection, reply);
+
+        if (result.err) |err| {
+            Debug.log(.ERROR, "Fan-out device {s} failed: {any}", .{ deviceNames[index], err });
+        } else {
+            successCount += 1;
+        }
+    }
+
+    // NOTE: Must close the handles first, otherwise eject will return DeviceBusy.
+    for (deviceHandles[0..openedCount]) |*handle| handle.close();
+    isClosed = true;
+
+    if (configEjectDevice != 0) {
+        for (deviceHandles[0..deviceCount], results[0..deviceCount], deviceNames) |*handle, result, name| {
+            if (result.err != null) continue;
+            dev.ejectDevice(handle) catch |err| {
+                Debug.log(.WARNING, "Unable to eject fan-out device {s}: {any}", .{ name, err });
+                continue;
+            };
+            Debug.log(.INFO, "Fan-out device {s} ejected successfully.", .{name});
+        }
+    } else {
+        Debug.log(.INFO, "Device eject skipped: config.ejectDevice flag is disabled.", .{});
+    }
+
+    if (successCount == 0) {
+        respondWithErrorAndTerminate(
+            .{ .err = error.AllFanOutTargetsFailed, .message = "Fan-out write failed on every device." },
+            .{ .xpcConnection = connection, .xpcResponseCode = .ISO_WRITE_FAIL },
+        );
+        return;
+    }
+
+    Debug.log(.INFO, "Fan-out write finished: {d} of {d} devices written.", .{ successCount, deviceCount });
+
+    for (0..3) |_| {
+        sendXPCReply(connection, .DEVICE_FLASH_COMPLETE, "Successfully finished the fan-out flashing process. Sending a repeating message...");
+        std.Thread.sleep(50_000_000); // 50 ms gap
+    }
+
+    Debug.log(.INFO, "Finished executing, now termining helper...", .{});
+
+    ShutdownManager.exitSuccessfully();
+}
+
 // ========================================================================================
 // TEST SUITE
 // ========================================================================================
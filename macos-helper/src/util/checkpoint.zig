@@ -0,0 +1,348 @@
+//! Write Checkpoint Journal
+//!
+//! Lets an interrupted image write resume instead of restarting from byte 0.
+//! While an uncompressed image is written, the helper periodically syncs the target
+//! and records the durably written prefix in a small journal on the host, together
+//! with the identity of the image and of the device. A later request for the same
+//! image/device pair spot-checks that prefix against the image and resumes after it.
+//!
+//! Identity:
+//! - Image: size, modification time and a SHA-256 of the first 1 MiB
+//! - Device: capacity and logical block size. The BSD name is deliberately left out:
+//!   a replugged stick often comes back under a different disk number. Nothing here tells
+//!   two media of the same model apart (card readers report their own serial, not the
+//!   card's), and the sampled prefix verification can pass on blank or similar media, so
+//!   resuming is opt-in: the requester vouches that the target is the interrupted medium
+//!
+//! Journal:
+//! - A single fixed-size record in host byte order (the helper runs one write job at
+//!   a time), replaced atomically via a temporary file, fsync and rename
+//! - Checksummed; a torn or foreign record is ignored and the write starts over
+//! - Cleared once the write completes
+//!
+//! The journal is best-effort: failing to read or store it never fails a write, it
+//! only costs the ability to resume.
+const std = @import("std");
+const builtin = @import("builtin");
+const freetracer_lib = @import("freetracer-lib");
+
+const Debug = freetracer_lib.Debug;
+const c = freetracer_lib.c;
+const BufferPool = freetracer_lib.bufferpool.BufferPool;
+const Sha256 = std.crypto.hash.sha2.Sha256;
+
+const isLinux = builtin.os.tag == .linux;
+
+/// Bytes written between two checkpoints. Every checkpoint costs a device sync, so this
+/// trades sync stalls against the amount of work redone after an interruption.
+pub const CHECKPOINT_INTERVAL_BYTES: u64 = 256 * 1024 * 1024;
+
+/// Leading image bytes hashed into the image identity.
+const IMAGE_HASH_PREFIX_BYTES = 1024 * 1024;
+
+/// Evenly spaced samples compared against the image before resuming; one more sample
+/// always covers the bytes right below the checkpoint.
+const VERIFY_SAMPLE_COUNT = 16;
+const VERIFY_SAMPLE_BYTES = 1024 * 1024;
+
+const JOURNAL_DIR = if (isLinux) "/var/lib/freetracer" else "/Library/Application Support/Freetracer";
+const JOURNAL_NAME = "write-checkpoint.journal";
+const JOURNAL_TMP_NAME = JOURNAL_NAME ++ ".tmp";
+const JOURNAL_MAGIC = "FTCKPT01".*;
+
+// <linux/fs.h> block device ioctl
+const BLKGETSIZE64: u32 = 0x80081272;
+
+pub const ImageIdentity = extern struct {
+    size: u64,
+    mtimeNs: i64,
+    prefixHash: [Sha256.digest_length]u8,
+};
+
+pub const DeviceIdentity = extern struct {
+    capacity: u64,
+    blockSize: u64,
+};
+
+/// On-disk journal record. `checksum` covers every byte before it.
+const Record = extern struct {
+    magic: [8]u8 = JOURNAL_MAGIC,
+    image: ImageIdentity,
+    device: DeviceIdentity,
+    syncedOffset: u64,
+    checksum: u32 = 0,
+    reserved: u32 = 0,
+
+    fn computeChecksum(self: *const Record) u32 {
+        return std.hash.Crc32.hash(std.mem.asBytes(self)[0..@offsetOf(Record, "checksum")]);
+    }
+};
+
+/// Builds the identity of `imageFile` from its size, mtime and leading bytes.
+///
+/// `Errors`:
+///   File stat/read errors
+pub fn identifyImage(imageFile: std.fs.File) !ImageIdentity {
+    const stat = try imageFile.stat();
+    const prefixEnd = @min(stat.size, IMAGE_HASH_PREFIX_BYTES);
+
+    var hasher = Sha256.init(.{});
+    var buffer: [64 * 1024]u8 = undefined;
+    var offset: u64 = 0;
+
+    while (offset < prefixEnd) {
+        const toRead: usize = @intCast(@min(@as(u64, buffer.len), prefixEnd - offset));
+        const bytesRead = try imageFile.preadAll(buffer[0..toRead], offset);
+        if (bytesRead == 0) break;
+
+        hasher.update(buffer[0..bytesRead]);
+        offset += bytesRead;
+    }
+
+    var identity = ImageIdentity{ .size = stat.size, .mtimeNs = @truncate(stat.mtime), .prefixHash = undefined };
+    hasher.final(&identity.prefixHash);
+    return identity;
+}
+
+/// Builds the identity of `device` from its capacity and `blockSize` (as probed by the writer).
+pub fn identifyDevice(device: std.fs.File, blockSize: u64) DeviceIdentity {
+    return .{ .capacity = probeCapacity(device, blockSize), .blockSize = blockSize };
+}
+
+/// Returns the device capacity in bytes (DKIOCGETBLOCKCOUNT / BLKGETSIZE64), falling back
+/// to the file size for plain-file targets. Returns 0 when nothing can be determined.
+fn probeCapacity(device: std.fs.File, blockSize: u64) u64 {
+    if (comptime isLinux) {
+        const linux = std.os.linux;
+        var size: u64 = 0;
+        if (linux.E.init(linux.ioctl(device.handle, BLKGETSIZE64, @intFromPtr(&size))) == .SUCCESS and size > 0) return size;
+    } else {
+        var blockCount: u64 = 0;
+        if (c.ioctl(device.handle, c.DKIOCGETBLOCKCOUNT, @as(?*u64, &blockCount)) == 0 and blockCount > 0) return blockCount * blockSize;
+    }
+
+    const stat = device.stat() catch return 0;
+    return stat.size;
+}
+
+/// Opens the host directory holding the journal, creating it on first use.
+pub fn openJournalDir() !std.fs.Dir {
+    try std.fs.cwd().makePath(JOURNAL_DIR);
+    return std.fs.cwd().openDir(JOURNAL_DIR, .{});
+}
+
+/// Returns the stored record, or null when there is none or it fails validation.
+fn loadRecord(dir: std.fs.Dir) ?Record {
+    const file = dir.openFile(JOURNAL_NAME, .{}) catch return null;
+    defer file.close();
+
+    var record: Record = undefined;
+    const bytesRead = file.preadAll(std.mem.asBytes(&record), 0) catch return null;
+
+    if (bytesRead != @sizeOf(Record)) return null;
+    if (!std.mem.eql(u8, &record.magic, &JOURNAL_MAGIC) or record.checksum != record.computeChecksum()) return null;
+
+    return record;
+}
+
+/// Replaces the stored record. The new record is fully on disk before it becomes visible.
+fn storeRecord(dir: std.fs.Dir, record: Record) !void {
+    var sealed = record;
+    sealed.checksum = sealed.computeChecksum();
+
+    {
+        const file = try dir.createFile(JOURNAL_TMP_NAME, .{ .truncate = true });
+        defer file.close();
+
+        try file.writeAll(std.mem.asBytes(&sealed));
+        try file.sync();
+    }
+
+    try dir.rename(JOURNAL_TMP_NAME, JOURNAL_NAME);
+}
+
+/// Tracks checkpoints of one write job against the journal in `dir` (owned by the caller).
+pub const Checkpointer = struct {
+    dir: std.fs.Dir,
+    image: ImageIdentity,
+    device: DeviceIdentity,
+    /// Offset the write starts from: 0, or a verified checkpoint (see resolveStartOffset)
+    startOffset: u64 = 0,
+    lastCheckpointOffset: u64 = 0,
+    interval: u64 = CHECKPOINT_INTERVAL_BYTES,
+
+    pub fn init(dir: std.fs.Dir, image: ImageIdentity, device: DeviceIdentity) Checkpointer {
+        return .{ .dir = dir, .image = image, .device = device };
+    }
+
+    /// Looks up a checkpoint for this image/device pair and, if the device prefix below it
+    /// still matches the image, moves `startOffset` to it. Otherwise the write starts at 0.
+    ///
+    /// `Arguments`:
+    ///   pool: Job buffer pool; two buffers are borrowed for the prefix samples
+    pub fn resolveStartOffset(self: *Checkpointer, imageFile: std.fs.File, target: std.fs.File, pool: *BufferPool) void {
+        const record = loadRecord(self.dir) orelse return;
+
+        if (!std.meta.eql(record.image, self.image) or !std.meta.eql(record.device, self.device)) {
+            Debug.log(.INFO, "Write checkpoint belongs to a different image or device; writing from byte 0.", .{});
+            return;
+        }
+
+        const offset = alignDown(@min(record.syncedOffset, self.image.size), self.device.blockSize);
+        if (offset == 0) return;
+
+        const isPrefixIntact = verifyPrefix(imageFile, target, offset, self.device.blockSize, pool) catch |err| blk: {
+            Debug.log(.WARNING, "Unable to verify the checkpointed prefix ({any}); writing from byte 0.", .{err});
+            break :blk false;
+        };
+
+        if (!isPrefixIntact) {
+            Debug.log(.WARNING, "Device no longer matches the image below the checkpoint at byte {d}; writing from byte 0.", .{offset});
+            return;
+        }
+
+        Debug.log(.INFO, "Resuming write from checkpoint at byte {d} of {d}.", .{ offset, self.image.size });
+        self.startOffset = offset;
+        self.lastCheckpointOffset = offset;
+    }
+
+    /// Syncs `target` and stores `durableOffset` once it is `interval` bytes past the
+    /// previous checkpoint. Every byte below `durableOffset` must have been written.
+    ///
+    /// `Errors`:
+    ///   Device sync errors. Journal write errors are only logged
+    pub fn record(self: *Checkpointer, target: std.fs.File, durableOffset: u64) !void {
+        if (durableOffset < self.lastCheckpointOffset + self.interval) return;
+
+        try target.sync();
+
+        storeRecord(self.dir, .{ .image = self.image, .device = self.device, .syncedOffset = durableOffset }) catch |err| {
+            Debug.log(.WARNING, "Unable to store write checkpoint at byte {d}: {any}", .{ durableOffset, err });
+        };
+
+        self.lastCheckpointOffset = durableOffset;
+    }
+
+    /// Forgets the checkpoint once the write has completed and been synced.
+    pub fn complete(self: *Checkpointer) void {
+        self.dir.deleteFile(JOURNAL_NAME) catch |err| switch (err) {
+            error.FileNotFound => {},
+            else => Debug.log(.WARNING, "Unable to clear the write checkpoint journal: {any}", .{err}),
+        };
+    }
+};
+
+/// Spot-checks the device prefix [0, offset) against the image: VERIFY_SAMPLE_COUNT evenly
+/// spaced samples plus the sample ending at `offset`, where an interrupted write is most
+/// likely to have left damage. Returns false on the first difference or short read.
+fn verifyPrefix(imageFile: std.fs.File, target: std.fs.File, offset: u64, blockSize: u64, pool: *BufferPool) !bool {
+    const imagePoolBuffer = pool.tryAcquire() orelse return error.BufferPoolExhausted;
+    defer pool.release(imagePoolBuffer);
+    const devicePoolBuffer = pool.tryAcquire() orelse return error.BufferPoolExhausted;
+    defer pool.release(devicePoolBuffer);
+
+    // Offsets and lengths stay block-aligned so raw devices accept the reads
+    const sampleSize: usize = @intCast(alignDown(@min(@as(u64, VERIFY_SAMPLE_BYTES), imagePoolBuffer.len, offset), blockSize));
+    if (sampleSize == 0) return false;
+
+    const imageBytes = imagePoolBuffer[0..sampleSize];
+    const deviceBytes = devicePoolBuffer[0..sampleSize];
+    const lastStart = offset - sampleSize;
+
+    for (0..VERIFY_SAMPLE_COUNT + 1) |i| {
+        const start = if (i == VERIFY_SAMPLE_COUNT) lastStart else alignDown(lastStart * i / VERIFY_SAMPLE_COUNT, blockSize);
+
+        const imageBytesRead = try imageFile.preadAll(imageBytes, start);
+        const deviceBytesRead = try target.preadAll(deviceBytes, start);
+
+        if (imageBytesRead != sampleSize or deviceBytesRead != sampleSize) return false;
+        if (!std.mem.eql(u8, imageBytes, deviceBytes)) return false;
+    }
+
+    return true;
+}
+
+fn alignDown(value: u64, blockSize: u64) u64 {
+    const block = @max(blockSize, 1);
+    return (value / block) * block;
+}
+
+// ============================================================================
+// TESTS
+// ============================================================================
+
+const TEST_IMAGE_SIZE = 64 * 1024;
+
+fn writeTestImage(dir: std.fs.Dir) !std.fs.File {
+    const file = try dir.createFile("image.img", .{ .read = true });
+    errdefer file.close();
+
+    var payload: [TEST_IMAGE_SIZE]u8 = undefined;
+    for (&payload, 0..) |*byte, i| byte.* = @truncate(i *% 73);
+    try file.writeAll(&payload);
+
+    return file;
+}
+
+test "Checkpointer resumes only a matching pair with an intact prefix" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const image = try writeTestImage(tmp.dir);
+    defer image.close();
+
+    // The target holds the first half of the image
+    const target = try tmp.dir.createFile("target.img", .{ .read = true });
+    defer target.close();
+    var half: [TEST_IMAGE_SIZE / 2]u8 = undefined;
+    _ = try image.preadAll(&half, 0);
+    try target.writeAll(&half);
+
+    var pool = try BufferPool.init(std.testing.allocator, .{ .bufferSize = 4096, .bufferCount = 2 });
+    defer pool.deinit(std.testing.allocator);
+
+    const imageIdentity = try identifyImage(image);
+    const deviceIdentity = DeviceIdentity{ .capacity = 1024 * 1024, .blockSize = 512 };
+
+    var writer = Checkpointer.init(tmp.dir, imageIdentity, deviceIdentity);
+    writer.interval = 16 * 1024;
+    try writer.record(target, 8 * 1024); // below the interval: not stored
+    try std.testing.expect(loadRecord(tmp.dir) == null);
+    try writer.record(target, half.len);
+
+    var resumed = Checkpointer.init(tmp.dir, imageIdentity, deviceIdentity);
+    resumed.resolveStartOffset(image, target, &pool);
+    try std.testing.expectEqual(@as(u64, half.len), resumed.startOffset);
+
+    var otherDevice = Checkpointer.init(tmp.dir, imageIdentity, .{ .capacity = 2 * 1024 * 1024, .blockSize = 512 });
+    otherDevice.resolveStartOffset(image, target, &pool);
+    try std.testing.expectEqual(@as(u64, 0), otherDevice.startOffset);
+
+    // A damaged boot sector invalidates the checkpoint
+    try target.pwriteAll(&[_]u8{0xFF}, 0);
+    var damaged = Checkpointer.init(tmp.dir, imageIdentity, deviceIdentity);
+    damaged.resolveStartOffset(image, target, &pool);
+    try std.testing.expectEqual(@as(u64, 0), damaged.startOffset);
+
+    resumed.complete();
+    try std.testing.expect(loadRecord(tmp.dir) == null);
+}
+
+test "Checkpoint journal ignores a torn record" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const record = Record{
+        .image = .{ .size = 1, .mtimeNs = 2, .prefixHash = [_]u8{3} ** Sha256.digest_length },
+        .device = .{ .capacity = 4, .blockSize = 512 },
+        .syncedOffset = 512,
+    };
+    try storeRecord(tmp.dir, record);
+    try std.testing.expectEqual(@as(u64, 512), loadRecord(tmp.dir).?.syncedOffset);
+
+    const file = try tmp.dir.openFile(JOURNAL_NAME, .{ .mode = .read_write });
+    defer file.close();
+    try file.pwriteAll(&[_]u8{0xEE}, @offsetOf(Record, "syncedOffset"));
+
+    try std.testing.expect(loadRecord(tmp.dir) == null);
+}
@@ -0,0 +1,218 @@
+//! Inline Image Digests
+//!
+//! Hashes the image while a write job streams it to the device, so verification only
+//! has to read the device back instead of reading the image a second time:
+//! - The image is cut into fixed CHUNK_SIZE chunks, independent of the chunk size the
+//!   writer happens to use (autotuner, sparse slots), and each chunk is hashed with BLAKE3
+//! - The image digest is BLAKE3 over the image size and the chunk digests, so zero
+//!   ranges reuse the digest of a zero chunk instead of hashing gigabytes of zeros. It is
+//!   the tree digest freetracer-lib's imagehash computes, so the GUI's fingerprint of the
+//!   selected image can be matched against the digest logged here
+//! - Bytes must arrive in offset order starting at 0. A write that cannot deliver them
+//!   that way (resumed jobs, out-of-order completions, chunk-table formats) leaves the
+//!   log incomplete, and verification falls back to comparing against the image
+//!
+//! The log is an optimization: allocation failures and gaps mark it broken instead of
+//! failing the write.
+const std = @import("std");
+const freetracer_lib = @import("freetracer-lib");
+const Debug = freetracer_lib.Debug;
+const imagehash = freetracer_lib.imagehash;
+
+const Blake3 = std.crypto.hash.Blake3;
+
+/// Bytes covered by one chunk digest; also the read size of digest verification.
+pub const CHUNK_SIZE: u64 = imagehash.TREE_CHUNK_SIZE;
+
+pub const Digest = imagehash.ChunkDigest;
+
+/// Chunk of zeros hashed per update when zero ranges are folded into a partial chunk.
+const ZERO_BLOCK = [_]u8{0} ** (64 * 1024);
+
+/// Hash of one full chunk (or the final short chunk) of device or image bytes.
+pub const hashChunk = imagehash.hashChunk;
+
+/// Per-chunk digests of one image, filled in offset order during a write.
+pub const DigestLog = struct {
+    allocator: std.mem.Allocator,
+    chunkDigests: std.ArrayList(Digest) = .empty,
+    /// Hasher of the chunk in progress, holding `chunkFill` bytes
+    chunkHasher: Blake3 = Blake3.init(.{}),
+    chunkFill: u64 = 0,
+    /// Every image byte below this offset has been hashed
+    hashedBytes: u64 = 0,
+    /// Set once a gap, reordering or allocation failure made the log unusable
+    isBroken: bool = false,
+    /// Set by finish(): the image digest over `hashedBytes` bytes
+    imageDigest: ?Digest = null,
+    zeroChunkDigest: Digest,
+
+    pub fn init(allocator: std.mem.Allocator) DigestLog {
+        var zeroHasher = Blake3.init(.{});
+        var remaining: u64 = CHUNK_SIZE;
+        while (remaining > 0) : (remaining -= ZERO_BLOCK.len) zeroHasher.update(&ZERO_BLOCK);
+
+        var log = DigestLog{ .allocator = allocator, .zeroChunkDigest = undefined };
+        zeroHasher.final(&log.zeroChunkDigest);
+        return log;
+    }
+
+    pub fn deinit(self: *DigestLog) void {
+        self.chunkDigests.deinit(self.allocator);
+    }
+
+    /// True once finish() sealed a log without gaps; verification may then skip the image.
+    pub fn isComplete(self: *const DigestLog) bool {
+        return !self.isBroken and self.imageDigest != null;
+    }
+
+    pub fn chunkCount(self: *const DigestLog) usize {
+        return self.chunkDigests.items.len;
+    }
+
+    /// Byte length of chunk `index`; only the last chunk may be short.
+    pub fn chunkLen(self: *const DigestLog, index: usize) u64 {
+        const offset = @as(u64, index) * CHUNK_SIZE;
+        return @min(CHUNK_SIZE, self.hashedBytes - offset);
+    }
+
+    /// Marks the log unusable; later updates are ignored.
+    pub fn invalidate(self: *DigestLog, reason: []const u8) void {
+        if (self.isBroken) return;
+        self.isBroken = true;
+        Debug.log(.WARNING, "Inline image digests disabled ({s}); verification will read the image again.", .{reason});
+    }
+
+    /// Hashes image `bytes` found at `offset`, which must continue the hashed prefix.
+    pub fn update(self: *DigestLog, offset: u64, bytes: []const u8) void {
+        if (!self.accepts(offset)) return;
+
+        var rest = bytes;
+        while (rest.len > 0) {
+            const len: usize = @intCast(@min(@as(u64, rest.len), CHUNK_SIZE - self.chunkFill));
+            self.chunkHasher.update(rest[0..len]);
+            self.advance(len);
+            rest = rest[len..];
+        }
+    }
+
+    /// Hashes `len` zero bytes at `offset` (sparse and unallocated ranges) without
+    /// materializing them: whole chunks reuse the zero chunk digest.
+    pub fn updateZeros(self: *DigestLog, offset: u64, len: u64) void {
+        if (!self.accepts(offset)) return;
+
+        var remaining = len;
+        while (remaining > 0 and !self.isBroken) {
+            if (self.chunkFill == 0 and remaining >= CHUNK_SIZE) {
+                self.appendChunk(self.zeroChunkDigest);
+                self.hashedBytes += CHUNK_SIZE;
+                remaining -= CHUNK_SIZE;
+                continue;
+            }
+
+            const step: usize = @intCast(@min(remaining, @min(@as(u64, ZERO_BLOCK.len), CHUNK_SIZE - self.chunkFill)));
+            self.chunkHasher.update(ZERO_BLOCK[0..step]);
+            self.advance(step);
+            remaining -= step;
+        }
+    }
+
+    /// Seals the log once the write finished: the partial last chunk is hashed and the
+    /// image digest computed. `imageSize` must match the bytes hashed.
+    pub fn finish(self: *DigestLog, imageSize: u64) void {
+        if (self.isBroken) return;
+        if (self.hashedBytes != imageSize) {
+            Debug.log(.DEBUG, "Digest log covers {d} of {d} image bytes.", .{ self.hashedBytes, imageSize });
+            return self.invalidate("the write path did not hash the whole image");
+        }
+
+        if (self.chunkFill > 0) self.sealChunk();
+        if (self.isBroken) return;
+
+        const digest = imagehash.combineChunkDigests(self.hashedBytes, self.chunkDigests.items);
+        self.imageDigest = digest;
+
+        Debug.log(.INFO, "Image digest over {d} bytes ({d} chunks): {s}", .{ self.hashedBytes, self.chunkCount(), std.fmt.bytesToHex(digest, .lower) });
+    }
+
+    fn accepts(self: *DigestLog, offset: u64) bool {
+        if (self.isBroken) return false;
+        if (self.imageDigest != null or offset != self.hashedBytes) {
+            self.invalidate("image bytes arrived out of order");
+            return false;
+        }
+        return true;
+    }
+
+    fn advance(self: *DigestLog, len: usize) void {
+        self.chunkFill += len;
+        self.hashedBytes += len;
+        if (self.chunkFill == CHUNK_SIZE) self.sealChunk();
+    }
+
+    fn sealChunk(self: *DigestLog) void {
+        var digest: Digest = undefined;
+        self.chunkHasher.final(&digest);
+        self.chunkHasher = Blake3.init(.{});
+        self.chunkFill = 0;
+        self.appendChunk(digest);
+    }
+
+    fn appendChunk(self: *DigestLog, digest: Digest) void {
+        self.chunkDigests.append(self.allocator, digest) catch self.invalidate("out of memory");
+    }
+};
+
+// ============================================================================
+// TESTS
+// ============================================================================
+
+test "DigestLog chunk digests do not depend on how the image was split" {
+    const allocator = std.testing.allocator;
+
+    const imageSize = CHUNK_SIZE * 2 + 1000;
+    const image = try allocator.alloc(u8, imageSize);
+    defer allocator.free(image);
+    for (image, 0..) |*byte, i| byte.* = @truncate(i *% 13 + 7);
+    // A zero range that straddles the first chunk boundary
+    @memset(image[CHUNK_SIZE - 500 .. CHUNK_SIZE + 700], 0);
+
+    var whole = DigestLog.init(allocator);
+    defer whole.deinit();
+    whole.update(0, image);
+    whole.finish(imageSize);
+
+    var pieces = DigestLog.init(allocator);
+    defer pieces.deinit();
+    pieces.update(0, image[0 .. CHUNK_SIZE - 500]);
+    pieces.updateZeros(CHUNK_SIZE - 500, 1200);
+    pieces.update(CHUNK_SIZE + 700, image[CHUNK_SIZE + 700 ..]);
+    pieces.finish(imageSize);
+
+    try std.testing.expect(whole.isComplete() and pieces.isComplete());
+    try std.testing.expectEqual(@as(usize, 3), pieces.chunkCount());
+    try std.testing.expectEqual(@as(u64, 1000), pieces.chunkLen(2));
+    try std.testing.expectEqualSlices(Digest, whole.chunkDigests.items, pieces.chunkDigests.items);
+    try std.testing.expectEqual(whole.imageDigest.?, pieces.imageDigest.?);
+    try std.testing.expectEqual(hashChunk(image[CHUNK_SIZE * 2 ..]), pieces.chunkDigests.items[2]);
+}
+
+test "DigestLog reuses the zero chunk digest and breaks on gaps" {
+    const allocator = std.testing.allocator;
+
+    const zeros = try allocator.alloc(u8, CHUNK_SIZE);
+    defer allocator.free(zeros);
+    @memset(zeros, 0);
+
+    var log = DigestLog.init(allocator);
+    defer log.deinit();
+    try std.testing.expectEqual(hashChunk(zeros), log.zeroChunkDigest);
+
+    log.updateZeros(0, CHUNK_SIZE * 3);
+    try std.testing.expectEqual(@as(usize, 3), log.chunkCount());
+
+    // Skipping ahead leaves a hole the log cannot vouch for
+    log.update(CHUNK_SIZE * 3 + 1, "late");
+    log.finish(CHUNK_SIZE * 3 + 5);
+    try std.testing.expect(!log.isComplete());
+}
@@ -6,24 +6,45 @@
 //!
 //! Key Operations:
 //! - Image writing with optimized block-aligned buffering
+//! - Pipelined reads overlapping source I/O with device writes
+//! - Memory-mapped image source: chunks are written and verified straight from mapped pages
+//! - io_uring write engine with fixed buffers on Linux hosts
+//! - Optional zero-copy (copy_file_range/splice) transfer on Linux hosts
+//! - Sparse mode: holes and all-zero chunks are skipped or discarded by policy
+//! - Delta mode: only chunks that differ from the device contents are rewritten
+//! - Block map (.bmap) mode: only mapped ranges are written, checked against their checksums
+//! - Android sparse images: RAW/FILL chunks are streamed to the device, DONT_CARE skipped
+//! - Apple UDIF (.dmg) images: chunks are decompressed in parallel and written in order
+//! - Virtual disks (qcow2/VHD/VHDX/VMDK): allocated clusters are streamed, unallocated ones are sparse
+//! - Streaming decompression of gzip/xz/zstd images on the reader thread
+//! - Fan-out: one source read feeding a writer thread per target device
 //! - Device capacity probing for safe write chunk sizes
+//! - Throughput autotuning of chunk size (and io_uring queue depth) on large images
 //! - Real-time progress reporting via XPC to GUI
 //! - Byte-by-byte verification of written data
+//! - One page-aligned BufferPool per job, shared by the write, decompress and verify stages
+//! - Checkpoint journal: interrupted writes of raw images resume after the last synced offset
 //! - Aggressive caching optimization (fcntl flags)
 //!
 //! Performance Characteristics:
 //! - Uses direct write to device (no extra buffering layers)
+//! - Reader thread fills a ring of aligned buffers while the device is written
 //! - Probes device capabilities (block size, max write blocks)
 //! - Adaptive chunk sizing (4-16 MB, aligned to device blocks)
-//! - Batched progress updates to reduce XPC overhead
+//! - Progress sampled on its own thread at 10 Hz; the I/O loop only bumps counters
 //! - Prefetching enabled on source image
 //!
 //! Reliability:
-//! - Single fsync() at end of write operation (via Zig's sync() abstraction)
-//! - Byte-by-byte verification with mismatch detection
+//! - Incremental writeback keeps dirty data bounded, so the final fsync() is short
+//! - One fsync() at end of write operation (via Zig's sync() abstraction), plus one
+//!   per checkpoint interval when the checkpoint journal is enabled
+//! - Failing chunks are retried and bisected to the failing blocks (see recovery.zig)
+//! - Byte-by-byte verification; mismatching ranges are rewritten and checked again
+//!   instead of failing the job (see repair.zig)
 //! - Comprehensive error logging
 
 const std = @import("std");
+const builtin = @import("builtin");
 const env = @import("../env.zig");
 const testing = std.testing;
 const freetracer_lib = @import("freetracer-lib");
@@ -38,6 +59,7 @@ const c = freetracer_lib.c;
 const String = freetracer_lib.String;
 const Character = freetracer_lib.constants.Character;
 const ImageType = freetracer_lib.types.ImageType;
+const SparseMode = freetracer_lib.types.SparseMode;
 const DeviceHandle = freetracer_lib.device.DeviceHandle;
 
 const isFilePathAllowed = freetracer_lib.fs.isFilePathAllowed;
@@ -46,6 +68,31 @@ const XPCService = freetracer_lib.Mach.XPCService;
 const XPCConnection = freetracer_lib.Mach.XPCConnection;
 const XPCObject = freetracer_lib.Mach.XPCObject;
 
+const Uring = freetracer_lib.Uring;
+const ZeroCopy = freetracer_lib.ZeroCopy;
+const simd = freetracer_lib.simd;
+const compression = freetracer_lib.compression;
+const autotune = freetracer_lib.autotune;
+const bmap = freetracer_lib.bmap;
+const simg = freetracer_lib.simg;
+const udif = freetracer_lib.udif;
+const vdisk = freetracer_lib.vdisk;
+const imagesource = freetracer_lib.imagesource;
+const ImageSource = imagesource.ImageSource;
+const BufferPool = freetracer_lib.bufferpool.BufferPool;
+
+const pipeline = @import("pipeline.zig");
+const checkpoint = @import("checkpoint.zig");
+const mapping = @import("mapping.zig");
+const sampling = @import("sampling.zig");
+const writeback = @import("writeback.zig");
+const recovery = @import("recovery.zig");
+const digestlog = @import("digestlog.zig");
+const quickverify = @import("quickverify.zig");
+const repair = @import("repair.zig");
+
+const isLinux = builtin.os.tag == .linux;
+
 const MIN_WRITE_SIZE = 4 * 1_024 * 1_024; // 4 MB minimum - safety threshold
 const MAX_WRITE_SIZE = 16 * 1_024 * 1_024; // 16 MB maximum - prevent excessive memory use
 
@@ -80,17 +127,9 @@ const MAX_WRITE_SIZE = 16 * 1_024 * 1_024; // 16 MB maximum - prevent excessive
 ///   - Validates non-zero values before use
 fn probeDeviceWriteSize(device: std.fs.File) u64 {
     const fd: c_int = @intCast(device.handle);
-    var blockSize: u32 = 4096; // Default: 4KB sectors
+    const blockSize = probeDeviceBlockSize(device);
     var maxBlockCount: u32 = 0;
 
-    // Query physical block size
-    if (c.ioctl(fd, c.DKIOCGETBLOCKSIZE, @as(?*c_uint, @ptrCast(&blockSize))) != 0 or blockSize == 0) {
-        Debug.log(.WARNING, "DKIOCGETBLOCKSIZE failed, using default 4KB block size", .{});
-        blockSize = 4096;
-    } else {
-        Debug.log(.INFO, "Device block size: {d} bytes", .{blockSize});
-    }
-
     // Query max write blocks
     if (c.ioctl(fd, c.DKIOCGETMAXBLOCKCOUNTWRITE, @as(?*c_uint, @ptrCast(&maxBlockCount))) != 0 or maxBlockCount == 0) {
         Debug.log(.WARNING, "DKIOCGETMAXBLOCKCOUNTWRITE failed, using default 1024 blocks", .{});
@@ -116,6 +155,334 @@ fn probeDeviceWriteSize(device: std.fs.File) u64 {
     return finalSize;
 }
 
+/// Queries DKIOCGETBLOCKSIZE; falls back to 4KB sectors when the device reports nothing.
+fn probeDeviceBlockSize(device: std.fs.File) u32 {
+    const fd: c_int = @intCast(device.handle);
+    var blockSize: u32 = 4096; // Default: 4KB sectors
+
+    if (c.ioctl(fd, c.DKIOCGETBLOCKSIZE, @as(?*c_uint, @ptrCast(&blockSize))) != 0 or blockSize == 0) {
+        Debug.log(.WARNING, "DKIOCGETBLOCKSIZE failed, using default 4KB block size", .{});
+        return 4096;
+    }
+
+    Debug.log(.INFO, "Device block size: {d} bytes", .{blockSize});
+    return blockSize;
+}
+
+// Batch progress updates to reduce XPC message overhead
+const PROGRESS_UPDATE_INTERVAL_BYTES = 8 * 1_024 * 1_024; // Verification updates the UI every 8MB
+const PROGRESS_UPDATE_INTERVAL_NS = 100_000_000; // Also update every 100ms to prevent XPC saturation
+
+/// Buffers in flight on each side of verification (image reader, device reader).
+/// Two per side lets each reader fill one buffer while the comparator drains the other.
+const VERIFY_RING_SLOTS = 2;
+
+/// Size of every buffer in a job's BufferPool: the largest chunk any stage transfers
+/// (probed sizes and autotune candidates are both capped at MAX_WRITE_SIZE).
+pub const POOL_BUFFER_SIZE = MAX_WRITE_SIZE;
+
+/// Number of pool buffers needed by the most demanding stage of a job run with `options`.
+/// Stages run one after another and return their buffers, so the pool is sized for the
+/// largest of them rather than their sum:
+///   - pipelined write: ring slots + decompressor + delta device buffer
+///   - io_uring write: one buffer per queue slot
+///   - verification: image and device reader rings + decompressor
+pub fn poolBufferCount(options: WriteOptions) usize {
+    const ringSlots = std.math.clamp(options.pipelineDepth, 2, pipeline.MAX_RING_SLOTS);
+    const uringSlots: usize = if (comptime isLinux) @max(options.queueDepth, 1) else 0;
+    return @max(ringSlots + 2, uringSlots, 2 * VERIFY_RING_SLOTS + 1);
+}
+
+pub const BadBlockPolicy = recovery.Policy;
+
+/// Tunables for a single write job, parsed from the XPC request by the caller.
+pub const WriteOptions = struct {
+    /// Number of buffers kept in flight between the image reader thread and the device writer.
+    /// Values below 2 fall back to the blocking single-buffer read/write loop.
+    pipelineDepth: usize = pipeline.DEFAULT_RING_SLOTS,
+    /// Number of registered buffers kept in flight by the io_uring engine (Linux only).
+    queueDepth: u16 = Uring.DEFAULT_QUEUE_DEPTH,
+    /// How zero ranges of the image are handled. Anything but OFF relies on the caller's
+    /// guarantee about the target's prior contents (see SparseMode).
+    sparseMode: SparseMode = .OFF,
+    /// Measure candidate chunk sizes (and io_uring queue depths) on the first few hundred MB
+    /// of large images and keep the fastest, instead of the static device probe.
+    autotune: bool = true,
+    /// Record the durably written prefix in the host checkpoint journal and resume an
+    /// interrupted write of the same image to the same device (uncompressed images only).
+    /// Opt-in: devices are told apart only by capacity and block size (see checkpoint.zig),
+    /// so the requester has to vouch that the target is the medium that was interrupted.
+    resumeFromCheckpoint: bool = false,
+    /// Write from (macOS) and verify against (all platforms) a memory mapping of the image
+    /// instead of copying each chunk into a buffer. Falls back to reads when mapping fails.
+    /// Opt-in: a read error or truncation of a mapped image raises SIGBUS and kills the
+    /// helper instead of failing the job, and the mapped write loop has no reader thread.
+    mapImage: bool = false,
+    /// Move image bytes to the device inside the kernel (copy_file_range or splice) instead of
+    /// through the io_uring buffers (Linux only). Ignored with a sparse mode; falls back to
+    /// io_uring when the kernel rejects the image/device pair.
+    zeroCopy: bool = false,
+    /// Push written data to the device every this many bytes instead of leaving it all to
+    /// the final sync (see writeback.zig). Rates then count durable bytes. 0 disables.
+    writebackInterval: u64 = writeback.DEFAULT_INTERVAL_BYTES,
+    /// What happens to blocks that stay unwritable after retries (see recovery.zig). Either
+    /// way a failing chunk is bisected first, so only the failing LBA range is reported.
+    badBlockPolicy: BadBlockPolicy = .ABORT,
+};
+
+/// Tracks write progress and emits ISO_WRITE_PROGRESS updates over XPC.
+/// Shared by all write loops so they report identically.
+///
+/// The I/O thread only counts bytes: advance() and friends publish the counters with
+/// relaxed atomic stores. Between start() and stop(), a sampler thread reads them at
+/// sampling.SAMPLE_INTERVAL_NS, derives the rates and sends the updates, so clock reads,
+/// rate arithmetic and XPC traffic never stall a write. stop() sends the final update.
+///
+/// For compressed images without size metadata the total is an estimate: it is
+/// extrapolated from the fraction of the compressed source consumed so far
+/// (see trackSource) and pinned to the real byte count by finish().
+///
+/// Must not be moved between start() and stop(); the sampler holds a pointer to it.
+const WriteProgress = struct {
+    connection: XPCConnection,
+    totalBytes: u64,
+    currentByte: u64 = 0,
+    /// Bytes accounted for without being written (delta mode: already identical on the device)
+    bytesSkipped: u64 = 0,
+    /// True while `totalBytes` is extrapolated from `sourceTotalBytes`
+    isTotalEstimated: bool = false,
+    sourceTotalBytes: u64 = 0,
+    /// Target index within a fan-out job; reported as `device_index` when set
+    deviceIndex: ?u64 = null,
+    /// Offset the job resumed from; bytes below it do not count towards the average rate
+    startByte: u64 = 0,
+    checkpointer: ?*checkpoint.Checkpointer = null,
+    flusher: ?writeback.Flusher = null,
+    badBlocks: ?recovery.Recovery = null,
+    /// Hashes the image bytes as they are written (see hashImage)
+    digests: ?*digestlog.DigestLog = null,
+    /// Every byte below this offset has been written (last value passed to markDurable)
+    writtenPrefix: u64 = 0,
+    /// Set with a flusher: rates are measured on durable bytes instead of written bytes.
+    /// Fixed before start(), so the sampler thread may read it.
+    isRateDurable: bool = false,
+    /// Snapshot of the fields above that the sampler thread reads
+    counters: sampling.Counters = .{},
+    sampler: sampling.Sampler = .{},
+    /// Owned by the sampler thread while it runs, by the caller of stop() afterwards
+    rates: sampling.RateTracker,
+    clock: std.time.Timer,
+
+    fn init(connection: XPCConnection, totalBytes: u64) !WriteProgress {
+        var progress = WriteProgress{
+            .connection = connection,
+            .totalBytes = totalBytes,
+            .rates = sampling.RateTracker.init(0, 0),
+            .clock = try std.time.Timer.start(),
+        };
+        progress.publish();
+        return progress;
+    }
+
+    /// Creates a tracker whose total is extrapolated from the consumed share of a
+    /// `sourceTotalBytes`-sized compressed source.
+    fn initEstimated(connection: XPCConnection, sourceTotalBytes: u64) !WriteProgress {
+        var progress = try WriteProgress.init(connection, sourceTotalBytes);
+        progress.isTotalEstimated = true;
+        progress.sourceTotalBytes = sourceTotalBytes;
+        return progress;
+    }
+
+    fn isComplete(self: *const WriteProgress) bool {
+        return !self.isTotalEstimated and self.currentByte >= self.totalBytes;
+    }
+
+    /// Starts the sampler thread. Rates are measured from the current byte onwards.
+    fn start(self: *WriteProgress) !void {
+        self.rates = sampling.RateTracker.init(self.currentByte, self.clock.read());
+        self.counters.durableBytes.store(self.currentByte, .monotonic);
+        try self.sampler.start(self, sample);
+    }
+
+    /// Stops the sampler thread and sends a final update reflecting the last counters.
+    fn stop(self: *WriteProgress) void {
+        self.sampler.stop();
+        self.sendUpdate();
+        if (self.badBlocks) |*badBlocks| badBlocks.report.log(badBlocks.blockSize);
+    }
+
+    /// Re-estimates the total from the compressed source position. No-op for exact totals.
+    fn trackSource(self: *WriteProgress, sourceConsumedBytes: u64) void {
+        if (!self.isTotalEstimated or sourceConsumedBytes == 0) return;
+
+        const estimate = @as(u128, self.currentByte) * self.sourceTotalBytes / sourceConsumedBytes;
+        self.totalBytes = @max(self.currentByte, @as(u64, @intCast(@min(estimate, std.math.maxInt(u64)))));
+        self.counters.totalBytes.store(self.totalBytes, .monotonic);
+    }
+
+    /// Pins an estimated total to the bytes actually processed.
+    fn finish(self: *WriteProgress) void {
+        if (!self.isTotalEstimated) return;
+
+        self.isTotalEstimated = false;
+        self.totalBytes = self.currentByte;
+        self.counters.totalBytes.store(self.totalBytes, .monotonic);
+    }
+
+    /// Records the chunk size and queue depth in use so updates can report them.
+    /// Public so the io_uring engine can report autotuner decisions through it.
+    pub fn setIoConfig(self: *WriteProgress, chunkSize: u64, queueDepth: u64) void {
+        self.counters.chunkSize.store(chunkSize, .monotonic);
+        self.counters.queueDepth.store(queueDepth, .monotonic);
+    }
+
+    /// Starts the tracker at the checkpointer's resume offset and records checkpoints
+    /// through it from then on (see markDurable). Call before start().
+    fn attachCheckpointer(self: *WriteProgress, checkpointer: ?*checkpoint.Checkpointer) void {
+        const attached = checkpointer orelse return;
+
+        self.checkpointer = attached;
+        self.startByte = attached.startOffset;
+        self.currentByte = attached.startOffset;
+        self.writtenPrefix = attached.startOffset;
+        self.publish();
+    }
+
+    /// Pushes written data to the device every `interval` bytes from now on (see
+    /// markDurable). Call after attachCheckpointer() and before start(); 0 is a no-op.
+    fn attachFlusher(self: *WriteProgress, interval: u64) void {
+        if (interval == 0) return;
+
+        self.flusher = writeback.Flusher.init(self.currentByte, interval);
+        self.isRateDurable = true;
+    }
+
+    /// Routes chunk writes through bad-block recovery (see writeChunk). Call before start().
+    fn attachRecovery(self: *WriteProgress, policy: recovery.Policy, blockSize: u64) void {
+        self.badBlocks = recovery.Recovery.init(blockSize, policy);
+    }
+
+    /// Hashes the image on its way to the device so verification can skip re-reading it.
+    /// The log needs every byte from 0, so a resumed job invalidates it. Call after
+    /// attachCheckpointer().
+    fn attachDigests(self: *WriteProgress, digests: ?*digestlog.DigestLog) void {
+        const attached = digests orelse return;
+
+        if (self.currentByte > 0) return attached.invalidate("the write resumed from a checkpoint");
+        self.digests = attached;
+    }
+
+    /// Feeds image `bytes` at `offset` to the attached digest log, if any.
+    fn hashImage(self: *WriteProgress, offset: u64, bytes: []const u8) void {
+        if (self.digests) |digests| digests.update(offset, bytes);
+    }
+
+    /// Feeds a zero range of the image (a ZERO slot) to the attached digest log, if any.
+    fn hashZeros(self: *WriteProgress, offset: u64, len: u64) void {
+        if (self.digests) |digests| digests.updateZeros(offset, len);
+    }
+
+    /// Seals the attached digest log over everything accounted for. Call once the write
+    /// completed; a log left unsealed is treated as incomplete by verifyWrittenBytes.
+    fn sealDigests(self: *WriteProgress) void {
+        if (self.digests) |digests| digests.finish(self.currentByte);
+    }
+
+    /// Writes one chunk to `device` at `offset`. With recovery attached, an I/O error
+    /// isolates and retries the failing blocks instead of failing the job outright.
+    fn writeChunk(self: *WriteProgress, device: std.fs.File, bytes: []const u8, offset: u64) !void {
+        const badBlocks = if (self.badBlocks) |*attached| attached else return device.pwriteAll(bytes, offset);
+
+        const result = badBlocks.pwriteAll(device, bytes, offset);
+        self.counters.badBytes.store(badBlocks.report.totalBytes, .monotonic);
+        return result;
+    }
+
+    /// Moves the cursor back to `offset` so a fallback path can rewrite everything after it.
+    fn rewindTo(self: *WriteProgress, offset: u64) void {
+        self.currentByte = offset;
+        self.counters.bytes.store(offset, .monotonic);
+    }
+
+    /// Reports that every byte below `durableOffset` has been written to `target`. The
+    /// flusher advances device writeback, and the checkpointer syncs the target and
+    /// journals the offset, whenever their intervals are due.
+    /// Public so the io_uring engine can report its completed prefix through it.
+    pub fn markDurable(self: *WriteProgress, target: std.fs.File, durableOffset: u64) !void {
+        self.writtenPrefix = durableOffset;
+        if (self.flusher) |*flusher| {
+            const flushedOffset = try flusher.advance(target, durableOffset);
+            self.counters.durableBytes.store(flushedOffset, .monotonic);
+        }
+        if (self.checkpointer) |checkpointer| try checkpointer.record(target, durableOffset);
+    }
+
+    /// Final sync of `target`; everything accounted for so far is durable afterwards.
+    fn syncTarget(self: *WriteProgress, target: std.fs.File) !void {
+        try target.sync();
+        self.markSynced();
+    }
+
+    /// Records that the target was synced by an engine that syncs on its own.
+    fn markSynced(self: *WriteProgress) void {
+        self.counters.durableBytes.store(self.currentByte, .monotonic);
+    }
+
+    /// Accounts for `bytesSkipped` bytes that needed no write, then advances like advance().
+    fn skip(self: *WriteProgress, bytesSkipped: u64) !void {
+        self.bytesSkipped += bytesSkipped;
+        self.counters.bytesSkipped.store(self.bytesSkipped, .monotonic);
+        try self.advance(bytesSkipped);
+    }
+
+    /// Accounts for `bytesWritten` additional bytes. The sampler thread picks them up.
+    /// Public so the io_uring engine in freetracer-lib can report completions through it.
+    pub fn advance(self: *WriteProgress, bytesWritten: u64) !void {
+        self.currentByte += bytesWritten;
+        self.counters.bytes.store(self.currentByte, .monotonic);
+    }
+
+    fn publish(self: *WriteProgress) void {
+        self.counters.bytes.store(self.currentByte, .monotonic);
+        self.counters.bytesSkipped.store(self.bytesSkipped, .monotonic);
+        self.counters.totalBytes.store(self.totalBytes, .monotonic);
+    }
+
+    /// Sampler thread entry point.
+    fn sample(self: *WriteProgress) void {
+        self.sendUpdate();
+    }
+
+    /// Builds an update from the published counters. Reads nothing the I/O thread writes
+    /// non-atomically, so it is safe on the sampler thread.
+    fn sendUpdate(self: *WriteProgress) void {
+        const bytes = self.counters.bytes.load(.monotonic);
+        const totalBytes = @max(self.counters.totalBytes.load(.monotonic), bytes);
+        const chunkSize = self.counters.chunkSize.load(.monotonic);
+        const durableBytes = self.counters.durableBytes.load(.monotonic);
+        const rates = self.rates.update(if (self.isRateDurable) durableBytes else bytes, self.clock.read());
+
+        const progressUpdate = XPCService.createResponse(.ISO_WRITE_PROGRESS);
+        defer XPCService.releaseObject(progressUpdate);
+        XPCService.createUInt64(progressUpdate, "write_progress", sampling.percentOf(bytes, totalBytes));
+        XPCService.createUInt64(progressUpdate, "write_rate", rates.instant);
+        XPCService.createUInt64(progressUpdate, "write_rate_ewma", rates.smoothed);
+        XPCService.createUInt64(progressUpdate, "write_rate_avg", rates.average);
+        XPCService.createUInt64(progressUpdate, "write_bytes", bytes);
+        XPCService.createUInt64(progressUpdate, "write_total_size", totalBytes);
+        XPCService.createUInt64(progressUpdate, "write_bytes_skipped", self.counters.bytesSkipped.load(.monotonic));
+        if (self.isRateDurable) XPCService.createUInt64(progressUpdate, "write_bytes_durable", durableBytes);
+        const badBytes = self.counters.badBytes.load(.monotonic);
+        if (badBytes > 0) XPCService.createUInt64(progressUpdate, "write_bytes_bad", badBytes);
+        if (self.deviceIndex) |index| XPCService.createUInt64(progressUpdate, "device_index", index);
+        if (chunkSize > 0) {
+            XPCService.createUInt64(progressUpdate, "write_chunk_size", chunkSize);
+            XPCService.createUInt64(progressUpdate, "write_queue_depth", self.counters.queueDepth.load(.monotonic));
+        }
+        XPCService.connectionSendMessage(self.connection, progressUpdate);
+    }
+};
+
 /// Writes an image to target device with aggressive performance optimization.
 /// Core operation: read from image file, write directly to device.
 /// Real-time progress is sent to GUI via XPC with instantaneous and average rates.
@@ -124,9 +491,16 @@ fn probeDeviceWriteSize(device: std.fs.File) u64 {
 ///   connection: XPC connection to GUI for progress updates
 ///   imageFile: Open ISO image file (read position at start)
 ///   deviceHandle: Target device to write to
+///   options: Per-job tunables (pipeline depth, io_uring queue depth, sparse mode)
+///   pool: Job buffer pool with at least poolBufferCount(options) buffers of POOL_BUFFER_SIZE
+///   digests: Optional log filled with the image's chunk digests for verifyWrittenBytes.
+///     Raw, compressed and virtual disk images written by the read/write loops fill it;
+///     other paths (io_uring, resumed jobs, sparse and UDIF chunk tables) leave it incomplete
 ///
 /// `Errors`:
 ///   Propagates file I/O errors from read/write operations
+///   error.BadBlock: a block stayed unwritable after retries (options.badBlockPolicy = ABORT)
+///   error.TooManyBadBlocks: more than recovery.MAX_BAD_RANGES failing ranges (SKIP)
 ///
 /// `Performance Optimizations`:
 ///   1. fcntl(F_NOCACHE): Disable filesystem caching on both files
@@ -138,27 +512,102 @@ fn probeDeviceWriteSize(device: std.fs.File) u64 {
 ///   3. Device-optimal chunk size (4-16 MB block-aligned)
 ///      - Minimizes syscall overhead
 ///      - Aligns with device's native I/O capabilities
-///   4. Single fsync() at end via Zig's sync()
-///      - Ensures all data reaches device
-///      - Amortized cost compared to sync after each chunk
+///   4. Pipelined reads (see writePipelined)
+///      - Reader thread keeps the source busy while the device is written
+///      - On large images the write size is autotuned from measured throughput
+///   5. Incremental writeback every options.writebackInterval bytes (see writeback.zig)
+///      - The kernel drains dirty pages behind the cursor instead of at the end
+///      - Rates count bytes that reached the device, not bytes that were buffered
+///   6. Final fsync() via Zig's sync()
+///      - Ensures all data reaches device, including the device's volatile cache
+///      - Takes milliseconds when writeback has kept up
+///
+/// `Resuming`:
+///   With options.resumeFromCheckpoint, uncompressed images are checkpointed every
+///   checkpoint.CHECKPOINT_INTERVAL_BYTES (device sync + journal record). A new job for the
+///   same image/device pair spot-checks the checkpointed prefix and continues after it;
+///   progress then starts at the resume offset. The journal is cleared on success.
 ///
 /// `Progress Reporting`:
-///   Sends updates on dual triggers to prevent both flooding XPC and stale UI:
-///   - Byte-based: Every 8 MB written (avoids excessive overhead)
-///   - Time-based: Every 100 ms (ensures responsive UI even on slow devices)
+///   The write loop only publishes byte counters; a sampler thread sends updates:
+///   - Time-based: Every 100 ms (sampling.SAMPLE_INTERVAL_NS), independent of chunk size
 ///   - Completion: Final update when write finishes
 ///
 /// `Reported Metrics`:
 ///   - write_progress: Percentage complete (0-100)
 ///   - write_rate: Current instantaneous write rate (bytes/sec)
+///   - write_rate_ewma: Exponentially smoothed write rate (bytes/sec)
 ///   - write_rate_avg: Average rate since start (bytes/sec)
 ///   - write_bytes: Total bytes written so far
 ///   - write_total_size: Total image size
-pub fn writeImage(connection: XPCConnection, imageFile: std.fs.File, deviceHandle: DeviceHandle) !void {
+///   - write_bytes_skipped: Bytes not written because the device already held them (delta mode)
+///   - write_bytes_durable: Bytes handed to the device by incremental writeback (when enabled)
+///   - write_bytes_bad: Bytes left unwritten by bad-block recovery (SKIP policy, when non-zero)
+///   - write_chunk_size / write_queue_depth: Transfer parameters in effect (autotuned or probed)
+///
+/// `Platforms`:
+///   macOS uses the read/write loops below; Linux hands the transfer to the io_uring
+///   engine (see writeImageUring). Both report through the same WriteProgress.
+///   Compressed images (gzip/xz/zstd, detected by magic) take writeCompressedImage,
+///   Android sparse images writeAndroidSparseImage, UDIF images writeUdifImage and
+///   virtual disks writeVirtualDiskImage, on both platforms.
+pub fn writeImage(connection: XPCConnection, imageFile: std.fs.File, deviceHandle: DeviceHandle, options: WriteOptions, pool: *BufferPool, digests: ?*digestlog.DigestLog) !void {
     Debug.log(.INFO, "Begin writing prep...", .{});
 
-    const device = deviceHandle.raw;
+    const imageCompression = compression.detect(imageFile);
+
+    if (udif.detect(imageFile)) {
+        try writeUdifImage(connection, imageFile, deviceHandle.raw, options, pool);
+    } else if (vdisk.detect(imageFile) != null) {
+        try writeVirtualDiskImage(connection, imageFile, deviceHandle.raw, options, pool, digests);
+    } else if (simg.detect(imageFile)) {
+        try writeAndroidSparseImage(connection, imageFile, deviceHandle.raw, options, pool);
+    } else if (imageCompression != .NONE) {
+        // A decoder cannot start mid-stream, so compressed images always restart from byte 0
+        try writeCompressedImage(connection, imageFile, deviceHandle.raw, imageCompression, options, pool, digests);
+    } else {
+        var journalDir = if (options.resumeFromCheckpoint) openCheckpointJournal() else null;
+        defer if (journalDir) |*dir| dir.close();
+
+        var checkpointer = if (journalDir) |dir| initCheckpointer(dir, imageFile, deviceHandle.raw, pool) else null;
+        const checkpointerRef: ?*checkpoint.Checkpointer = if (checkpointer) |*cp| cp else null;
+
+        if (comptime isLinux) {
+            try writeImageUring(connection, imageFile, deviceHandle.raw, options, pool, checkpointerRef);
+        } else {
+            try writeImageDarwin(connection, imageFile, deviceHandle.raw, options, pool, checkpointerRef, digests);
+        }
 
+        if (checkpointer) |*cp| cp.complete();
+    }
+
+    Debug.log(.INFO, "Finished writing image to device!", .{});
+}
+
+/// Opens the host checkpoint journal directory, or returns null (no resume, no checkpoints).
+fn openCheckpointJournal() ?std.fs.Dir {
+    return checkpoint.openJournalDir() catch |err| {
+        Debug.log(.WARNING, "Checkpoint journal unavailable ({any}); the write cannot be resumed if interrupted.", .{err});
+        return null;
+    };
+}
+
+/// Identifies the image/device pair and resolves where the write starts (see checkpoint.zig).
+/// Returns null, i.e. write from byte 0 without checkpoints, when the image cannot be identified.
+fn initCheckpointer(journalDir: std.fs.Dir, imageFile: std.fs.File, device: std.fs.File, pool: *BufferPool) ?checkpoint.Checkpointer {
+    const image = checkpoint.identifyImage(imageFile) catch |err| {
+        Debug.log(.WARNING, "Unable to identify the image for checkpointing ({any}); the write cannot be resumed.", .{err});
+        return null;
+    };
+
+    var checkpointer = checkpoint.Checkpointer.init(journalDir, image, checkpoint.identifyDevice(device, probeBlockSize(device)));
+    checkpointer.resolveStartOffset(imageFile, device, pool);
+    return checkpointer;
+}
+
+/// macOS write path: disables the buffer cache, probes the device via DKIOC ioctls and
+/// runs either the pipelined or the sequential read/write loop.
+fn writeImageDarwin(connection: XPCConnection, imageFile: std.fs.File, device: std.fs.File, options: WriteOptions, pool: *BufferPool, checkpointer: ?*checkpoint.Checkpointer, digests: ?*digestlog.DigestLog) !void {
     const noCacheDevice = c.fcntl(device.handle, c.F_NOCACHE, @as(c_int, 1));
     const noCacheImage = c.fcntl(imageFile.handle, c.F_NOCACHE, @as(c_int, 1));
     const imagePrefetcher = c.fcntl(imageFile.handle, c.F_RDAHEAD, @as(c_int, 1));
@@ -171,236 +620,1737 @@ pub fn writeImage(connection: XPCConnection, imageFile: std.fs.File, deviceHandl
     const fileStat = try imageFile.stat();
     const imageSize = fileStat.size;
 
-    // Allocate single read buffer (no extra buffering layer)
-    const readBuffer = try std.heap.page_allocator.alloc(u8, CHUNK_SIZE);
-    defer std.heap.page_allocator.free(readBuffer);
-
-    var xpcResponseTimer = try std.time.Timer.start();
-    var overallTimer = try std.time.Timer.start();
-
     Debug.log(.INFO, "File and device are opened successfully! File size: {d}", .{imageSize});
     Debug.log(.INFO, "Writing image to device with {d}MB chunks, please wait...", .{CHUNK_SIZE / (1024 * 1024)});
 
-    // Seek both files to start
-    try imageFile.seekTo(0);
-    try device.seekTo(0);
+    var progress = try WriteProgress.init(connection, imageSize);
+    progress.attachCheckpointer(checkpointer);
+    progress.attachDigests(digests);
+    progress.attachFlusher(options.writebackInterval);
+    progress.attachRecovery(options.badBlockPolicy, probeDeviceBlockSize(device));
+    progress.setIoConfig(CHUNK_SIZE, 1);
+    try progress.start();
+    defer progress.stop();
 
-    // Progress tracking variables
-    var currentByte: u64 = 0;
-    var lastProgressUpdateByte: u64 = 0;
-    var bytesSinceUpdate: u64 = 0;
-    var timerCheckCounter: u32 = 0;
+    // Sparse mode needs hole queries on the reader thread; otherwise the device is written
+    // straight from the mapped image whenever the filesystem supports mapping
+    var mappedImage = if (options.mapImage and options.sparseMode == .OFF) mapping.mapImageOrNull(imageFile, imageSize) else null;
+    defer if (mappedImage) |*image| image.deinit();
+
+    // The tuner times individual writes, which the blocking sequential loop does not split out
+    const isTunable = mappedImage != null or options.pipelineDepth >= 2 or options.sparseMode != .OFF;
+    var tuner = if (isTunable) initWriteAutotuner(options, imageSize, probeDeviceBlockSize(device)) else null;
+    const tunerRef: ?*autotune.Autotuner = if (tuner) |*t| t else null;
+    const ringChunkSize: u64 = if (tuner != null) MAX_WRITE_SIZE else CHUNK_SIZE;
+
+    var fileSource = imagesource.FileSource.initSized(imageFile, imageSize);
+
+    if (mappedImage) |*image| {
+        try writeMapped(image, device, CHUNK_SIZE, tunerRef, &progress);
+    } else if (options.sparseMode != .OFF) {
+        // Sparse mode relies on positional writes, so it always runs on the pipelined path
+        const depth = std.math.clamp(options.pipelineDepth, 2, pipeline.MAX_RING_SLOTS);
+        try writePipelined(fileSource.imageSource(), device, pool, ringChunkSize, depth, options.sparseMode, tunerRef, &progress);
+    } else if (options.pipelineDepth >= 2) {
+        try writePipelined(fileSource.imageSource(), device, pool, ringChunkSize, @min(options.pipelineDepth, pipeline.MAX_RING_SLOTS), .OFF, tunerRef, &progress);
+    } else {
+        try writeSequential(imageFile, device, pool, CHUNK_SIZE, &progress);
+    }
+
+    // Final sync to ensure all data is written to disk; short when writeback kept up
+    try progress.syncTarget(device);
+    progress.sealDigests();
+}
+
+/// Linux write path: keeps `options.queueDepth` registered buffers in flight via io_uring.
+/// Chunk size comes from BLKIOOPT/BLKSSZGET, so the same path serves block devices,
+/// loop devices and plain files. The engine syncs the target once all writes complete.
+fn writeImageUring(connection: XPCConnection, imageFile: std.fs.File, device: std.fs.File, options: WriteOptions, pool: *BufferPool, checkpointer: ?*checkpoint.Checkpointer) !void {
+    const imageSize = (try imageFile.stat()).size;
+
+    var progress = try WriteProgress.init(connection, imageSize);
+    progress.attachCheckpointer(checkpointer);
+    progress.attachFlusher(options.writebackInterval);
+    progress.attachRecovery(options.badBlockPolicy, probeBlockSize(device));
+    try progress.start();
+    defer progress.stop();
+
+    runKernelEngine(imageFile, device, options, pool, imageSize, &progress) catch |err| switch (err) {
+        // The kernel engines cannot retry single blocks, so finish with recovering writes.
+        // Completions arrive out of order; restart from the contiguous written prefix.
+        error.InputOutput => {
+            Debug.log(.WARNING, "Kernel write engine hit an I/O error; rewriting from byte {d} with bad-block recovery.", .{progress.writtenPrefix});
+            progress.rewindTo(progress.writtenPrefix);
+            try writeSequential(imageFile, device, pool, probeTransferSize(device), &progress);
+            return progress.syncTarget(device);
+        },
+        else => return err,
+    };
+    progress.markSynced();
+}
+
+/// Runs zero-copy (when enabled) and then io_uring from `progress.currentByte` to the end
+/// of the image. Both engines sync the target when they finish.
+fn runKernelEngine(imageFile: std.fs.File, device: std.fs.File, options: WriteOptions, pool: *BufferPool, imageSize: u64, progress: *WriteProgress) !void {
+    // Zero chunks cannot be detected in the kernel, so sparse modes stay on io_uring
+    if (options.zeroCopy and options.sparseMode == .OFF) {
+        if (try writeZeroCopy(imageFile, device, imageSize, progress)) return;
+    }
+
+    var engine = try Uring.UringWriter.init(std.heap.page_allocator, device, .{
+        .queueDepth = options.queueDepth,
+        .sparseMode = options.sparseMode,
+        .autotune = options.autotune and imageSize >= autotune.MIN_IMAGE_SIZE,
+        .pool = pool,
+    });
+    defer engine.deinit();
+
+    Debug.log(.INFO, "Writing {d} bytes via io_uring ({d} buffers of {d}MB in flight)", .{ imageSize, options.queueDepth, engine.chunkSize / (1024 * 1024) });
+
+    try engine.run(imageFile, device, progress.currentByte, imageSize, progress);
+}
+
+/// Runs the zero-copy engine from `progress.currentByte` with the probed chunk size.
+/// Returns false when the kernel rejects the image/device pair; `progress` then holds
+/// everything already transferred and the caller continues from there.
+fn writeZeroCopy(imageFile: std.fs.File, device: std.fs.File, imageSize: u64, progress: *WriteProgress) !bool {
+    var engine = ZeroCopy.ZeroCopyWriter.init(device, .{});
+    defer engine.deinit();
 
-    const PROGRESS_UPDATE_INTERVAL_BYTES = 8 * 1_024 * 1_024; // Update UI every 8MB
-    const PROGRESS_UPDATE_INTERVAL_NS = 100_000_000; // Also update every 100ms
-    const TIMER_CHECK_INTERVAL = 100; // Check elapsed time every N iterations
+    Debug.log(.INFO, "Writing {d} bytes via zero-copy transfer in {d}MB chunks", .{ imageSize - progress.currentByte, engine.chunkSize / (1024 * 1024) });
 
-    while (currentByte < imageSize) {
-        const bytesRead = try imageFile.read(readBuffer);
+    engine.run(imageFile, device, progress.currentByte, imageSize, progress) catch |err| switch (err) {
+        error.ZeroCopyUnsupported => {
+            Debug.log(.WARNING, "Kernel rejected zero-copy transfer at byte {d}; continuing with io_uring.", .{progress.currentByte});
+            return false;
+        },
+        else => return err,
+    };
+
+    return true;
+}
+
+/// Compressed write path: a decoder thread feeds decompressed chunks into the buffer ring
+/// while this thread writes them, so decompression overlaps with device I/O and the
+/// image never needs to be decompressed to disk.
+///
+/// `Progress`:
+///   - Total comes from container metadata (xz index, zstd frame header) when present
+///   - Otherwise it is extrapolated from the compressed bytes consumed (gzip, or
+///     encoders that omit the size) and pinned to the real size when the stream ends
+fn writeCompressedImage(connection: XPCConnection, imageFile: std.fs.File, device: std.fs.File, imageCompression: compression.Compression, options: WriteOptions, pool: *BufferPool, digests: ?*digestlog.DigestLog) !void {
+    if (comptime !isLinux) {
+        _ = c.fcntl(device.handle, c.F_NOCACHE, @as(c_int, 1));
+        _ = c.fcntl(imageFile.handle, c.F_RDAHEAD, @as(c_int, 1));
+    }
+
+    const chunkSize = probeTransferSize(device);
+    const compressedSize = (try imageFile.stat()).size;
+    const knownSize = compression.uncompressedSize(imageFile, imageCompression);
+
+    var stream: compression.DecompressStream = undefined;
+    try stream.initPooled(std.heap.page_allocator, pool, imageFile, imageCompression);
+    defer stream.deinit();
+
+    Debug.log(.INFO, "Writing {s} compressed image ({d} bytes, decompressed size: {?d}) with {d}MB chunks...", .{
+        @tagName(imageCompression),
+        compressedSize,
+        knownSize,
+        chunkSize / (1024 * 1024),
+    });
+
+    var progress = if (knownSize) |size| try WriteProgress.init(connection, size) else try WriteProgress.initEstimated(connection, compressedSize);
+    progress.attachDigests(digests);
+    progress.attachFlusher(options.writebackInterval);
+    progress.attachRecovery(options.badBlockPolicy, probeBlockSize(device));
+    progress.setIoConfig(chunkSize, 1);
+    try progress.start();
+    defer progress.stop();
+
+    // Without size metadata the compressed size is a lower bound for the decompressed one
+    var tuner = initWriteAutotuner(options, knownSize orelse compressedSize, probeBlockSize(device));
+    const tunerRef: ?*autotune.Autotuner = if (tuner) |*t| t else null;
+
+    var decompressSource = imagesource.DecompressSource{ .stream = &stream };
+    const depth = std.math.clamp(options.pipelineDepth, 2, pipeline.MAX_RING_SLOTS);
+    try writePipelined(decompressSource.imageSource(), device, pool, if (tuner != null) MAX_WRITE_SIZE else chunkSize, depth, options.sparseMode, tunerRef, &progress);
+    progress.finish();
+
+    try progress.syncTarget(device);
+    progress.sealDigests();
+}
+
+/// Blocking single-buffer loop: read a chunk, write it, repeat, from `progress.currentByte`.
+/// Kept as the fallback for pipelineDepth < 2 and for kernel engines that hit an I/O error.
+fn writeSequential(imageFile: std.fs.File, device: std.fs.File, pool: *BufferPool, chunkSize: u64, progress: *WriteProgress) !void {
+    // Single read buffer from the job pool (no extra buffering layer)
+    const poolBuffer = pool.tryAcquire() orelse return error.BufferPoolExhausted;
+    defer pool.release(poolBuffer);
+    const readBuffer = poolBuffer[0..@intCast(chunkSize)];
+
+    while (!progress.isComplete()) {
+        const bytesRead = try imageFile.pread(readBuffer, progress.currentByte);
 
         if (bytesRead == 0) {
-            Debug.log(.INFO, "End of image file reached at byte: {d}", .{currentByte});
+            Debug.log(.INFO, "End of image file reached at byte: {d}", .{progress.currentByte});
             break;
         }
 
         // Direct write to device (no extra buffering)
-        try device.writeAll(readBuffer[0..bytesRead]);
-
-        currentByte += @as(u64, @intCast(bytesRead));
-        bytesSinceUpdate += @as(u64, @intCast(bytesRead));
-
-        // Check if we should send progress update
-        const bytesSincLastUpdate = currentByte - lastProgressUpdateByte;
-        const shouldUpdateByBytes = bytesSincLastUpdate >= PROGRESS_UPDATE_INTERVAL_BYTES;
-        const isComplete = currentByte >= imageSize;
-
-        var shouldUpdateByTime = false;
-        timerCheckCounter += 1;
-        if (timerCheckCounter >= TIMER_CHECK_INTERVAL) {
-            const elapsedNsSinceLastUpdate = xpcResponseTimer.read();
-            shouldUpdateByTime = elapsedNsSinceLastUpdate >= PROGRESS_UPDATE_INTERVAL_NS;
-            timerCheckCounter = 0;
+        try progress.writeChunk(device, readBuffer[0..bytesRead], progress.currentByte);
+        progress.hashImage(progress.currentByte, readBuffer[0..bytesRead]);
+
+        try progress.advance(@as(u64, @intCast(bytesRead)));
+        try progress.markDurable(device, progress.currentByte);
+    }
+}
+
+/// Mapped loop: writes every chunk straight from the mapped image pages, so the image is
+/// never copied into a private buffer. Kernel readahead (MADV_WILLNEED on each window)
+/// takes the place of the pipeline's reader thread, and written pages are dropped behind
+/// the cursor. With a `tuner`, chunks follow its current chunk size.
+/// The transfer starts at `progress.currentByte`, which is past 0 for resumed writes.
+fn writeMapped(image: *mapping.MappedImage, device: std.fs.File, chunkSize: u64, tuner: ?*autotune.Autotuner, progress: *WriteProgress) !void {
+    Debug.log(.INFO, "Mapped write enabled: image mapped in {d}MB windows.", .{image.windowSize / (1024 * 1024)});
+
+    while (!progress.isComplete()) {
+        const offset = progress.currentByte;
+        const len: usize = if (tuner) |t| t.current().chunkSize else @intCast(chunkSize);
+
+        const bytes = try image.slice(offset, len);
+        if (bytes.len == 0) break;
+
+        // Direct write from the mapped pages (no intermediate copy)
+        try progress.writeChunk(device, bytes, offset);
+        progress.hashImage(offset, bytes);
+        image.discardBefore(offset + bytes.len);
+
+        if (tuner) |t| {
+            t.record(bytes.len);
+            const config = t.current();
+            progress.setIoConfig(config.chunkSize, config.queueDepth);
         }
 
-        if (shouldUpdateByBytes or shouldUpdateByTime or isComplete) {
-            const currentProgress = try std.math.divFloor(u64, currentByte * 100, imageSize);
+        try progress.advance(@as(u64, bytes.len));
+        try progress.markDurable(device, progress.currentByte);
+    }
+}
 
-            const totalElapsedNs = overallTimer.read();
-            const totalSeconds: f128 = if (totalElapsedNs == 0) 1.0e-9 else @as(f128, @floatFromInt(totalElapsedNs)) / 1_000_000_000.0;
-            var avgRateFloat = @as(f128, @floatFromInt(currentByte)) / totalSeconds;
-            if (!std.math.isFinite(avgRateFloat) or avgRateFloat <= 0) {
-                avgRateFloat = 0;
-            }
+/// An image opened for the shared pipeline of fan-out and delta writes: the raw file, its
+/// decompressed stream or the guest disk of a virtual disk, behind one ImageSource.
+/// Initialized in place by open(), since the source points into the struct.
+const PipelineImage = struct {
+    fileSource: imagesource.FileSource = undefined,
+    stream: compression.DecompressStream = undefined,
+    decompressSource: imagesource.DecompressSource = undefined,
+    map: vdisk.ExtentMap = undefined,
+    diskSource: imagesource.VirtualDiskSource = undefined,
+    kind: enum { FILE, COMPRESSED, VIRTUAL_DISK } = .FILE,
+    /// Decoded image size, or null when only the end of the stream tells
+    knownSize: ?u64 = null,
 
-            const elapsedNsSinceLastUpdate = xpcResponseTimer.read();
-            const deltaTimeSeconds: f128 = if (elapsedNsSinceLastUpdate == 0) 1.0e-9 else @as(f128, @floatFromInt(elapsedNsSinceLastUpdate)) / 1_000_000_000.0;
-            var instantRateFloat = @as(f128, @floatFromInt(bytesSinceUpdate)) / deltaTimeSeconds;
-            if (!std.math.isFinite(instantRateFloat) or instantRateFloat <= 0) {
-                instantRateFloat = 0;
-            }
+    fn open(self: *PipelineImage, imageFile: std.fs.File, pool: *BufferPool) !void {
+        self.* = .{};
+
+        if (vdisk.detect(imageFile) != null) {
+            self.map = try vdisk.parse(std.heap.page_allocator, imageFile);
+            self.diskSource = .{ .file = imageFile, .map = &self.map };
+            self.kind = .VIRTUAL_DISK;
+            self.knownSize = self.map.virtualSize;
+            return;
+        }
+
+        const imageCompression = compression.detect(imageFile);
+        if (imageCompression != .NONE) {
+            try self.stream.initPooled(std.heap.page_allocator, pool, imageFile, imageCompression);
+            self.decompressSource = .{ .stream = &self.stream };
+            self.kind = .COMPRESSED;
+            self.knownSize = compression.uncompressedSize(imageFile, imageCompression);
+            return;
+        }
+
+        self.fileSource = try imagesource.FileSource.init(imageFile);
+        self.knownSize = self.fileSource.fileSize;
+    }
+
+    fn source(self: *PipelineImage) ImageSource {
+        return switch (self.kind) {
+            .FILE => self.fileSource.imageSource(),
+            .COMPRESSED => self.decompressSource.imageSource(),
+            .VIRTUAL_DISK => self.diskSource.imageSource(),
+        };
+    }
 
-            const maxRate = @as(f128, @floatFromInt(std.math.maxInt(u64)));
-            const averageByteWriteRate: u64 = if (avgRateFloat >= maxRate) std.math.maxInt(u64) else @intFromFloat(avgRateFloat);
-            const instantaneousByteWriteRate: u64 = if (instantRateFloat >= maxRate) std.math.maxInt(u64) else @intFromFloat(instantRateFloat);
-
-            const progressUpdate = XPCService.createResponse(.ISO_WRITE_PROGRESS);
-            defer XPCService.releaseObject(progressUpdate);
-            XPCService.createUInt64(progressUpdate, "write_progress", currentProgress);
-            XPCService.createUInt64(progressUpdate, "write_rate", instantaneousByteWriteRate);
-            XPCService.createUInt64(progressUpdate, "write_rate_avg", averageByteWriteRate);
-            XPCService.createUInt64(progressUpdate, "write_bytes", currentByte);
-            XPCService.createUInt64(progressUpdate, "write_total_size", imageSize);
-            XPCService.connectionSendMessage(connection, progressUpdate);
-
-            lastProgressUpdateByte = currentByte;
-            bytesSinceUpdate = 0;
-            _ = xpcResponseTimer.lap();
+    fn deinit(self: *PipelineImage) void {
+        switch (self.kind) {
+            .FILE => {},
+            .COMPRESSED => self.stream.deinit(),
+            .VIRTUAL_DISK => self.map.deinit(),
         }
     }
+};
 
-    // Single sync at the end to ensure all data is written to disk
-    try device.sync();
+/// Double-buffered loop: a reader thread fills a ring of `depth` aligned buffers from the
+/// image while this thread drains them to the device, keeping both sides busy.
+/// With a sparse mode other than OFF the reader publishes holes and all-zero chunks as
+/// ZERO slots, which are handed to ZeroRangeWriter instead of being written.
+/// With a `tuner`, DATA slots are written in pieces of the tuner's current chunk size
+/// (see writeSlotTuned); `chunkSize` must then cover its largest candidate.
+/// The transfer starts at `progress.currentByte`, which is past 0 for resumed writes.
+///
+/// `Error Handling`:
+///   - Device write errors cancel the ring so the reader thread exits promptly
+///   - Reader errors are surfaced after the already-read slots are drained
+///   - The reader thread is always joined before the ring buffers are freed
+fn writePipelined(source: ImageSource, device: std.fs.File, pool: *BufferPool, chunkSize: u64, depth: usize, sparseMode: SparseMode, tuner: ?*autotune.Autotuner, progress: *WriteProgress) !void {
+    var ring = try pipeline.BufferRing.init(std.heap.page_allocator, pool, depth, @intCast(chunkSize));
+    defer ring.deinit();
 
-    Debug.log(.INFO, "Finished writing image to device!", .{});
+    Debug.log(.INFO, "Pipelined write enabled: {d} buffers of {d}MB in flight, sparse mode: {s}", .{ depth, chunkSize / (1024 * 1024), @tagName(sparseMode) });
+
+    const reader = try std.Thread.spawn(.{}, pipeline.readSourceIntoRing, .{ &ring, source, progress.currentByte, sparseMode != .OFF });
+    defer reader.join();
+    errdefer ring.cancel();
+
+    var zeroWriter = ZeroRangeWriter{ .device = device, .mode = sparseMode };
+    defer if (zeroWriter.bytesElided > 0) Debug.log(.INFO, "Sparse mode elided {d} zero bytes ({d} discarded).", .{ zeroWriter.bytesElided, zeroWriter.bytesDiscarded });
+
+    while (ring.acquireFilled()) |slot| {
+        switch (slot.kind) {
+            .DATA => {
+                // Direct positional write to device (no extra buffering)
+                if (tuner) |t| try writeSlotTuned(device, slot, t, progress) else try progress.writeChunk(device, slot.bytes(), slot.offset);
+                progress.hashImage(slot.offset, slot.bytes());
+            },
+            .ZERO => {
+                try zeroWriter.apply(slot);
+                progress.hashZeros(slot.offset, slot.len);
+            },
+        }
+
+        const bytesWritten: u64 = slot.len;
+        // Slots arrive in offset order, so everything below this slot's end is written
+        const durableOffset = slot.offset + slot.len;
+        progress.trackSource(slot.sourceOffset);
+        ring.release();
+
+        try progress.advance(bytesWritten);
+        try progress.markDurable(device, durableOffset);
+    }
+
+    if (ring.getProducerError()) |err| return err;
 }
 
-// ============================================================================
-// VERIFICATION OPERATION - Byte-by-byte integrity check
-// ============================================================================
+/// Writes a DATA slot in pieces of the tuner's current chunk size, timing each piece.
+fn writeSlotTuned(device: std.fs.File, slot: *const pipeline.Slot, tuner: *autotune.Autotuner, progress: *WriteProgress) !void {
+    const bytes = slot.bytes();
+    var written: usize = 0;
 
-/// Verifies that data written to device matches source ISO image exactly.
-/// Critical final step: ensures write completed successfully and uncorrupted.
-/// Reads chunks from both image and device, comparing sequentially.
+    while (written < bytes.len) {
+        const len = @min(tuner.current().chunkSize, bytes.len - written);
+        try progress.writeChunk(device, bytes[written..][0..len], slot.offset + written);
+        tuner.record(len);
+        written += len;
+    }
+
+    const config = tuner.current();
+    progress.setIoConfig(config.chunkSize, config.queueDepth);
+}
+
+/// Starts a chunk-size autotuner for the pipelined write loop when the job is large enough
+/// to amortize the search. That loop has one write outstanding at a time, so only the
+/// chunk size is tuned. Returns null when disabled, too small, or without a usable clock.
+fn initWriteAutotuner(options: WriteOptions, imageSize: u64, blockSize: u64) ?autotune.Autotuner {
+    if (!options.autotune or imageSize < autotune.MIN_IMAGE_SIZE) return null;
+
+    return autotune.Autotuner.init(.{ .maxChunkSize = MAX_WRITE_SIZE, .blockSize = @intCast(blockSize) }) catch |err| {
+        Debug.log(.WARNING, "Autotuner unavailable ({any}); using the probed chunk size.", .{err});
+        return null;
+    };
+}
+
+/// Outcome of one target in a fan-out job.
+pub const FanOutResult = struct {
+    /// First error that stopped this target, or null if it was written and synced
+    err: ?anyerror = null,
+    bytesWritten: u64 = 0,
+};
+
+/// Writes one image to several devices at once, reading every chunk of the source only once.
 ///
 /// `Arguments`:
-///   connection: XPC connection to GUI for progress updates
-///   imageFile: Source ISO image file
-///   deviceHandle: Target device to verify
-///
-/// `Errors`:
-///   error.MismatchingISOAndDeviceBytesDetected: Byte mismatch found
-///   File I/O errors from read operations
-///
-/// `Verification Strategy`:
-///   1. Use same probed chunk size as writeISO (consistency)
-///   2. Read chunk from image, read same amount from device
-///   3. Compare byte-by-byte (std.mem.eql)
-///   4. Return error immediately on first mismatch (fail-fast)
-///   5. Send progress updates with same batching as write
-///
-/// `Performance Considerations`:
-///   - Allocates two buffers (device may cache differently than image)
-///   - Sequential reads are fast (kernel-optimized)
-///   - Verification is slower than write but essential
-///   - Batched progress updates prevent XPC saturation
-///   - Same 8MB/100ms update intervals as write
-///
-/// `Data Integrity`:
-///   - Detects bit flips, write failures, or device issues
-///   - Catches silent data corruption that write() doesn't detect
-///   - Essential for bootable media (bad sectors corrupt boot)
+///   connection: XPC connection to GUI for progress updates (tagged with `device_index`)
+///   imageFile: Open image file (raw, gzip/xz/zstd compressed or a virtual disk)
+///   devices: Target devices, opened for writing
+///   results: One entry per device, filled with each target's outcome
+///   options: Per-job tunables; pipelineDepth bounds the shared buffer window
+///   pool: Job buffer pool (see poolBufferCount)
 ///
-/// `Error Handling`:
-///   - Detects device returning fewer bytes than expected (I/O error)
-///   - Fails fast on first mismatch (no partial passes)
-///   - Logs mismatch details for debugging
+/// `Behavior`:
+///   - A single reader thread fills a ring of `pipelineDepth` buffers shared by all targets
+///   - Each device gets its own writer thread that drains every slot in order
+///   - A slot is reused only once every target has written it, so the fastest target
+///     can run at most `pipelineDepth` chunks ahead of the slowest one
+///   - A failing target is detached from the ring and recorded in `results`; the others
+///     continue. When every target has failed the reader stops early
+///   - Sparse mode is ignored: zero slots would be materialized in the shared buffers
 ///
-/// `Note`:
-///   This is deliberately slow and thorough - we verify the entire image
-///   to ensure correctness, not speed. A failed verify is better than
-///   a silent corruption that prevents boot.
-pub fn verifyWrittenBytes(connection: XPCConnection, imageFile: std.fs.File, deviceHandle: DeviceHandle) !void {
-    const device = deviceHandle.raw;
+/// `Errors`:
+///   Setup failures (allocation, thread spawn, decompressor init) are returned directly;
+///   per-device write errors are only reported through `results`
+///   error.SparseImageFanOutUnsupported: Android sparse images are written one device at a time
+///   error.UdifImageFanOutUnsupported: UDIF images are written one device at a time
+pub fn writeImageFanOut(connection: XPCConnection, imageFile: std.fs.File, devices: []const std.fs.File, results: []FanOutResult, options: WriteOptions, pool: *BufferPool) !void {
+    std.debug.assert(devices.len == results.len);
+    if (devices.len == 0) return error.NoFanOutTargets;
+    // The shared ring carries a contiguous byte stream; sparse chunks would need per-target expansion
+    if (simg.detect(imageFile)) return error.SparseImageFanOutUnsupported;
+    if (udif.detect(imageFile)) return error.UdifImageFanOutUnsupported;
 
-    // Use the same probed chunk size for consistency
-    const CHUNK_SIZE = probeDeviceWriteSize(device);
+    Debug.log(.INFO, "Begin fan-out writing prep for {d} devices...", .{devices.len});
 
-    // Batch progress updates to reduce XPC message overhead
-    const PROGRESS_UPDATE_INTERVAL_BYTES = 8 * 1_024 * 1_024; // Update UI every 8MB
-    const PROGRESS_UPDATE_INTERVAL_NS = 100_000_000; // Also update every 100ms to prevent XPC saturation
-    const TIMER_CHECK_INTERVAL = 100; // Check elapsed time every N iterations
+    if (comptime !isLinux) {
+        _ = c.fcntl(imageFile.handle, c.F_NOCACHE, @as(c_int, 1));
+        _ = c.fcntl(imageFile.handle, c.F_RDAHEAD, @as(c_int, 1));
+        for (devices) |device| _ = c.fcntl(device.handle, c.F_NOCACHE, @as(c_int, 1));
+    }
 
-    const imageByteBuffer = try std.heap.page_allocator.alloc(u8, CHUNK_SIZE);
-    defer std.heap.page_allocator.free(imageByteBuffer);
-    const deviceByteBuffer = try std.heap.page_allocator.alloc(u8, CHUNK_SIZE);
-    defer std.heap.page_allocator.free(deviceByteBuffer);
+    // Every target receives the same chunks, so use a size all of them accept
+    var chunkSize: u64 = MAX_WRITE_SIZE;
+    for (devices) |device| chunkSize = @min(chunkSize, probeTransferSize(device));
 
-    const fileStat = try imageFile.stat();
-    const imageSize = fileStat.size;
+    const imageSize = (try imageFile.stat()).size;
+    const depth = std.math.clamp(options.pipelineDepth, 2, pipeline.MAX_RING_SLOTS);
 
-    var currentByte: u64 = 0;
-    var lastProgressUpdateByte: u64 = 0;
-    var currentProgress: u64 = 0;
-    var xpcResponseTimer = try std.time.Timer.start();
-    var timerCheckCounter: u32 = 0;
+    var image: PipelineImage = undefined;
+    try image.open(imageFile, pool);
+    defer image.deinit();
+    const knownSize = image.knownSize;
 
-    Debug.log(.INFO, "File and device are opened successfully! File size: {d}", .{imageSize});
-    Debug.log(.INFO, "Verifying image bytes written to device with {d}MB chunks, please wait...", .{CHUNK_SIZE / (1024 * 1024)});
+    var ring = try pipeline.BufferRing.initShared(std.heap.page_allocator, pool, depth, @intCast(chunkSize), devices.len);
+    defer ring.deinit();
 
-    // Seek both files to start
-    try imageFile.seekTo(0);
-    try device.seekTo(0);
+    const writers = try std.heap.page_allocator.alloc(FanOutWriter, devices.len);
+    defer std.heap.page_allocator.free(writers);
 
-    while (currentByte < imageSize) {
-        // Read sequentially from both files (files maintain position)
-        const imageBytesRead = try imageFile.read(imageByteBuffer);
+    for (writers, devices, results, 0..) |*writer, device, *result, index| {
+        result.* = .{};
+        writer.* = .{
+            .ring = &ring,
+            .consumer = index,
+            .device = device,
+            .result = result,
+            .progress = if (knownSize) |size| try WriteProgress.init(connection, size) else try WriteProgress.initEstimated(connection, imageSize),
+        };
+        writer.progress.deviceIndex = index;
+        writer.progress.attachFlusher(options.writebackInterval);
+        writer.progress.attachRecovery(options.badBlockPolicy, probeBlockSize(device));
+    }
 
-        if (imageBytesRead == 0) {
-            Debug.log(.INFO, "End of image file reached at byte: {d}", .{currentByte});
-            break;
-        }
+    Debug.log(.INFO, "Fan-out writing {d} bytes to {d} devices: {d} shared buffers of {d}MB", .{ imageSize, devices.len, depth, chunkSize / (1024 * 1024) });
 
-        // Read from device sequentially (matching position in image file)
-        var deviceBytesReadTotal: usize = 0;
-        while (deviceBytesReadTotal < imageBytesRead) {
-            const remainingSlice = deviceByteBuffer[deviceBytesReadTotal..imageBytesRead];
-            const deviceBytesRead = try device.read(remainingSlice);
-
-            if (deviceBytesRead == 0) {
-                Debug.log(
-                    .ERROR,
-                    "Device returned fewer bytes than expected during verification. Expected: {d}, received: {d}",
-                    .{ imageBytesRead, deviceBytesReadTotal },
-                );
-                return error.MismatchingISOAndDeviceBytesDetected;
-            }
+    const reader = try std.Thread.spawn(.{}, pipeline.readSourceIntoRing, .{ &ring, image.source(), @as(u64, 0), false });
+    defer reader.join();
+    errdefer ring.cancel();
 
-            deviceBytesReadTotal += deviceBytesRead;
-        }
+    const threads = try std.heap.page_allocator.alloc(std.Thread, devices.len);
+    defer std.heap.page_allocator.free(threads);
 
-        const imageSlice = imageByteBuffer[0..imageBytesRead];
-        const deviceSlice = deviceByteBuffer[0..deviceBytesReadTotal];
+    var spawnedCount: usize = 0;
+    defer for (threads[0..spawnedCount]) |thread| thread.join();
+    // Unblock already running writers if a later spawn fails; never-spawned consumers would stall the ring
+    errdefer ring.cancel();
 
-        if (!std.mem.eql(u8, imageSlice, deviceSlice)) return error.MismatchingISOAndDeviceBytesDetected;
+    for (writers, threads) |*writer, *thread| {
+        thread.* = try std.Thread.spawn(.{}, FanOutWriter.run, .{writer});
+        spawnedCount += 1;
+    }
+}
 
-        currentByte += @as(u64, @intCast(imageBytesRead));
+/// Per-device consumer of a fan-out ring; runs on its own thread.
+const FanOutWriter = struct {
+    ring: *pipeline.BufferRing,
+    consumer: usize,
+    device: std.fs.File,
+    progress: WriteProgress,
+    result: *FanOutResult,
 
-        // Batch progress updates to reduce XPC overhead
-        // Check byte-based updates always, but only check time-based updates periodically
-        const bytesSincLastUpdate = currentByte - lastProgressUpdateByte;
-        const shouldUpdateByBytes = bytesSincLastUpdate >= PROGRESS_UPDATE_INTERVAL_BYTES;
-        const isComplete = currentByte >= imageSize;
+    fn run(self: *FanOutWriter) void {
+        // Progress is cosmetic: a target without a sampler still gets its final update
+        self.progress.start() catch |err| {
+            Debug.log(.WARNING, "Fan-out target #{d} reports no live progress: {any}", .{ self.consumer, err });
+        };
+        defer self.progress.stop();
 
-        var shouldUpdateByTime = false;
-        timerCheckCounter += 1;
-        if (timerCheckCounter >= TIMER_CHECK_INTERVAL) {
-            const elapsedNsSinceLastUpdate = xpcResponseTimer.read();
-            shouldUpdateByTime = elapsedNsSinceLastUpdate >= PROGRESS_UPDATE_INTERVAL_NS;
-            timerCheckCounter = 0;
-        }
+        self.drain() catch |err| {
+            Debug.log(.ERROR, "Fan-out target #{d} failed after {d} bytes: {any}", .{ self.consumer, self.result.bytesWritten, err });
+            self.result.err = err;
+            self.ring.detach(self.consumer);
+        };
+    }
 
-        if (shouldUpdateByBytes or shouldUpdateByTime or isComplete) {
-            currentProgress = try std.math.divFloor(u64, currentByte * @as(u64, 100), imageSize);
+    fn drain(self: *FanOutWriter) !void {
+        while (self.ring.acquireFilledFor(self.consumer)) |slot| {
+            try self.progress.writeChunk(self.device, slot.bytes(), slot.offset);
 
-            const progressUpdate = XPCService.createResponse(.WRITE_VERIFICATION_PROGRESS);
-            defer XPCService.releaseObject(progressUpdate);
-            XPCService.createUInt64(progressUpdate, "verification_progress", currentProgress);
-            XPCService.connectionSendMessage(connection, progressUpdate);
+            const bytesWritten: u64 = slot.len;
+            self.progress.trackSource(slot.sourceOffset);
+            self.ring.releaseFor(self.consumer);
 
-            lastProgressUpdateByte = currentByte;
-            _ = xpcResponseTimer.lap();
+            self.result.bytesWritten += bytesWritten;
+            try self.progress.advance(bytesWritten);
+            try self.progress.markDurable(self.device, self.progress.currentByte);
         }
+
+        if (self.ring.getProducerError()) |err| return err;
+
+        self.progress.finish();
+        try self.progress.syncTarget(self.device);
+
+        Debug.log(.INFO, "Fan-out target #{d} finished: {d} bytes written.", .{ self.consumer, self.result.bytesWritten });
     }
+};
 
-    Debug.log(.INFO, "Finished verifying image written to device!", .{});
-}
+/// Delta write: rewrites only the chunks whose contents differ on the device.
+/// Intended for reflashing media that already holds a previous build of the same image;
+/// reads are several times faster than writes on most flash media, so unchanged chunks
+/// cost a device read instead of a device write.
+///
+/// `Arguments`:
+///   connection: XPC connection to GUI for progress updates
+///   imageFile: Open image file
+///   deviceHandle: Target device, opened for reading and writing
+///   options: Per-job tunables (pipeline depth is used for the image reader ring)
+///   pool: Job buffer pool (see poolBufferCount)
+///   digests: Optional log of the image's chunk digests for verifyWrittenBytes (see writeImage)
+///
+/// `Behavior`:
+///   - A reader thread streams the image into the buffer ring (see writePipelined)
+///   - For each image chunk the same range is read from the device and compared
+///   - Identical chunks are skipped; differing or short-read chunks are written
+///   - Progress reports `write_bytes_skipped` alongside the usual fields; `write_bytes`
+///     counts every processed byte so percentages stay comparable with writeImage
+///   - Sparse mode is ignored: an unchanged zero chunk is skipped anyway, and a changed
+///     one must be written to be correct
+///   - Compressed images and virtual disks are compared in decoded form
+///   - Android sparse and UDIF images are written with their own writers instead
+pub fn writeImageDelta(connection: XPCConnection, imageFile: std.fs.File, deviceHandle: DeviceHandle, options: WriteOptions, pool: *BufferPool, digests: ?*digestlog.DigestLog) !void {
+    Debug.log(.INFO, "Begin delta writing prep...", .{});
+
+    if (simg.detect(imageFile)) {
+        Debug.log(.WARNING, "Delta mode does not apply to Android sparse images; writing their chunks instead.", .{});
+        return writeAndroidSparseImage(connection, imageFile, deviceHandle.raw, options, pool);
+    }
+    if (udif.detect(imageFile)) {
+        Debug.log(.WARNING, "Delta mode does not apply to UDIF images; writing their chunks instead.", .{});
+        return writeUdifImage(connection, imageFile, deviceHandle.raw, options, pool);
+    }
+
+    const device = deviceHandle.raw;
+
+    if (comptime !isLinux) {
+        // Device reads must observe the media, not stale cache pages
+        _ = c.fcntl(device.handle, c.F_NOCACHE, @as(c_int, 1));
+        _ = c.fcntl(imageFile.handle, c.F_NOCACHE, @as(c_int, 1));
+        _ = c.fcntl(imageFile.handle, c.F_RDAHEAD, @as(c_int, 1));
+    }
+
+    const chunkSize = probeTransferSize(device);
+    const imageSize = (try imageFile.stat()).size;
+    const depth = std.math.clamp(options.pipelineDepth, 2, pipeline.MAX_RING_SLOTS);
+
+    var image: PipelineImage = undefined;
+    try image.open(imageFile, pool);
+    defer image.deinit();
+    const knownSize = image.knownSize;
+
+    var ring = try pipeline.BufferRing.init(std.heap.page_allocator, pool, depth, @intCast(chunkSize));
+    defer ring.deinit();
+
+    const devicePoolBuffer = pool.tryAcquire() orelse return error.BufferPoolExhausted;
+    defer pool.release(devicePoolBuffer);
+    const deviceBuffer = devicePoolBuffer[0..@intCast(chunkSize)];
+
+    Debug.log(.INFO, "Delta writing {d} bytes in {d}MB chunks...", .{ imageSize, chunkSize / (1024 * 1024) });
+
+    var progress = if (knownSize) |size| try WriteProgress.init(connection, size) else try WriteProgress.initEstimated(connection, imageSize);
+    progress.attachDigests(digests);
+    progress.attachFlusher(options.writebackInterval);
+    progress.attachRecovery(options.badBlockPolicy, probeBlockSize(device));
+    try progress.start();
+    defer progress.stop();
+
+    const reader = try std.Thread.spawn(.{}, pipeline.readSourceIntoRing, .{ &ring, image.source(), @as(u64, 0), false });
+    defer reader.join();
+    errdefer ring.cancel();
+
+    while (ring.acquireFilled()) |slot| {
+        const imageBytes = slot.bytes();
+        const deviceBytesRead = try device.preadAll(deviceBuffer[0..imageBytes.len], slot.offset);
+
+        const isUnchanged = deviceBytesRead == imageBytes.len and simd.findMismatch(imageBytes, deviceBuffer[0..deviceBytesRead]) == null;
+
+        if (!isUnchanged) try progress.writeChunk(device, imageBytes, slot.offset);
+        progress.hashImage(slot.offset, imageBytes);
+
+        const chunkBytes: u64 = slot.len;
+        progress.trackSource(slot.sourceOffset);
+        ring.release();
+
+        if (isUnchanged) try progress.skip(chunkBytes) else try progress.advance(chunkBytes);
+        try progress.markDurable(device, progress.currentByte);
+    }
+
+    if (ring.getProducerError()) |err| return err;
+
+    progress.finish();
+    try progress.syncTarget(device);
+    progress.sealDigests();
+
+    Debug.log(.INFO, "Finished delta write: {d} bytes written, {d} bytes already up to date.", .{ progress.currentByte - progress.bytesSkipped, progress.bytesSkipped });
+}
+
+/// Reads and parses the block map in `bmapFile` and checks that it describes `imageFile`.
+///
+/// `Errors`:
+///   error.BmapTooLarge: the file exceeds bmap.MAX_BMAP_SIZE
+///   error.BmapImageSizeMismatch: the map was generated for an image of another size
+///   bmap.parse errors (malformed map, failed file checksum, missing range checksums)
+pub fn loadBlockMap(allocator: std.mem.Allocator, bmapFile: std.fs.File, imageFile: std.fs.File) !bmap.BlockMap {
+    const xml = bmapFile.readToEndAlloc(allocator, bmap.MAX_BMAP_SIZE) catch |err| switch (err) {
+        error.FileTooBig => return error.BmapTooLarge,
+        else => return err,
+    };
+    defer allocator.free(xml);
+
+    var map = try bmap.parse(allocator, xml);
+    errdefer map.deinit();
+
+    // Compressed images are checked against container metadata when it records the size
+    const imageCompression = compression.detect(imageFile);
+    const imageSize = if (imageCompression == .NONE) (try imageFile.stat()).size else compression.uncompressedSize(imageFile, imageCompression);
+    if (imageSize) |size| {
+        if (size != map.imageSize) {
+            Debug.log(.ERROR, "Block map describes a {d}-byte image, but the image holds {d} bytes.", .{ map.imageSize, size });
+            return error.BmapImageSizeMismatch;
+        }
+    }
+
+    Debug.log(.INFO, "Block map loaded: {d} of {d} bytes mapped in {d} ranges ({s}).", .{ map.mappedBytes(), map.imageSize, map.ranges.len, @tagName(map.checksumType) });
+    return map;
+}
+
+/// Block map write: writes only the ranges listed in the image's .bmap file and checks
+/// every range against its checksum on the way (see bmap.RangeVerifier).
+///
+/// `Arguments`:
+///   connection: XPC connection to GUI for progress updates
+///   imageFile: Open image file, raw or compressed
+///   deviceHandle: Target device
+///   map: Block map of the (decompressed) image, see loadBlockMap
+///   options: Per-job tunables (pipeline depth, writeback, bad-block policy)
+///   pool: Job buffer pool (see poolBufferCount)
+///
+/// `Behavior`:
+///   - Raw images: the reader thread reads only the mapped ranges
+///   - Compressed images: the whole stream is decompressed and only the mapped parts of
+///     each chunk are written
+///   - Ranges are written in ascending offset order, so the device sees sequential writes
+///   - Progress is computed over mapped bytes rather than the image size
+///   - Unmapped ranges are left untouched; verify with verifyBlockMap, not verifyWrittenBytes
+///   - Sparse mode and checkpoint resume do not apply
+///
+/// `Errors`:
+///   error.BmapChecksumMismatch: image data disagrees with the map (the write stops there)
+///   error.UnexpectedEndOfImage: the image ended inside a mapped range
+pub fn writeImageBlockMap(connection: XPCConnection, imageFile: std.fs.File, deviceHandle: DeviceHandle, map: *const bmap.BlockMap, options: WriteOptions, pool: *BufferPool) !void {
+    const device = deviceHandle.raw;
+
+    if (comptime !isLinux) {
+        _ = c.fcntl(device.handle, c.F_NOCACHE, @as(c_int, 1));
+        _ = c.fcntl(imageFile.handle, c.F_NOCACHE, @as(c_int, 1));
+        _ = c.fcntl(imageFile.handle, c.F_RDAHEAD, @as(c_int, 1));
+    }
+
+    const chunkSize = probeTransferSize(device);
+    const depth = std.math.clamp(options.pipelineDepth, 2, pipeline.MAX_RING_SLOTS);
+
+    const imageCompression = compression.detect(imageFile);
+    var stream: compression.DecompressStream = undefined;
+    if (imageCompression != .NONE) try stream.initPooled(std.heap.page_allocator, pool, imageFile, imageCompression);
+    defer if (imageCompression != .NONE) stream.deinit();
+
+    var ring = try pipeline.BufferRing.init(std.heap.page_allocator, pool, depth, @intCast(chunkSize));
+    defer ring.deinit();
+
+    Debug.log(.INFO, "Writing {d} mapped bytes of a {d}-byte image with {d}MB chunks...", .{ map.mappedBytes(), map.imageSize, chunkSize / (1024 * 1024) });
+
+    var progress = try WriteProgress.init(connection, map.mappedBytes());
+    progress.attachFlusher(options.writebackInterval);
+    progress.attachRecovery(options.badBlockPolicy, probeBlockSize(device));
+    progress.setIoConfig(chunkSize, 1);
+    try progress.start();
+    defer progress.stop();
+
+    var decompressSource = imagesource.DecompressSource{ .stream = &stream };
+    var fileSource = imagesource.FileSource.initSized(imageFile, map.imageSize);
+
+    const reader = if (imageCompression != .NONE)
+        try std.Thread.spawn(.{}, pipeline.readSourceIntoRing, .{ &ring, decompressSource.imageSource(), @as(u64, 0), false })
+    else
+        try std.Thread.spawn(.{}, pipeline.readMappedRangesIntoRing, .{ &ring, fileSource.imageSource(), @as([]const bmap.Range, map.ranges) });
+    defer reader.join();
+    errdefer ring.cancel();
+
+    var verifier = bmap.RangeVerifier.init(map);
+
+    while (ring.acquireFilled()) |slot| {
+        // A range is checked when its last part arrives, before that part is written
+        while (try verifier.nextPart(slot.offset, slot.bytes())) |part| {
+            try verifier.consume(part);
+            try progress.writeChunk(device, part.bytes, part.offset);
+            try progress.advance(part.bytes.len);
+        }
+
+        const durableOffset = slot.offset + slot.len;
+        ring.release();
+
+        try progress.markDurable(device, durableOffset);
+    }
+
+    if (ring.getProducerError()) |err| return err;
+    if (!verifier.isComplete()) return error.UnexpectedEndOfImage;
+
+    try progress.syncTarget(device);
+
+    Debug.log(.INFO, "Finished block map write: {d} bytes written, unmapped ranges skipped.", .{progress.currentByte});
+}
+
+/// Verifies a block map write by reading every mapped range back from the device and
+/// checking it against the range checksum. The image is not read, and unmapped ranges
+/// (never written) are not compared.
+///
+/// `Errors`:
+///   error.MismatchingISOAndDeviceBytesDetected: a range read back does not match its checksum;
+///     `mismatches` then holds the whole range, since a checksum cannot narrow it down. The
+///     checksum state does not survive a mismatch, so the map is truncated (not repairable).
+pub fn verifyBlockMap(connection: XPCConnection, deviceHandle: DeviceHandle, map: *const bmap.BlockMap, pool: *BufferPool, mismatches: *repair.MismatchMap) !void {
+    const device = deviceHandle.raw;
+    const chunkSize: usize = @intCast(probeTransferSize(device));
+    const blockSize = probeBlockSize(device);
+
+    const poolBuffer = pool.tryAcquire() orelse return error.BufferPoolExhausted;
+    defer pool.release(poolBuffer);
+    const buffer = poolBuffer[0..chunkSize];
+
+    const mappedBytes = map.mappedBytes();
+    var verifiedBytes: u64 = 0;
+    var progress = try VerifyProgress.init(connection, mappedBytes);
+    var verifier = bmap.RangeVerifier.init(map);
+
+    Debug.log(.INFO, "Verifying {d} mapped bytes against the block map checksums...", .{mappedBytes});
+
+    for (map.ranges) |range| {
+        var offset = range.offset;
+
+        while (offset < range.end()) {
+            const len: usize = @intCast(@min(@as(u64, chunkSize), range.end() - offset));
+            const bytesRead = try device.preadAll(buffer[0..len], offset);
+            if (bytesRead < len) return stopVerification(mismatches, .{ .offset = offset + bytesRead, .len = len - bytesRead, .blockSize = blockSize });
+
+            const part = (try verifier.nextPart(offset, buffer[0..len])) orelse unreachable;
+            verifier.consume(part) catch |err| switch (err) {
+                error.BmapChecksumMismatch => {
+                    Debug.log(.ERROR, "Device bytes [{d}, {d}) do not match the block map checksum.", .{ range.offset, range.end() });
+                    return stopVerification(mismatches, .{ .offset = range.offset, .len = range.len, .blockSize = blockSize });
+                },
+                else => return err,
+            };
+
+            offset += len;
+            verifiedBytes += len;
+
+            progress.update(verifiedBytes, verifiedBytes);
+        }
+    }
+
+    Debug.log(.INFO, "Finished verifying block map ranges on the device!", .{});
+}
+
+/// Android sparse image write: streams the chunks of an simg file straight to the device
+/// without expanding the image first.
+///
+/// `Behavior`:
+///   - The chunk layout is validated in full (simg.scan) before anything is written
+///   - RAW chunks are read from the image in transfer-size pieces and written at their
+///     output offset
+///   - FILL chunks are written from one buffer prefilled with the pattern; zero patterns
+///     follow options.sparseMode like the zero ranges of raw images
+///   - DONT_CARE chunks are skipped, or discarded when options.sparseMode is DISCARD
+///   - CRC32 chunks, when present, are checked against the expanded output so far, with
+///     DONT_CARE ranges counted as zeros (as libsparse does)
+///   - Progress is computed over RAW + FILL bytes
+///   - Checkpoint resume does not apply
+///
+/// `Errors`:
+///   simg errors (invalid or truncated image)
+///   error.SparseImageChecksumMismatch: a CRC32 chunk disagrees with the data before it
+fn writeAndroidSparseImage(connection: XPCConnection, imageFile: std.fs.File, device: std.fs.File, options: WriteOptions, pool: *BufferPool) !void {
+    if (comptime !isLinux) {
+        _ = c.fcntl(device.handle, c.F_NOCACHE, @as(c_int, 1));
+        _ = c.fcntl(imageFile.handle, c.F_NOCACHE, @as(c_int, 1));
+        _ = c.fcntl(imageFile.handle, c.F_RDAHEAD, @as(c_int, 1));
+    }
+
+    const summary = try simg.scan(imageFile);
+    const chunkSize = probeTransferSize(device);
+
+    Debug.log(.INFO, "Writing Android sparse image: {d} of {d} bytes hold data, {d} bytes are don't-care, {d}-byte blocks.", .{
+        summary.dataBytes,
+        summary.header.expandedSize(),
+        summary.dontCareBytes,
+        summary.header.blockSize,
+    });
+
+    var progress = try WriteProgress.init(connection, summary.dataBytes);
+    progress.attachFlusher(options.writebackInterval);
+    progress.attachRecovery(options.badBlockPolicy, probeBlockSize(device));
+    progress.setIoConfig(chunkSize, 1);
+    try progress.start();
+    defer progress.stop();
+
+    const readPoolBuffer = pool.tryAcquire() orelse return error.BufferPoolExhausted;
+    defer pool.release(readPoolBuffer);
+    const fillPoolBuffer = pool.tryAcquire() orelse return error.BufferPoolExhausted;
+    defer pool.release(fillPoolBuffer);
+
+    const readBuffer = readPoolBuffer[0..@intCast(chunkSize)];
+    var fill = SparseFillBuffer{ .bytes = fillPoolBuffer[0..@intCast(chunkSize)] };
+
+    var zeroes = ZeroRangeWriter{ .device = device, .mode = options.sparseMode };
+    var checksum: ?std.hash.Crc32 = if (summary.hasChecksums) std.hash.Crc32.init() else null;
+
+    var reader = try simg.ChunkReader.init(imageFile);
+    while (try reader.next()) |chunk| {
+        switch (chunk.type) {
+            .RAW => {
+                var done: u64 = 0;
+                while (done < chunk.outputLen) {
+                    const len: usize = @intCast(@min(chunkSize, chunk.outputLen - done));
+                    const bytes = readBuffer[0..len];
+                    if (try imageFile.preadAll(bytes, chunk.dataOffset + done) < len) return error.UnexpectedEndOfImage;
+                    if (checksum) |*crc| crc.update(bytes);
+
+                    try progress.writeChunk(device, bytes, chunk.outputOffset + done);
+                    try progress.advance(len);
+                    done += len;
+                    try progress.markDurable(device, chunk.outputOffset + done);
+                }
+            },
+            .FILL => {
+                const pattern = fill.get(chunk.value);
+                if (checksum) |*crc| updateChecksumRepeated(crc, pattern, chunk.outputLen);
+
+                if (chunk.value == 0 and zeroes.elide(chunk.outputOffset, chunk.outputLen)) {
+                    try progress.skip(chunk.outputLen);
+                    continue;
+                }
+
+                try writeRepeated(device, pattern, chunk.outputOffset, chunk.outputLen, &progress);
+            },
+            .DONT_CARE => {
+                if (checksum) |*crc| updateChecksumRepeated(crc, fill.get(0), chunk.outputLen);
+                // Whatever the device holds is acceptable; discarding only frees the blocks
+                if (options.sparseMode == .DISCARD and zeroes.isDiscardSupported) _ = zeroes.elide(chunk.outputOffset, chunk.outputLen);
+            },
+            .CRC32 => if (checksum) |crc| {
+                if (crc.final() != chunk.value) {
+                    Debug.log(.ERROR, "Sparse image checksum mismatch before byte {d}: expected {x:0>8}, computed {x:0>8}.", .{ chunk.outputOffset, chunk.value, crc.final() });
+                    return error.SparseImageChecksumMismatch;
+                }
+            },
+        }
+    }
+
+    try progress.syncTarget(device);
+
+    Debug.log(.INFO, "Finished sparse write: {d} bytes written, {d} zero-fill bytes elided, {d} don't-care bytes skipped, {d} bytes discarded.", .{
+        progress.currentByte - progress.bytesSkipped,
+        progress.bytesSkipped,
+        summary.dontCareBytes,
+        zeroes.bytesDiscarded,
+    });
+}
+
+/// Writes `len` bytes at `offset` by repeating `pattern` (a whole number of pattern
+/// periods long, e.g. a tiled FILL buffer or zeros), advancing progress per write.
+fn writeRepeated(device: std.fs.File, pattern: []const u8, offset: u64, len: u64, progress: *WriteProgress) !void {
+    var done: u64 = 0;
+    while (done < len) {
+        const step: usize = @intCast(@min(@as(u64, pattern.len), len - done));
+        try progress.writeChunk(device, pattern[0..step], offset + done);
+        try progress.advance(step);
+        done += step;
+        try progress.markDurable(device, offset + done);
+    }
+}
+
+/// Pool buffer holding a tiled FILL pattern; refilled only when the pattern changes.
+const SparseFillBuffer = struct {
+    bytes: []u8,
+    pattern: ?u32 = null,
+
+    fn get(self: *SparseFillBuffer, pattern: u32) []const u8 {
+        if (self.pattern != pattern) {
+            simg.fillPattern(self.bytes, pattern);
+            self.pattern = pattern;
+        }
+        return self.bytes;
+    }
+};
+
+/// Feeds `len` bytes of the repeating `pattern` buffer into `crc`.
+fn updateChecksumRepeated(crc: *std.hash.Crc32, pattern: []const u8, len: u64) void {
+    var remaining = len;
+    while (remaining > 0) {
+        const step: usize = @intCast(@min(@as(u64, pattern.len), remaining));
+        crc.update(pattern[0..step]);
+        remaining -= step;
+    }
+}
+
+/// Verifies an Android sparse image write: RAW chunks are compared with the image
+/// payload, FILL chunks with the pattern. DONT_CARE ranges are not read.
+///
+/// `Errors`:
+///   error.MismatchingISOAndDeviceBytesDetected: device bytes differ from a RAW or FILL chunk
+fn verifyAndroidSparseImage(connection: XPCConnection, imageFile: std.fs.File, device: std.fs.File, pool: *BufferPool, mismatches: *repair.MismatchMap) !void {
+    const chunkSize: usize = @intCast(probeTransferSize(device));
+    const blockSize = probeBlockSize(device);
+    const summary = try simg.scan(imageFile);
+
+    const imagePoolBuffer = pool.tryAcquire() orelse return error.BufferPoolExhausted;
+    defer pool.release(imagePoolBuffer);
+    const devicePoolBuffer = pool.tryAcquire() orelse return error.BufferPoolExhausted;
+    defer pool.release(devicePoolBuffer);
+    const fillPoolBuffer = pool.tryAcquire() orelse return error.BufferPoolExhausted;
+    defer pool.release(fillPoolBuffer);
+
+    const imageBuffer = imagePoolBuffer[0..chunkSize];
+    const deviceBuffer = devicePoolBuffer[0..chunkSize];
+    var fill = SparseFillBuffer{ .bytes = fillPoolBuffer[0..chunkSize] };
+
+    var verifiedBytes: u64 = 0;
+    var progress = try VerifyProgress.init(connection, summary.dataBytes);
+
+    Debug.log(.INFO, "Verifying {d} data bytes of the sparse image on the device...", .{summary.dataBytes});
+
+    var reader = try simg.ChunkReader.init(imageFile);
+    while (try reader.next()) |chunk| {
+        if (chunk.type != .RAW and chunk.type != .FILL) continue;
+
+        var done: u64 = 0;
+        while (done < chunk.outputLen) {
+            const len: usize = @intCast(@min(@as(u64, chunkSize), chunk.outputLen - done));
+
+            const expected: []const u8 = if (chunk.type == .RAW) blk: {
+                if (try imageFile.preadAll(imageBuffer[0..len], chunk.dataOffset + done) < len) return error.UnexpectedEndOfImage;
+                break :blk imageBuffer[0..len];
+            } else fill.get(chunk.value)[0..len];
+
+            const deviceBytesRead = try device.preadAll(deviceBuffer[0..len], chunk.outputOffset + done);
+            try collectMismatches(expected, deviceBuffer[0..deviceBytesRead], chunk.outputOffset + done, blockSize, mismatches);
+
+            done += len;
+            verifiedBytes += len;
+
+            progress.update(verifiedBytes, verifiedBytes);
+        }
+    }
+
+    try finishVerification(mismatches);
+    Debug.log(.INFO, "Finished verifying sparse image chunks on the device!", .{});
+}
+
+/// Apple UDIF (.dmg) write: chunks are decompressed on a pool of worker threads
+/// (udif.ParallelDecoder) and written in output order as they become available.
+///
+/// `Behavior`:
+///   - The koly trailer and blkx tables are parsed and validated before anything is written
+///   - zlib and LZMA chunks decode on every host; bzip2 and LZFSE need macOS
+///   - Zero-fill and ignore chunks (and sectors no table covers) are sparse ranges: they
+///     follow options.sparseMode like the zero ranges of raw images
+///   - Progress is computed over the expanded image size
+///   - Checkpoint resume does not apply
+///
+/// `Errors`:
+///   udif errors (invalid image, unsupported codec, corrupt chunk)
+fn writeUdifImage(connection: XPCConnection, imageFile: std.fs.File, device: std.fs.File, options: WriteOptions, pool: *BufferPool) !void {
+    if (comptime !isLinux) {
+        _ = c.fcntl(device.handle, c.F_NOCACHE, @as(c_int, 1));
+        _ = c.fcntl(imageFile.handle, c.F_NOCACHE, @as(c_int, 1));
+    }
+
+    var image = try udif.parse(std.heap.page_allocator, imageFile);
+    defer image.deinit();
+
+    const chunkSize = probeTransferSize(device);
+    const workerCount = udif.defaultWorkerCount();
+
+    Debug.log(.INFO, "Writing UDIF image: {d} chunks, {d} of {d} bytes hold data, {d} decoder threads.", .{
+        image.chunks.len,
+        image.dataBytes(),
+        image.expandedSize(),
+        workerCount,
+    });
+
+    var decoder: udif.ParallelDecoder = undefined;
+    try decoder.start(std.heap.page_allocator, imageFile, &image, workerCount);
+    defer decoder.stop();
+
+    var progress = try WriteProgress.init(connection, image.expandedSize());
+    progress.attachFlusher(options.writebackInterval);
+    progress.attachRecovery(options.badBlockPolicy, probeBlockSize(device));
+    progress.setIoConfig(chunkSize, 1);
+    try progress.start();
+    defer progress.stop();
+
+    const zeroPoolBuffer = pool.tryAcquire() orelse return error.BufferPoolExhausted;
+    defer pool.release(zeroPoolBuffer);
+    const zeroBuffer = zeroPoolBuffer[0..@intCast(chunkSize)];
+    @memset(zeroBuffer, 0);
+
+    var zeroes = ZeroRangeWriter{ .device = device, .mode = options.sparseMode };
+
+    while (try decoder.next()) |decoded| {
+        const chunk = decoded.chunk;
+
+        if (!chunk.type.isSparse()) {
+            try progress.writeChunk(device, decoded.bytes, chunk.outputOffset);
+            try progress.advance(decoded.bytes.len);
+        } else if (zeroes.elide(chunk.outputOffset, chunk.outputLen)) {
+            try progress.skip(chunk.outputLen);
+        } else {
+            try writeRepeated(device, zeroBuffer, chunk.outputOffset, chunk.outputLen, &progress);
+        }
+
+        decoder.release();
+        try progress.markDurable(device, chunk.end());
+    }
+
+    try progress.syncTarget(device);
+
+    Debug.log(.INFO, "Finished UDIF write: {d} bytes written, {d} sparse bytes elided.", .{ progress.currentByte - progress.bytesSkipped, progress.bytesSkipped });
+}
+
+/// Verifies a UDIF write by decoding the image again and comparing every chunk with the
+/// device. Sparse chunks are compared with zeros.
+///
+/// `Errors`:
+///   error.MismatchingISOAndDeviceBytesDetected: device bytes differ from the decoded image
+fn verifyUdifImage(connection: XPCConnection, imageFile: std.fs.File, device: std.fs.File, pool: *BufferPool, mismatches: *repair.MismatchMap) !void {
+    const chunkSize: usize = @intCast(probeTransferSize(device));
+    const blockSize = probeBlockSize(device);
+
+    var image = try udif.parse(std.heap.page_allocator, imageFile);
+    defer image.deinit();
+
+    var decoder: udif.ParallelDecoder = undefined;
+    try decoder.start(std.heap.page_allocator, imageFile, &image, udif.defaultWorkerCount());
+    defer decoder.stop();
+
+    const devicePoolBuffer = pool.tryAcquire() orelse return error.BufferPoolExhausted;
+    defer pool.release(devicePoolBuffer);
+    const zeroPoolBuffer = pool.tryAcquire() orelse return error.BufferPoolExhausted;
+    defer pool.release(zeroPoolBuffer);
+
+    const deviceBuffer = devicePoolBuffer[0..chunkSize];
+    const zeroBuffer = zeroPoolBuffer[0..chunkSize];
+    @memset(zeroBuffer, 0);
+
+    const expandedSize = image.expandedSize();
+    var progress = try VerifyProgress.init(connection, expandedSize);
+
+    Debug.log(.INFO, "Verifying {d} bytes of the UDIF image on the device...", .{expandedSize});
+
+    while (try decoder.next()) |decoded| {
+        const chunk = decoded.chunk;
+
+        var done: u64 = 0;
+        while (done < chunk.outputLen) {
+            const len: usize = @intCast(@min(@as(u64, chunkSize), chunk.outputLen - done));
+            const expected = if (chunk.type.isSparse()) zeroBuffer[0..len] else decoded.bytes[@intCast(done)..][0..len];
+
+            const deviceBytesRead = try device.preadAll(deviceBuffer[0..len], chunk.outputOffset + done);
+            try collectMismatches(expected, deviceBuffer[0..deviceBytesRead], chunk.outputOffset + done, blockSize, mismatches);
+
+            done += len;
+        }
+
+        decoder.release();
+
+        progress.update(chunk.end(), chunk.end());
+    }
+
+    try finishVerification(mismatches);
+    Debug.log(.INFO, "Finished verifying UDIF chunks on the device!", .{});
+}
+
+/// Virtual disk (qcow2/VHD/VHDX/VMDK) write: the allocation table is mapped to extents
+/// up front (vdisk.parse) and the guest disk is streamed through the pipeline.
+///
+/// `Behavior`:
+///   - The reader thread reads allocated clusters up to pipelineDepth slots ahead of the
+///     device writes, gathering scattered clusters into full-size chunks
+///   - Unallocated clusters become sparse ranges: they follow options.sparseMode like the
+///     zero ranges of raw images and are written as zeros when it is OFF
+///   - Progress is computed over the virtual disk size
+///   - Checkpoint resume does not apply
+///
+/// `Errors`:
+///   vdisk errors (invalid image, backing or parent disks, compressed clusters)
+///   error.UnexpectedEndOfImage: an allocated cluster lies past the end of the file
+fn writeVirtualDiskImage(connection: XPCConnection, imageFile: std.fs.File, device: std.fs.File, options: WriteOptions, pool: *BufferPool, digests: ?*digestlog.DigestLog) !void {
+    if (comptime !isLinux) {
+        _ = c.fcntl(device.handle, c.F_NOCACHE, @as(c_int, 1));
+        _ = c.fcntl(imageFile.handle, c.F_RDAHEAD, @as(c_int, 1));
+    }
+
+    var map = try vdisk.parse(std.heap.page_allocator, imageFile);
+    defer map.deinit();
+
+    const chunkSize = probeTransferSize(device);
+
+    Debug.log(.INFO, "Writing {s} virtual disk: {d} extents, {d} of {d} bytes allocated.", .{
+        @tagName(map.format),
+        map.extents.len,
+        map.dataBytes(),
+        map.virtualSize,
+    });
+
+    var progress = try WriteProgress.init(connection, map.virtualSize);
+    progress.attachDigests(digests);
+    progress.attachFlusher(options.writebackInterval);
+    progress.attachRecovery(options.badBlockPolicy, probeBlockSize(device));
+    progress.setIoConfig(chunkSize, 1);
+    try progress.start();
+    defer progress.stop();
+
+    var tuner = initWriteAutotuner(options, map.virtualSize, probeBlockSize(device));
+    const tunerRef: ?*autotune.Autotuner = if (tuner) |*t| t else null;
+
+    var diskSource = imagesource.VirtualDiskSource{ .file = imageFile, .map = &map };
+    const depth = std.math.clamp(options.pipelineDepth, 2, pipeline.MAX_RING_SLOTS);
+    try writePipelined(diskSource.imageSource(), device, pool, if (tuner != null) MAX_WRITE_SIZE else chunkSize, depth, options.sparseMode, tunerRef, &progress);
+
+    try progress.syncTarget(device);
+    progress.sealDigests();
+
+    Debug.log(.INFO, "Finished virtual disk write: {d} bytes.", .{progress.currentByte});
+}
+
+/// Chooses the platform probe for the device logical block size.
+fn probeBlockSize(device: std.fs.File) u64 {
+    if (comptime isLinux) {
+        return Uring.probeLogicalBlockSize(device);
+    } else {
+        return probeDeviceBlockSize(device);
+    }
+}
+
+/// Chooses the platform probe for the device transfer size.
+fn probeTransferSize(device: std.fs.File) u64 {
+    if (comptime isLinux) {
+        return Uring.probeChunkSize(device);
+    } else {
+        return probeDeviceWriteSize(device);
+    }
+}
+
+/// Applies the SparseMode policy to ZERO slots produced by the sparse reader.
+///   - ASSUME_ZEROED: nothing is written; the caller vouched for a zeroed target
+///   - DISCARD: the range is unmapped with DKIOCUNMAP; if the device rejects unmap,
+///     zeros are written instead (and unmap is not attempted again when unsupported)
+///   - OFF: zeros are written (the non-sparse reader never produces ZERO slots)
+const ZeroRangeWriter = struct {
+    device: std.fs.File,
+    mode: SparseMode,
+    isDiscardSupported: bool = true,
+    bytesElided: u64 = 0,
+    bytesDiscarded: u64 = 0,
+
+    fn apply(self: *ZeroRangeWriter, slot: *pipeline.Slot) !void {
+        if (self.elide(slot.offset, slot.len)) return;
+        try self.writeZeros(slot);
+    }
+
+    /// Applies the policy to [offset, offset + length) without writing. Returns false
+    /// when the range still has to be written (OFF, or discard failed).
+    fn elide(self: *ZeroRangeWriter, offset: u64, length: u64) bool {
+        switch (self.mode) {
+            .ASSUME_ZEROED => {
+                self.bytesElided += length;
+                return true;
+            },
+            .DISCARD => if (self.isDiscardSupported) {
+                if (self.discard(offset, length)) {
+                    self.bytesElided += length;
+                    self.bytesDiscarded += length;
+                    return true;
+                } else |err| {
+                    Debug.log(.WARNING, "Discard of {d} bytes at {d} failed ({any}).", .{ length, offset, err });
+                    if (err == error.DiscardNotSupported) self.isDiscardSupported = false;
+                }
+            },
+            .OFF => {},
+        }
+
+        return false;
+    }
+
+    fn discard(self: *ZeroRangeWriter, offset: u64, length: u64) !void {
+        if (comptime isLinux) {
+            return Uring.discardRange(self.device, offset, length);
+        } else {
+            return discardRangeDarwin(self.device, offset, length);
+        }
+    }
+
+    fn discardRangeDarwin(device: std.fs.File, offset: u64, length: u64) !void {
+        var extent = c.dk_extent_t{ .offset = offset, .length = length };
+        var unmap = std.mem.zeroes(c.dk_unmap_t);
+        unmap.extents = &extent;
+        unmap.extentsCount = 1;
+
+        const rc = c.ioctl(device.handle, c.DKIOCUNMAP, &unmap);
+        if (rc != 0) {
+            return switch (std.posix.errno(rc)) {
+                .NOTTY, .OPNOTSUPP, .NOTSUP => error.DiscardNotSupported,
+                else => error.DiscardFailed,
+            };
+        }
+    }
+
+    /// Writes `slot.len` zero bytes at `slot.offset`, reusing the slot buffer as the zero source.
+    fn writeZeros(self: *ZeroRangeWriter, slot: *pipeline.Slot) !void {
+        @memset(slot.data, 0);
+
+        var written: u64 = 0;
+        while (written < slot.len) {
+            const len: usize = @intCast(@min(@as(u64, slot.data.len), slot.len - written));
+            try self.device.pwriteAll(slot.data[0..len], slot.offset + written);
+            written += len;
+        }
+    }
+};
+
+// ============================================================================
+// VERIFICATION OPERATION - Byte-by-byte integrity check
+// ============================================================================
+
+/// Verifies that data written to device matches source ISO image exactly.
+/// Critical final step: ensures write completed successfully and uncorrupted.
+/// Reads chunks from both image and device, comparing sequentially.
+///
+/// `Arguments`:
+///   connection: XPC connection to GUI for progress updates
+///   imageFile: Source ISO image file
+///   deviceHandle: Target device to verify
+///   pool: Job buffer pool; up to 2 * VERIFY_RING_SLOTS + 1 buffers are borrowed
+///   mapImage: Compare raw images against a memory mapping instead of reading them into a buffer
+///   digests: Chunk digests recorded by the write. When complete, only the device is read
+///     and hashed (see verifyDeviceDigests); otherwise the image is read again
+///   mismatches: Filled with every differing range (see repair.zig) when verification fails
+///
+/// `Errors`:
+///   error.MismatchingISOAndDeviceBytesDetected: Byte mismatch found (see `mismatches`)
+///   File I/O errors from read operations
+///
+/// `Verification Strategy`:
+///   1. Use same probed chunk size as writeISO (consistency)
+///   2. An image reader thread and a device reader thread each fill their own ring of
+///      VERIFY_RING_SLOTS pool buffers, so both reads are in flight at once
+///   3. The calling thread compares ready pairs with the vectorized simd.findMismatch
+///   4. Keep comparing after a mismatch and collect the differing ranges, so the repair
+///      step can rewrite just those; stop once repair.MismatchMap hits its bounds. Both
+///      readers are cancelled and joined before returning
+///   5. Send progress updates with verification rates (see VerifyProgress)
+///
+/// `Image Sources`:
+///   - Raw images: read from the file, or compared against their mapped pages (mapImage),
+///     in which case no image reader thread is needed
+///   - Compressed images: decompressed on the image reader thread; progress follows the
+///     compressed bytes consumed since the decompressed size may be unknown
+///   - Virtual disks: the guest disk is read through its extent map, holes as zeros
+///   - Android sparse and UDIF images have their own verifiers
+///
+/// `Performance Considerations`:
+///   - Verification time is the slower of the two reads rather than their sum
+///   - Buffers are borrowed from the job pool so verification allocates nothing
+///   - Batched progress updates prevent XPC saturation
+///   - Same 8MB/100ms update intervals as write
+///
+/// `Data Integrity`:
+///   - Detects bit flips, write failures, or device issues
+///   - Catches silent data corruption that write() doesn't detect
+///   - Essential for bootable media (bad sectors corrupt boot)
+///
+/// `Error Handling`:
+///   - Detects device returning fewer bytes than expected (I/O error)
+///   - Reader errors are surfaced once the comparator runs out of slots
+///   - Logs mismatch details for debugging
+///
+/// `Note`:
+///   This is deliberately thorough - we verify the entire image to ensure
+///   correctness. A failed verify is better than a silent corruption that
+///   prevents boot.
+pub fn verifyWrittenBytes(connection: XPCConnection, imageFile: std.fs.File, deviceHandle: DeviceHandle, pool: *BufferPool, mapImage: bool, digests: ?*const digestlog.DigestLog, mismatches: *repair.MismatchMap) !void {
+    const device = deviceHandle.raw;
+    mismatches.clear();
+
+    if (digests) |log| {
+        if (log.isComplete()) return verifyDeviceDigests(connection, device, log, pool, mismatches);
+        Debug.log(.INFO, "No complete digest log for this write; comparing the device against the image.", .{});
+    }
+
+    if (simg.detect(imageFile)) return verifyAndroidSparseImage(connection, imageFile, device, pool, mismatches);
+    if (udif.detect(imageFile)) return verifyUdifImage(connection, imageFile, device, pool, mismatches);
+
+    // Use the same probed chunk size for consistency
+    const CHUNK_SIZE: usize = @intCast(probeTransferSize(device));
+    const blockSize = probeBlockSize(device);
+    const fileSize = (try imageFile.stat()).size;
+
+    var image: PipelineImage = undefined;
+    try image.open(imageFile, pool);
+    defer image.deinit();
+
+    // Raw images are compared against their mapped pages, skipping the image read copy
+    var mappedImage = if (image.kind == .FILE and mapImage) mapping.mapImageOrNull(imageFile, fileSize) else null;
+    defer if (mappedImage) |*mapped| mapped.deinit();
+
+    var deviceRing = try pipeline.BufferRing.init(std.heap.page_allocator, pool, VERIFY_RING_SLOTS, CHUNK_SIZE);
+    defer deviceRing.deinit();
+    var imageRing: ?pipeline.BufferRing = if (mappedImage == null) try pipeline.BufferRing.init(std.heap.page_allocator, pool, VERIFY_RING_SLOTS, CHUNK_SIZE) else null;
+    defer if (imageRing) |*ring| ring.deinit();
+
+    // Decompressed sizes are only hints, so the device is read until the comparison stops,
+    // and progress follows the compressed bytes consumed
+    const deviceLimit: u64 = if (image.kind == .COMPRESSED) std.math.maxInt(u64) else image.knownSize.?;
+    var progress = try VerifyProgress.init(connection, if (image.kind == .COMPRESSED) fileSize else image.knownSize.?);
+
+    Debug.log(.INFO, "File and device are opened successfully! File size: {d}", .{fileSize});
+    Debug.log(.INFO, "Verifying image bytes written to device with {d}MB chunks, please wait...", .{CHUNK_SIZE / (1024 * 1024)});
+
+    var deviceSource = imagesource.FileSource.initSized(device, deviceLimit);
+    const deviceReader = try std.Thread.spawn(.{}, pipeline.readSourceIntoRing, .{ &deviceRing, deviceSource.imageSource(), @as(u64, 0), false });
+    defer deviceReader.join();
+    // Always stop the device reader: it may be reading ahead past the end of the image
+    defer deviceRing.cancel();
+
+    const imageReader: ?std.Thread = if (imageRing) |*ring| try std.Thread.spawn(.{}, pipeline.readSourceIntoRing, .{ ring, image.source(), @as(u64, 0), false }) else null;
+    defer if (imageReader) |thread| thread.join();
+    defer if (imageRing) |*ring| ring.cancel();
+
+    var currentByte: u64 = 0;
+
+    while (true) {
+        const imageSlot = if (imageRing) |*ring| ring.acquireFilled() else null;
+        const imageSlice: []const u8 = if (mappedImage) |*mapped|
+            try mapped.slice(currentByte, CHUNK_SIZE)
+        else if (imageSlot) |slot|
+            slot.bytes()
+        else
+            &.{};
+
+        if (imageSlice.len == 0) {
+            Debug.log(.INFO, "End of image file reached at byte: {d}", .{currentByte});
+            break;
+        }
+
+        // Both readers fill whole chunks until their end, so slots pair up by position
+        const deviceSlot = deviceRing.acquireFilled() orelse {
+            if (deviceRing.getProducerError()) |err| return err;
+            Debug.log(.ERROR, "Device ended at byte {d} during verification, before the image did.", .{currentByte});
+            return stopVerification(mismatches, .{ .offset = currentByte, .len = imageSlice.len, .blockSize = blockSize });
+        };
+        const deviceSlice = deviceSlot.bytes();
+
+        // A short device slice (I/O error at the end of the device) is a mismatch up to the image's end
+        try collectMismatches(imageSlice, deviceSlice[0..@min(deviceSlice.len, imageSlice.len)], currentByte, blockSize, mismatches);
+
+        currentByte += imageSlice.len;
+        const sourcePosition = if (imageSlot) |slot| slot.sourceOffset else currentByte;
+
+        deviceRing.release();
+        if (imageRing) |*ring| ring.release();
+        if (mappedImage) |*mapped| mapped.discardBefore(currentByte);
+
+        progress.update(currentByte, if (image.kind == .COMPRESSED) sourcePosition else currentByte);
+    }
+
+    if (imageRing) |*ring| if (ring.getProducerError()) |err| return err;
+
+    try finishVerification(mismatches);
+    Debug.log(.INFO, "Finished verifying image written to device!", .{});
+}
+
+/// Quick verification: compares only the ranges of a quickverify.Plan (image edges,
+/// partition tables, El Torito boot images and seeded random samples) with the device.
+///
+/// `Arguments`:
+///   options: Seed and sample count of the plan; the same seed replays the same ranges
+///   mismatches: Filled with every differing range when verification fails
+///   coverage: Set to the share of the image the plan covered once every sampled range
+///     was compared; stays null when the image had to be verified in full instead
+///
+/// `Errors`:
+///   error.MismatchingISOAndDeviceBytesDetected: Byte mismatch found (see `mismatches`)
+///   error.UnexpectedEndOfImage: the image is shorter than its reported size
+///
+/// `Behavior`:
+///   - Raw images and virtual disks are sampled through their seekable image source
+///   - Compressed, Android sparse and UDIF images cannot be read at random offsets and
+///     fall back to verifyWrittenBytes
+///   - Ranges are read one transfer-sized piece at a time on the calling thread; the
+///     reads are scattered, so read-ahead threads would gain little
+pub fn verifySampledBytes(connection: XPCConnection, imageFile: std.fs.File, deviceHandle: DeviceHandle, pool: *BufferPool, options: quickverify.Options, mismatches: *repair.MismatchMap, coverage: *?quickverify.Coverage) !void {
+    const device = deviceHandle.raw;
+    mismatches.clear();
+    coverage.* = null;
+
+    const isSeekable = !simg.detect(imageFile) and !udif.detect(imageFile) and
+        (vdisk.detect(imageFile) != null or compression.detect(imageFile) == .NONE);
+
+    if (!isSeekable) {
+        Debug.log(.WARNING, "Quick verification needs random access to the image; verifying this image in full instead.", .{});
+        return verifyWrittenBytes(connection, imageFile, deviceHandle, pool, false, null, mismatches);
+    }
+
+    const chunkSize: usize = @intCast(probeTransferSize(device));
+    const probedBlockSize = probeBlockSize(device);
+    const blockSize = if (std.math.isPowerOfTwo(probedBlockSize) and probedBlockSize <= quickverify.SAMPLE_BLOCK_SIZE) probedBlockSize else 512;
+
+    var image: PipelineImage = undefined;
+    try image.open(imageFile, pool);
+    defer image.deinit();
+    const source = image.source();
+    const imageSize = image.knownSize.?;
+
+    var plan = try quickverify.Plan.build(std.heap.page_allocator, source, imageSize, blockSize, options.seed, options.sampleCount);
+    defer plan.deinit(std.heap.page_allocator);
+    const planned = plan.coverage();
+
+    Debug.log(.INFO, "Quick verification: {d} ranges, {d} of {d} bytes ({d}.{d:0>2}%), seed {d}, {d} samples.", .{
+        plan.ranges.items.len,
+        planned.coveredBytes,
+        imageSize,
+        planned.basisPoints() / 100,
+        planned.basisPoints() % 100,
+        planned.seed,
+        planned.sampleCount,
+    });
+
+    const imagePoolBuffer = pool.tryAcquire() orelse return error.BufferPoolExhausted;
+    defer pool.release(imagePoolBuffer);
+    const devicePoolBuffer = pool.tryAcquire() orelse return error.BufferPoolExhausted;
+    defer pool.release(devicePoolBuffer);
+
+    const imageBuffer = imagePoolBuffer[0..chunkSize];
+    const deviceBuffer = devicePoolBuffer[0..chunkSize];
+
+    var verifiedBytes: u64 = 0;
+    var progress = try VerifyProgress.init(connection, planned.coveredBytes);
+
+    for (plan.ranges.items) |range| {
+        var done: u64 = 0;
+        while (done < range.len) {
+            const offset = range.offset + done;
+            const len: usize = @intCast(@min(@as(u64, chunkSize), range.len - done));
+
+            if (try source.pread(imageBuffer[0..len], offset) < len) return error.UnexpectedEndOfImage;
+            const deviceBytesRead = try device.preadAll(deviceBuffer[0..len], offset);
+            try collectMismatches(imageBuffer[0..len], deviceBuffer[0..deviceBytesRead], offset, blockSize, mismatches);
+
+            done += len;
+            verifiedBytes += len;
+            progress.update(verifiedBytes, verifiedBytes);
+        }
+    }
+
+    coverage.* = planned;
+    try finishVerification(mismatches);
+    Debug.log(.INFO, "Finished quick verification: {d} sampled bytes match (seed {d}).", .{ verifiedBytes, planned.seed });
+}
+
+/// Repair step after a failed verification: rewrites only the ranges in `mismatches`
+/// from the image, flushes them and compares them again.
+///
+/// `Arguments`:
+///   mismatches: Ranges collected by the failed pass; refilled by the second comparison
+///
+/// `Errors`:
+///   error.MismatchingISOAndDeviceBytesDetected: the map cannot be repaired (truncated),
+///     the image format has no byte-addressable source, or the ranges still differ after
+///     the rewrite (see `mismatches`)
+///   Device write and image read errors
+///
+/// `Behavior`:
+///   - Ranges are widened to whole device blocks; matching bytes rewritten along the way
+///     are rewritten with the same contents
+///   - Raw images and virtual disks are read at the range offsets; compressed images are
+///     decompressed once from the start per pass, reading only up to the last range
+///   - Android sparse and UDIF images are not repaired: their chunks would have to be
+///     decoded again to find the bytes of a device range
+pub fn repairMismatches(connection: XPCConnection, imageFile: std.fs.File, deviceHandle: DeviceHandle, pool: *BufferPool, mismatches: *repair.MismatchMap) !void {
+    const device = deviceHandle.raw;
+
+    if (!mismatches.isRepairable()) return error.MismatchingISOAndDeviceBytesDetected;
+    if (simg.detect(imageFile) or udif.detect(imageFile)) {
+        Debug.log(.WARNING, "Mismatches in Android sparse or UDIF images cannot be repaired in place.", .{});
+        return error.MismatchingISOAndDeviceBytesDetected;
+    }
+
+    const chunkSize: usize = @intCast(probeTransferSize(device));
+
+    // Second pass refills the map, so keep the block ranges to rewrite and check
+    var targets: [repair.MAX_MISMATCH_RANGES]repair.Mismatch = undefined;
+    for (mismatches.slice(), 0..) |found, index| targets[index] = found.blockRange();
+    const targetRanges = targets[0..mismatches.count];
+
+    var targetBytes: u64 = 0;
+    for (targetRanges) |range| targetBytes += range.len;
+
+    Debug.log(.WARNING, "Repairing {d} mismatching ranges ({d} bytes) instead of failing the job...", .{ targetRanges.len, targetBytes });
+
+    const imagePoolBuffer = pool.tryAcquire() orelse return error.BufferPoolExhausted;
+    defer pool.release(imagePoolBuffer);
+    const devicePoolBuffer = pool.tryAcquire() orelse return error.BufferPoolExhausted;
+    defer pool.release(devicePoolBuffer);
+
+    const imageBuffer = imagePoolBuffer[0..chunkSize];
+    const deviceBuffer = devicePoolBuffer[0..chunkSize];
+
+    {
+        var image: PipelineImage = undefined;
+        try image.open(imageFile, pool);
+        defer image.deinit();
+        var reader = ForwardReader{ .source = image.source() };
+
+        for (targetRanges) |range| {
+            var done: u64 = 0;
+            while (done < range.len) {
+                const len: usize = @intCast(@min(@as(u64, chunkSize), range.len - done));
+                const bytesRead = try reader.readAt(imageBuffer[0..len], range.offset + done);
+                if (bytesRead == 0) break;
+
+                try device.pwriteAll(imageBuffer[0..bytesRead], range.offset + done);
+                done += bytesRead;
+            }
+        }
+
+        try device.sync();
+    }
+
+    mismatches.clear();
+    var verifiedBytes: u64 = 0;
+    var progress = try VerifyProgress.init(connection, targetBytes);
+
+    {
+        var image: PipelineImage = undefined;
+        try image.open(imageFile, pool);
+        defer image.deinit();
+        var reader = ForwardReader{ .source = image.source() };
+
+        for (targetRanges) |range| {
+            var done: u64 = 0;
+            while (done < range.len) {
+                const offset = range.offset + done;
+                const len: usize = @intCast(@min(@as(u64, chunkSize), range.len - done));
+                const bytesRead = try reader.readAt(imageBuffer[0..len], offset);
+                if (bytesRead == 0) break;
+
+                const deviceBytesRead = try device.preadAll(deviceBuffer[0..bytesRead], offset);
+                try collectMismatches(imageBuffer[0..bytesRead], deviceBuffer[0..deviceBytesRead], offset, range.blockSize, mismatches);
+
+                done += bytesRead;
+                verifiedBytes += bytesRead;
+                progress.update(verifiedBytes, verifiedBytes);
+            }
+        }
+    }
+
+    finishVerification(mismatches) catch |err| {
+        Debug.log(.ERROR, "Rewritten ranges still differ from the image; the device does not hold the data.", .{});
+        return err;
+    };
+
+    Debug.log(.INFO, "Repaired {d} ranges ({d} bytes); the device now matches the image.", .{ targetRanges.len, verifiedBytes });
+}
+
+/// Reads image ranges in ascending offset order from any ImageSource: seekable sources
+/// are read at the offset, streams are read forward and the bytes in between discarded.
+const ForwardReader = struct {
+    source: ImageSource,
+    /// Stream position of non-seekable sources
+    position: u64 = 0,
+
+    /// Fills `buffer` from image `offset`; fewer bytes (possibly 0) at the end of the image.
+    fn readAt(self: *ForwardReader, buffer: []u8, offset: u64) !usize {
+        if (self.source.isSeekable()) return self.source.pread(buffer, offset);
+        std.debug.assert(offset >= self.position);
+
+        while (self.position < offset) {
+            const skip: usize = @intCast(@min(@as(u64, buffer.len), offset - self.position));
+            const skipped = try self.source.read(buffer[0..skip]);
+            if (skipped == 0) return 0;
+            self.position += skipped;
+        }
+
+        const bytesRead = try self.source.read(buffer);
+        self.position += bytesRead;
+        return bytesRead;
+    }
+};
+
+/// Verifies a write against the chunk digests recorded while it streamed the image
+/// (see digestlog.zig). Only the device is read, one digestlog.CHUNK_SIZE chunk at a
+/// time, so the image's disk sees no verification traffic at all. A reader thread keeps
+/// the next chunk in flight while the current one is hashed.
+///
+/// `Errors`:
+///   error.MismatchingISOAndDeviceBytesDetected: a chunk read back hashes differently, or the
+///     device is shorter than the image. Every such chunk is logged and recorded whole in
+///     `mismatches`, since a digest cannot narrow it down.
+fn verifyDeviceDigests(connection: XPCConnection, device: std.fs.File, log: *const digestlog.DigestLog, pool: *BufferPool, mismatches: *repair.MismatchMap) !void {
+    comptime std.debug.assert(digestlog.CHUNK_SIZE <= POOL_BUFFER_SIZE);
+    const blockSize = probeBlockSize(device);
+
+    var ring = try pipeline.BufferRing.init(std.heap.page_allocator, pool, VERIFY_RING_SLOTS, @intCast(digestlog.CHUNK_SIZE));
+    defer ring.deinit();
+
+    var progress = try VerifyProgress.init(connection, log.hashedBytes);
+
+    Debug.log(.INFO, "Verifying {d} device bytes against {d} chunk digests recorded during the write...", .{ log.hashedBytes, log.chunkCount() });
+
+    var deviceSource = imagesource.FileSource.initSized(device, log.hashedBytes);
+    const reader = try std.Thread.spawn(.{}, pipeline.readSourceIntoRing, .{ &ring, deviceSource.imageSource(), @as(u64, 0), false });
+    defer reader.join();
+    defer ring.cancel();
+
+    for (log.chunkDigests.items, 0..) |expected, index| {
+        const offset = @as(u64, index) * digestlog.CHUNK_SIZE;
+        const len = log.chunkLen(index);
+
+        const slot = ring.acquireFilled() orelse {
+            if (ring.getProducerError()) |err| return err;
+            Debug.log(.ERROR, "Device ended at byte {d}, inside chunk #{d}.", .{ offset, index });
+            return stopVerification(mismatches, .{ .offset = offset, .len = len, .blockSize = blockSize });
+        };
+
+        if (slot.len < len) {
+            Debug.log(.ERROR, "Device ended inside chunk #{d} after {d} of {d} bytes.", .{ index, slot.len, len });
+            return stopVerification(mismatches, .{ .offset = offset, .len = len, .blockSize = blockSize });
+        }
+
+        if (!std.mem.eql(u8, &digestlog.hashChunk(slot.bytes()), &expected)) {
+            Debug.log(.ERROR, "Device chunk #{d} (bytes [{d}, {d})) does not match the image digest.", .{ index, offset, offset + len });
+            try noteMismatch(mismatches, .{ .offset = offset, .len = len, .blockSize = blockSize });
+        }
+
+        ring.release();
+        progress.update(offset + len, offset + len);
+    }
+
+    try finishVerification(mismatches);
+    Debug.log(.INFO, "Finished verifying the device against the write's chunk digests!", .{});
+}
+
+/// Compares `expected` image bytes with the `actual` device bytes read at device `offset`
+/// and records every differing run. Device bytes missing at the end (short read) count
+/// as differing.
+///
+/// `Errors`:
+///   error.MismatchingISOAndDeviceBytesDetected: the map hit its bounds; stop verifying
+fn collectMismatches(expected: []const u8, actual: []const u8, offset: u64, blockSize: u64, mismatches: *repair.MismatchMap) !void {
+    const compared = @min(expected.len, actual.len);
+
+    var position: usize = 0;
+    while (simd.findMismatch(expected[position..compared], actual[position..compared])) |run| {
+        try noteMismatch(mismatches, .{ .offset = offset + position + run.offset, .len = run.len, .blockSize = blockSize });
+        position += run.offset + run.len;
+    }
+
+    if (compared < expected.len) {
+        try noteMismatch(mismatches, .{ .offset = offset + compared, .len = expected.len - compared, .blockSize = blockSize });
+    }
+}
+
+/// Records `found` and lets verification go on, unless the map is full.
+fn noteMismatch(mismatches: *repair.MismatchMap, found: repair.Mismatch) error{MismatchingISOAndDeviceBytesDetected}!void {
+    if (mismatches.record(found)) return;
+
+    Debug.log(.ERROR, "Too many mismatching ranges to repair; stopping verification at byte {d}.", .{found.offset});
+    mismatches.log();
+    return error.MismatchingISOAndDeviceBytesDetected;
+}
+
+/// Records `found` as a mismatch the verifier cannot go past (the device ended, or the
+/// checksum state is lost) and fails; the rest of the device stays unchecked.
+fn stopVerification(mismatches: *repair.MismatchMap, found: repair.Mismatch) error{MismatchingISOAndDeviceBytesDetected} {
+    _ = mismatches.record(found);
+    mismatches.truncate();
+    mismatches.log();
+    return error.MismatchingISOAndDeviceBytesDetected;
+}
+
+/// Ends a verification pass that went through: fails if anything differed.
+fn finishVerification(mismatches: *const repair.MismatchMap) error{MismatchingISOAndDeviceBytesDetected}!void {
+    if (mismatches.isEmpty()) return;
+    mismatches.log();
+    return error.MismatchingISOAndDeviceBytesDetected;
+}
+
+/// Sends WRITE_VERIFICATION_PROGRESS updates, batched like the write path (every
+/// PROGRESS_UPDATE_INTERVAL_BYTES or PROGRESS_UPDATE_INTERVAL_NS, and at the end), with
+/// verification rates derived the same way (sampling.RateTracker):
+///   - verification_progress: Percentage of `totalBytes` covered
+///   - verification_rate / verification_rate_ewma / verification_rate_avg: Bytes/sec compared
+///   - verification_bytes: Bytes compared so far
+/// Updated from the comparing thread; one clock read per chunk is noise next to the reads.
+const VerifyProgress = struct {
+    connection: XPCConnection,
+    /// Denominator of the percentage; the compressed size while decompressing
+    totalBytes: u64,
+    lastUpdateBytes: u64 = 0,
+    lastUpdateNs: u64 = 0,
+    rates: sampling.RateTracker,
+    clock: std.time.Timer,
+
+    fn init(connection: XPCConnection, totalBytes: u64) !VerifyProgress {
+        var clock = try std.time.Timer.start();
+        return .{ .connection = connection, .totalBytes = totalBytes, .rates = sampling.RateTracker.init(0, clock.read()), .clock = clock };
+    }
+
+    /// Records `verifiedBytes` compared so far; `position` is how far into `totalBytes`
+    /// they reach (the compressed bytes consumed for compressed images).
+    fn update(self: *VerifyProgress, verifiedBytes: u64, position: u64) void {
+        const nowNs = self.clock.read();
+        const isDue = verifiedBytes - self.lastUpdateBytes >= PROGRESS_UPDATE_INTERVAL_BYTES or nowNs - self.lastUpdateNs >= PROGRESS_UPDATE_INTERVAL_NS;
+        if (!isDue and position < self.totalBytes) return;
+
+        const rates = self.rates.update(verifiedBytes, nowNs);
+
+        const progressUpdate = XPCService.createResponse(.WRITE_VERIFICATION_PROGRESS);
+        defer XPCService.releaseObject(progressUpdate);
+        XPCService.createUInt64(progressUpdate, "verification_progress", sampling.percentOf(position, self.totalBytes));
+        XPCService.createUInt64(progressUpdate, "verification_rate", rates.instant);
+        XPCService.createUInt64(progressUpdate, "verification_rate_ewma", rates.smoothed);
+        XPCService.createUInt64(progressUpdate, "verification_rate_avg", rates.average);
+        XPCService.createUInt64(progressUpdate, "verification_bytes", verifiedBytes);
+        XPCService.connectionSendMessage(self.connection, progressUpdate);
+
+        self.lastUpdateBytes = verifiedBytes;
+        self.lastUpdateNs = nowNs;
+    }
+};
@@ -0,0 +1,175 @@
+//! Memory-Mapped Image Source
+//!
+//! Exposes an image file as read-only slices of a sliding mapping, so the writer can
+//! hand mapped pages straight to the device and the verifier can compare against them
+//! without first copying each chunk into a private buffer.
+//!
+//! Window Management:
+//! - The file is mapped in windows of `windowSize` bytes starting at page boundaries
+//! - Every new window is advised MADV_SEQUENTIAL and MADV_WILLNEED, so the kernel reads
+//!   ahead while earlier chunks are still being written
+//! - Pages behind the cursor are dropped with MADV_DONTNEED (see discardBefore), and a
+//!   window is unmapped as soon as the cursor leaves it, keeping resident memory bounded
+//!
+//! Fallback:
+//! - init() fails when the filesystem cannot map the file (network and FUSE mounts,
+//!   special files); callers then keep using positional reads
+//!
+//! Failure Mode:
+//! - An I/O error on a mapped page (image on a disk that is unplugged or returns EIO, file
+//!   truncated mid-job) is delivered as SIGBUS, not as an error. Mapping is therefore
+//!   opt-in (WriteOptions.mapImage) for images on local, stable storage
+//!
+//! Slices are only valid until the next slice() call or deinit(). Not thread-safe.
+const std = @import("std");
+const freetracer_lib = @import("freetracer-lib");
+const Debug = freetracer_lib.Debug;
+
+const posix = std.posix;
+
+/// Default mapping window: several write chunks, so readahead runs well ahead of the cursor.
+pub const DEFAULT_WINDOW_SIZE: usize = 64 * 1024 * 1024;
+
+const PageAlignedSlice = []align(std.heap.page_size_min) const u8;
+
+pub const MappedImage = struct {
+    file: std.fs.File,
+    size: u64,
+    windowSize: usize,
+    pageSize: usize,
+    window: ?PageAlignedSlice = null,
+    /// Image offset of the first byte of `window`
+    windowOffset: u64 = 0,
+    /// Window bytes below this many are already released with MADV_DONTNEED
+    discardedBytes: usize = 0,
+
+    /// Maps the first window of `file` to confirm the filesystem supports mapping.
+    ///
+    /// `Errors`:
+    ///   error.EmptyImage: nothing to map
+    ///   mmap errors (e.g. error.AccessDenied, error.MemoryMappingNotSupported): use read() instead
+    pub fn init(file: std.fs.File, size: u64, windowSize: usize) !MappedImage {
+        if (size == 0) return error.EmptyImage;
+
+        const pageSize = std.heap.pageSize();
+        var image = MappedImage{
+            .file = file,
+            .size = size,
+            .windowSize = std.mem.alignForward(usize, @max(windowSize, pageSize), pageSize),
+            .pageSize = pageSize,
+        };
+
+        try image.mapWindow(0, 1);
+        return image;
+    }
+
+    pub fn deinit(self: *MappedImage) void {
+        self.unmapWindow();
+    }
+
+    /// Returns the image bytes [offset, offset + len), mapping a new window when the range
+    /// is not covered by the current one. `len` is clipped to the end of the image.
+    pub fn slice(self: *MappedImage, offset: u64, len: usize) ![]const u8 {
+        if (offset >= self.size) return &.{};
+        const end = @min(offset + len, self.size);
+
+        const isCovered = if (self.window) |window| offset >= self.windowOffset and end <= self.windowOffset + window.len else false;
+        if (!isCovered) try self.mapWindow(offset, end - offset);
+
+        const start: usize = @intCast(offset - self.windowOffset);
+        return self.window.?[start..][0..@intCast(end - offset)];
+    }
+
+    /// Releases mapped pages below `offset`; they will not be read again.
+    pub fn discardBefore(self: *MappedImage, offset: u64) void {
+        const window = self.window orelse return;
+        if (offset <= self.windowOffset) return;
+
+        const consumed: usize = @intCast(@min(offset - self.windowOffset, window.len));
+        const releasable = std.mem.alignBackward(usize, consumed, self.pageSize);
+        if (releasable <= self.discardedBytes) return;
+
+        // Advice only: a rejected DONTNEED costs memory, not correctness
+        posix.madvise(@alignCast(@constCast(window.ptr + self.discardedBytes)), releasable - self.discardedBytes, posix.MADV.DONTNEED) catch {};
+        self.discardedBytes = releasable;
+    }
+
+    /// Replaces the current window with one starting at the page containing `offset` and
+    /// covering at least `minLen` bytes from it. The old window stays mapped if this fails.
+    fn mapWindow(self: *MappedImage, offset: u64, minLen: u64) !void {
+        const start = std.mem.alignBackward(u64, offset, self.pageSize);
+        const needed = offset - start + minLen;
+        const len: usize = @intCast(@min(@max(@as(u64, self.windowSize), needed), self.size - start));
+
+        const window = try posix.mmap(null, len, posix.PROT.READ, .{ .TYPE = .SHARED }, self.file.handle, start);
+
+        posix.madvise(window.ptr, window.len, posix.MADV.SEQUENTIAL) catch {};
+        posix.madvise(window.ptr, window.len, posix.MADV.WILLNEED) catch {};
+
+        self.unmapWindow();
+        self.window = window;
+        self.windowOffset = start;
+        self.discardedBytes = 0;
+    }
+
+    fn unmapWindow(self: *MappedImage) void {
+        const window = self.window orelse return;
+        posix.madvise(@constCast(window.ptr), window.len, posix.MADV.DONTNEED) catch {};
+        posix.munmap(window);
+        self.window = null;
+    }
+};
+
+/// Maps `imageFile` for a mapped write or verify loop, or returns null (logging why) so
+/// the caller falls back to read().
+pub fn mapImageOrNull(imageFile: std.fs.File, imageSize: u64) ?MappedImage {
+    return MappedImage.init(imageFile, imageSize, DEFAULT_WINDOW_SIZE) catch |err| {
+        Debug.log(.INFO, "Image cannot be memory-mapped ({any}); reading it into buffers instead.", .{err});
+        return null;
+    };
+}
+
+// ============================================================================
+// TESTS
+// ============================================================================
+
+test "MappedImage serves slices across window boundaries" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const pageSize = std.heap.pageSize();
+    const payload = try std.testing.allocator.alloc(u8, pageSize * 5 + 99);
+    defer std.testing.allocator.free(payload);
+    for (payload, 0..) |*byte, i| byte.* = @truncate(i *% 29);
+
+    const file = try tmp.dir.createFile("image.img", .{ .read = true });
+    defer file.close();
+    try file.writeAll(payload);
+
+    // Two-page windows force remaps, including a chunk that straddles a window edge
+    var image = try MappedImage.init(file, payload.len, pageSize * 2);
+    defer image.deinit();
+
+    const chunk = pageSize + pageSize / 2;
+    var offset: usize = 0;
+    while (offset < payload.len) {
+        const bytes = try image.slice(offset, chunk);
+        try std.testing.expectEqualSlices(u8, payload[offset..][0..bytes.len], bytes);
+
+        offset += bytes.len;
+        image.discardBefore(offset);
+    }
+
+    try std.testing.expectEqual(payload.len, offset);
+    try std.testing.expectEqual(@as(usize, 0), (try image.slice(payload.len, chunk)).len);
+}
+
+test "MappedImage refuses an empty image" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const file = try tmp.dir.createFile("empty.img", .{ .read = true });
+    defer file.close();
+
+    try std.testing.expectError(error.EmptyImage, MappedImage.init(file, 0, DEFAULT_WINDOW_SIZE));
+}
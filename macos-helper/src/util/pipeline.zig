@@ -0,0 +1,640 @@
+//! Pipelined Image Transfer
+//!
+//! Overlaps source image reads with device writes for the privileged helper.
+//! A dedicated reader thread fills a ring of block-aligned buffers from the image
+//! while the writer thread drains them to the device, so neither the source disk
+//! nor the target device sits idle waiting on the other.
+//!
+//! Threading Model:
+//! - Single producer (reader thread); one consumer (writer thread) by default, or
+//!   several for fan-out jobs where every consumer writes every slot
+//! - Slot ownership is handed over under the ring mutex; a slot's buffer is only
+//!   touched by the side that currently owns it. With several consumers a slot is
+//!   shared read-only until the slowest one releases it
+//! - The ring size bounds how far the fastest consumer can run ahead of the slowest;
+//!   a consumer that fails detaches and stops holding the others back
+//! - Either side may cancel the ring; the other side observes the cancellation on
+//!   its next acquire call and unwinds without blocking
+//!
+//! Image Sources:
+//! - readSourceIntoRing() is the one producer for every ImageSource (plain and split
+//!   files, pipes, decompressed streams, virtual disks): seekable sources are read
+//!   positionally, streams sequentially, so decompression overlaps with device writes
+//!   exactly like plain reads do
+//! - The reader runs up to the ring depth ahead of the writer, which is the prefetch
+//!   window for every source
+//!
+//! Sparse Images:
+//! - In sparse mode the ZERO extents a source reports (filesystem holes, unallocated
+//!   virtual disk clusters) are published as ZERO slots without being read, and
+//!   all-zero chunks are flagged as ZERO slots too
+//! - What the writer does with a ZERO slot is decided by the SparseMode policy
+//!
+//! Block Maps:
+//! - readMappedRangesIntoRing() reads only the ranges listed in a .bmap file; the
+//!   unmapped remainder of the image is never read
+//!
+//! Memory Ownership:
+//! - Slot buffers are borrowed from the job's BufferPool at init() and returned in deinit()
+//! - deinit() must only be called after the reader thread has been joined
+//! ==========================================================================
+const std = @import("std");
+const freetracer_lib = @import("freetracer-lib");
+const Debug = freetracer_lib.Debug;
+const simd = freetracer_lib.simd;
+const BufferPool = freetracer_lib.bufferpool.BufferPool;
+const bmap = freetracer_lib.bmap;
+const vdisk = freetracer_lib.vdisk;
+const ImageSource = freetracer_lib.imagesource.ImageSource;
+const imagesource = freetracer_lib.imagesource;
+
+/// Alignment of every ring buffer (the pool's page alignment), so buffers stay safe for
+/// F_NOCACHE / unbuffered raw device I/O.
+pub const BUFFER_ALIGNMENT = freetracer_lib.bufferpool.BUFFER_ALIGNMENT;
+
+/// Default number of buffers in flight between the reader and the writer.
+/// Two is enough to overlap I/O; the extra slots absorb latency spikes on either side.
+pub const DEFAULT_RING_SLOTS = 4;
+
+/// Upper bound on ring slots to keep memory use predictable (slots * chunk size).
+pub const MAX_RING_SLOTS = 16;
+
+/// Upper bound on io_uring buffers in flight; the pool holds one chunk-sized buffer per slot.
+pub const MAX_QUEUE_DEPTH = 64;
+
+pub const AlignedBuffer = freetracer_lib.bufferpool.AlignedBuffer;
+
+pub const SlotKind = enum {
+    /// `data[0..len]` holds image bytes
+    DATA,
+    /// `len` bytes of zeros; the buffer contents are meaningless and `len` may exceed `data.len`
+    ZERO,
+};
+
+/// A single ring entry covering `len` image bytes destined for `offset` on the target.
+pub const Slot = struct {
+    data: AlignedBuffer,
+    len: u64 = 0,
+    offset: u64 = 0,
+    kind: SlotKind = .DATA,
+    /// Source file position after producing this slot. Differs from `offset + len` only
+    /// for compressed sources, where it tracks the compressed bytes consumed.
+    sourceOffset: u64 = 0,
+
+    /// Returns the populated portion of the slot buffer. Only valid for DATA slots.
+    pub fn bytes(self: *const Slot) []const u8 {
+        std.debug.assert(self.kind == .DATA);
+        return self.data[0..@intCast(self.len)];
+    }
+};
+
+/// Bounded single-producer ring of aligned I/O buffers, drained by one or more consumers.
+pub const BufferRing = struct {
+    allocator: std.mem.Allocator,
+    pool: *BufferPool,
+    slots: []Slot,
+
+    mutex: std.Thread.Mutex = .{},
+    slotFilled: std.Thread.Condition = .{},
+    slotReleased: std.Thread.Condition = .{},
+
+    /// Number of slots committed by the producer since init (monotonic)
+    produced: u64 = 0,
+    /// Per-consumer number of slots released since init (monotonic)
+    consumed: []u64,
+    /// Consumers that stopped draining; they no longer hold back the producer
+    isDetached: []bool,
+
+    isProducerDone: bool = false,
+    isCancelled: bool = false,
+    producerError: ?anyerror = null,
+
+    /// Builds a single-consumer ring of `slotCount` buffers taken from `pool`, each
+    /// trimmed to `chunkSize` bytes (the read size of every slot).
+    ///
+    /// `Errors`:
+    ///   error.InvalidBufferRingConfiguration: zero slots, a zero chunk size, or a chunk larger than the pool's buffers
+    ///   error.BufferPoolExhausted: the pool has fewer than `slotCount` free buffers (taken buffers are returned)
+    ///   error.OutOfMemory: bookkeeping allocation failed
+    pub fn init(allocator: std.mem.Allocator, pool: *BufferPool, slotCount: usize, chunkSize: usize) !BufferRing {
+        return initShared(allocator, pool, slotCount, chunkSize, 1);
+    }
+
+    /// Like init(), but every committed slot must be released by each of `consumerCount`
+    /// consumers before the producer may reuse it.
+    pub fn initShared(allocator: std.mem.Allocator, pool: *BufferPool, slotCount: usize, chunkSize: usize, consumerCount: usize) !BufferRing {
+        if (slotCount == 0 or chunkSize == 0 or chunkSize > pool.bufferSize or consumerCount == 0) return error.InvalidBufferRingConfiguration;
+
+        const consumed = try allocator.alloc(u64, consumerCount);
+        errdefer allocator.free(consumed);
+        @memset(consumed, 0);
+
+        const isDetached = try allocator.alloc(bool, consumerCount);
+        errdefer allocator.free(isDetached);
+        @memset(isDetached, false);
+
+        const slots = try allocator.alloc(Slot, slotCount);
+        errdefer allocator.free(slots);
+
+        var takenCount: usize = 0;
+        errdefer for (slots[0..takenCount]) |slot| pool.release(slot.data);
+
+        // Never block here: a pool sized too small for the ring is a configuration error
+        for (slots) |*slot| {
+            const buffer = pool.tryAcquire() orelse return error.BufferPoolExhausted;
+            slot.* = .{ .data = buffer[0..chunkSize] };
+            takenCount += 1;
+        }
+
+        return BufferRing{
+            .allocator = allocator,
+            .pool = pool,
+            .slots = slots,
+            .consumed = consumed,
+            .isDetached = isDetached,
+        };
+    }
+
+    pub fn deinit(self: *BufferRing) void {
+        for (self.slots) |slot| self.pool.release(slot.data);
+        self.allocator.free(self.slots);
+        self.allocator.free(self.isDetached);
+        self.allocator.free(self.consumed);
+        self.slots = &.{};
+    }
+
+    /// Number of committed slots the slowest attached consumer has not released yet.
+    /// Returns null when every consumer has detached. Caller must hold the mutex.
+    fn pendingForSlowest(self: *const BufferRing) ?u64 {
+        var slowest: ?u64 = null;
+        for (self.consumed, self.isDetached) |count, isDetached| {
+            if (isDetached) continue;
+            slowest = if (slowest) |current| @min(current, count) else count;
+        }
+        return if (slowest) |count| self.produced - count else null;
+    }
+
+    // --- Producer side ---------------------------------------------------
+
+    /// Blocks until a free slot is available and returns it for filling.
+    /// Returns null once the ring has been cancelled or every consumer has detached.
+    pub fn acquireFree(self: *BufferRing) ?*Slot {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        while (!self.isCancelled) {
+            const pending = self.pendingForSlowest() orelse return null;
+            if (pending < self.slots.len) return &self.slots[@intCast(self.produced % self.slots.len)];
+            self.slotReleased.wait(&self.mutex);
+        }
+
+        return null;
+    }
+
+    /// Publishes the slot previously returned by acquireFree() to the consumers.
+    pub fn commit(self: *BufferRing) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        self.produced += 1;
+        self.slotFilled.broadcast();
+    }
+
+    /// Marks the producer as finished. A non-null `err` is surfaced to the consumer
+    /// once it has drained the remaining slots.
+    pub fn finish(self: *BufferRing, err: ?anyerror) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        self.isProducerDone = true;
+        self.producerError = err;
+        self.slotFilled.broadcast();
+    }
+
+    // --- Consumer side ---------------------------------------------------
+
+    /// Single-consumer shorthand for acquireFilledFor(0).
+    pub fn acquireFilled(self: *BufferRing) ?*Slot {
+        return self.acquireFilledFor(0);
+    }
+
+    /// Single-consumer shorthand for releaseFor(0).
+    pub fn release(self: *BufferRing) void {
+        self.releaseFor(0);
+    }
+
+    /// Blocks until `consumer` has a filled slot to drain and returns it.
+    /// Returns null when the producer has finished and the consumer has drained every
+    /// slot, or when the ring has been cancelled. The slot must be treated as read-only
+    /// when the ring has more than one consumer.
+    pub fn acquireFilledFor(self: *BufferRing, consumer: usize) ?*Slot {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        while (self.consumed[consumer] == self.produced and !self.isProducerDone and !self.isCancelled) self.slotFilled.wait(&self.mutex);
+        if (self.isCancelled or self.consumed[consumer] == self.produced) return null;
+
+        return &self.slots[@intCast(self.consumed[consumer] % self.slots.len)];
+    }
+
+    /// Returns the slot previously obtained from acquireFilledFor(consumer).
+    pub fn releaseFor(self: *BufferRing, consumer: usize) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        self.consumed[consumer] += 1;
+        self.slotReleased.signal();
+    }
+
+    /// Removes `consumer` from the ring after a failure so it no longer holds back the
+    /// producer. Once every consumer has detached the producer's acquireFree() returns null.
+    pub fn detach(self: *BufferRing, consumer: usize) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        self.isDetached[consumer] = true;
+        self.slotReleased.signal();
+    }
+
+    /// Aborts the transfer; wakes both sides so neither stays blocked.
+    pub fn cancel(self: *BufferRing) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        self.isCancelled = true;
+        self.slotFilled.broadcast();
+        self.slotReleased.broadcast();
+    }
+
+    /// Returns the error the producer finished with, if any.
+    pub fn getProducerError(self: *BufferRing) ?anyerror {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        return self.producerError;
+    }
+};
+
+/// Reader thread entry point for any ImageSource: fills the ring from `startOffset` until
+/// the source ends, reaches its size, or the consumer cancels the ring.
+///   - Seekable sources are read positionally, so a non-zero `startOffset` resumes an
+///     interrupted write (see checkpoint.zig); streams must start at byte 0
+///   - With `isSparse`, ZERO extents reported by the source (filesystem holes, unallocated
+///     virtual disk clusters) are published as ZERO slots without being read, reads stop
+///     at the next ZERO extent so it gets its own slot, and read chunks that turn out to
+///     be all zeros are published as ZERO slots too
+///   - Without `isSparse` every slot is DATA; ZERO extents are read as zeros
+///   - `sourceOffset` is the image position for seekable sources and the stored bytes
+///     consumed (source.consumedBytes) for streams
+pub fn readSourceIntoRing(ring: *BufferRing, source: ImageSource, startOffset: u64, isSparse: bool) void {
+    std.debug.assert(startOffset == 0 or source.isSeekable());
+
+    const imageSize = source.size();
+    var offset: u64 = startOffset;
+
+    while (imageSize == null or offset < imageSize.?) {
+        const slot = ring.acquireFree() orelse return;
+        var toRead: usize = slot.data.len;
+        if (imageSize) |size| toRead = @intCast(@min(@as(u64, toRead), size - offset));
+
+        if (isSparse) {
+            if (source.extentAt(offset)) |extent| switch (extent.kind) {
+                .ZERO => {
+                    const len = if (imageSize) |size| @min(extent.len, size - offset) else extent.len;
+                    slot.* = .{ .data = slot.data, .len = len, .offset = offset, .kind = .ZERO, .sourceOffset = offset + len };
+                    ring.commit();
+                    offset += len;
+                    continue;
+                },
+                .DATA => toRead = @intCast(@min(@as(u64, toRead), extent.len)),
+            };
+        }
+
+        const readResult = if (source.isSeekable()) source.pread(slot.data[0..toRead], offset) else source.read(slot.data[0..toRead]);
+        const bytesRead = readResult catch |err| {
+            Debug.log(.ERROR, "Pipeline reader failed to read image at byte {d}. Error: {any}", .{ offset, err });
+            ring.finish(err);
+            return;
+        };
+
+        if (bytesRead == 0) {
+            Debug.log(.INFO, "End of image reached at byte: {d}", .{offset});
+            break;
+        }
+
+        slot.len = bytesRead;
+        slot.offset = offset;
+        slot.kind = if (isSparse and simd.isAllZero(slot.data[0..bytesRead])) .ZERO else .DATA;
+        slot.sourceOffset = if (source.isSeekable()) offset + bytesRead else source.consumedBytes();
+        ring.commit();
+
+        offset += bytesRead;
+
+        // Sources only return short at the end of the image
+        if (bytesRead < toRead) break;
+    }
+
+    if (!source.isSeekable()) Debug.log(.INFO, "Read {d} image bytes from {d} stored bytes.", .{ offset, source.consumedBytes() });
+    ring.finish(null);
+}
+
+/// Block map reader thread entry point: reads only the mapped `ranges` of a seekable
+/// `source`, in ascending offset order, and publishes them as DATA slots. Unmapped bytes
+/// are never read. `sourceOffset` reports mapped bytes read so far.
+pub fn readMappedRangesIntoRing(ring: *BufferRing, source: ImageSource, ranges: []const bmap.Range) void {
+    std.debug.assert(source.isSeekable());
+    var mappedBytesRead: u64 = 0;
+
+    for (ranges) |range| {
+        var offset = range.offset;
+
+        while (offset < range.end()) {
+            const slot = ring.acquireFree() orelse return;
+            const toRead: usize = @intCast(@min(@as(u64, slot.data.len), range.end() - offset));
+
+            const bytesRead = source.pread(slot.data[0..toRead], offset) catch |err| {
+                Debug.log(.ERROR, "Pipeline reader failed to read mapped range at byte {d}. Error: {any}", .{ offset, err });
+                ring.finish(err);
+                return;
+            };
+
+            // The block map promises these bytes; a short image cannot satisfy it
+            if (bytesRead < toRead) {
+                Debug.log(.ERROR, "Image ends at byte {d}, inside a mapped range ending at {d}.", .{ offset + bytesRead, range.end() });
+                ring.finish(error.UnexpectedEndOfImage);
+                return;
+            }
+
+            mappedBytesRead += bytesRead;
+            slot.* = .{ .data = slot.data, .len = bytesRead, .offset = offset, .kind = .DATA, .sourceOffset = mappedBytesRead };
+            ring.commit();
+
+            offset += bytesRead;
+        }
+    }
+
+    ring.finish(null);
+}
+
+// ============================================================================
+// TESTS
+// ============================================================================
+
+fn initTestPool(bufferCount: usize) !BufferPool {
+    return BufferPool.init(std.testing.allocator, .{ .bufferSize = BUFFER_ALIGNMENT, .bufferCount = bufferCount });
+}
+
+test "BufferRing hands over every slot in order and reports completion" {
+    var pool = try initTestPool(2);
+    defer pool.deinit(std.testing.allocator);
+
+    var ring = try BufferRing.init(std.testing.allocator, &pool, 2, BUFFER_ALIGNMENT);
+    defer ring.deinit();
+
+    for (0..2) |i| {
+        const slot = ring.acquireFree().?;
+        slot.len = @as(u64, i + 1);
+        slot.offset = i * BUFFER_ALIGNMENT;
+        ring.commit();
+    }
+    ring.finish(null);
+
+    for (0..2) |i| {
+        const slot = ring.acquireFilled().?;
+        try std.testing.expectEqual(@as(u64, i + 1), slot.len);
+        try std.testing.expectEqual(@as(u64, i * BUFFER_ALIGNMENT), slot.offset);
+        ring.release();
+    }
+
+    try std.testing.expect(ring.acquireFilled() == null);
+    try std.testing.expect(ring.getProducerError() == null);
+}
+
+test "BufferRing cancellation unblocks the producer" {
+    var pool = try initTestPool(1);
+    defer pool.deinit(std.testing.allocator);
+
+    var ring = try BufferRing.init(std.testing.allocator, &pool, 1, BUFFER_ALIGNMENT);
+    defer ring.deinit();
+
+    _ = ring.acquireFree().?;
+    ring.commit();
+
+    const thread = try std.Thread.spawn(.{}, struct {
+        fn run(r: *BufferRing) void {
+            // Ring is full; this blocks until cancel() wakes it up.
+            std.debug.assert(r.acquireFree() == null);
+        }
+    }.run, .{&ring});
+
+    ring.cancel();
+    thread.join();
+
+    try std.testing.expect(ring.acquireFilled() == null);
+}
+
+test "BufferRing with several consumers bounds the lead of the fastest one" {
+    var pool = try initTestPool(2);
+    defer pool.deinit(std.testing.allocator);
+
+    var ring = try BufferRing.initShared(std.testing.allocator, &pool, 2, BUFFER_ALIGNMENT, 2);
+    defer ring.deinit();
+
+    for (0..2) |i| {
+        const slot = ring.acquireFree().?;
+        slot.len = @as(u64, i + 1);
+        ring.commit();
+    }
+
+    // Consumer 0 drains both slots; consumer 1 has not started, so the ring is still full
+    for (0..2) |_| {
+        _ = ring.acquireFilledFor(0).?;
+        ring.releaseFor(0);
+    }
+    try std.testing.expectEqual(@as(?u64, 2), ring.pendingForSlowest());
+
+    // Detaching the slow consumer frees the window for the producer
+    ring.detach(1);
+    try std.testing.expect(ring.acquireFree() != null);
+
+    ring.detach(0);
+    try std.testing.expect(ring.acquireFree() == null);
+}
+
+test "readSourceIntoRing streams a file through the ring" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const payloadSize = BUFFER_ALIGNMENT * 3 + 123;
+    var payload: [payloadSize]u8 = undefined;
+    for (&payload, 0..) |*byte, i| byte.* = @truncate(i *% 31);
+
+    const file = try tmp.dir.createFile("image.img", .{ .read = true });
+    defer file.close();
+    try file.writeAll(&payload);
+
+    var pool = try initTestPool(2);
+    defer pool.deinit(std.testing.allocator);
+
+    var ring = try BufferRing.init(std.testing.allocator, &pool, 2, BUFFER_ALIGNMENT);
+    defer ring.deinit();
+
+    var fileSource = imagesource.FileSource.initSized(file, payloadSize);
+    const reader = try std.Thread.spawn(.{}, readSourceIntoRing, .{ &ring, fileSource.imageSource(), @as(u64, 0), false });
+
+    var received: usize = 0;
+    while (ring.acquireFilled()) |slot| {
+        try std.testing.expectEqual(@as(u64, received), slot.offset);
+        try std.testing.expectEqualSlices(u8, payload[received .. received + slot.bytes().len], slot.bytes());
+        received += slot.bytes().len;
+        ring.release();
+    }
+
+    reader.join();
+
+    try std.testing.expectEqual(payloadSize, received);
+    try std.testing.expect(ring.getProducerError() == null);
+}
+
+test "readSourceIntoRing publishes zero ranges as ZERO slots in sparse mode" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    // data | zeros | zeros | data, one ring buffer per block
+    var payload = [_]u8{0} ** (BUFFER_ALIGNMENT * 4);
+    @memset(payload[0..BUFFER_ALIGNMENT], 0xAB);
+    @memset(payload[BUFFER_ALIGNMENT * 3 ..], 0xCD);
+
+    const file = try tmp.dir.createFile("sparse.img", .{ .read = true });
+    defer file.close();
+    try file.writeAll(&payload);
+
+    var pool = try initTestPool(2);
+    defer pool.deinit(std.testing.allocator);
+
+    var ring = try BufferRing.init(std.testing.allocator, &pool, 2, BUFFER_ALIGNMENT);
+    defer ring.deinit();
+
+    var fileSource = imagesource.FileSource.initSized(file, payload.len);
+    const reader = try std.Thread.spawn(.{}, readSourceIntoRing, .{ &ring, fileSource.imageSource(), @as(u64, 0), true });
+
+    var covered: u64 = 0;
+    var zeroBytes: u64 = 0;
+    while (ring.acquireFilled()) |slot| {
+        try std.testing.expectEqual(covered, slot.offset);
+        switch (slot.kind) {
+            .DATA => try std.testing.expect(!simd.isAllZero(slot.bytes())),
+            .ZERO => zeroBytes += slot.len,
+        }
+        covered += slot.len;
+        ring.release();
+    }
+
+    reader.join();
+
+    try std.testing.expectEqual(@as(u64, payload.len), covered);
+    try std.testing.expectEqual(@as(u64, BUFFER_ALIGNMENT * 2), zeroBytes);
+    try std.testing.expect(ring.getProducerError() == null);
+}
+
+test "BufferRing refuses a pool without enough free buffers" {
+    var pool = try initTestPool(1);
+    defer pool.deinit(std.testing.allocator);
+
+    try std.testing.expectError(error.BufferPoolExhausted, BufferRing.init(std.testing.allocator, &pool, 2, BUFFER_ALIGNMENT));
+    try std.testing.expectEqual(@as(usize, 1), pool.freeCount);
+}
+
+test "readMappedRangesIntoRing reads only the mapped ranges" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    var payload: [BUFFER_ALIGNMENT * 4]u8 = undefined;
+    for (&payload, 0..) |*byte, i| byte.* = @truncate(i *% 31 + 1);
+
+    const file = try tmp.dir.createFile("image.img", .{ .read = true });
+    defer file.close();
+    try file.writeAll(&payload);
+
+    var pool = try initTestPool(2);
+    defer pool.deinit(std.testing.allocator);
+
+    var ring = try BufferRing.init(std.testing.allocator, &pool, 2, BUFFER_ALIGNMENT);
+    defer ring.deinit();
+
+    // The second range spans two slots
+    const ranges = [_]bmap.Range{
+        .{ .offset = 100, .len = 50, .digest = undefined },
+        .{ .offset = BUFFER_ALIGNMENT * 2, .len = BUFFER_ALIGNMENT + 10, .digest = undefined },
+    };
+
+    var fileSource = try imagesource.FileSource.init(file);
+    const reader = try std.Thread.spawn(.{}, readMappedRangesIntoRing, .{ &ring, fileSource.imageSource(), @as([]const bmap.Range, &ranges) });
+
+    var received: usize = 0;
+    while (ring.acquireFilled()) |slot| {
+        const offset: usize = @intCast(slot.offset);
+        try std.testing.expectEqualSlices(u8, payload[offset..][0..slot.bytes().len], slot.bytes());
+        received += slot.bytes().len;
+        ring.release();
+    }
+
+    reader.join();
+    try std.testing.expect(ring.getProducerError() == null);
+    try std.testing.expectEqual(@as(usize, 50 + BUFFER_ALIGNMENT + 10), received);
+}
+
+test "readSourceIntoRing gathers scattered virtual disk clusters and publishes holes as ZERO slots" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const A = BUFFER_ALIGNMENT;
+    var payload: [A * 4]u8 = undefined;
+    for (&payload, 0..) |*byte, i| byte.* = @truncate(i *% 31 + 1);
+
+    const file = try tmp.dir.createFile("disk.img", .{ .read = true });
+    defer file.close();
+    try file.writeAll(&payload);
+
+    var pool = try initTestPool(2);
+    defer pool.deinit(std.testing.allocator);
+
+    var ring = try BufferRing.init(std.testing.allocator, &pool, 2, A);
+    defer ring.deinit();
+
+    // Stored out of order, with a hole in the middle
+    var extents = [_]vdisk.Extent{
+        .{ .outputOffset = 0, .len = A / 2, .fileOffset = 3 * A },
+        .{ .outputOffset = A / 2, .len = A, .fileOffset = 0 },
+        .{ .outputOffset = 3 * A / 2, .len = A, .fileOffset = null },
+        .{ .outputOffset = 5 * A / 2, .len = A / 2, .fileOffset = A },
+    };
+
+    var expected = [_]u8{0} ** (3 * A);
+    for (extents) |extent| {
+        const fileOffset: usize = @intCast(extent.fileOffset orelse continue);
+        @memcpy(expected[@intCast(extent.outputOffset)..][0..@intCast(extent.len)], payload[fileOffset..][0..@intCast(extent.len)]);
+    }
+
+    const map = vdisk.ExtentMap{ .allocator = std.testing.allocator, .format = .QCOW2, .virtualSize = 3 * A, .extents = &extents };
+    var disk = imagesource.VirtualDiskSource{ .file = file, .map = &map };
+    const reader = try std.Thread.spawn(.{}, readSourceIntoRing, .{ &ring, disk.imageSource(), @as(u64, 0), true });
+
+    const kinds = [_]SlotKind{ .DATA, .DATA, .ZERO, .DATA };
+    var slotCount: usize = 0;
+    var cursor: u64 = 0;
+    while (ring.acquireFilled()) |slot| {
+        try std.testing.expectEqual(kinds[slotCount], slot.kind);
+        try std.testing.expectEqual(cursor, slot.offset);
+        if (slot.kind == .DATA) try std.testing.expectEqualSlices(u8, expected[@intCast(slot.offset)..][0..slot.bytes().len], slot.bytes());
+
+        cursor += slot.len;
+        slotCount += 1;
+        ring.release();
+    }
+
+    reader.join();
+    try std.testing.expect(ring.getProducerError() == null);
+    try std.testing.expectEqual(kinds.len, slotCount);
+    try std.testing.expectEqual(@as(u64, 3 * A), cursor);
+}
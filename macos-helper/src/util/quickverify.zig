@@ -0,0 +1,369 @@
+//! Quick Verification Plans
+//!
+//! Chooses which image ranges a quick (sampled) verification reads back instead of the
+//! whole image:
+//! - The first and last EDGE_BYTES, which hold the MBR, the primary and backup GPT and
+//!   the ISO 9660 system area and volume descriptors of hybrid images
+//! - GPT headers and partition entry arrays wherever the headers place them
+//! - The El Torito boot catalog and every bootable image it lists
+//! - `sampleCount` SAMPLE_BLOCK_SIZE blocks picked by a PRNG seeded with `seed`
+//!
+//! Plans are reproducible: the same image, seed and sample count always yield the same
+//! ranges, so a failed or suspicious quick verification can be replayed from the seed
+//! in the logs. The ranges are sorted, disjoint and widened to the device block size
+//! (raw devices reject unaligned reads); coverage() reports how much of the image they span.
+//!
+//! Layout discovery is best effort: structures that cannot be read or do not parse are
+//! left out, and the edges and samples still apply.
+const std = @import("std");
+const freetracer_lib = @import("freetracer-lib");
+const Debug = freetracer_lib.Debug;
+const ImageSource = freetracer_lib.imagesource.ImageSource;
+
+/// Bytes always verified at the start and the end of the image.
+pub const EDGE_BYTES: u64 = 1024 * 1024;
+
+/// Size and alignment of one random sample.
+pub const SAMPLE_BLOCK_SIZE: u64 = 64 * 1024;
+
+/// Samples drawn when the request does not name a count (64 MiB of reads).
+pub const DEFAULT_SAMPLE_COUNT: u64 = 1024;
+
+/// Upper bound on requested samples; past this a full verification is the better tool.
+pub const MAX_SAMPLE_COUNT: u64 = 1024 * 1024;
+
+const ISO_SECTOR_SIZE: u64 = 2048;
+const ISO_FIRST_VOLUME_DESCRIPTOR: u64 = 16;
+const ISO_MAX_VOLUME_DESCRIPTORS: u64 = 32;
+/// El Torito counts boot image sizes in 512-byte virtual sectors
+const EL_TORITO_VIRTUAL_SECTOR_SIZE: u64 = 512;
+
+/// Caps for sizes read from the image, so a corrupt header cannot request gigabytes.
+const MAX_GPT_ENTRIES_BYTES: u64 = 1024 * 1024;
+const MAX_BOOT_IMAGE_BYTES: u64 = 64 * 1024 * 1024;
+
+/// Parameters of a quick verification request.
+pub const Options = struct {
+    seed: u64,
+    sampleCount: u64 = DEFAULT_SAMPLE_COUNT,
+};
+
+pub const Range = struct {
+    offset: u64,
+    len: u64,
+
+    pub fn end(self: Range) u64 {
+        return self.offset + self.len;
+    }
+};
+
+/// How much of an image a plan verifies, for logs and the verification reply.
+pub const Coverage = struct {
+    coveredBytes: u64,
+    imageSize: u64,
+    seed: u64,
+    sampleCount: u64,
+
+    /// Covered share of the image in hundredths of a percent (10000 = everything).
+    pub fn basisPoints(self: Coverage) u64 {
+        if (self.imageSize == 0) return 10_000;
+        return @intCast(@as(u128, self.coveredBytes) * 10_000 / self.imageSize);
+    }
+};
+
+pub const Plan = struct {
+    /// Sorted, disjoint ranges within [0, imageSize)
+    ranges: std.ArrayList(Range) = .empty,
+    imageSize: u64,
+    /// Power of two every range starts on and, unless it ends the image, ends on
+    alignment: u64,
+    seed: u64,
+    sampleCount: u64,
+
+    /// Builds the plan for an image of `imageSize` bytes readable through `image`.
+    ///
+    /// `Arguments`:
+    ///   image: Source of the expanded image; its layout is probed with pread(), so
+    ///     non-seekable sources only contribute the edges and the samples
+    ///   alignment: Device logical block size (a power of two up to SAMPLE_BLOCK_SIZE)
+    ///   seed: PRNG seed of the samples
+    ///   sampleCount: Random blocks to draw, capped at MAX_SAMPLE_COUNT. Blocks drawn
+    ///     twice or inside a fixed region only count once toward the coverage.
+    pub fn build(allocator: std.mem.Allocator, image: ImageSource, imageSize: u64, alignment: u64, seed: u64, sampleCount: u64) !Plan {
+        std.debug.assert(std.math.isPowerOfTwo(alignment));
+        var plan = Plan{ .imageSize = imageSize, .alignment = alignment, .seed = seed, .sampleCount = @min(sampleCount, MAX_SAMPLE_COUNT) };
+        errdefer plan.deinit(allocator);
+
+        try plan.add(allocator, 0, EDGE_BYTES);
+        if (imageSize > EDGE_BYTES) try plan.add(allocator, imageSize - EDGE_BYTES, EDGE_BYTES);
+
+        if (image.isSeekable()) {
+            try plan.addGptRegions(allocator, image);
+            try plan.addElToritoRegions(allocator, image);
+        }
+
+        try plan.addSamples(allocator);
+        plan.coalesce();
+
+        return plan;
+    }
+
+    pub fn deinit(self: *Plan, allocator: std.mem.Allocator) void {
+        self.ranges.deinit(allocator);
+    }
+
+    pub fn coverage(self: *const Plan) Coverage {
+        var coveredBytes: u64 = 0;
+        for (self.ranges.items) |range| coveredBytes += range.len;
+        return .{ .coveredBytes = coveredBytes, .imageSize = self.imageSize, .seed = self.seed, .sampleCount = self.sampleCount };
+    }
+
+    /// Adds [offset, offset + len) widened to `alignment` and clipped to the image.
+    fn add(self: *Plan, allocator: std.mem.Allocator, offset: u64, len: u64) !void {
+        if (offset >= self.imageSize or len == 0) return;
+
+        const start = std.mem.alignBackward(u64, offset, self.alignment);
+        const end = @min(std.mem.alignForward(u64, offset + @min(len, self.imageSize - offset), self.alignment), self.imageSize);
+        try self.ranges.append(allocator, .{ .offset = start, .len = end - start });
+    }
+
+    fn addSamples(self: *Plan, allocator: std.mem.Allocator) !void {
+        const blockCount = std.math.divCeil(u64, self.imageSize, SAMPLE_BLOCK_SIZE) catch unreachable;
+        if (blockCount == 0) return;
+
+        // Spelled out rather than DefaultPrng so the sequence for a seed stays put
+        var prng = std.Random.Xoshiro256.init(self.seed);
+        const random = prng.random();
+
+        try self.ranges.ensureUnusedCapacity(allocator, @intCast(self.sampleCount));
+        for (0..@intCast(self.sampleCount)) |_| {
+            const block = random.uintLessThan(u64, blockCount);
+            try self.add(allocator, block * SAMPLE_BLOCK_SIZE, SAMPLE_BLOCK_SIZE);
+        }
+    }
+
+    /// Adds the protective MBR plus both GPT headers and entry arrays. GPT images use
+    /// 512-byte logical blocks almost always; 4096 is tried when no header sits at 512.
+    fn addGptRegions(self: *Plan, allocator: std.mem.Allocator, image: ImageSource) !void {
+        try self.add(allocator, 0, 512);
+
+        for ([_]u64{ 512, 4096 }) |lbaSize| {
+            var header: [92]u8 = undefined;
+            if (!readExact(image, &header, lbaSize)) continue;
+            if (!std.mem.eql(u8, header[0..8], "EFI PART")) continue;
+
+            const backupLba = std.mem.readInt(u64, header[32..40], .little);
+            const entriesLba = std.mem.readInt(u64, header[72..80], .little);
+            const entryCount = std.mem.readInt(u32, header[80..84], .little);
+            const entrySize = std.mem.readInt(u32, header[84..88], .little);
+            const entriesLen = @min(@as(u64, entryCount) * entrySize, MAX_GPT_ENTRIES_BYTES);
+
+            try self.add(allocator, lbaSize, lbaSize);
+            if (std.math.mul(u64, entriesLba, lbaSize)) |offset| try self.add(allocator, offset, entriesLen) else |_| {}
+
+            // The backup entry array sits right before the backup header
+            const backupOffset = std.math.mul(u64, backupLba, lbaSize) catch return;
+            try self.add(allocator, backupOffset, lbaSize);
+            try self.add(allocator, backupOffset -| entriesLen, @min(entriesLen, backupOffset));
+
+            Debug.log(.DEBUG, "Quick verify: GPT with {d}-byte blocks, entries at LBA {d}, backup header at LBA {d}.", .{ lbaSize, entriesLba, backupLba });
+            return;
+        }
+    }
+
+    /// Adds the El Torito boot catalog and the boot images of its bootable entries.
+    fn addElToritoRegions(self: *Plan, allocator: std.mem.Allocator, image: ImageSource) !void {
+        var sector: [ISO_SECTOR_SIZE]u8 = undefined;
+        var catalogLba: ?u32 = null;
+
+        for (0..ISO_MAX_VOLUME_DESCRIPTORS) |index| {
+            if (!readExact(image, &sector, (ISO_FIRST_VOLUME_DESCRIPTOR + index) * ISO_SECTOR_SIZE)) return;
+            if (!std.mem.eql(u8, sector[1..6], "CD001")) return;
+            // Volume Descriptor Set Terminator
+            if (sector[0] == 0xFF) break;
+            if (sector[0] == 0x00 and std.mem.startsWith(u8, sector[7..39], "EL TORITO SPECIFICATION")) {
+                catalogLba = std.mem.readInt(u32, sector[71..75], .little);
+            }
+        }
+
+        const catalogOffset = @as(u64, catalogLba orelse return) * ISO_SECTOR_SIZE;
+        if (!readExact(image, &sector, catalogOffset)) return;
+        try self.add(allocator, catalogOffset, ISO_SECTOR_SIZE);
+
+        // Validation entry: header 0x01 and the 0x55AA key
+        if (sector[0] != 0x01 or sector[30] != 0x55 or sector[31] != 0xAA) return;
+
+        try self.addBootImage(allocator, image, sector[32..64]);
+
+        // Section headers (0x90, or 0x91 for the last one), each followed by its entries
+        var position: usize = 64;
+        while (position + 32 <= sector.len) {
+            const headerId = sector[position];
+            if (headerId != 0x90 and headerId != 0x91) break;
+
+            var remaining = std.mem.readInt(u16, sector[position + 2 ..][0..2], .little);
+            position += 32;
+
+            while (remaining > 0 and position + 32 <= sector.len) : (position += 32) {
+                // Extension entries (0x44) continue the previous entry and are not counted
+                if (sector[position] == 0x44) continue;
+                try self.addBootImage(allocator, image, sector[position..][0..32]);
+                remaining -= 1;
+            }
+
+            if (headerId == 0x91) break;
+        }
+    }
+
+    /// Adds the boot image of a bootable (0x88) initial or section entry.
+    fn addBootImage(self: *Plan, allocator: std.mem.Allocator, image: ImageSource, entry: *const [32]u8) !void {
+        if (entry[0] != 0x88) return;
+
+        const sectorCount = std.mem.readInt(u16, entry[6..8], .little);
+        const offset = @as(u64, std.mem.readInt(u32, entry[8..12], .little)) * ISO_SECTOR_SIZE;
+
+        // Mastering tools record 0 or 1 sectors for EFI images that do not fit the field;
+        // the FAT file system inside then tells the real size
+        const len = if (sectorCount > 1) @as(u64, sectorCount) * EL_TORITO_VIRTUAL_SECTOR_SIZE else fatVolumeSize(image, offset) orelse ISO_SECTOR_SIZE;
+
+        Debug.log(.DEBUG, "Quick verify: El Torito boot image at byte {d}, {d} bytes.", .{ offset, len });
+        try self.add(allocator, offset, @min(len, MAX_BOOT_IMAGE_BYTES));
+    }
+
+    /// Sorts the ranges and merges overlapping or touching ones.
+    fn coalesce(self: *Plan) void {
+        const items = self.ranges.items;
+        if (items.len == 0) return;
+
+        std.mem.sort(Range, items, {}, struct {
+            fn lessThan(_: void, a: Range, b: Range) bool {
+                return a.offset < b.offset;
+            }
+        }.lessThan);
+
+        var last: usize = 0;
+        for (items[1..]) |range| {
+            if (range.offset <= items[last].end()) {
+                items[last].len = @max(items[last].end(), range.end()) - items[last].offset;
+            } else {
+                last += 1;
+                items[last] = range;
+            }
+        }
+        self.ranges.shrinkRetainingCapacity(last + 1);
+    }
+};
+
+/// Size of the FAT volume whose boot sector is at `offset`, or null if there is none.
+fn fatVolumeSize(image: ImageSource, offset: u64) ?u64 {
+    var bootSector: [512]u8 = undefined;
+    if (!readExact(image, &bootSector, offset)) return null;
+    if (bootSector[510] != 0x55 or bootSector[511] != 0xAA) return null;
+
+    const bytesPerSector = std.mem.readInt(u16, bootSector[11..13], .little);
+    if (bytesPerSector < 512 or !std.math.isPowerOfTwo(bytesPerSector)) return null;
+
+    const shortCount = std.mem.readInt(u16, bootSector[19..21], .little);
+    const sectorCount: u64 = if (shortCount != 0) shortCount else std.mem.readInt(u32, bootSector[32..36], .little);
+    if (sectorCount == 0) return null;
+
+    return sectorCount * bytesPerSector;
+}
+
+fn readExact(image: ImageSource, buffer: []u8, offset: u64) bool {
+    const bytesRead = image.pread(buffer, offset) catch return false;
+    return bytesRead == buffer.len;
+}
+
+// ============================================================================
+// TESTS
+// ============================================================================
+
+const FileSource = freetracer_lib.imagesource.FileSource;
+
+test "Quick verify plans are reproducible from the seed and cover the edges" {
+    const allocator = std.testing.allocator;
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const imageSize = 64 * 1024 * 1024;
+    const file = try tmp.dir.createFile("image.bin", .{ .read = true });
+    defer file.close();
+    try file.setEndPos(imageSize);
+
+    var source = try FileSource.init(file);
+
+    var first = try Plan.build(allocator, source.imageSource(), imageSize, 512, 42, 64);
+    defer first.deinit(allocator);
+    var again = try Plan.build(allocator, source.imageSource(), imageSize, 512, 42, 64);
+    defer again.deinit(allocator);
+    var other = try Plan.build(allocator, source.imageSource(), imageSize, 512, 43, 64);
+    defer other.deinit(allocator);
+
+    try std.testing.expectEqualSlices(Range, first.ranges.items, again.ranges.items);
+    try std.testing.expect(!std.mem.eql(u8, std.mem.sliceAsBytes(first.ranges.items), std.mem.sliceAsBytes(other.ranges.items)));
+
+    const ranges = first.ranges.items;
+    try std.testing.expectEqual(@as(u64, 0), ranges[0].offset);
+    try std.testing.expect(ranges[0].len >= EDGE_BYTES);
+    try std.testing.expectEqual(@as(u64, imageSize), ranges[ranges.len - 1].end());
+    for (ranges[1..], ranges[0 .. ranges.len - 1]) |range, previous| try std.testing.expect(range.offset > previous.end());
+
+    const coverage = first.coverage();
+    try std.testing.expect(coverage.coveredBytes <= 2 * EDGE_BYTES + 64 * SAMPLE_BLOCK_SIZE);
+    try std.testing.expect(coverage.basisPoints() > 0 and coverage.basisPoints() < 10_000);
+}
+
+test "Quick verify plans include the El Torito boot image and GPT entries" {
+    const allocator = std.testing.allocator;
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const imageSize = 256 * 1024 * 1024;
+    const file = try tmp.dir.createFile("hybrid.iso", .{ .read = true });
+    defer file.close();
+    try file.setEndPos(imageSize);
+
+    // GPT header at LBA 1 with its entry array far from the start
+    var gptHeader = [_]u8{0} ** 92;
+    @memcpy(gptHeader[0..8], "EFI PART");
+    std.mem.writeInt(u64, gptHeader[32..40], imageSize / 512 - 1, .little);
+    std.mem.writeInt(u64, gptHeader[72..80], 300_000, .little);
+    std.mem.writeInt(u32, gptHeader[80..84], 128, .little);
+    std.mem.writeInt(u32, gptHeader[84..88], 128, .little);
+    try file.pwriteAll(&gptHeader, 512);
+
+    // Boot record volume descriptor, then the terminator
+    var sector = [_]u8{0} ** ISO_SECTOR_SIZE;
+    @memcpy(sector[1..6], "CD001");
+    @memcpy(sector[7..30], "EL TORITO SPECIFICATION");
+    std.mem.writeInt(u32, sector[71..75], 50_000, .little);
+    try file.pwriteAll(&sector, 16 * ISO_SECTOR_SIZE);
+    @memset(&sector, 0);
+    sector[0] = 0xFF;
+    @memcpy(sector[1..6], "CD001");
+    try file.pwriteAll(&sector, 17 * ISO_SECTOR_SIZE);
+
+    // Boot catalog: validation entry and a bootable initial entry of 8 virtual sectors
+    @memset(&sector, 0);
+    sector[0] = 0x01;
+    sector[30] = 0x55;
+    sector[31] = 0xAA;
+    sector[32] = 0x88;
+    std.mem.writeInt(u16, sector[38..40], 8, .little);
+    std.mem.writeInt(u32, sector[40..44], 60_000, .little);
+    try file.pwriteAll(&sector, 50_000 * ISO_SECTOR_SIZE);
+
+    var source = try FileSource.init(file);
+    var plan = try Plan.build(allocator, source.imageSource(), imageSize, 512, 7, 0);
+    defer plan.deinit(allocator);
+
+    const expected = [_]Range{
+        .{ .offset = 0, .len = EDGE_BYTES },
+        .{ .offset = 50_000 * ISO_SECTOR_SIZE, .len = ISO_SECTOR_SIZE },
+        .{ .offset = 60_000 * ISO_SECTOR_SIZE, .len = 8 * 512 },
+        .{ .offset = 300_000 * 512, .len = 128 * 128 },
+        .{ .offset = imageSize - EDGE_BYTES, .len = EDGE_BYTES },
+    };
+    try std.testing.expectEqualSlices(Range, &expected, plan.ranges.items);
+}
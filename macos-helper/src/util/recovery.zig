@@ -0,0 +1,226 @@
+//! Write Error Recovery
+//!
+//! Keeps a single failing sector from aborting a whole write job. When a chunk write
+//! fails with EIO, the chunk is retried once, then bisected down to the device block
+//! size so that only the blocks that really fail are isolated. Each isolated block gets
+//! a few delayed retries (marginal cards often accept a rewrite) before it is recorded
+//! in the job's BadBlockReport.
+//!
+//! Policy:
+//! - ABORT: the job fails on the first block that stays unwritable, after isolating it
+//!   (the report names the failing LBA range instead of a whole chunk)
+//! - SKIP: failing blocks are left unwritten and recorded; the job continues. Verification
+//!   will then report the same ranges as mismatches.
+//!
+//! Only error.InputOutput is treated as a media error; every other error (device gone,
+//! no space, permission) propagates unchanged.
+const std = @import("std");
+const freetracer_lib = @import("freetracer-lib");
+const Debug = freetracer_lib.Debug;
+
+/// Retries of an isolated block before it is recorded as bad.
+pub const DEFAULT_RETRY_COUNT: u32 = 2;
+/// Delay before the first retry of an isolated block; later retries back off linearly.
+pub const DEFAULT_RETRY_DELAY_NS: u64 = 10 * std.time.ns_per_ms;
+/// Distinct bad ranges a report can hold. Adjacent blocks merge into one range; a card
+/// with more separate failures than this is not worth finishing.
+pub const MAX_BAD_RANGES = 64;
+
+pub const Policy = enum(u8) {
+    ABORT = 0,
+    SKIP = 1,
+};
+
+pub const Range = struct {
+    offset: u64,
+    len: u64,
+};
+
+/// Device ranges that could not be written, in ascending offset order.
+pub const BadBlockReport = struct {
+    ranges: [MAX_BAD_RANGES]Range = undefined,
+    count: usize = 0,
+    totalBytes: u64 = 0,
+
+    pub fn slice(self: *const BadBlockReport) []const Range {
+        return self.ranges[0..self.count];
+    }
+
+    /// Records [offset, offset + len), merging it into the previous range when adjacent.
+    ///
+    /// `Errors`:
+    ///   error.TooManyBadBlocks: MAX_BAD_RANGES distinct ranges are already recorded
+    fn add(self: *BadBlockReport, offset: u64, len: u64) !void {
+        self.totalBytes += len;
+
+        if (self.count > 0) {
+            const last = &self.ranges[self.count - 1];
+            if (last.offset + last.len == offset) {
+                last.len += len;
+                return;
+            }
+        }
+
+        if (self.count == MAX_BAD_RANGES) return error.TooManyBadBlocks;
+        self.ranges[self.count] = .{ .offset = offset, .len = len };
+        self.count += 1;
+    }
+
+    /// Logs every range with its LBAs in `blockSize` units.
+    pub fn log(self: *const BadBlockReport, blockSize: u64) void {
+        if (self.count == 0) return;
+
+        Debug.log(.WARNING, "Bad-block report: {d} bytes in {d} ranges could not be written.", .{ self.totalBytes, self.count });
+        for (self.slice()) |range| {
+            Debug.log(.WARNING, "  bytes [{d}, {d}), LBA {d}-{d}", .{ range.offset, range.offset + range.len, range.offset / blockSize, (range.offset + range.len - 1) / blockSize });
+        }
+    }
+};
+
+/// Positional writer that isolates failing blocks instead of failing whole chunks.
+/// `target` is anything with `pwriteAll([]const u8, u64) !void`, such as std.fs.File.
+pub const Recovery = struct {
+    blockSize: u64,
+    policy: Policy,
+    retries: u32 = DEFAULT_RETRY_COUNT,
+    retryDelayNs: u64 = DEFAULT_RETRY_DELAY_NS,
+    report: BadBlockReport = .{},
+
+    pub fn init(blockSize: u64, policy: Policy) Recovery {
+        return .{ .blockSize = @max(blockSize, 1), .policy = policy };
+    }
+
+    /// Writes `bytes` at `offset`. On EIO the chunk is retried, then bisected.
+    ///
+    /// `Errors`:
+    ///   error.BadBlock: a block stayed unwritable under the ABORT policy
+    ///   error.TooManyBadBlocks: the report is full under the SKIP policy
+    ///   Any non-EIO error from `target`
+    pub fn pwriteAll(self: *Recovery, target: anytype, bytes: []const u8, offset: u64) !void {
+        if (tryWrite(target, bytes, offset)) |_| return else |err| try ignoreMediaError(err);
+
+        Debug.log(.WARNING, "Write of {d} bytes at byte {d} failed with an I/O error; retrying.", .{ bytes.len, offset });
+        if (tryWrite(target, bytes, offset)) |_| return else |err| try ignoreMediaError(err);
+
+        try self.bisect(target, bytes, offset);
+    }
+
+    /// Splits a failing range at a block boundary and writes each half, recursing into
+    /// halves that fail until single blocks remain. The error set is explicit because
+    /// recursive functions cannot infer one.
+    fn bisect(self: *Recovery, target: anytype, bytes: []const u8, offset: u64) anyerror!void {
+        if (bytes.len <= self.blockSize) return self.writeBlock(target, bytes, offset);
+
+        const blockSize: usize = @intCast(self.blockSize);
+        const alignedHalf = std.mem.alignBackward(usize, bytes.len / 2, blockSize);
+        const half = if (alignedHalf == 0) blockSize else alignedHalf;
+
+        for ([_][]const u8{ bytes[0..half], bytes[half..] }, [_]u64{ offset, offset + half }) |part, partOffset| {
+            if (tryWrite(target, part, partOffset)) |_| {} else |err| {
+                try ignoreMediaError(err);
+                try self.bisect(target, part, partOffset);
+            }
+        }
+    }
+
+    /// Retries a single failing block with a growing delay, then records it.
+    fn writeBlock(self: *Recovery, target: anytype, bytes: []const u8, offset: u64) !void {
+        var attempt: u32 = 1;
+        while (attempt <= self.retries) : (attempt += 1) {
+            if (self.retryDelayNs > 0) std.Thread.sleep(self.retryDelayNs * attempt);
+            if (tryWrite(target, bytes, offset)) |_| return else |err| try ignoreMediaError(err);
+        }
+
+        Debug.log(.ERROR, "LBA {d} (byte {d}, {d} bytes) failed after {d} retries.", .{ offset / self.blockSize, offset, bytes.len, self.retries });
+        try self.report.add(offset, bytes.len);
+
+        if (self.policy == .ABORT) return error.BadBlock;
+    }
+};
+
+fn tryWrite(target: anytype, bytes: []const u8, offset: u64) !void {
+    return target.pwriteAll(bytes, offset);
+}
+
+/// Returns normally for media errors (worth retrying) and propagates everything else.
+fn ignoreMediaError(err: anyerror) !void {
+    if (err != error.InputOutput) return err;
+}
+
+// ============================================================================
+// TESTS
+// ============================================================================
+
+/// File-backed target failing writes that touch [badOffset, badOffset + badLen), after
+/// failing every write `transientFailures` times first.
+const FaultyTarget = struct {
+    file: std.fs.File,
+    badOffset: u64 = 0,
+    badLen: u64 = 0,
+    transientFailures: u32 = 0,
+    writeCount: usize = 0,
+
+    pub fn pwriteAll(self: *FaultyTarget, bytes: []const u8, offset: u64) !void {
+        self.writeCount += 1;
+
+        if (self.transientFailures > 0) {
+            self.transientFailures -= 1;
+            return error.InputOutput;
+        }
+        if (offset < self.badOffset + self.badLen and self.badOffset < offset + bytes.len) return error.InputOutput;
+
+        try self.file.pwriteAll(bytes, offset);
+    }
+};
+
+test "Recovery isolates a bad block and skips it" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const file = try tmp.dir.createFile("target.img", .{ .read = true });
+    defer file.close();
+
+    const blockSize = 512;
+    var payload: [blockSize * 16]u8 = undefined;
+    for (&payload, 0..) |*byte, i| byte.* = @truncate(i *% 13 + 1);
+
+    var target = FaultyTarget{ .file = file, .badOffset = blockSize * 5 + 100, .badLen = blockSize };
+    var recovery = Recovery.init(blockSize, .SKIP);
+    recovery.retryDelayNs = 0;
+
+    try recovery.pwriteAll(&target, &payload, 0);
+
+    // The failing range straddles blocks 5 and 6; both are recorded as one range
+    try std.testing.expectEqual(@as(usize, 1), recovery.report.count);
+    try std.testing.expectEqual(Range{ .offset = blockSize * 5, .len = blockSize * 2 }, recovery.report.slice()[0]);
+
+    // Everything else reached the target
+    var written: [payload.len]u8 = undefined;
+    _ = try file.preadAll(&written, 0);
+    try std.testing.expectEqualSlices(u8, payload[0 .. blockSize * 5], written[0 .. blockSize * 5]);
+    try std.testing.expectEqualSlices(u8, payload[blockSize * 7 ..], written[blockSize * 7 ..]);
+}
+
+test "Recovery rides out transient errors and aborts on a persistent one" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const file = try tmp.dir.createFile("target.img", .{ .read = true });
+    defer file.close();
+
+    const blockSize = 512;
+    const payload = [_]u8{0x5A} ** (blockSize * 4);
+
+    var flaky = FaultyTarget{ .file = file, .transientFailures = 1 };
+    var recovery = Recovery.init(blockSize, .ABORT);
+    recovery.retryDelayNs = 0;
+
+    // One failure is absorbed by the whole-chunk retry
+    try recovery.pwriteAll(&flaky, &payload, 0);
+    try std.testing.expectEqual(@as(usize, 2), flaky.writeCount);
+    try std.testing.expectEqual(@as(usize, 0), recovery.report.count);
+
+    var broken = FaultyTarget{ .file = file, .badOffset = blockSize * 3, .badLen = 1 };
+    try std.testing.expectError(error.BadBlock, recovery.pwriteAll(&broken, &payload, 0));
+    try std.testing.expectEqual(@as(u64, blockSize * 3), recovery.report.slice()[0].offset);
+}
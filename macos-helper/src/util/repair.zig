@@ -0,0 +1,170 @@
+//! Verification Repair
+//!
+//! Turns a failed verification into a short rewrite instead of a re-flash. Verifiers
+//! keep comparing after a mismatch and collect the differing device ranges in a
+//! MismatchMap; the repair step (filesystem.repairMismatches) rewrites only those
+//! ranges from the image and compares them again.
+//!
+//! The map is bounded, like the bad-block report of a write (recovery.zig):
+//! - Runs closer than MERGE_GAP_BYTES merge into one range, so a scattered pattern of
+//!   flipped bits costs one rewrite instead of many
+//! - Past MAX_MISMATCH_RANGES ranges or MAX_REPAIR_BYTES bytes the device is failing
+//!   broadly; the map is marked truncated, verification stops and the job fails
+//! - A verifier that cannot carry on after a mismatch truncates the map as well, since
+//!   the unchecked rest of the device would never be verified again
+const std = @import("std");
+const freetracer_lib = @import("freetracer-lib");
+const Debug = freetracer_lib.Debug;
+
+/// Distinct mismatching ranges a map can hold.
+pub const MAX_MISMATCH_RANGES = 64;
+/// Runs separated by fewer matching bytes than this are repaired as one range.
+pub const MERGE_GAP_BYTES: u64 = 64 * 1024;
+/// Mismatching bytes worth repairing; past this, re-flashing is the honest answer.
+pub const MAX_REPAIR_BYTES: u64 = 256 * 1024 * 1024;
+
+/// Where verification found the device to differ from the image, for the failure response.
+/// Byte-exact for image comparisons; digest and block map verification can only name the
+/// chunk or range whose checksum failed.
+pub const Mismatch = struct {
+    /// Device byte offset of the first differing byte
+    offset: u64,
+    /// Bytes from `offset` to the last differing byte of the run (or merged runs)
+    len: u64,
+    /// Device logical block size that lba() and blockCount() refer to
+    blockSize: u64,
+
+    pub fn end(self: Mismatch) u64 {
+        return self.offset + self.len;
+    }
+
+    /// Logical block holding the first differing byte.
+    pub fn lba(self: Mismatch) u64 {
+        return self.offset / self.blockSize;
+    }
+
+    /// Logical blocks touched by the differing run.
+    pub fn blockCount(self: Mismatch) u64 {
+        const endBlock = std.math.divCeil(u64, self.offset + @max(self.len, 1), self.blockSize) catch unreachable;
+        return endBlock - self.lba();
+    }
+
+    /// The whole blocks a repair rewrites; the end may still be cut short by the image end.
+    pub fn blockRange(self: Mismatch) Mismatch {
+        const start = self.lba() * self.blockSize;
+        return .{ .offset = start, .len = self.blockCount() * self.blockSize, .blockSize = self.blockSize };
+    }
+};
+
+/// Mismatching device ranges of one verification pass, in ascending offset order.
+pub const MismatchMap = struct {
+    ranges: [MAX_MISMATCH_RANGES]Mismatch = undefined,
+    count: usize = 0,
+    totalBytes: u64 = 0,
+    /// Set once the map stopped listing every mismatch (a bound was hit, or the
+    /// verifier gave up early); such a map cannot be repaired
+    isTruncated: bool = false,
+
+    pub fn slice(self: *const MismatchMap) []const Mismatch {
+        return self.ranges[0..self.count];
+    }
+
+    pub fn isEmpty(self: *const MismatchMap) bool {
+        return self.count == 0;
+    }
+
+    /// First mismatch found, for the failure response.
+    pub fn first(self: *const MismatchMap) ?Mismatch {
+        return if (self.count > 0) self.ranges[0] else null;
+    }
+
+    /// True when rewriting the listed ranges can fix the device.
+    pub fn isRepairable(self: *const MismatchMap) bool {
+        return self.count > 0 and !self.isTruncated;
+    }
+
+    pub fn clear(self: *MismatchMap) void {
+        self.* = .{};
+    }
+
+    /// Marks the map as incomplete, so the job fails instead of being repaired.
+    pub fn truncate(self: *MismatchMap) void {
+        self.isTruncated = true;
+    }
+
+    /// Records a differing run found after every run recorded so far.
+    /// Returns false once the map is truncated; the verifier should then stop.
+    pub fn record(self: *MismatchMap, found: Mismatch) bool {
+        if (self.isTruncated) return false;
+
+        if (self.count > 0) {
+            const last = &self.ranges[self.count - 1];
+            if (found.offset <= last.end() + MERGE_GAP_BYTES) {
+                const mergedEnd = @max(last.end(), found.end());
+                self.totalBytes += mergedEnd - last.end();
+                last.len = mergedEnd - last.offset;
+                return self.checkBudget();
+            }
+        }
+
+        if (self.count == MAX_MISMATCH_RANGES) {
+            self.truncate();
+            return false;
+        }
+
+        self.ranges[self.count] = found;
+        self.count += 1;
+        self.totalBytes += found.len;
+        return self.checkBudget();
+    }
+
+    /// Logs every range with its LBAs.
+    pub fn log(self: *const MismatchMap) void {
+        if (self.count == 0) return;
+
+        Debug.log(.ERROR, "Mismatch map: {d} bytes in {d} ranges differ from the image{s}.", .{ self.totalBytes, self.count, if (self.isTruncated) " (truncated)" else "" });
+        for (self.slice()) |range| {
+            Debug.log(.ERROR, "  bytes [{d}, {d}), LBA {d}, {d} blocks", .{ range.offset, range.end(), range.lba(), range.blockCount() });
+        }
+    }
+
+    fn checkBudget(self: *MismatchMap) bool {
+        if (self.totalBytes <= MAX_REPAIR_BYTES) return true;
+        self.truncate();
+        return false;
+    }
+};
+
+// ============================================================================
+// TESTS
+// ============================================================================
+
+test "MismatchMap merges nearby runs and truncates past its bounds" {
+    var map = MismatchMap{};
+
+    try std.testing.expect(map.record(.{ .offset = 1000, .len = 10, .blockSize = 512 }));
+    // Within MERGE_GAP_BYTES of the first run
+    try std.testing.expect(map.record(.{ .offset = 1000 + MERGE_GAP_BYTES, .len = 6, .blockSize = 512 }));
+    try std.testing.expect(map.record(.{ .offset = 10 * MERGE_GAP_BYTES, .len = 1, .blockSize = 512 }));
+
+    try std.testing.expectEqual(@as(usize, 2), map.count);
+    try std.testing.expectEqual(@as(u64, MERGE_GAP_BYTES + 6), map.slice()[0].len);
+    try std.testing.expectEqual(@as(u64, MERGE_GAP_BYTES + 7), map.totalBytes);
+    try std.testing.expect(map.isRepairable());
+
+    // Repairs cover whole blocks
+    const blocks = map.slice()[0].blockRange();
+    try std.testing.expectEqual(@as(u64, 512), blocks.offset);
+    try std.testing.expectEqual(@as(u64, 0), blocks.end() % 512);
+    try std.testing.expect(blocks.end() >= map.slice()[0].end());
+
+    var offset: u64 = 100 * MERGE_GAP_BYTES;
+    while (map.record(.{ .offset = offset, .len = 1, .blockSize = 512 })) offset += 2 * MERGE_GAP_BYTES;
+    try std.testing.expectEqual(@as(usize, MAX_MISMATCH_RANGES), map.count);
+    try std.testing.expect(!map.isRepairable());
+
+    map.clear();
+    try std.testing.expect(!map.record(.{ .offset = 0, .len = MAX_REPAIR_BYTES + 1, .blockSize = 512 }));
+    try std.testing.expectEqual(@as(u64, 0), map.first().?.offset);
+    try std.testing.expect(!map.isRepairable());
+}
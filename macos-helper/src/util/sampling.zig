@@ -0,0 +1,178 @@
+//! Progress Sampler
+//!
+//! Moves progress reporting off the I/O thread. Writers publish their byte counters
+//! with single relaxed atomic stores; a sampler thread wakes at a fixed cadence
+//! (SAMPLE_INTERVAL_NS, 10 Hz), derives rates in integer arithmetic and sends the
+//! update. The I/O loop never reads a clock, divides, or talks to XPC.
+//!
+//! Rates (bytes per second):
+//! - instant: bytes moved during the last interval
+//! - smoothed: exponentially weighted moving average of the instant rate
+//! - average: bytes moved since sampling started, excluding a resumed prefix
+//!
+//! Counters only ever grow, except `totalBytes`, which estimated jobs refine.
+const std = @import("std");
+
+/// Time between two samples.
+pub const SAMPLE_INTERVAL_NS: u64 = 100 * std.time.ns_per_ms;
+
+/// Weight of the newest instant rate in the smoothed rate, as EWMA_WEIGHT / EWMA_SCALE.
+const EWMA_WEIGHT = 1;
+const EWMA_SCALE = 4;
+
+/// Values shared between the I/O thread (writer) and the sampler thread (reader).
+pub const Counters = struct {
+    bytes: std.atomic.Value(u64) = .init(0),
+    bytesSkipped: std.atomic.Value(u64) = .init(0),
+    /// Prefix known to have reached the device (see writeback.zig)
+    durableBytes: std.atomic.Value(u64) = .init(0),
+    /// Bytes recorded as unwritable by bad-block recovery
+    badBytes: std.atomic.Value(u64) = .init(0),
+    totalBytes: std.atomic.Value(u64) = .init(0),
+    chunkSize: std.atomic.Value(u64) = .init(0),
+    queueDepth: std.atomic.Value(u64) = .init(0),
+};
+
+pub const Rates = struct {
+    instant: u64 = 0,
+    smoothed: u64 = 0,
+    average: u64 = 0,
+};
+
+/// Turns successive byte counts into rates. Owned by the sampler thread.
+pub const RateTracker = struct {
+    startBytes: u64,
+    startNs: u64,
+    lastBytes: u64,
+    lastNs: u64,
+    smoothed: ?u64 = null,
+
+    pub fn init(startBytes: u64, nowNs: u64) RateTracker {
+        return .{ .startBytes = startBytes, .startNs = nowNs, .lastBytes = startBytes, .lastNs = nowNs };
+    }
+
+    /// Records that `bytes` had been reached at `nowNs` and returns the updated rates.
+    pub fn update(self: *RateTracker, bytes: u64, nowNs: u64) Rates {
+        const instant = bytesPerSecond(bytes -| self.lastBytes, nowNs -| self.lastNs);
+
+        const smoothed: u64 = if (self.smoothed) |previous|
+            @intCast((@as(u128, previous) * (EWMA_SCALE - EWMA_WEIGHT) + @as(u128, instant) * EWMA_WEIGHT) / EWMA_SCALE)
+        else
+            instant;
+
+        self.smoothed = smoothed;
+        self.lastBytes = bytes;
+        self.lastNs = nowNs;
+
+        return .{
+            .instant = instant,
+            .smoothed = smoothed,
+            .average = bytesPerSecond(bytes -| self.startBytes, nowNs -| self.startNs),
+        };
+    }
+};
+
+fn bytesPerSecond(bytes: u64, elapsedNs: u64) u64 {
+    if (elapsedNs == 0) return 0;
+    return @intCast(@min(@as(u128, bytes) * std.time.ns_per_s / elapsedNs, std.math.maxInt(u64)));
+}
+
+/// Whole percent of `bytes` in `totalBytes`, capped at 100 (container metadata can under-report).
+pub fn percentOf(bytes: u64, totalBytes: u64) u64 {
+    return @intCast(@min(@as(u128, bytes) * 100 / @max(totalBytes, 1), 100));
+}
+
+/// Background thread calling a sample function at SAMPLE_INTERVAL_NS until stopped.
+pub const Sampler = struct {
+    thread: ?std.Thread = null,
+    mutex: std.Thread.Mutex = .{},
+    wake: std.Thread.Condition = .{},
+    isStopping: bool = false,
+
+    /// Spawns the thread; it calls `sampleFn(context)` once per interval.
+    /// `context` must outlive the sampler (until stop() returns).
+    pub fn start(self: *Sampler, context: anytype, comptime sampleFn: fn (@TypeOf(context)) void) !void {
+        const Loop = struct {
+            fn run(sampler: *Sampler, ctx: @TypeOf(context)) void {
+                while (sampler.waitInterval()) sampleFn(ctx);
+            }
+        };
+
+        self.isStopping = false;
+        self.thread = try std.Thread.spawn(.{}, Loop.run, .{ self, context });
+    }
+
+    /// Wakes and joins the thread. No-op if the sampler was never started.
+    pub fn stop(self: *Sampler) void {
+        const thread = self.thread orelse return;
+
+        {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+
+            self.isStopping = true;
+            self.wake.signal();
+        }
+
+        thread.join();
+        self.thread = null;
+    }
+
+    /// Sleeps one interval. Returns false once stop() was requested.
+    fn waitInterval(self: *Sampler) bool {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        if (self.isStopping) return false;
+        self.wake.timedWait(&self.mutex, SAMPLE_INTERVAL_NS) catch {};
+        return !self.isStopping;
+    }
+};
+
+// ============================================================================
+// TESTS
+// ============================================================================
+
+test "RateTracker reports instant, smoothed and average rates" {
+    const MiB = 1024 * 1024;
+    var tracker = RateTracker.init(10 * MiB, 0);
+
+    // 10 MiB in the first 100 ms
+    var rates = tracker.update(20 * MiB, 100 * std.time.ns_per_ms);
+    try std.testing.expectEqual(@as(u64, 100 * MiB), rates.instant);
+    try std.testing.expectEqual(@as(u64, 100 * MiB), rates.smoothed);
+
+    // Stalled for the next 100 ms: the smoothed rate decays instead of dropping to zero
+    rates = tracker.update(20 * MiB, 200 * std.time.ns_per_ms);
+    try std.testing.expectEqual(@as(u64, 0), rates.instant);
+    try std.testing.expectEqual(@as(u64, 75 * MiB), rates.smoothed);
+
+    // The resumed prefix (start bytes) does not count towards the average
+    try std.testing.expectEqual(@as(u64, 50 * MiB), rates.average);
+}
+
+test "Sampler calls the sample function until stopped" {
+    var sampleCount = std.atomic.Value(usize).init(0);
+
+    var sampler = Sampler{};
+    try sampler.start(&sampleCount, struct {
+        fn sample(count: *std.atomic.Value(usize)) void {
+            _ = count.fetchAdd(1, .monotonic);
+        }
+    }.sample);
+
+    std.Thread.sleep(3 * SAMPLE_INTERVAL_NS + SAMPLE_INTERVAL_NS / 2);
+    sampler.stop();
+
+    const samples = sampleCount.load(.monotonic);
+    try std.testing.expect(samples >= 1 and samples <= 4);
+
+    // Stopping twice is harmless
+    sampler.stop();
+}
+
+test "percentOf caps at 100" {
+    try std.testing.expectEqual(@as(u64, 50), percentOf(5, 10));
+    try std.testing.expectEqual(@as(u64, 100), percentOf(12, 10));
+    try std.testing.expectEqual(@as(u64, 0), percentOf(0, 0));
+}
@@ -158,6 +158,7 @@ fn queryAndSaveImageDetails(self: *DataFlasher) !void {
     self.state.data.imagePath = imageInfo.imagePath;
     self.state.data.image = imageInfo.image;
     self.state.data.config.userForcedFlag = imageInfo.userForcedUnknownImage;
+    self.state.data.config.useBlockMapFlag = imageInfo.image.hasBlockMap;
 }
 
 fn queryAndSaveSelectedDevice(self: *DataFlasher) !void {
@@ -326,6 +327,20 @@ pub fn toggleConfigFlagVerifyBytes(ctx: *anyopaque) void {
     self.state.data.config.verifyBytesFlag = !self.state.data.config.verifyBytesFlag;
 }
 
+pub fn toggleConfigFlagQuickVerify(ctx: *anyopaque) void {
+    var self: *DataFlasher = @ptrCast(@alignCast(ctx));
+    self.state.lock();
+    defer self.state.unlock();
+    self.state.data.config.quickVerifyFlag = !self.state.data.config.quickVerifyFlag;
+}
+
+pub fn toggleConfigFlagResume(ctx: *anyopaque) void {
+    var self: *DataFlasher = @ptrCast(@alignCast(ctx));
+    self.state.lock();
+    defer self.state.unlock();
+    self.state.data.config.resumeFlag = !self.state.data.config.resumeFlag;
+}
+
 pub fn toggleConfigFlagEjectDevice(ctx: *anyopaque) void {
     var self: *DataFlasher = @ptrCast(@alignCast(ctx));
     self.state.lock();
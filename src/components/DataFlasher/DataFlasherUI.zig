@@ -387,6 +387,16 @@ pub fn setIsActive(self: *DataFlasherUI, isActive: bool) void {
         .enabled = true,
     } }, .{ .excludeSelf = true });
 
+    self.layout.emitEvent(.{ .EnabledChanged = .{
+        .target = .DataFlasherQuickVerifyCheckbox,
+        .enabled = true,
+    } }, .{ .excludeSelf = true });
+
+    self.layout.emitEvent(.{ .EnabledChanged = .{
+        .target = .DataFlasherResumeCheckbox,
+        .enabled = true,
+    } }, .{ .excludeSelf = true });
+
     self.layout.emitEvent(.{ .EnabledChanged = .{
         .target = .DataFlasherEjectDeviceCheckbox,
         .enabled = true,
@@ -406,7 +416,9 @@ pub fn handleOnISOWriteProgressChanged(self: *DataFlasherUI, event: ComponentEve
     var eventResult = EventResult.init();
     const data = PrivilegedHelper.Events.onISOWriteProgressChanged.getData(event) orelse return eventResult.fail();
 
-    const rateMb: f64 = @as(f64, @floatFromInt(data.rate)) / 1_000_000.0;
+    // The smoothed rate does not jump between samples; older helpers only send the instant one
+    const rate = if (data.rate_ewma > 0) data.rate_ewma else data.rate;
+    const rateMb: f64 = @as(f64, @floatFromInt(rate)) / 1_000_000.0;
     const rateAvgMb: f64 = @as(f64, @floatFromInt(data.rate_avg)) / 1_000_000.0;
     Debug.log(.INFO, "Write progress is: {d}, speed: {d:.2} MB/s, speed (avg): {d:.2} MB/s", .{ data.newProgress, rateMb, rateAvgMb });
 
@@ -514,7 +526,10 @@ pub fn handleOnWriteVerificationProgressChanged(self: *DataFlasherUI, event: Com
     var eventResult = EventResult.init();
     const data = PrivilegedHelper.Events.onWriteVerificationProgressChanged.getData(event) orelse return eventResult.fail();
 
-    Debug.log(.INFO, "Verification progress is: {d}", .{data.newProgress});
+    const rate = if (data.rate_ewma > 0) data.rate_ewma else data.rate;
+    const rateMb: f64 = @as(f64, @floatFromInt(rate)) / 1_000_000.0;
+    const rateAvgMb: f64 = @as(f64, @floatFromInt(data.rate_avg)) / 1_000_000.0;
+    Debug.log(.INFO, "Verification progress is: {d}, speed: {d:.2} MB/s, speed (avg): {d:.2} MB/s", .{ data.newProgress, rateMb, rateAvgMb });
 
     var buf: [5]u8 = std.mem.zeroes([5]u8);
     const newText: [:0]const u8 = @ptrCast(try std.fmt.bufPrint(buf[0..], "{d}%", .{data.newProgress}));
@@ -717,6 +732,16 @@ fn setStatusBoxUIToFailedState(self: *DataFlasherUI) void {
         .target = .DataFlasherVerifyBytesCheckbox,
         .enabled = true,
     } }, params);
+
+    self.layout.emitEvent(.{ .EnabledChanged = .{
+        .target = .DataFlasherQuickVerifyCheckbox,
+        .enabled = true,
+    } }, params);
+
+    self.layout.emitEvent(.{ .EnabledChanged = .{
+        .target = .DataFlasherResumeCheckbox,
+        .enabled = true,
+    } }, params);
 }
 
 fn initLayout(self: *DataFlasherUI) !void {
@@ -943,11 +968,35 @@ fn initLayout(self: *DataFlasherUI) !void {
             } })
             .active(false),
 
+        ui.texturedCheckbox(.{ .text = "Quick verify (sampled)", .checked = false })
+            .id("checkbox_quick_verify")
+            .elId(.DataFlasherQuickVerifyCheckbox)
+            .position(.percent(0, 1.3))
+            .positionRef(.{ .NodeId = "checkbox_verify" })
+            .size(.pixels(14, 14))
+            .callbacks(.{ .onClick = .{
+                .function = DataFlasher.toggleConfigFlagQuickVerify,
+                .context = self.parent,
+            } })
+            .active(false),
+
+        ui.texturedCheckbox(.{ .text = "Resumable write (same device only)", .checked = false })
+            .id("checkbox_resume")
+            .elId(.DataFlasherResumeCheckbox)
+            .position(.percent(0, 1.3))
+            .positionRef(.{ .NodeId = "checkbox_quick_verify" })
+            .size(.pixels(14, 14))
+            .callbacks(.{ .onClick = .{
+                .function = DataFlasher.toggleConfigFlagResume,
+                .context = self.parent,
+            } })
+            .active(false),
+
         ui.texturedCheckbox(.{ .text = "Eject device on completion", .checked = true })
             .id("checkbox_eject")
             .elId(.DataFlasherEjectDeviceCheckbox)
             .position(.percent(0, 1.3))
-            .positionRef(.{ .NodeId = "checkbox_verify" })
+            .positionRef(.{ .NodeId = "checkbox_resume" })
             .size(.pixels(14, 14))
             .callbacks(.{ .onClick = .{
                 .function = DataFlasher.toggleConfigFlagEjectDevice,
@@ -1157,6 +1206,22 @@ pub const UIConfig = struct {
                     params,
                 );
 
+                component.layout.emitEvent(
+                    .{ .EnabledChanged = .{
+                        .target = .DataFlasherQuickVerifyCheckbox,
+                        .enabled = false,
+                    } },
+                    params,
+                );
+
+                component.layout.emitEvent(
+                    .{ .EnabledChanged = .{
+                        .target = .DataFlasherResumeCheckbox,
+                        .enabled = false,
+                    } },
+                    params,
+                );
+
                 const eventResult = EventManager.signal(
                     EventManager.ComponentName.DATA_FLASHER,
                     DataFlasher.Events.onWriteImageRequested.create(null, null),
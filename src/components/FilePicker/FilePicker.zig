@@ -2,6 +2,8 @@
 // worker thread that invokes the platform file dialog. Owns the selected image
 // memory and propagates state to other components via the ComponentFramework
 // event bus while ensuring allocator ownership and worker lifecycle safety.
+// Once an image is selected, a background thread hashes it (checking any SHA256SUMS
+// style sidecar next to it) and the result is shown before the user moves on.
 // ------------------------------------------------------------------------------
 const std = @import("std");
 const Dialog = @import("../../modules/dialog.zig");
@@ -13,6 +15,8 @@ const ImageType = freetracer_lib.types.ImageType;
 const Image = freetracer_lib.types.Image;
 
 const fs = freetracer_lib.fs;
+const bmap = freetracer_lib.bmap;
+const imagehash = freetracer_lib.imagehash;
 
 const AppConfig = @import("../../config.zig");
 const MAX_EXT_LEN = AppConfig.MAX_EXT_LEN;
@@ -34,6 +38,30 @@ pub const FilePickerState = struct {
     userForcedUnknownImage: bool = false,
 };
 
+/// Progress and outcome of the background hash of the selected image.
+pub const ChecksumStatus = union(enum) {
+    NONE,
+    /// Percent of the image hashed so far
+    HASHING: u8,
+    DONE: imagehash.Result,
+    FAILED: anyerror,
+};
+
+/// Background hash of the selected image. The hashing thread only touches this struct,
+/// never the component state, so the owner may cancel and join it while holding the state
+/// lock. On the owner's side every access happens under the state lock: jobs are started
+/// and stopped by the selection path (possibly on the dialog worker thread) and polled by
+/// update() on the main thread.
+const ImageHashJob = struct {
+    thread: ?std.Thread = null,
+    control: imagehash.Control = .{},
+    mutex: std.Thread.Mutex = .{},
+    /// Set by the thread once it finished; guarded by `mutex`
+    outcome: ?ChecksumStatus = null,
+    /// Last percentage shown in the UI, so progress is only redrawn when it changes
+    reportedPercent: u8 = 0,
+};
+
 pub const ImageQueryObject = struct {
     imagePath: [:0]u8 = undefined,
     image: Image = undefined,
@@ -60,6 +88,7 @@ component: ?Component = null,
 // Component-specific, unique props
 allocator: std.mem.Allocator,
 uiComponent: ?FilePickerUI = null,
+hashJob: ImageHashJob = .{},
 
 pub const Events = struct {
 
@@ -162,6 +191,7 @@ pub fn start(self: *FilePicker) !void {
 
 pub fn update(self: *FilePicker) !void {
     self.checkAndJoinWorker();
+    self.checkImageHash();
 }
 
 pub fn draw(self: *FilePicker) !void {
@@ -193,6 +223,7 @@ pub fn handleEvent(self: *FilePicker, event: ComponentEvent) !EventResult {
 pub fn deinit(self: *FilePicker) void {
     self.state.lock();
     defer self.state.unlock();
+    self.stopImageHash();
     if (self.state.data.selectedPath) |path| self.allocator.free(path);
     self.state.data.selectedPath = null;
     self.state.data.image = .{};
@@ -298,7 +329,8 @@ fn processImageValidationResult(imageValidationResult: fs.ImageFileValidationRes
 
 fn processSelectedPathLocked(self: *FilePicker, newPath: [:0]u8) !void {
     Debug.log(.DEBUG, "processSelectedPathLocked: attempting to validate the selected image file: {s}", .{newPath});
-    const imageType = fs.getImageType(fs.getExtensionFromPath(newPath));
+    self.stopImageHash();
+    const imageType = fs.getImageType(newPath);
 
     Debug.log(.DEBUG, "processSelectedPathLocked: detected image type", .{});
     self.state.data.image.path = newPath;
@@ -343,6 +375,12 @@ fn processSelectedPathLocked(self: *FilePicker, newPath: [:0]u8) !void {
         self.state.data.userForcedUnknownImage = true;
     } else self.state.data.userForcedUnknownImage = false;
 
+    // The helper locates and validates the block map itself; this only records that one exists
+    var bmapPathBuffer: [std.fs.max_path_bytes]u8 = undefined;
+    const bmapPath = bmap.findSiblingPath(&bmapPathBuffer, newPath);
+    self.state.data.image.hasBlockMap = bmapPath != null;
+    if (bmapPath) |path| Debug.log(.INFO, "FilePicker found a block map for the selected image: {s}", .{path});
+
     Debug.log(.INFO, "FilePicker selected file: {s}, size: {d:.0}", .{ newPath, stat.size });
 
     if (self.uiComponent) |*ui| {
@@ -355,9 +393,130 @@ fn processSelectedPathLocked(self: *FilePicker, newPath: [:0]u8) !void {
         _ = try ui.handleEvent(pathChangedEvent);
     }
 
+    self.startImageHash(newPath);
+
     Debug.log(.DEBUG, "processSelectedPathLocked: completed successfully", .{});
 }
 
+/// Starts hashing `path` in the background; the outcome is picked up by checkImageHash().
+/// Failing to start only costs the checksum, never the selection.
+fn startImageHash(self: *FilePicker, path: [:0]const u8) void {
+    self.stopImageHash();
+
+    const ownedPath = self.allocator.dupe(u8, path) catch |err| {
+        Debug.log(.ERROR, "FilePicker: unable to start hashing the selected image. Error: {any}", .{err});
+        return;
+    };
+
+    self.hashJob = .{};
+    self.hashJob.thread = std.Thread.spawn(.{}, hashImageWorker, .{ &self.hashJob, self.allocator, ownedPath }) catch |err| {
+        Debug.log(.ERROR, "FilePicker: unable to spawn the image hashing thread. Error: {any}", .{err});
+        self.allocator.free(ownedPath);
+        return;
+    };
+
+    self.notifyChecksumChanged(.{ .HASHING = 0 });
+}
+
+/// Cancels and joins a running hash; its outcome is discarded.
+fn stopImageHash(self: *FilePicker) void {
+    const thread = self.hashJob.thread orelse return;
+    self.hashJob.control.cancel();
+    thread.join();
+    self.hashJob = .{};
+}
+
+/// Polled from update(): reports hashing progress and, once the thread is done, its outcome.
+/// Skips the frame while the selection path holds the state lock.
+fn checkImageHash(self: *FilePicker) void {
+    if (!self.state.tryLock()) return;
+
+    const finished = blk: {
+        defer self.state.unlock();
+
+        const thread = self.hashJob.thread orelse return;
+
+        const outcome = outcome: {
+            self.hashJob.mutex.lock();
+            defer self.hashJob.mutex.unlock();
+            break :outcome self.hashJob.outcome;
+        };
+
+        const status = outcome orelse {
+            const percent = self.hashJob.control.percent();
+            if (percent == self.hashJob.reportedPercent) return;
+            self.hashJob.reportedPercent = percent;
+            self.notifyChecksumChanged(.{ .HASHING = percent });
+            return;
+        };
+
+        thread.join();
+        self.hashJob = .{};
+        self.notifyChecksumChanged(status);
+        break :blk status;
+    };
+
+    // Outside the lock, so a mismatch dialog does not hold up the next selection
+    reportImageHash(finished);
+}
+
+fn reportImageHash(status: ChecksumStatus) void {
+    switch (status) {
+        .DONE => |result| {
+            const hex = result.digest.hex();
+            Debug.log(.INFO, "FilePicker: selected image {s} digest: {s} ({s}).", .{ result.digest.algorithm.label(), hex, @tagName(result.verdict) });
+
+            if (result.verdict == .MISMATCH) {
+                const expected = std.fmt.bytesToHex(result.sidecar.?.expected, .lower);
+                Debug.log(.WARNING, "FilePicker: {s} expects {s}.", .{ result.sidecar.?.name, expected });
+                _ = Dialog.message(
+                    "The SHA-256 checksum of the selected image does not match the one listed in {s}. The download may be corrupted or tampered with; flashing it is not recommended.",
+                    .{result.sidecar.?.name},
+                    .OK,
+                    .WARNING,
+                );
+            }
+        },
+        .FAILED => |err| Debug.log(.WARNING, "FilePicker: unable to hash the selected image. Error: {any}", .{err}),
+        .NONE, .HASHING => {},
+    }
+}
+
+fn notifyChecksumChanged(self: *FilePicker, status: ChecksumStatus) void {
+    if (self.uiComponent) |*ui| {
+        const event = FilePickerUI.Events.onImageChecksumChanged.create(self.asComponentPtr(), &.{ .status = status });
+        _ = ui.handleEvent(event) catch |err| {
+            Debug.log(.ERROR, "FilePicker: unable to show the image checksum. Error: {any}", .{err});
+        };
+    }
+}
+
+/// Hashing thread entry point; owns and frees `path`.
+fn hashImageWorker(job: *ImageHashJob, allocator: std.mem.Allocator, path: []u8) void {
+    defer allocator.free(path);
+
+    const outcome: ChecksumStatus = if (hashImageAt(allocator, path, &job.control)) |result|
+        .{ .DONE = result }
+    else |err|
+        .{ .FAILED = err };
+
+    job.mutex.lock();
+    defer job.mutex.unlock();
+    job.outcome = outcome;
+}
+
+fn hashImageAt(allocator: std.mem.Allocator, path: []const u8, control: *imagehash.Control) !imagehash.Result {
+    const file = try fs.openFileValidated(path, .{
+        .userHomePath = std.posix.getenv("HOME") orelse return error.UnableToGetUserPath,
+    });
+    defer file.close();
+
+    var directory = try std.fs.openDirAbsolute(std.fs.path.dirname(path) orelse "/", .{});
+    defer directory.close();
+
+    return imagehash.hashImage(allocator, file, directory, std.fs.path.basename(path), control);
+}
+
 pub fn acceptDroppedFile(self: *FilePicker, path: []const u8) !void {
     if (path.len == 0) return;
 
@@ -71,6 +71,12 @@ pub const Events = struct {
         struct {},
     );
 
+    pub const onImageChecksumChanged = ComponentFramework.defineEvent(
+        EventManager.createEventName(ComponentName, "on_image_checksum_changed"),
+        struct { status: FilePicker.ChecksumStatus },
+        struct {},
+    );
+
     pub const onActiveStateChanged = ComponentFramework.defineEvent(
         EventManager.createEventName(ComponentName, "on_active_state_changed"),
         struct { isActive: bool },
@@ -116,6 +122,7 @@ pub fn handleEvent(self: *FilePickerUI, event: ComponentEvent) !EventResult {
 
     return switch (event.hash) {
         Events.onImageFilePathChanged.Hash => try self.handleImageFilePathChanged(event),
+        Events.onImageChecksumChanged.Hash => try self.handleImageChecksumChanged(event),
         Events.onRootViewTransformQueried.Hash => try self.handleOnRootViewTransformQueried(event),
         FilePicker.Events.onActiveStateChanged.Hash => try self.handleActiveStateChanged(event),
         AppManager.Events.AppResetEvent.Hash => self.handleAppResetRequest(),
@@ -325,6 +332,45 @@ fn handleImageFilePathChanged(self: *FilePickerUI, event: ComponentEvent) !Event
     return eventResult.succeed();
 }
 
+/// Shows hashing progress, then the checksum verdict (or the fingerprint when the image
+/// came without a checksum file) under the image size.
+fn handleImageChecksumChanged(self: *FilePickerUI, event: ComponentEvent) !EventResult {
+    var eventResult = EventResult.init();
+    const data = Events.onImageChecksumChanged.getData(event) orelse return eventResult.fail();
+
+    var textBuf: [96:0]u8 = undefined;
+    var color = Color.offWhite;
+
+    const text: [:0]const u8 = switch (data.status) {
+        .NONE => "",
+        .HASHING => |percent| try std.fmt.bufPrintZ(&textBuf, "Hashing image... {d}%", .{percent}),
+        .FAILED => "Checksum unavailable",
+        .DONE => |result| blk: {
+            const hex = result.digest.hex();
+            switch (result.verdict) {
+                .MATCH => {
+                    color = Color.themePrimary;
+                    break :blk try std.fmt.bufPrintZ(&textBuf, "SHA-256 matches {s}", .{result.sidecar.?.name});
+                },
+                .MISMATCH => {
+                    color = Color.themeFailure;
+                    break :blk try std.fmt.bufPrintZ(&textBuf, "SHA-256 DOES NOT match {s}!", .{result.sidecar.?.name});
+                },
+                .UNVERIFIED => break :blk try std.fmt.bufPrintZ(&textBuf, "{s} {s}... (no checksum file)", .{ result.digest.algorithm.label(), hex[0..16] }),
+            }
+        },
+    };
+
+    self.layout.emitEvent(.{ .TextChanged = .{
+        .target = .FilePickerImageChecksumText,
+        .text = text,
+        .style = .{ .textColor = if (data.status == .HASHING) rl.Color.gray else color },
+        .pulsate = .{ .enabled = data.status == .HASHING },
+    } }, .{ .excludeSelf = true });
+
+    return eventResult.succeed();
+}
+
 pub fn handleAppResetRequest(self: *FilePickerUI) EventResult {
     var eventResult = EventResult.init();
 
@@ -364,6 +410,15 @@ pub fn handleAppResetRequest(self: *FilePickerUI) EventResult {
         .{ .excludeSelf = true },
     );
 
+    self.layout.emitEvent(
+        .{ .TextChanged = .{
+            .target = .FilePickerImageChecksumText,
+            .text = "",
+            .pulsate = .{},
+        } },
+        .{ .excludeSelf = true },
+    );
+
     self.layout.emitEvent(
         .{ .SpriteButtonEnabledChanged = .{
             .target = .FilePickerConfirmButton,
@@ -491,6 +546,18 @@ fn initLayout(self: *FilePickerUI) !void {
             .positionRef(.{ .NodeId = "image_info_textbox" })
             .sizeRef(.{ .NodeId = "image_info_bg" }),
 
+        ui.text("", .{
+            .identifier = .FilePickerImageChecksumText,
+            .style = .{
+                .textColor = rl.Color.gray,
+            },
+        })
+            .id("image_info_checksum_text")
+            .position(.percent(0, 1))
+            .offset(0, 4)
+            .positionRef(.{ .NodeId = "image_info_size_text" })
+            .sizeRef(.{ .NodeId = "image_info_bg" }),
+
         ui.textbox("Pick an image file such as .iso or .img to flash to device.", UIConfig.Styles.FilePickerHintTextbox, Textbox.Params{})
             .id("file_picker_hint_text")
             .position(.percent(0, 1.3))
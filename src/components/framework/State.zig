@@ -14,6 +14,11 @@ pub fn ComponentState(comptime T: type) type {
             self.mutex.lock();
         }
 
+        /// Non-blocking lock for per-frame polling; returns false if another thread holds it.
+        pub fn tryLock(self: *Self) bool {
+            return self.mutex.tryLock();
+        }
+
         pub fn unlock(self: *Self) void {
             self.mutex.unlock();
         }
@@ -49,6 +49,20 @@ pub const WriteConfig = struct {
     userForcedFlag: bool = false,
     ejectDeviceFlag: bool = true,
     verifyBytesFlag: bool = true,
+    /// Verify a seeded sample (edges, partition tables, boot images, random blocks) instead of every byte
+    quickVerifyFlag: bool = false,
+    /// Sample seed; the helper draws one when null and reports it back
+    quickVerifySeed: ?u64 = null,
+    /// Random blocks to sample; the helper default when null
+    quickVerifySamples: ?u64 = null,
+    /// Rewrite only the chunks that differ from what is already on the device
+    deltaModeFlag: bool = false,
+    /// Write only the ranges listed in the image's sibling .bmap file
+    useBlockMapFlag: bool = false,
+    /// Resume an interrupted write of the same image from the helper's checkpoint journal.
+    /// Opt-in: the device is only recognized by capacity and block size, so the user must
+    /// vouch that it is the same medium
+    resumeFlag: bool = false,
 };
 
 /// Consolidated request data bundled for XPC transmission
@@ -190,13 +204,13 @@ pub const Events = struct {
 
     pub const onISOWriteProgressChanged = ComponentFramework.defineEvent(
         EventManager.createEventName(ComponentName, "on_iso_write_progress_changed"),
-        struct { newProgress: u64, rate: u64, rate_avg: u64, bytes_written: u64, bytes_total: u64 },
+        struct { newProgress: u64, rate: u64, rate_avg: u64, bytes_written: u64, bytes_total: u64, bytes_skipped: u64 = 0, chunk_size: u64 = 0, queue_depth: u64 = 0, rate_ewma: u64 = 0, bytes_bad: u64 = 0 },
         struct {},
     );
 
     pub const onWriteVerificationProgressChanged = ComponentFramework.defineEvent(
         EventManager.createEventName(ComponentName, "on_write_verification_progress_changed"),
-        struct { newProgress: u64 },
+        struct { newProgress: u64, rate: u64 = 0, rate_avg: u64 = 0, rate_ewma: u64 = 0 },
         struct {},
     );
 
@@ -601,6 +615,12 @@ fn processResponseMessage(connection: XPCConnection, data: XPCObject) !void {
             const speed_avg = try XPCService.getUInt64(data, "write_rate_avg");
             const bytes_written = try XPCService.getUInt64(data, "write_bytes");
             const bytes_total = try XPCService.getUInt64(data, "write_total_size");
+            // Optional: older helpers do not report skipped bytes
+            const bytes_skipped = XPCService.getUInt64(data, "write_bytes_skipped") catch 0;
+            const chunk_size = XPCService.getUInt64(data, "write_chunk_size") catch 0;
+            const queue_depth = XPCService.getUInt64(data, "write_queue_depth") catch 0;
+            const speed_ewma = XPCService.getUInt64(data, "write_rate_ewma") catch 0;
+            const bytes_bad = XPCService.getUInt64(data, "write_bytes_bad") catch 0;
             EventManager.broadcast(Events.onISOWriteProgressChanged.create(
                 null,
                 &Events.onISOWriteProgressChanged.Data{
@@ -609,6 +629,11 @@ fn processResponseMessage(connection: XPCConnection, data: XPCObject) !void {
                     .rate_avg = speed_avg,
                     .bytes_total = bytes_total,
                     .bytes_written = bytes_written,
+                    .bytes_skipped = bytes_skipped,
+                    .chunk_size = chunk_size,
+                    .queue_depth = queue_depth,
+                    .rate_ewma = speed_ewma,
+                    .bytes_bad = bytes_bad,
                 },
             ));
         },
@@ -625,19 +650,42 @@ fn processResponseMessage(connection: XPCConnection, data: XPCObject) !void {
 
         .WRITE_VERIFICATION_PROGRESS => {
             const progress = try XPCService.getUInt64(data, "verification_progress");
+            // Optional: older helpers do not report verification rates
+            const speed = XPCService.getUInt64(data, "verification_rate") catch 0;
+            const speed_avg = XPCService.getUInt64(data, "verification_rate_avg") catch 0;
+            const speed_ewma = XPCService.getUInt64(data, "verification_rate_ewma") catch 0;
             EventManager.broadcast(Events.onWriteVerificationProgressChanged.create(
                 null,
-                &Events.onWriteVerificationProgressChanged.Data{ .newProgress = progress },
+                &Events.onWriteVerificationProgressChanged.Data{
+                    .newProgress = progress,
+                    .rate = speed,
+                    .rate_avg = speed_avg,
+                    .rate_ewma = speed_ewma,
+                },
             ));
         },
 
         .WRITE_VERIFICATION_SUCCESS => {
             Debug.log(.INFO, "Helper successfully verified the ISO bytes written to device.", .{});
+            // Coverage keys are only sent for quick (sampled) verification
+            if (XPCService.getUInt64(data, "verification_coverage")) |coverage| {
+                const seed = XPCService.getUInt64(data, "verification_seed") catch 0;
+                const samples = XPCService.getUInt64(data, "verification_samples") catch 0;
+                Debug.log(.INFO, "Quick verification covered {d}.{d:0>2}% of the image ({d} samples, seed {d}).", .{ coverage / 100, coverage % 100, samples, seed });
+            } else |_| {}
             EventManager.broadcast(Events.onHelperVerificationSuccess.create(null, null));
         },
 
         .WRITE_VERIFICATION_FAIL => {
             Debug.log(.ERROR, "Helper failed to verify bytes written to device.", .{});
+            // Location keys are only sent when verification found differing bytes (not on I/O errors)
+            if (XPCService.getUInt64(data, "mismatch_offset")) |offset| {
+                const lba = XPCService.getUInt64(data, "mismatch_lba") catch 0;
+                const count = XPCService.getUInt64(data, "mismatch_count") catch 0;
+                const bytes = XPCService.getUInt64(data, "mismatch_bytes") catch 0;
+                const ranges = XPCService.getUInt64(data, "mismatch_ranges") catch 1;
+                Debug.log(.ERROR, "First mismatch at byte {d} (LBA {d}): {d} bytes over {d} blocks ({d} differing ranges).", .{ offset, lba, bytes, count, ranges });
+            } else |_| {}
             EventManager.broadcast(Events.onHelperVerificationFailed.create(null, null));
         },
 
@@ -655,6 +703,16 @@ fn processResponseMessage(connection: XPCConnection, data: XPCObject) !void {
             Debug.log(.INFO, "Successfully finished writing image to device! All done.", .{});
             EventManager.broadcast(Events.onDeviceFlashComplete.create(null, null));
         },
+
+        .FANOUT_DEVICE_WRITE_SUCCESS => {
+            const deviceIndex = XPCService.getUInt64(data, "device_index") catch 0;
+            Debug.log(.INFO, "Helper reported fan-out target #{d} written successfully.", .{deviceIndex});
+        },
+
+        .FANOUT_DEVICE_WRITE_FAIL => {
+            const deviceIndex = XPCService.getUInt64(data, "device_index") catch 0;
+            Debug.log(.ERROR, "Helper reported fan-out target #{d} failed to write.", .{deviceIndex});
+        },
     }
 
     _ = connection;
@@ -729,6 +787,12 @@ fn buildXPCWriteRequest(writeRequest: WriteRequest) !XPCObject {
     XPCService.createUInt64(request, "config_userForced", @as(u64, @intCast(@intFromBool(writeRequest.config.userForcedFlag))));
     XPCService.createUInt64(request, "config_ejectDevice", @as(u64, @intCast(@intFromBool(writeRequest.config.ejectDeviceFlag))));
     XPCService.createUInt64(request, "config_verifyBytes", @as(u64, @intCast(@intFromBool(writeRequest.config.verifyBytesFlag))));
+    XPCService.createUInt64(request, "config_quickVerify", @as(u64, @intCast(@intFromBool(writeRequest.config.quickVerifyFlag))));
+    if (writeRequest.config.quickVerifySeed) |seed| XPCService.createUInt64(request, "config_quickVerifySeed", seed);
+    if (writeRequest.config.quickVerifySamples) |samples| XPCService.createUInt64(request, "config_quickVerifySamples", samples);
+    XPCService.createUInt64(request, "config_deltaMode", @as(u64, @intCast(@intFromBool(writeRequest.config.deltaModeFlag))));
+    XPCService.createUInt64(request, "config_useBmap", @as(u64, @intCast(@intFromBool(writeRequest.config.useBlockMapFlag))));
+    XPCService.createUInt64(request, "config_resume", @as(u64, @intCast(@intFromBool(writeRequest.config.resumeFlag))));
 
     return request;
 }
@@ -802,12 +866,16 @@ fn acquireStateDataOwnership(self: *PrivilegedHelper, writeRequest: WriteRequest
     self.state.data.imageType = writeRequest.imageType;
     self.state.data.config = writeRequest.config;
 
-    Debug.log(.INFO, "Acquired state ownership:\n\tImage Path: {s}\n\ttargetDisk: {s}\n\tConfig: userForced={}, ejectDevice={}, verifyBytes={}", .{
+    Debug.log(.INFO, "Acquired state ownership:\n\tImage Path: {s}\n\ttargetDisk: {s}\n\tConfig: userForced={}, ejectDevice={}, verifyBytes={}, quickVerify={}, deltaMode={}, useBmap={}, resume={}", .{
         self.state.data.imagePath.?,
         self.state.data.targetDisk.?,
         self.state.data.config.userForcedFlag,
         self.state.data.config.ejectDeviceFlag,
         self.state.data.config.verifyBytesFlag,
+        self.state.data.config.quickVerifyFlag,
+        self.state.data.config.deltaModeFlag,
+        self.state.data.config.useBlockMapFlag,
+        self.state.data.config.resumeFlag,
     });
 }
 
@@ -15,6 +15,7 @@ pub const UIElementIdentifier = enum(u8) {
     FilePickerFileDropzone,
     FilePickerImageInfoTextbox,
     FilePickerImageSizeText,
+    FilePickerImageChecksumText,
     FilePickerConfirmButton,
     FilePickerImageSelectedTexture,
     FilePickerImageSelectedTextbox,
@@ -51,6 +52,8 @@ pub const UIElementIdentifier = enum(u8) {
     DataFlasherLogsTextbox,
     DataFlasherCopyLogsButton,
     DataFlasherVerifyBytesCheckbox,
+    DataFlasherQuickVerifyCheckbox,
+    DataFlasherResumeCheckbox,
     DataFlasherEjectDeviceCheckbox,
 
     DataFlasherLaunchButton,